@@ -0,0 +1,591 @@
+﻿#include <algorithm>
+#include <array>
+#include <atomic>
+#include <chrono>
+#include <cstdlib>
+#include <filesystem>
+#include <new>
+#include <string>
+#include <string_view>
+#include <thread>
+#include <utility>
+#include <vector>
+
+#include <benchmark/benchmark.h>
+
+#ifdef _WIN32
+#include <malloc.h>
+#endif
+
+#include "auto_dj.hpp"
+#include "fake_media_session_backend.hpp"
+#include "fake_volume_backend.hpp"
+#include "fuzzy_keyword_matcher.hpp"
+#include "keywords.hpp"
+#include "labeled_tracks.hpp"
+#include "logger.hpp"
+#include "match_cache.hpp"
+#include "metrics.hpp"
+#include "string_utils.hpp"
+#include "track_classifier.hpp"
+
+// Every allocation made by the process is counted, so that each benchmark can report the
+// allocations it makes per call
+
+namespace
+{
+
+std::atomic<std::size_t> g_allocations {0};
+
+}  // namespace
+
+void* operator new(const std::size_t size)
+{
+    g_allocations.fetch_add(1, std::memory_order_relaxed);
+    if (void* const ptr = std::malloc(size == 0 ? 1 : size))
+    {
+        return ptr;
+    }
+    throw std::bad_alloc {};
+}
+
+void* operator new[](const std::size_t size)
+{
+    return operator new(size);
+}
+
+void* operator new(const std::size_t size, const std::align_val_t align)
+{
+    g_allocations.fetch_add(1, std::memory_order_relaxed);
+
+    // aligned_alloc() takes a multiple of the alignment, a power of 2
+    const std::size_t alignment = std::size_t(align);
+    const std::size_t rounded =
+        (std::max<std::size_t>(size, 1) + alignment - 1) & ~(alignment - 1);
+#ifdef _WIN32
+    if (void* const ptr = ::_aligned_malloc(rounded, alignment))
+#else
+    if (void* const ptr = std::aligned_alloc(alignment, rounded))
+#endif
+    {
+        return ptr;
+    }
+    throw std::bad_alloc {};
+}
+
+void* operator new[](const std::size_t size, const std::align_val_t align)
+{
+    return operator new(size, align);
+}
+
+// GCC pairs the free() below with the operator new it can see being inlined, and reports them as
+// mismatched, although both are the replacements above
+#if defined(__GNUC__) && !defined(__clang__)
+#pragma GCC diagnostic push
+#pragma GCC diagnostic ignored "-Wmismatched-new-delete"
+#endif
+
+void operator delete(void* const ptr) noexcept
+{
+    std::free(ptr);
+}
+
+void operator delete(void* const ptr, std::size_t) noexcept
+{
+    std::free(ptr);
+}
+
+void operator delete[](void* const ptr) noexcept
+{
+    std::free(ptr);
+}
+
+void operator delete[](void* const ptr, std::size_t) noexcept
+{
+    std::free(ptr);
+}
+
+void operator delete(void* const ptr, const std::align_val_t) noexcept
+{
+#ifdef _WIN32
+    ::_aligned_free(ptr);
+#else
+    std::free(ptr);
+#endif
+}
+
+void operator delete(void* const ptr, std::size_t, const std::align_val_t align) noexcept
+{
+    operator delete(ptr, align);
+}
+
+void operator delete[](void* const ptr, const std::align_val_t align) noexcept
+{
+    operator delete(ptr, align);
+}
+
+void operator delete[](void* const ptr, std::size_t, const std::align_val_t align) noexcept
+{
+    operator delete(ptr, align);
+}
+
+#if defined(__GNUC__) && !defined(__clang__)
+#pragma GCC diagnostic pop
+#endif
+
+namespace manelemax
+{
+
+namespace
+{
+
+struct track
+{
+    std::wstring artist;
+    std::wstring title;
+};
+
+const std::vector<track> g_ascii_tracks {
+    {L"Florin Salam", L"Ma tin de tine (Official Video)"},
+    {L"Nicolae Guta", L"Cine e ca mine"},
+    {L"Adele", L"Rolling in the Deep"},
+    {L"Dua Lipa", L"Levitating (feat. DaBaby)"},
+    {L"Babasha", L"Iubirea mea - Live"},
+    {L"Coldplay", L"Viva La Vida"},
+    {L"Tzanca Uraganu", L"Numai tu"},
+    {L"Queen", L"Bohemian Rhapsody (Remastered 2011)"},
+};
+
+const std::vector<track> g_diacritic_tracks {
+    {L"Florin Salam", L"Bună dimineața, iubirea mea"},
+    {L"Dani Mocanu", L"Împărăția mea, țara și căsuța"},
+    {L"Ionuț Cercel", L"Să-mi dai inima înapoi"},
+    {L"Sorinel Puștiu", L"Ți-am spus că te iubesc"},
+    {L"Vița de Vie", L"Să nu-mi spui că nu știi"},
+    {L"Andra", L"Inevitabil va fi bine (Șapte seri)"},
+};
+
+const std::vector<track> g_long_tracks {
+    {L"Manele Mix",
+     L"MANELE MIX 2024 🔥 Cele mai noi manele de dragoste 🔥 Florin Salam, Nicolae Guta, Dani "
+     L"Mocanu, Tzanca Uraganu, Bogdan de la Ploiesti, Costel Biju, Sorinel Pustiu, Adi de la "
+     L"Valcea, Jean de la Craiova (Colaj Nou - 3 ore de muzica non-stop pentru petrecere)"},
+    {L"Chill Vibes Radio",
+     L"lofi hip hop radio - beats to relax/study to | 24/7 live stream with the best chill music "
+     L"for studying, working, sleeping and gaming, featuring deep focus playlists, rainy night "
+     L"ambience, coffee shop jazz and late night drives through the city lights"},
+};
+
+const std::vector<track> g_non_matching_tracks {
+    {L"Radiohead", L"Paranoid Android"},
+    {L"Daft Punk", L"Harder, Better, Faster, Stronger"},
+    {L"Metallica", L"Nothing Else Matters (Remastered)"},
+    {L"Taylor Swift", L"Anti-Hero (Official Music Video)"},
+    {L"The Beatles", L"Here Comes The Sun - Remastered 2009"},
+    {L"Eminem", L"Lose Yourself"},
+};
+
+// Typos on the keywords, only matched by the fuzzy matcher
+const std::vector<track> g_misspelled_tracks {
+    {L"Florin Salamm", L"Ma tin de tine"},
+    {L"Nicolae Gutta", L"Cine e ca mine"},
+    {L"Tzanca Uragan", L"Numai tu"},
+    {L"Romeo Fantastic", L"Sunt tot al tau"},
+    {L"Sorinel Pustu", L"Dusmanii mei"},
+    {L"Bogdan de la Ploesti", L"Viata mea"},
+};
+
+struct named_corpus
+{
+    std::string_view          name;
+    const std::vector<track>* tracks;
+};
+
+const std::array<named_corpus, 5> g_corpora {{
+    {"ascii", &g_ascii_tracks},
+    {"diacritics", &g_diacritic_tracks},
+    {"long", &g_long_tracks},
+    {"non_matching", &g_non_matching_tracks},
+    {"misspelled", &g_misspelled_tracks},
+}};
+
+std::string normalized_title(const track& t)
+{
+    stringutils::normalized_text normalized;
+    stringutils::normalize_into(t.title, normalized);
+    return normalized.text;
+}
+
+std::string title_with_words(const std::size_t word_count)
+{
+    constexpr std::array words {"manele", "mix", "florin", "salam", "colaj", "nou", "de", "nunta"};
+
+    std::string title;
+    for (std::size_t idx = 0; idx != word_count; ++idx)
+    {
+        if (idx != 0)
+        {
+            title.push_back(' ');
+        }
+        title.append(words[idx % words.size()]);
+    }
+    return title;
+}
+
+// Runs fn once per iteration, cycling through the inputs, and reports the allocations per call
+template<typename Input, typename Fn>
+void run(benchmark::State& state, const std::vector<Input>& inputs, Fn&& fn)
+{
+    std::size_t idx = 0;
+
+    const std::size_t allocations_before = g_allocations.load(std::memory_order_relaxed);
+    for (auto _ : state)
+    {
+        fn(inputs[idx]);
+        idx = idx + 1 == inputs.size() ? 0 : idx + 1;
+    }
+    const std::size_t allocations =
+        g_allocations.load(std::memory_order_relaxed) - allocations_before;
+
+    state.counters["allocs/call"] =
+        benchmark::Counter(double(allocations), benchmark::Counter::kAvgIterations);
+}
+
+void bm_remove_ro_diacritics(benchmark::State& state, const std::vector<track>& tracks)
+{
+    run(state, tracks, [](const track& t) {
+        benchmark::DoNotOptimize(stringutils::remove_ro_diacritics(t.title));
+    });
+}
+
+void bm_keep_alpha_and_spaces(benchmark::State& state, const std::vector<track>& tracks)
+{
+    std::vector<std::string> inputs;
+    for (const track& t : tracks)
+    {
+        inputs.push_back(stringutils::remove_ro_diacritics(t.title));
+    }
+
+    std::string str;
+    run(state, inputs, [&str](const std::string& input) {
+        str = input;
+        benchmark::DoNotOptimize(stringutils::keep_alpha_and_spaces(str));
+    });
+}
+
+void bm_to_lower(benchmark::State& state, const std::vector<track>& tracks)
+{
+    std::vector<std::string> inputs;
+    for (const track& t : tracks)
+    {
+        inputs.push_back(stringutils::remove_ro_diacritics(t.title));
+    }
+
+    std::string str;
+    run(state, inputs, [&str](const std::string& input) {
+        str = input;
+        benchmark::DoNotOptimize(stringutils::to_lower(str));
+    });
+}
+
+void bm_split(benchmark::State& state, const std::vector<track>& tracks)
+{
+    std::vector<std::string> inputs;
+    for (const track& t : tracks)
+    {
+        inputs.push_back(normalized_title(t));
+    }
+
+    run(state, inputs, [](const std::string& input) {
+        benchmark::DoNotOptimize(stringutils::split(input));
+    });
+}
+
+void bm_normalize_into(benchmark::State& state, const std::vector<track>& tracks)
+{
+    stringutils::normalized_text normalized;
+    run(state, tracks, [&normalized](const track& t) {
+        stringutils::normalize_into(t.title, normalized);
+        benchmark::DoNotOptimize(normalized.text.data());
+    });
+}
+
+void bm_all_word_aligned_substrings(benchmark::State& state)
+{
+    const std::vector<std::string> inputs {title_with_words(std::size_t(state.range(0)))};
+    run(state, inputs, [](const std::string& input) {
+        benchmark::DoNotOptimize(stringutils::all_word_aligned_substrings(input));
+    });
+}
+BENCHMARK(bm_all_word_aligned_substrings)->ArgName("words")->Arg(10)->Arg(50)->Arg(200);
+
+void bm_word_aligned_substrings_view(benchmark::State& state)
+{
+    const std::vector<std::string> inputs {title_with_words(std::size_t(state.range(0)))};
+    run(state, inputs, [](const std::string& input) {
+        for (const std::string_view substr : stringutils::word_aligned_substrings_view {input})
+        {
+            benchmark::DoNotOptimize(substr.data());
+        }
+    });
+}
+BENCHMARK(bm_word_aligned_substrings_view)->ArgName("words")->Arg(10)->Arg(50)->Arg(200);
+
+// The whole keyword_match path: normalization and matching of the artist, then of the title
+void bm_keyword_match(benchmark::State& state, const std::vector<track>& tracks)
+{
+    const keyword_matcher matcher = g_keyword_table.matcher();
+    track_classifier      classifier;
+    run(state, tracks, [&](const track& t) {
+        benchmark::DoNotOptimize(classifier.classify(matcher, t.artist, t.title));
+    });
+}
+
+// The same path with the fuzzy matcher, which only costs more than the exact one on no match
+void bm_fuzzy_keyword_match(benchmark::State& state, const std::vector<track>& tracks)
+{
+    const fuzzy_keyword_matcher matcher {g_keyword_table.matcher()};
+    track_classifier            classifier;
+    run(state, tracks, [&](const track& t) {
+        benchmark::DoNotOptimize(classifier.classify(matcher, t.artist, t.title));
+    });
+}
+
+// The same path behind the match cache, as taken for the repeated notifications of a track
+void bm_cached_keyword_match(benchmark::State& state, const std::vector<track>& tracks)
+{
+    const keyword_matcher matcher = g_keyword_table.matcher();
+    track_classifier      classifier;
+    match_cache           cache;
+    run(state, tracks, [&](const track& t) {
+        const match_cache::key key = match_cache::make_key(t.artist, t.title);
+        if (const auto result = cache.find(key, 0); result.has_value())
+        {
+            benchmark::DoNotOptimize(*result);
+            return;
+        }
+        cache.insert(key, 0, classifier.classify(matcher, t.artist, t.title));
+    });
+}
+
+// Classifies the labeled tracks and reports the precision and recall of the matcher
+template<typename Matcher>
+void bm_labeled_accuracy(benchmark::State& state, const Matcher& matcher)
+{
+    track_classifier classifier;
+
+    std::size_t true_positives  = 0;
+    std::size_t false_positives = 0;
+    std::size_t false_negatives = 0;
+
+    for (auto _ : state)
+    {
+        true_positives  = 0;
+        false_positives = 0;
+        false_negatives = 0;
+
+        for (const labeled_track& labeled : g_labeled_tracks)
+        {
+            const bool matched =
+                !classifier.classify(matcher, labeled.artist, labeled.title).keyword.empty();
+            const bool manele = labeled.expected != label::other;
+
+            true_positives += matched && manele;
+            false_positives += matched && !manele;
+            false_negatives += !matched && manele;
+        }
+    }
+
+    state.counters["precision"] =
+        double(true_positives) / double(std::max<std::size_t>(true_positives + false_positives, 1));
+    state.counters["recall"] =
+        double(true_positives) / double(std::max<std::size_t>(true_positives + false_negatives, 1));
+    state.counters["tracks"] = double(g_labeled_tracks.size());
+}
+
+void bm_exact_accuracy(benchmark::State& state)
+{
+    bm_labeled_accuracy(state, g_keyword_table.matcher());
+}
+BENCHMARK(bm_exact_accuracy);
+
+void bm_fuzzy_accuracy(benchmark::State& state)
+{
+    bm_labeled_accuracy(state, fuzzy_keyword_matcher {g_keyword_table.matcher()});
+}
+BENCHMARK(bm_fuzzy_accuracy);
+
+// The cost of the instrumentation of the hot paths, per counter update and per timed section
+void bm_metrics_add(benchmark::State& state)
+{
+    for (auto _ : state)
+    {
+        metrics::add(metrics::counter::session_changes);
+    }
+}
+BENCHMARK(bm_metrics_add)->ThreadRange(1, 4);
+
+void bm_metrics_scoped_timer(benchmark::State& state)
+{
+    for (auto _ : state)
+    {
+        const scoped_timer timer {metrics::histogram::notifier_callback};
+    }
+}
+BENCHMARK(bm_metrics_scoped_timer)->ThreadRange(1, 4);
+
+const std::filesystem::path g_log_path =
+    std::filesystem::temp_directory_path() / "manelemax_bench.log";
+
+void start_logger(const benchmark::State& /*state*/)
+{
+    logger::start({.path = g_log_path, .max_file_size = 16 << 20, .max_files = 1});
+}
+
+void stop_logger(const benchmark::State& /*state*/)
+{
+    logger::stop();
+}
+
+// Time per log call, with the writer thread formatting the records into a file meanwhile. Each
+// iteration times a batch of calls, then waits for the writer, so that the ring never fills up and
+// the calls measured are not dropped ones, which the "dropped" counter confirms.
+void bm_logger_log(benchmark::State& state)
+{
+    constexpr std::int64_t batch {64};
+
+    const std::uint64_t dropped_before = logger::dropped();
+
+    std::chrono::duration<double, std::nano> logging {0};
+    for (auto _ : state)
+    {
+        const auto start = std::chrono::steady_clock::now();
+        for (std::int64_t idx = 0; idx != batch; ++idx)
+        {
+            logger::log(logger::level::info, "bench volume", double(idx));
+        }
+        const std::chrono::duration<double, std::nano> elapsed =
+            std::chrono::steady_clock::now() - start;
+
+        state.SetIterationTime(elapsed.count() / 1e9);
+        logging += elapsed;
+
+        logger::flush();
+    }
+
+    state.counters["ns_per_call"] = benchmark::Counter(
+        logging.count() / double(std::max<std::int64_t>(state.iterations() * batch, 1)),
+        benchmark::Counter::kAvgThreads
+    );
+    state.counters["dropped"] = benchmark::Counter(
+        double(logger::dropped() - dropped_before),
+        benchmark::Counter::kAvgThreads
+    );
+}
+BENCHMARK(bm_logger_log)
+    ->ThreadRange(1, 4)
+    ->UseManualTime()
+    ->Setup(start_logger)
+    ->Teardown(stop_logger);
+
+// The bench has neither an audio device nor media players, the backends of the platform are the
+// fakes, which take as long to come up as g_activation_latency
+std::atomic<std::chrono::milliseconds::rep> g_activation_latency {0};
+
+void simulate_activation()
+{
+    std::this_thread::sleep_for(std::chrono::milliseconds {g_activation_latency.load()});
+}
+
+// Time until auto_dj::make() returns, with the audio endpoint activation and the media session
+// manager request each taking the latency given as argument. A startup that waits for one, then
+// for the other, takes twice as long.
+void bm_cold_start(benchmark::State& state)
+{
+    g_activation_latency = state.range(0);
+
+    const std::filesystem::path missing_database =
+        std::filesystem::temp_directory_path() / "manelemax_bench_missing.kwdb";
+
+    for (auto _ : state)
+    {
+        const auto start       = std::chrono::steady_clock::now();
+        auto       auto_dj_obj = auto_dj::make(missing_database);
+        const auto elapsed     = std::chrono::steady_clock::now() - start;
+
+        if (!auto_dj_obj.has_value())
+        {
+            state.SkipWithError("auto_dj::make failed");
+            break;
+        }
+        state.SetIterationTime(std::chrono::duration<double>(elapsed).count());
+    }
+
+    g_activation_latency = 0;
+}
+BENCHMARK(bm_cold_start)
+    ->ArgName("latency_ms")
+    ->Arg(0)
+    ->Arg(20)
+    ->UseManualTime()
+    ->Unit(benchmark::kMillisecond);
+
+void register_corpus_benchmarks()
+{
+    using corpus_benchmark = void (*)(benchmark::State&, const std::vector<track>&);
+
+    constexpr std::array<std::pair<std::string_view, corpus_benchmark>, 8> benchmarks {{
+        {"remove_ro_diacritics", &bm_remove_ro_diacritics},
+        {"keep_alpha_and_spaces", &bm_keep_alpha_and_spaces},
+        {"to_lower", &bm_to_lower},
+        {"split", &bm_split},
+        {"normalize_into", &bm_normalize_into},
+        {"keyword_match", &bm_keyword_match},
+        {"fuzzy_keyword_match", &bm_fuzzy_keyword_match},
+        {"cached_keyword_match", &bm_cached_keyword_match},
+    }};
+
+    for (const auto& [bench_name, bench] : benchmarks)
+    {
+        for (const named_corpus& corpus : g_corpora)
+        {
+            benchmark::RegisterBenchmark(
+                std::string {bench_name}.append("/").append(corpus.name).c_str(),
+                bench,
+                *corpus.tracks
+            );
+        }
+    }
+}
+
+}  // namespace
+
+std::expected<std::unique_ptr<volume_backend>, os_error> volume_backend::make_default()
+{
+    simulate_activation();
+    return std::make_unique<fake_volume_backend>();
+}
+
+std::expected<std::unique_ptr<media_session_backend>, os_error>
+media_session_backend::make_default()
+{
+    simulate_activation();
+    return std::make_unique<fake_media_session_backend>();
+}
+
+}  // namespace manelemax
+
+int main(int argc, char** argv)
+{
+    manelemax::register_corpus_benchmarks();
+
+    benchmark::Initialize(&argc, argv);
+    if (benchmark::ReportUnrecognizedArguments(argc, argv))
+    {
+        return EXIT_FAILURE;
+    }
+    benchmark::RunSpecifiedBenchmarks();
+    benchmark::Shutdown();
+
+    return EXIT_SUCCESS;
+}
@@ -0,0 +1,45 @@
+#pragma once
+
+#include <algorithm>
+#include <cstdint>
+#include <cwctype>
+#include <string>
+#include <string_view>
+
+namespace manelemax
+{
+
+// The application that owns a media session, so that its audio streams can be told apart from the
+// ones of the other applications, like a call
+struct application
+{
+    // 0 when the media session does not tell
+    std::uint32_t process_id {0};
+
+    // Name of the executable, without its extension. Matched as well, as browsers play their audio
+    // from another process than the one of their media session.
+    std::wstring name {};
+
+    bool operator==(const application&) const = default;
+
+    bool known() const
+    {
+        return process_id != 0 || !name.empty();
+    }
+
+    // Whether an audio stream of the given process and executable belongs to the application
+    bool owns(const std::uint32_t stream_process_id, const std::wstring_view stream_name) const
+    {
+        if (process_id != 0 && stream_process_id == process_id)
+        {
+            return true;
+        }
+
+        return !name.empty() &&
+               std::ranges::equal(name, stream_name, [](const wchar_t lhs, const wchar_t rhs) {
+                   return std::towlower(lhs) == std::towlower(rhs);
+               });
+    }
+};
+
+}  // namespace manelemax
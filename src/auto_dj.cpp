@@ -1,39 +1,58 @@
+#include <chrono>
+#include <future>
 #include <optional>
-#include <unordered_set>
-#include <algorithm>
-#include <mutex>
+#include <span>
+#include <string>
+#include <string_view>
 
 #include "auto_dj.hpp"
+#include "executor.hpp"
 #include "volume_control.hpp"
 #include "system_media_properties_notifier.hpp"
-#include "keywords.hpp"
-#include "string_utils.hpp"
+#include "keyword_store.hpp"
+#include "logger.hpp"
+#include "match_cache.hpp"
+#include "media_event_coalescer.hpp"
+#include "match_state.hpp"
+#include "seqlock.hpp"
+#include "startup_trace.hpp"
+#include "track_classifier.hpp"
+#include "volume_ramp.hpp"
 
 namespace manelemax
 {
 
 struct auto_dj::impl
 {
-    impl() = default;
+    using media_session = system_media_properties_notifier::session;
 
+    explicit impl(const executor::mode run_mode)
+        : event_loop {event_queue_capacity, run_mode}
+    {
+    }
+
+    // The listeners run on the threads of the backends, they only post to the event loop, which
+    // owns all of the state below
     struct volume_listener : public volume_control::listener
     {
-        void on_volume_changed(const float vol) override
+        void on_volume_changed(const float /*old_vol*/, const float /*new_vol*/) override
         {
-            if (parent->force_volume)
-            {
-                parent->vol_ctrl->set_volume(parent->current_volume);
-            }
+            parent->event_loop.post([parent = parent] { parent->enforce_volume(); });
         }
 
         void on_muted_state_changed(const bool muted) override
         {
-            if (muted && parent->force_unmute)
+            if (muted)
             {
-                parent->vol_ctrl->set_muted(false);
+                parent->event_loop.post([parent = parent] { parent->enforce_unmuted(); });
             }
         }
 
+        void on_device_changed() override
+        {
+            parent->event_loop.post([parent = parent] { parent->follow_default_device(); });
+        }
+
         impl* parent {nullptr};
     };
 
@@ -41,32 +60,86 @@ struct auto_dj::impl
     {
         void on_play(const system_media_properties_notifier::properties& media_props) override
         {
-            parent->update_volume_settings(media_props);
+            parent->event_loop.post([parent = parent, media_props] {
+                parent->update_volume_settings(media_props);
+            });
         }
 
         void on_stop() override
         {
-            parent->update_volume_settings(std::nullopt);
+            parent->event_loop.post([parent = parent] {
+                parent->update_volume_settings(std::nullopt);
+            });
         }
 
         impl* parent {nullptr};
     };
 
+    ~impl()
+    {
+        // Everything is stopped before any member is destroyed. The loop first, as its tasks use
+        // the notifier and the volume control. Then the backends, which are joined by the
+        // destruction of their owners, and until then call the listeners, the coalescer and
+        // pick_session(). The loop is destroyed last, so their posts are then a no-op.
+        event_loop.stop();
+        media_props_notifier.reset();
+        vol_ctrl.reset();
+    }
+
     impl(const impl&)            = delete;
     impl& operator=(const impl&) = delete;
     impl(impl&&)                 = delete;
     impl& operator=(impl&&)      = delete;
 
-    std::expected<void, win32_com_error> init()
+    // The factories make the volume_control and the system_media_properties_notifier
+    template<typename MakeVolumeControl, typename MakeNotifier>
+    std::expected<void, os_error> init(
+        const std::filesystem::path& keyword_database_path,
+        MakeVolumeControl&&          make_vol_ctrl,
+        MakeNotifier&&               make_notifier
+    )
     {
-        if (auto new_vol_ctrl = manelemax::volume_control::make(); new_vol_ctrl.has_value())
+        startup_trace& trace = startup_trace::process();
+
+        // Only the classifications of the daemon are timed into the metrics
+        classifier.set_timed(true);
+        session_classifier.set_timed(true);
+
+        // The activation of the audio endpoint is the slowest part of the startup, it runs while
+        // the keywords are loaded and the media sessions requested. On Windows its thread joins
+        // the multithreaded apartment of the process implicitly.
+        auto pending_vol_ctrl = std::async(std::launch::async, [&trace, &make_vol_ctrl] {
+            auto result = make_vol_ctrl();
+            trace.mark("audio endpoint activated");
+            return result;
+        });
+
+        // Not fatal, the keywords in the file are then loaded once, or the built-in ones are kept.
+        // Either way there is nothing to build, both are mapped as they are.
+        if (!keyword_database_path.empty())
         {
-            vol_ctrl = *std::move(new_vol_ctrl);
+            keywords.watch(keyword_database_path);
         }
-        else
+        trace.mark("keywords loaded");
+
+        auto new_notifier = make_notifier();
+        trace.mark("media sessions requested");
+
+        auto new_vol_ctrl = pending_vol_ctrl.get();
+        if (!new_vol_ctrl.has_value())
         {
             return std::unexpected {new_vol_ctrl.error()};
         }
+        vol_ctrl = *std::move(new_vol_ctrl);
+
+        if (!new_notifier.has_value())
+        {
+            return std::unexpected {new_notifier.error()};
+        }
+        media_props_notifier = *std::move(new_notifier);
+        media_props_notifier->set_policy([this](const std::span<const media_session> sessions) {
+            return pick_session(sessions);
+        });
 
         vol_lsn.parent = this;
         if (const auto result = vol_ctrl->set_listener(&vol_lsn); !result.has_value())
@@ -74,104 +147,318 @@ struct auto_dj::impl
             return std::unexpected {result.error()};
         }
 
+        // A track change raises several events in a row, they reach media_lsn as one
         media_lsn.parent = this;
-        media_props_notifier.set_listener(&media_lsn);
+        media_coalescer.set_listener(&media_lsn);
+        media_props_notifier->set_listener(&media_coalescer);
 
-        keywords_set.insert_range(g_keywords);
-
-        update_volume_settings(media_props_notifier.get_media_props());
+        event_loop.post([this] {
+            update_volume_settings(media_props_notifier->get_media_props());
+        });
 
+        trace.mark("auto_dj ready");
         return {};
     }
 
+    // Runs on the threads of the media session backend, one call at a time. The playing sessions
+    // with a keyword come first, so that manele playing in one player is not missed because
+    // another one started afterwards.
+    const media_session* pick_session(const std::span<const media_session> sessions)
+    {
+        const keyword_store::read_guard snapshot = keywords.read();
+
+        const media_session* picked = nullptr;
+        for (const media_session& candidate : sessions)
+        {
+            if (!candidate.state.playing ||
+                (picked != nullptr && candidate.started_at < picked->started_at))
+            {
+                continue;
+            }
+
+            const track_classifier::result result = session_classifier.classify(
+                snapshot->matcher,
+                candidate.state.media_props.artist,
+                candidate.state.media_props.title
+            );
+            if (!result.keyword.empty())
+            {
+                picked = &candidate;
+            }
+        }
+
+        if (picked != nullptr)
+        {
+            return picked;
+        }
+        return system_media_properties_notifier::most_recently_started(sessions);
+    }
+
+    // The enforcement writes are rate limited by volume_control. A deferred one is retried once,
+    // after the delay, so that the volume is still restored after the last of a burst of changes.
+    void enforce_volume()
+    {
+        // A ramp in progress overwrites any change on its next tick, and ends on its target
+        if (!force_volume || volume_retry_pending || ramp.active())
+        {
+            return;
+        }
+
+        const auto delay = vol_ctrl->enforce_volume(current_volume, event_loop.now());
+        if (!delay.has_value())
+        {
+            logger::log(logger::level::error, "could not restore the volume", delay.error());
+        }
+        else if (*delay != volume_control::clock::duration::zero())
+        {
+            volume_retry_pending = event_loop.post_after(*delay, [this] {
+                volume_retry_pending = false;
+                enforce_volume();
+            });
+        }
+    }
+
+    void enforce_unmuted()
+    {
+        if (!force_unmute || mute_retry_pending)
+        {
+            return;
+        }
+
+        const auto delay = vol_ctrl->enforce_unmuted(event_loop.now());
+        if (!delay.has_value())
+        {
+            logger::log(logger::level::error, "could not unmute", delay.error());
+        }
+        else if (*delay != volume_control::clock::duration::zero())
+        {
+            mute_retry_pending = event_loop.post_after(*delay, [this] {
+                mute_retry_pending = false;
+                enforce_unmuted();
+            });
+        }
+    }
+
+    // Headphones connected, or the output switched to HDMI. The mode is applied to the new endpoint
+    // at once, rather than ramped to or left for the next track.
+    void follow_default_device()
+    {
+        if (const auto result = vol_ctrl->follow_default(); !result.has_value())
+        {
+            logger::log(
+                logger::level::error,
+                "could not follow the default device",
+                result.error()
+            );
+            return;
+        }
+        logger::log(logger::level::info, "default device changed");
+
+        ramp.cancel();
+        if (force_unmute)
+        {
+            log_failure("could not unmute", vol_ctrl->set_muted(false));
+        }
+        if (force_volume)
+        {
+            log_failure("could not set the volume", vol_ctrl->set_volume(current_volume));
+        }
+    }
+
+    // A new target retargets the ramp in progress, from where it is, rather than starting over
+    void ramp_volume(const float target)
+    {
+        ramp.start(vol_ctrl->volume(), target, event_loop.now());
+        if (!ramp_tick_pending)
+        {
+            tick_ramp();
+        }
+    }
+
+    // One endpoint write per tick at most
+    void tick_ramp()
+    {
+        const volume_ramp::step step = ramp.tick(event_loop.now());
+        if (step.volume.has_value())
+        {
+            log_failure("could not set the volume", vol_ctrl->set_volume(*step.volume));
+        }
+
+        if (!step.next_tick.has_value())
+        {
+            return;
+        }
+
+        ramp_tick_pending =
+            event_loop.post_after(*step.next_tick - event_loop.now(), [this] {
+                ramp_tick_pending = false;
+                tick_ramp();
+            });
+
+        // The timers are full, jumping to the target beats leaving the volume half way
+        if (!ramp_tick_pending)
+        {
+            ramp.cancel();
+            logger::log(logger::level::warning, "timers full, ramp skipped");
+            log_failure("could not set the volume", vol_ctrl->set_volume(ramp.target()));
+        }
+    }
+
+    // The volume is written again on the next tick, enforcement or track, a failed write is only
+    // logged
+    static void log_failure(
+        const std::string_view               message,
+        const std::expected<void, os_error>& result
+    )
+    {
+        if (!result.has_value())
+        {
+            logger::log(logger::level::error, message, result.error());
+        }
+    }
+
     void update_volume_settings(
         const std::optional<manelemax::system_media_properties_notifier::properties>& media_props
     )
     {
+        match_state new_state {.changed_at = std::chrono::system_clock::now()};
+
         if (!media_props.has_value())
         {
             force_unmute = false;
             force_volume = false;
-            std::lock_guard lock {current_match_mutex};
-            current_match.clear();
+
+            new_state.mode   = volume_mode::idle;
+            new_state.volume = current_volume;
+            state.store(new_state);
+
+            logger::log(logger::level::info, "playback stopped");
             return;
         }
 
-        std::string match;
+        {
+            // The matched keyword lives in the keyword store and has to be copied before the
+            // guard is released, after which a reload can free it
+            const keyword_store::read_guard snapshot = keywords.read();
+
+            // The same track is notified again on every pause, seek or tab switch
+            const match_cache::key key =
+                match_cache::make_key(media_props->artist, media_props->title);
+
+            std::optional<track_classifier::result> result = cache.find(key, snapshot->generation);
+            if (!result.has_value())
+            {
+                result = classifier.classify(
+                    snapshot->matcher,
+                    media_props->artist,
+                    media_props->title
+                );
+                cache.insert(key, snapshot->generation, *result);
+            }
+
+            if (!first_track_classified)
+            {
+                first_track_classified = true;
+                startup_trace::process().mark("first track classified");
+            }
+
+            new_state.set_keyword(result->keyword);
+            new_state.score = result->score;
+
+            breakdown.clear();
+            track_classifier::append_breakdown(*result, breakdown);
+            new_state.set_breakdown(breakdown);
+        }
+
+        // Only the player changes volume, not the other applications, a call included. A ramp in
+        // progress carries on over the new target.
+        log_failure("could not target the player", vol_ctrl->set_application(media_props->app));
 
-        if (!(match = keyword_match(media_props->artist)).empty() ||
-            !(match = keyword_match(media_props->title)).empty())
+        if (!new_state.keyword().empty())
         {
             current_volume = max_mode_volume;
             force_unmute   = true;
             force_volume   = true;
-            vol_ctrl->set_muted(false);
-            vol_ctrl->set_volume(current_volume);
+            log_failure("could not unmute", vol_ctrl->set_muted(false));
+            ramp_volume(current_volume);
         }
         else
         {
             current_volume = normal_mode_volume;
             force_unmute   = false;
             force_volume   = true;
-            vol_ctrl->set_volume(current_volume);
+            ramp_volume(current_volume);
         }
 
-        std::lock_guard lock {current_match_mutex};
-        current_match = match;
-    }
-
-    std::string keyword_match(const std::wstring& wstr) const
-    {
-        constexpr size_t max_words = 4;
+        new_state.mode   = new_state.keyword().empty() ? volume_mode::normal : volume_mode::max;
+        new_state.volume = current_volume;
+        state.store(new_state);
 
-        if (wstr.empty())
-        {
-            return "";
-        }
-
-        std::string str = stringutils::remove_ro_diacritics(wstr);
-
-        const auto to_search = stringutils::all_word_aligned_substrings(
-            stringutils::to_lower(stringutils::keep_alpha_and_spaces(str)),
-            max_words
+        logger::log(
+            logger::level::info,
+            new_state.mode == volume_mode::max ? "manele, volume" : "not manele, volume",
+            current_volume
         );
+    }
 
-        if (const auto it = std::ranges::find_if(
-                to_search,
-                [this](const std::string& s) { return keywords_set.contains(s); }
-            );
-            it != to_search.end())
-        {
-            return *it;
-        }
+    // On Windows, runs on the COM multithreaded apartment initialized by the main thread
+    executor event_loop;
 
-        return "";
-    }
+    keyword_store                 keywords {};
+    std::optional<volume_control> vol_ctrl {std::nullopt};
 
-    std::optional<volume_control>    vol_ctrl {std::nullopt};
-    system_media_properties_notifier media_props_notifier {};
+    // Used by pick_session(), so it outlives the notifier, whose backend calls it
+    track_classifier                                session_classifier {};
+    std::optional<system_media_properties_notifier> media_props_notifier {std::nullopt};
 
     static constexpr float normal_mode_volume {0.25f};
     static constexpr float max_mode_volume = {1.0f};
 
+    static constexpr std::chrono::milliseconds media_event_window {150};
+    static constexpr std::chrono::milliseconds enforcement_interval {100};
+    static constexpr std::chrono::milliseconds volume_ramp_duration {1000};
+    static constexpr std::chrono::milliseconds volume_ramp_tick {25};
+    static constexpr std::size_t               event_queue_capacity {64};
+
     bool  force_unmute {false};
     bool  force_volume {false};
     float current_volume {normal_mode_volume};
 
+    bool volume_retry_pending {false};
+    bool mute_retry_pending {false};
+    bool first_track_classified {false};
+
+    // dB-linear, so that the loudness changes evenly
+    volume_ramp ramp {ramp_curve::db_linear, volume_ramp_duration, volume_ramp_tick};
+    bool        ramp_tick_pending {false};
+
     volume_listener vol_lsn {};
     media_listener  media_lsn {};
-    std::string     current_match {};
-    std::mutex      current_match_mutex {};
+    match_cache     cache {};
+
+    // Owns the normalization buffer, which is reused to avoid allocations
+    track_classifier classifier {};
+    std::string      breakdown {};
 
-    std::unordered_set<std::string_view> keywords_set;
+    // Read from the tray menu without blocking the callbacks that update it
+    seqlock<match_state> state {};
+
+    // Called by the notifier's backend, and by the loop once a window elapses
+    media_event_coalescer media_coalescer {event_loop, media_event_window};
 };
 
-std::expected<auto_dj, win32_com_error> auto_dj::make()
+std::expected<auto_dj, os_error>
+auto_dj::make(const std::filesystem::path& keyword_database_path)
 {
     auto_dj instance;
-    instance.impl_ = std::make_unique<impl>();
+    instance.impl_ = std::make_unique<impl>(executor::mode::threaded);
 
-    if (const auto result = instance.impl_->init(); !result.has_value())
+    if (const auto result = instance.impl_->init(
+            keyword_database_path,
+            [] { return volume_control::make(impl::enforcement_interval); },
+            [] { return system_media_properties_notifier::make(); }
+        );
+        !result.has_value())
     {
         return std::unexpected {result.error()};
     }
@@ -179,10 +466,46 @@ std::expected<auto_dj, win32_com_error> auto_dj::make()
     return instance;
 }
 
-std::string auto_dj::current_match() const
+std::expected<auto_dj, os_error> auto_dj::make(
+    const std::filesystem::path&           keyword_database_path,
+    std::unique_ptr<volume_backend>        volume,
+    std::unique_ptr<media_session_backend> media_sessions,
+    const executor::mode                   run_mode
+)
+{
+    auto_dj instance;
+    instance.impl_ = std::make_unique<impl>(run_mode);
+
+    if (const auto result = instance.impl_->init(
+            keyword_database_path,
+            [&volume] {
+                return volume_control::make(std::move(volume), impl::enforcement_interval);
+            },
+            [&media_sessions] {
+                return system_media_properties_notifier::make(std::move(media_sessions));
+            }
+        );
+        !result.has_value())
+    {
+        return std::unexpected {result.error()};
+    }
+
+    return instance;
+}
+
+void auto_dj::advance_to(const executor::clock::time_point time)
+{
+    impl_->event_loop.advance_to(time);
+}
+
+executor::clock::time_point auto_dj::now() const
+{
+    return impl_->event_loop.now();
+}
+
+match_state auto_dj::current_state() const
 {
-    std::lock_guard lock {impl_->current_match_mutex};
-    return impl_->current_match;
+    return impl_->state.load();
 }
 
 auto_dj::auto_dj(auto_dj&&)            = default;
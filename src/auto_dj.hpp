@@ -2,9 +2,13 @@
 
 #include <memory>
 #include <expected>
-#include <string>
+#include <filesystem>
 
-#include "win32_error.hpp"
+#include "executor.hpp"
+#include "match_state.hpp"
+#include "media_session_backend.hpp"
+#include "os_error.hpp"
+#include "volume_backend.hpp"
 
 namespace manelemax
 {
@@ -12,14 +16,35 @@ namespace manelemax
 class auto_dj
 {
 public:
-    static std::expected<auto_dj, win32_com_error> make();
+    // The keywords are read from the database at keyword_database_path, and reloaded whenever it
+    // changes. The built-in keywords are used while there is no such file, or for an empty path.
+    static std::expected<auto_dj, os_error>
+    make(const std::filesystem::path& keyword_database_path);
+
+    // Same as above, over the given backends instead of the ones of the platform. With a manual
+    // executor, the timers only run in advance_to(), so that a replay is deterministic and does
+    // not wait for them.
+    static std::expected<auto_dj, os_error> make(
+        const std::filesystem::path&           keyword_database_path,
+        std::unique_ptr<volume_backend>        volume,
+        std::unique_ptr<media_session_backend> media_sessions,
+        executor::mode                         run_mode
+    );
 
     auto_dj(auto_dj&&);
     auto_dj& operator=(auto_dj&&);
 
     ~auto_dj();
 
-    std::string current_match() const;
+    // Lock free and allocation free, safe to call from any thread
+    match_state current_state() const;
+
+    // Manual executor only, see executor::advance_to(). The changes of the backends made on the
+    // calling thread in between are handled then as well.
+    void advance_to(executor::clock::time_point time);
+
+    // The time of the event loop, the simulated one for a manual executor
+    executor::clock::time_point now() const;
 
 private:
     struct impl;
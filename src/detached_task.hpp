@@ -0,0 +1,129 @@
+#pragma once
+
+#include <condition_variable>
+#include <coroutine>
+#include <cstddef>
+#include <exception>
+#include <mutex>
+#include <utility>
+
+namespace manelemax
+{
+
+// Return type of a coroutine that starts at once, on the calling thread, and is destroyed as soon
+// as it completes. Nothing waits for its result, an async_scope waits for the coroutine itself.
+//
+// An exception that escapes the coroutine terminates the process, the coroutine has to handle the
+// failures of what it awaits.
+struct detached_task
+{
+    struct promise_type
+    {
+        detached_task get_return_object() noexcept
+        {
+            return {};
+        }
+
+        std::suspend_never initial_suspend() noexcept
+        {
+            return {};
+        }
+
+        std::suspend_never final_suspend() noexcept
+        {
+            return {};
+        }
+
+        void return_void() noexcept {}
+
+        void unhandled_exception() noexcept
+        {
+            std::terminate();
+        }
+    };
+};
+
+// Counts the detached coroutines that use an object, so that the object can wait for them to
+// complete before it is destroyed.
+//
+// Each coroutine takes a guard by value as a parameter. The guard then lives in the coroutine frame
+// and leaves the scope when the frame is destroyed, after the coroutine completed. The parameter
+// cannot be const, the guard is moved into the frame and cannot be copied.
+//
+// The last guard notifies under the mutex, so wait() cannot return, and the scope die, before the
+// guard is done with it.
+class async_scope
+{
+public:
+    class guard
+    {
+    public:
+        guard(guard&& other) noexcept
+            : scope_ {std::exchange(other.scope_, nullptr)}
+        {
+        }
+
+        guard(const guard&)            = delete;
+        guard& operator=(const guard&) = delete;
+        guard& operator=(guard&&)      = delete;
+
+        ~guard()
+        {
+            if (scope_ != nullptr)
+            {
+                scope_->leave();
+            }
+        }
+
+    private:
+        friend class async_scope;
+
+        explicit guard(async_scope& scope)
+            : scope_ {&scope}
+        {
+        }
+
+        async_scope* scope_;
+    };
+
+    async_scope() = default;
+
+    async_scope(const async_scope&)            = delete;
+    async_scope& operator=(const async_scope&) = delete;
+
+    ~async_scope()
+    {
+        wait();
+    }
+
+    guard enter()
+    {
+        std::lock_guard lock {mutex_};
+        ++count_;
+        return guard {*this};
+    }
+
+    // Blocks until every coroutine of the scope completed. Whatever they await has to complete, or
+    // be cancelled, first. Cannot be called from one of them.
+    void wait()
+    {
+        std::unique_lock lock {mutex_};
+        done_.wait(lock, [this] { return count_ == 0; });
+    }
+
+private:
+    void leave()
+    {
+        std::lock_guard lock {mutex_};
+        if (--count_ == 0)
+        {
+            done_.notify_all();
+        }
+    }
+
+    std::mutex              mutex_ {};
+    std::condition_variable done_ {};
+    std::size_t             count_ {0};
+};
+
+}  // namespace manelemax
@@ -0,0 +1,406 @@
+#include "event_trace.hpp"
+
+#include <atomic>
+#include <bit>
+#include <cerrno>
+#include <cstring>
+#include <fstream>
+#include <mutex>
+
+#include "logger.hpp"
+#include "string_utils.hpp"
+
+namespace manelemax
+{
+
+namespace
+{
+
+// LEB128 is 10 bytes at most for 64 bits
+constexpr std::size_t max_varint_size {10};
+
+// Past this, the recording thread writes the records itself, as when no logger is running
+constexpr std::size_t max_pending_size {64 * 1024};
+
+void append_varint(std::string& out, std::uint64_t value)
+{
+    while (value >= 0x80)
+    {
+        out.push_back(char(0x80 | (value & 0x7F)));
+        value >>= 7;
+    }
+    out.push_back(char(value));
+}
+
+void append_string(std::string& out, const std::string_view str)
+{
+    append_varint(out, str.size());
+    out.append(str);
+}
+
+void append_float(std::string& out, const float value)
+{
+    const std::uint32_t bits = std::bit_cast<std::uint32_t>(value);
+    for (int shift = 0; shift != 32; shift += 8)
+    {
+        out.push_back(char((bits >> shift) & 0xFF));
+    }
+}
+
+// The reads return false past the end of the data
+bool read_varint(std::string_view& data, std::uint64_t& value)
+{
+    value = 0;
+    for (std::size_t idx = 0; idx != max_varint_size && idx != data.size(); ++idx)
+    {
+        const auto byte = std::uint8_t(data[idx]);
+        value |= std::uint64_t(byte & 0x7F) << (7 * idx);
+        if ((byte & 0x80) == 0)
+        {
+            data.remove_prefix(idx + 1);
+            return true;
+        }
+    }
+    return false;
+}
+
+bool read_string(std::string_view& data, std::string_view& str)
+{
+    std::uint64_t size = 0;
+    if (!read_varint(data, size) || size > data.size())
+    {
+        return false;
+    }
+
+    str = data.substr(0, std::size_t(size));
+    data.remove_prefix(std::size_t(size));
+    return true;
+}
+
+bool read_byte(std::string_view& data, std::uint8_t& value)
+{
+    if (data.empty())
+    {
+        return false;
+    }
+
+    value = std::uint8_t(data.front());
+    data.remove_prefix(1);
+    return true;
+}
+
+bool read_float(std::string_view& data, float& value)
+{
+    if (data.size() < 4)
+    {
+        return false;
+    }
+
+    std::uint32_t bits = 0;
+    for (int idx = 0; idx != 4; ++idx)
+    {
+        bits |= std::uint32_t(std::uint8_t(data[idx])) << (8 * idx);
+    }
+    value = std::bit_cast<float>(bits);
+    data.remove_prefix(4);
+    return true;
+}
+
+// The file being recorded into. The events come from the threads of the backends and from the
+// event loop, which only encode them under the mutex: the file is written by the thread of the
+// logger, so that they never wait for the disk.
+class recorder
+{
+public:
+    static recorder& instance()
+    {
+        static recorder g_recorder;
+        return g_recorder;
+    }
+
+    bool recording() const
+    {
+        return recording_.load(std::memory_order_relaxed);
+    }
+
+    std::expected<void, os_error> start(const std::filesystem::path& path)
+    {
+        std::scoped_lock lock {file_mutex_, mutex_};
+
+        file_ = std::ofstream {path, std::ios::binary | std::ios::trunc};
+        if (!file_.write(event_trace::magic.data(), event_trace::magic.size()).flush())
+        {
+            file_ = {};
+            return std::unexpected {os_error {"event_trace::start_recording", EIO}};
+        }
+
+        pending_.clear();
+        last_ = std::chrono::steady_clock::now();
+        recording_.store(true, std::memory_order_relaxed);
+        logger::set_sink(&write_pending_records);
+        return {};
+    }
+
+    // The records not written yet by the logger are written on this thread
+    void stop()
+    {
+        recording_.store(false, std::memory_order_relaxed);
+        logger::set_sink(nullptr);
+
+        std::lock_guard file_lock {file_mutex_};
+        write_pending();
+        file_ = {};
+    }
+
+    // Encodes the record of the given kind, whose fields are appended by fn
+    template<typename Fn>
+    void record(const event_trace::kind type, Fn&& fn)
+    {
+        if (!recording())
+        {
+            return;
+        }
+
+        bool full = false;
+        {
+            std::lock_guard lock {mutex_};
+
+            const auto now   = std::chrono::steady_clock::now();
+            const auto delta = std::chrono::duration_cast<std::chrono::microseconds>(now - last_);
+
+            append_varint(pending_, std::uint64_t(delta.count()));
+            pending_.push_back(char(type));
+            fn(pending_);
+            last_ = now;
+            full  = pending_.size() >= max_pending_size;
+        }
+
+        if (full)
+        {
+            std::lock_guard file_lock {file_mutex_};
+            write_pending();
+        }
+        else
+        {
+            logger::wake();
+        }
+    }
+
+private:
+    static void write_pending_records()
+    {
+        std::lock_guard file_lock {instance().file_mutex_};
+        instance().write_pending();
+    }
+
+    // The file mutex is held. The records are taken out of the way of the recording threads
+    // before they are written, so that the mutex they take is never held across a write.
+    void write_pending()
+    {
+        {
+            std::lock_guard lock {mutex_};
+            std::swap(pending_, writing_);
+        }
+        if (writing_.empty() || !file_.is_open())
+        {
+            writing_.clear();
+            return;
+        }
+
+        file_.write(writing_.data(), std::streamsize(writing_.size())).flush();
+        writing_.clear();
+    }
+
+    std::atomic<bool> recording_ {false};
+
+    // Taken by the recording threads, to encode
+    std::mutex                            mutex_ {};
+    std::chrono::steady_clock::time_point last_ {};
+    std::string                           pending_ {};
+
+    // Taken by the thread that writes, the logger's or the one that stops the recording
+    std::mutex    file_mutex_ {};
+    std::ofstream file_ {};
+    std::string   writing_ {};
+};
+
+}  // namespace
+
+std::expected<void, os_error> event_trace::start_recording(const std::filesystem::path& path)
+{
+    return recorder::instance().start(path);
+}
+
+void event_trace::stop_recording()
+{
+    recorder::instance().stop();
+}
+
+void event_trace::record_session_changed(
+    const std::string&                          id,
+    const media_session_backend::session_state& state
+)
+{
+    recorder::instance().record(kind::session_changed, [&](std::string& out) {
+        append_string(out, id);
+        out.push_back(char(state.playing));
+        append_string(out, stringutils::wide_to_utf8(state.media_props.artist));
+        append_string(out, stringutils::wide_to_utf8(state.media_props.title));
+        append_varint(out, state.media_props.app.process_id);
+        append_string(out, stringutils::wide_to_utf8(state.media_props.app.name));
+    });
+}
+
+void event_trace::record_session_removed(const std::string& id)
+{
+    recorder::instance().record(kind::session_removed, [&](std::string& out) {
+        append_string(out, id);
+    });
+}
+
+void event_trace::record_endpoint(const kind type, const volume_backend::endpoint& endpoint)
+{
+    recorder::instance().record(type, [&](std::string& out) {
+        append_float(out, endpoint.volume);
+        out.push_back(char(endpoint.muted));
+    });
+}
+
+void event_trace::record_default_changed()
+{
+    recorder::instance().record(kind::default_changed, [](std::string& /*out*/) {});
+}
+
+void event_trace::record_volume_written(const float vol)
+{
+    recorder::instance().record(kind::volume_written, [&](std::string& out) {
+        append_float(out, vol);
+    });
+}
+
+void event_trace::record_mute_written(const bool muted)
+{
+    recorder::instance().record(kind::mute_written, [&](std::string& out) {
+        out.push_back(char(muted));
+    });
+}
+
+event_trace::reader::reader(mapped_file file)
+    : file_ {std::move(file)}
+    , data_ {file_.data()}
+{
+}
+
+auto event_trace::reader::open(const std::filesystem::path& path)
+    -> std::expected<reader, os_error>
+{
+    auto file = mapped_file::open(path);
+    if (!file.has_value())
+    {
+        return std::unexpected {file.error()};
+    }
+
+    const std::string_view data = file->data();
+    if (data.size() < magic.size() || std::memcmp(data.data(), magic.data(), magic.size()) != 0)
+    {
+        return std::unexpected {os_error {"event_trace magic", std::int64_t(data.size())}};
+    }
+
+    reader instance {*std::move(file)};
+    instance.data_.remove_prefix(magic.size());
+    return instance;
+}
+
+auto event_trace::reader::next() -> std::expected<std::optional<event>, os_error>
+{
+    std::string_view data = data_;
+
+    std::uint64_t delta = 0;
+    std::uint8_t  type  = 0;
+    if (!read_varint(data, delta) || !read_byte(data, type))
+    {
+        return std::nullopt;
+    }
+
+    event ev {.at = at_ + std::chrono::microseconds(delta), .type = kind(type)};
+
+    bool complete = false;
+    switch (ev.type)
+    {
+        case kind::session_changed:
+        {
+            std::string_view id;
+            std::uint8_t     playing = 0;
+            std::string_view artist;
+            std::string_view title;
+            std::uint64_t    process_id = 0;
+            std::string_view app_name;
+
+            complete = read_string(data, id) && read_byte(data, playing) &&
+                       read_string(data, artist) && read_string(data, title) &&
+                       read_varint(data, process_id) && read_string(data, app_name);
+            if (complete)
+            {
+                media_session_backend::properties& props = ev.session.media_props;
+
+                ev.session_id        = id;
+                ev.session.playing   = playing != 0;
+                props.artist         = stringutils::utf8_to_wide(artist);
+                props.title          = stringutils::utf8_to_wide(title);
+                props.app.process_id = std::uint32_t(process_id);
+                props.app.name       = stringutils::utf8_to_wide(app_name);
+            }
+            break;
+        }
+        case kind::session_removed:
+        {
+            std::string_view id;
+            complete = read_string(data, id);
+            if (complete)
+            {
+                ev.session_id = id;
+            }
+            break;
+        }
+        case kind::endpoint_opened: [[fallthrough]];
+        case kind::endpoint_changed:
+        {
+            std::uint8_t muted = 0;
+            complete           = read_float(data, ev.endpoint.volume) && read_byte(data, muted);
+            ev.endpoint.muted  = muted != 0;
+            break;
+        }
+        case kind::default_changed:
+        {
+            complete = true;
+            break;
+        }
+        case kind::volume_written:
+        {
+            complete = read_float(data, ev.endpoint.volume);
+            break;
+        }
+        case kind::mute_written:
+        {
+            std::uint8_t muted = 0;
+            complete           = read_byte(data, muted);
+            ev.endpoint.muted  = muted != 0;
+            break;
+        }
+        default:
+        {
+            return std::unexpected {os_error {"event_trace kind", type}};
+        }
+    }
+
+    if (!complete)
+    {
+        return std::nullopt;
+    }
+
+    data_ = data;
+    at_   = ev.at;
+    return ev;
+}
+
+}  // namespace manelemax
@@ -0,0 +1,95 @@
+#pragma once
+
+#include <array>
+#include <chrono>
+#include <cstdint>
+#include <expected>
+#include <filesystem>
+#include <optional>
+#include <string>
+#include <string_view>
+
+#include "mapped_file.hpp"
+#include "media_session_backend.hpp"
+#include "os_error.hpp"
+#include "volume_backend.hpp"
+
+namespace manelemax
+{
+
+// Binary trace of what auto_dj reacts to, the changes of the media sessions and of the endpoint,
+// along with the volume writes it makes, so that a misbehavior seen in production can be replayed
+// at will, see manelemax-replay.
+//
+// The file holds the magic, then one record per event: the time since the previous record in
+// microseconds, the kind on one byte, then the fields of the kind. The integers are LEB128, the
+// strings a LEB128 length and UTF-8, the volumes a 32-bit float, little-endian. A track change is
+// about 50 bytes.
+//
+// Format errors are reported as an os_error naming the failed check, with the offending value as
+// the code.
+class event_trace
+{
+public:
+    static constexpr std::array<char, 8> magic {'M', 'M', 'X', 'T', 'R', 'C', '1', '\0'};
+
+    enum class kind : std::uint8_t
+    {
+        session_changed = 1,  // session_id, session
+        session_removed,      // session_id
+        endpoint_opened,      // endpoint, as read when the volume control starts
+        endpoint_changed,     // endpoint, changed by someone else
+        default_changed,
+        volume_written,  // endpoint.volume
+        mute_written,    // endpoint.muted
+    };
+
+    struct event
+    {
+        std::chrono::microseconds            at {};  // Since the recording started
+        kind                                 type {kind::session_changed};
+        std::string                          session_id {};
+        media_session_backend::session_state session {};
+        volume_backend::endpoint             endpoint {};
+    };
+
+    // Records the events of the process into the file, which is replaced. Recording is off
+    // until then, and every record call is then only an atomic load.
+    static std::expected<void, os_error> start_recording(const std::filesystem::path& path);
+    static void                          stop_recording();
+
+    // Safe to call from any thread. A record is only encoded, then written by the thread of the
+    // logger once woken up, so that the trace survives a crash but for its last records. Without
+    // a logger keeping up, the recording thread writes the records itself once 64 KiB are
+    // pending, and the rest is written when recording stops. To have the trace in the order the
+    // changes were applied, a change is recorded under the lock that applies it.
+    static void record_session_changed(
+        const std::string&                          id,
+        const media_session_backend::session_state& state
+    );
+    static void record_session_removed(const std::string& id);
+    static void record_endpoint(kind type, const volume_backend::endpoint& endpoint);
+    static void record_default_changed();
+    static void record_volume_written(float vol);
+    static void record_mute_written(bool muted);
+
+    // Reads a recorded trace back, one event at a time
+    class reader
+    {
+    public:
+        static std::expected<reader, os_error> open(const std::filesystem::path& path);
+
+        // Empty at the end of the trace, which a truncated record also is, as written by a
+        // process that was killed
+        std::expected<std::optional<event>, os_error> next();
+
+    private:
+        explicit reader(mapped_file file);
+
+        mapped_file               file_;
+        std::string_view          data_;
+        std::chrono::microseconds at_ {};
+    };
+};
+
+}  // namespace manelemax
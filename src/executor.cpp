@@ -0,0 +1,175 @@
+#include "executor.hpp"
+
+#include <algorithm>
+#include <utility>
+
+namespace manelemax
+{
+
+namespace
+{
+
+constexpr auto later_deadline = [](const auto& lhs, const auto& rhs) {
+    return lhs.deadline > rhs.deadline;
+};
+
+}  // namespace
+
+executor::executor(const std::size_t capacity, const mode run_mode)
+    : run_mode_ {run_mode}
+    , ring_(capacity)
+    , thread_ {
+          run_mode == mode::threaded ?
+              std::jthread {[this](const std::stop_token stop) { run(stop); }} :
+              std::jthread {}
+      }
+{
+}
+
+executor::~executor()
+{
+    stop();
+}
+
+bool executor::post(task fn)
+{
+    {
+        std::lock_guard lock {mutex_};
+        if (stopped_ || size_ == ring_.size())
+        {
+            dropped_.fetch_add(1, std::memory_order_relaxed);
+            return false;
+        }
+
+        ring_[(head_ + size_) % ring_.size()] = std::move(fn);
+        ++size_;
+    }
+
+    cv_.notify_one();
+    return true;
+}
+
+bool executor::post_after(const clock::duration delay, task fn)
+{
+    {
+        std::lock_guard lock {mutex_};
+        if (stopped_ || timers_.size() == ring_.size())
+        {
+            dropped_.fetch_add(1, std::memory_order_relaxed);
+            return false;
+        }
+
+        timers_.push_back({.deadline = now() + delay, .fn = std::move(fn)});
+        std::ranges::push_heap(timers_, later_deadline);
+        ++timers_version_;
+    }
+
+    cv_.notify_one();
+    return true;
+}
+
+void executor::stop()
+{
+    {
+        std::lock_guard lock {mutex_};
+        stopped_ = true;
+    }
+
+    thread_.request_stop();
+    if (thread_.joinable())
+    {
+        thread_.join();
+    }
+
+    // The tasks may own resources, they are released now rather than with the executor
+    std::lock_guard lock {mutex_};
+    for (task& fn : ring_)
+    {
+        fn = nullptr;
+    }
+    size_ = 0;
+    timers_.clear();
+}
+
+auto executor::now() const -> clock::time_point
+{
+    return run_mode_ == mode::manual ? manual_now_.load() : clock::now();
+}
+
+void executor::advance_to(const clock::time_point time)
+{
+    std::unique_lock lock {mutex_};
+    while (task fn = next_task(time))
+    {
+        lock.unlock();
+        fn();
+        lock.lock();
+    }
+
+    if (manual_now_.load() < time)
+    {
+        manual_now_ = time;
+    }
+}
+
+auto executor::next_task(const clock::time_point time) -> task
+{
+    task fn;
+    if (size_ != 0)
+    {
+        fn    = std::move(ring_[head_]);
+        head_ = (head_ + 1) % ring_.size();
+        --size_;
+    }
+    else if (!timers_.empty() && timers_.front().deadline <= time)
+    {
+        if (run_mode_ == mode::manual && manual_now_.load() < timers_.front().deadline)
+        {
+            manual_now_ = timers_.front().deadline;
+        }
+
+        std::ranges::pop_heap(timers_, later_deadline);
+        fn = std::move(timers_.back().fn);
+        timers_.pop_back();
+    }
+    return fn;
+}
+
+void executor::run(const std::stop_token stop)
+{
+    std::unique_lock lock {mutex_};
+    while (!stop.stop_requested())
+    {
+        const std::uint64_t version = timers_version_;
+
+        const auto timer_due = [this] {
+            return !timers_.empty() && timers_.front().deadline <= clock::now();
+        };
+        const auto has_work = [&] {
+            return size_ != 0 || timers_version_ != version || timer_due();
+        };
+
+        if (timers_.empty())
+        {
+            cv_.wait(lock, stop, has_work);
+        }
+        else
+        {
+            // A copy, the lock is released while waiting and a post_after() may reallocate
+            const clock::time_point deadline = timers_.front().deadline;
+            cv_.wait_until(lock, stop, deadline, has_work);
+        }
+
+        task fn = next_task(clock::now());
+        if (!fn)
+        {
+            continue;
+        }
+
+        lock.unlock();
+        fn();
+        lock.lock();
+    }
+}
+
+}  // namespace manelemax
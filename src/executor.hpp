@@ -0,0 +1,108 @@
+#pragma once
+
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <cstddef>
+#include <cstdint>
+#include <functional>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+namespace manelemax
+{
+
+// Runs tasks one at a time, in the order they were posted, on its own thread.
+//
+// Any thread can post. Posting never blocks: the queue is a bounded ring, and a task posted while
+// it is full is dropped and counted, so the callbacks of the OS never wait for the executor. The
+// delayed tasks are bounded the same way.
+//
+// A manual executor has no thread and its own clock, which only moves in advance_to(), where the
+// tasks run on the calling thread. A replay then runs through hours of timers in no time, and
+// always in the same order.
+class executor
+{
+public:
+    using task  = std::move_only_function<void()>;
+    using clock = std::chrono::steady_clock;
+
+    enum class mode : std::uint8_t
+    {
+        threaded,
+        manual
+    };
+
+    explicit executor(std::size_t capacity, mode run_mode = mode::threaded);
+
+    executor(const executor&)            = delete;
+    executor& operator=(const executor&) = delete;
+
+    ~executor();
+
+    // Returns false if the task was dropped, because the queue is full or the executor stopped
+    bool post(task fn);
+
+    // Same as above, the task runs once the delay elapsed and the tasks posted before are done
+    bool post_after(clock::duration delay, task fn);
+
+    // Waits for the running task, drops the queued ones and rejects the later posts. Cannot be
+    // called from a task.
+    void stop();
+
+    // The time the delays of post_after() count from, the one of the manual clock for a manual
+    // executor, which starts at the epoch of the clock
+    clock::time_point now() const;
+
+    // Manual executor only. Runs the tasks posted, and the delayed ones due by the given time, in
+    // the order of their deadlines, with the clock moved to each deadline in turn, then to the
+    // given time. The tasks posted meanwhile run as well.
+    void advance_to(clock::time_point time);
+
+    bool is_executor_thread() const
+    {
+        return std::this_thread::get_id() == thread_.get_id();
+    }
+
+    std::uint64_t dropped() const
+    {
+        return dropped_.load(std::memory_order_relaxed);
+    }
+
+private:
+    struct timer
+    {
+        clock::time_point deadline;
+        task              fn;
+    };
+
+    void run(std::stop_token stop);
+
+    // The mutex is held. The next task to run by the given time, the clock moved to it if it is
+    // a delayed one, or an empty task if there is none.
+    task next_task(clock::time_point time);
+
+    const mode run_mode_;
+
+    std::mutex                  mutex_ {};
+    std::condition_variable_any cv_ {};
+    std::vector<task>           ring_;
+    std::size_t                 head_ {0};
+    std::size_t                 size_ {0};
+    bool                        stopped_ {false};
+
+    // Min-heap on the deadline. The version tells the loop to wait for an earlier deadline.
+    std::vector<timer> timers_ {};
+    std::uint64_t      timers_version_ {0};
+
+    // Manual executor only, written under the mutex
+    std::atomic<clock::time_point> manual_now_ {};
+
+    std::atomic<std::uint64_t> dropped_ {0};
+
+    // Last, so that it is started once everything else is initialized
+    std::jthread thread_;
+};
+
+}  // namespace manelemax
@@ -0,0 +1,58 @@
+#pragma once
+
+#include <map>
+#include <mutex>
+#include <string>
+
+#include "media_session_backend.hpp"
+
+namespace manelemax
+{
+
+// Sessions driven by hand rather than by media players, to exercise the notifier and its
+// policies. The changes are reported from the thread that makes them.
+class fake_media_session_backend : public media_session_backend
+{
+public:
+    void set_listener(listener* const lsn) override
+    {
+        std::lock_guard lock {mutex_};
+        lsn_ = lsn;
+
+        if (lsn_)
+        {
+            for (const auto& [id, state] : sessions_)
+            {
+                lsn_->on_session_changed(id, state);
+            }
+        }
+    }
+
+    // Adds the session if there is none with that id yet
+    void update(const std::string& id, const session_state& state)
+    {
+        std::lock_guard lock {mutex_};
+        sessions_[id] = state;
+
+        if (lsn_)
+        {
+            lsn_->on_session_changed(id, state);
+        }
+    }
+
+    void remove(const std::string& id)
+    {
+        std::lock_guard lock {mutex_};
+        if (sessions_.erase(id) != 0 && lsn_)
+        {
+            lsn_->on_session_removed(id);
+        }
+    }
+
+private:
+    std::mutex                           mutex_ {};
+    std::map<std::string, session_state> sessions_ {};
+    listener*                            lsn_ {nullptr};
+};
+
+}  // namespace manelemax
@@ -0,0 +1,95 @@
+#pragma once
+
+#include <mutex>
+#include <optional>
+
+#include "volume_backend.hpp"
+
+namespace manelemax
+{
+
+// An endpoint kept in memory rather than an audio device, to exercise volume_control and auto_dj.
+// The changes are reported from the thread that makes them, the target is only recorded.
+class fake_volume_backend : public volume_backend
+{
+public:
+    explicit fake_volume_backend(const endpoint initial = {.volume = 1.0f, .muted = false})
+        : endpoint_ {initial}
+    {
+    }
+
+    std::expected<endpoint, os_error> get() override
+    {
+        std::lock_guard lock {mutex_};
+        return endpoint_;
+    }
+
+    std::expected<void, os_error> set_volume(const float vol) override
+    {
+        std::lock_guard lock {mutex_};
+        endpoint_.volume = vol;
+        report();
+        return {};
+    }
+
+    std::expected<void, os_error> set_muted(const bool muted) override
+    {
+        std::lock_guard lock {mutex_};
+        endpoint_.muted = muted;
+        report();
+        return {};
+    }
+
+    std::expected<void, os_error> set_listener(listener* const lsn) override
+    {
+        std::lock_guard lock {mutex_};
+        lsn_ = lsn;
+        return {};
+    }
+
+    void set_target(const std::optional<application>& app) override
+    {
+        std::lock_guard lock {mutex_};
+        target_ = app;
+    }
+
+    std::expected<void, os_error> follow_default() override
+    {
+        return {};
+    }
+
+    // A change made by someone else, like a user dragging the slider
+    void update(const endpoint& new_endpoint)
+    {
+        std::lock_guard lock {mutex_};
+        endpoint_ = new_endpoint;
+        report();
+    }
+
+    // Another endpoint became the default one, it keeps the same state
+    void change_default()
+    {
+        std::lock_guard lock {mutex_};
+        if (lsn_)
+        {
+            lsn_->on_default_changed();
+        }
+    }
+
+private:
+    // The mutex is held
+    void report() const
+    {
+        if (lsn_)
+        {
+            lsn_->on_endpoint_changed(endpoint_);
+        }
+    }
+
+    std::mutex                 mutex_ {};
+    endpoint                   endpoint_;
+    std::optional<application> target_ {};
+    listener*                  lsn_ {nullptr};
+};
+
+}  // namespace manelemax
@@ -0,0 +1,60 @@
+#pragma once
+
+#include <cstdint>
+#include <functional>
+#include <utility>
+
+namespace manelemax
+{
+
+// The successive fetches of a value that keeps changing, of which only the latest one started may
+// apply its result, so that a slow fetch can never overwrite the value of a newer one.
+//
+// Starting a fetch makes the one in progress stale and hands back its cancellation. Call it once
+// the lock is released: a cancellation may complete the stale fetch at once, on the same thread,
+// and its coroutine then takes the lock to find out that it is stale.
+//
+// Not thread safe, it belongs to the state the results are applied to and is used under its lock.
+class fetch_sequence
+{
+public:
+    using cancel_fn = std::move_only_function<void()>;
+
+    struct started
+    {
+        std::uint64_t id {0};
+        cancel_fn     cancel_previous;  // Empty if there was no fetch in progress
+    };
+
+    started start(cancel_fn cancel)
+    {
+        return {.id = ++latest_, .cancel_previous = std::exchange(cancel_, std::move(cancel))};
+    }
+
+    bool is_latest(const std::uint64_t id) const
+    {
+        return id == latest_;
+    }
+
+    // The latest fetch completed, there is nothing to cancel anymore
+    void finish(const std::uint64_t id)
+    {
+        if (id == latest_)
+        {
+            cancel_ = {};
+        }
+    }
+
+    // Makes the fetch in progress stale, as when a newer one starts, and returns its cancellation
+    cancel_fn stop()
+    {
+        ++latest_;
+        return std::exchange(cancel_, {});
+    }
+
+private:
+    std::uint64_t latest_ {0};
+    cancel_fn     cancel_ {};
+};
+
+}  // namespace manelemax
@@ -0,0 +1,266 @@
+#include "fuzzy_keyword_matcher.hpp"
+
+#include <algorithm>
+#include <array>
+#include <ranges>
+#include <span>
+#include <utility>
+
+namespace manelemax
+{
+
+namespace
+{
+
+constexpr std::size_t no_skip {std::string_view::npos};
+
+// FNV-1a of the word without the letters at skip_first and skip_second
+std::uint64_t deletion_hash(
+    const std::string_view word,
+    const std::size_t      skip_first,
+    const std::size_t      skip_second
+)
+{
+    std::uint64_t hash {14695981039346656037ull};
+    for (std::size_t idx = 0; idx != word.size(); ++idx)
+    {
+        if (idx != skip_first && idx != skip_second)
+        {
+            hash = (hash ^ std::uint8_t(word[idx])) * 1099511628211ull;
+        }
+    }
+    return hash;
+}
+
+// Calls fn with the hash of the word, then with the ones of the word with up to max_deletions
+// letters deleted, until fn returns false. A doubled letter gives the same variant twice.
+template<typename Fn>
+void for_each_deletion(const std::string_view word, const std::size_t max_deletions, Fn&& fn)
+{
+    if (!fn(deletion_hash(word, no_skip, no_skip)))
+    {
+        return;
+    }
+
+    for (std::size_t first = 0; max_deletions >= 1 && first != word.size(); ++first)
+    {
+        if (!fn(deletion_hash(word, first, no_skip)))
+        {
+            return;
+        }
+
+        for (std::size_t second = first + 1; max_deletions >= 2 && second != word.size(); ++second)
+        {
+            if (!fn(deletion_hash(word, first, second)))
+            {
+                return;
+            }
+        }
+    }
+}
+
+// Optimal string alignment distance, or limit + 1 as soon as it is known to be over the limit.
+// Both words are at most MaxLength letters long.
+template<std::size_t MaxLength>
+std::size_t edit_distance(const std::string_view lhs, const std::string_view rhs, std::size_t limit)
+{
+    const std::size_t length_diff =
+        lhs.size() > rhs.size() ? lhs.size() - rhs.size() : rhs.size() - lhs.size();
+    if (length_diff > limit)
+    {
+        return limit + 1;
+    }
+
+    // Rows i - 2, i - 1 and i of the matrix
+    std::array<std::uint8_t, MaxLength + 1> before;
+    std::array<std::uint8_t, MaxLength + 1> prev;
+    std::array<std::uint8_t, MaxLength + 1> crt;
+
+    for (std::size_t col = 0; col <= rhs.size(); ++col)
+    {
+        prev[col] = std::uint8_t(col);
+    }
+
+    for (std::size_t row = 1; row <= lhs.size(); ++row)
+    {
+        crt[0]               = std::uint8_t(row);
+        std::uint8_t row_min = crt[0];
+
+        for (std::size_t col = 1; col <= rhs.size(); ++col)
+        {
+            const bool same = lhs[row - 1] == rhs[col - 1];
+
+            std::uint8_t value = std::min({
+                std::uint8_t(prev[col] + 1),
+                std::uint8_t(crt[col - 1] + 1),
+                std::uint8_t(prev[col - 1] + (same ? 0 : 1)),
+            });
+            if (row > 1 && col > 1 && lhs[row - 1] == rhs[col - 2] && lhs[row - 2] == rhs[col - 1])
+            {
+                value = std::min(value, std::uint8_t(before[col - 2] + 1));
+            }
+
+            crt[col] = value;
+            row_min  = std::min(row_min, value);
+        }
+
+        if (row_min > limit)
+        {
+            return limit + 1;
+        }
+
+        std::swap(before, prev);
+        std::swap(prev, crt);
+    }
+
+    return std::min<std::size_t>(prev[rhs.size()], limit + 1);
+}
+
+constexpr bool is_letter(const char c)
+{
+    return c >= 'a' && c <= 'z';
+}
+
+}  // namespace
+
+fuzzy_keyword_matcher::fuzzy_keyword_matcher(const keyword_matcher& matcher)
+    : matcher_ {matcher}
+{
+    for (std::size_t idx = 0; idx != matcher_.keyword_count(); ++idx)
+    {
+        const std::string_view keyword = matcher_.keyword(idx);
+        if (!_internal::is_matchable_keyword(keyword) ||
+            keyword.find(' ') == std::string_view::npos)
+        {
+            continue;
+        }
+
+        for (const auto word : std::views::split(keyword, ' '))
+        {
+            if (word.size() <= max_word_length)
+            {
+                words_.emplace_back(word.begin(), word.end());
+            }
+        }
+    }
+
+    std::ranges::sort(words_);
+    const auto duplicates = std::ranges::unique(words_);
+    words_.erase(duplicates.begin(), duplicates.end());
+
+    std::vector<std::pair<std::uint64_t, std::uint32_t>> entries;
+    for (std::uint32_t id = 0; id != words_.size(); ++id)
+    {
+        const std::string_view word = words_[id];
+        longest_word_               = std::max(longest_word_, word.size());
+
+        const auto add = [&entries, id](const std::uint64_t hash) {
+            entries.emplace_back(hash, id);
+            return true;
+        };
+        for_each_deletion(word, max_distance(word.size()), add);
+    }
+
+    std::ranges::sort(entries);
+    const auto repeated = std::ranges::unique(entries);
+    entries.erase(repeated.begin(), repeated.end());
+
+    // Sorted by hash, so the words of a deletion are contiguous
+    postings_.reserve(entries.size());
+    for (const auto& [hash, id] : entries)
+    {
+        posting_range& range = deletions_[hash];
+        if (range.count == 0)
+        {
+            range.offset = std::uint32_t(postings_.size());
+        }
+        ++range.count;
+        postings_.push_back(id);
+    }
+}
+
+std::uint32_t fuzzy_keyword_matcher::closest_word(const std::string_view word) const
+{
+    // A keyword word with typos has at least 5 letters, one of which may be missing
+    if (word.size() < 4 || word.size() > longest_word_ + 2)
+    {
+        return no_word;
+    }
+
+    std::uint32_t best          = no_word;
+    std::size_t   best_distance = SIZE_MAX;
+
+    // Only the words of 9 letters or more allow two edits, they are 7 letters long at least
+    const std::size_t max_deletions = word.size() >= 7 ? 2 : 1;
+
+    for_each_deletion(word, max_deletions, [&](const std::uint64_t hash) {
+        const auto found = deletions_.find(hash);
+        if (found == deletions_.end())
+        {
+            return true;
+        }
+
+        const std::span<const std::uint32_t> ids =
+            std::span {postings_}.subspan(found->second.offset, found->second.count);
+        for (const std::uint32_t id : ids)
+        {
+            if (id == best)
+            {
+                continue;
+            }
+
+            const std::string_view candidate = words_[id];
+            const std::size_t      limit = std::min(max_distance(candidate.size()), best_distance);
+            const std::size_t      distance =
+                edit_distance<max_word_length + 2>(word, candidate, limit);
+
+            // On ties, the first word in alphabetical order, so that the result does not depend
+            // on the order of the lookups
+            if (distance <= limit && (distance < best_distance || id < best))
+            {
+                best          = id;
+                best_distance = distance;
+            }
+        }
+
+        // Done once the word itself is found among the keyword words
+        return best_distance != 0;
+    });
+
+    return best;
+}
+
+bool fuzzy_keyword_matcher::correct(const std::string_view text, std::string& corrected) const
+{
+    corrected.clear();
+    bool changed = false;
+
+    for (std::size_t pos = 0; pos != text.size();)
+    {
+        if (!is_letter(text[pos]))
+        {
+            ++pos;
+            continue;
+        }
+
+        std::size_t end = pos + 1;
+        while (end != text.size() && is_letter(text[end]))
+        {
+            ++end;
+        }
+
+        const std::string_view word    = text.substr(pos, end - pos);
+        const std::uint32_t    closest = closest_word(word);
+
+        const std::string_view replacement = closest == no_word ? word : words_[closest];
+        changed |= replacement != word;
+
+        corrected.append(replacement);
+        corrected.push_back(' ');
+        pos = end;
+    }
+
+    return changed;
+}
+
+}  // namespace manelemax
@@ -0,0 +1,90 @@
+#pragma once
+
+#include <cstdint>
+#include <string>
+#include <string_view>
+#include <unordered_map>
+#include <vector>
+
+#include "keyword_matcher.hpp"
+
+namespace manelemax
+{
+
+// Matches the keywords with a few typos, on top of keyword_matcher.
+//
+// Every word of the text is replaced by the closest keyword word within max_distance() edits
+// (Damerau-Levenshtein, adjacent transpositions included), then the corrected text is run through
+// the exact automaton. The candidates come from a SymSpell index: the deletions of up to two
+// letters of every keyword word, precomputed and looked up with the deletions of the words of the
+// text, so a word costs a few hash lookups.
+//
+// Only the words of the keywords with several words are corrected. A single word with a typo is
+// most often another word ("denise" is not "denisa"), while the other words of the keyword confirm
+// the match.
+//
+// The matcher is kept as is, it has to outlive this one. Build it again when the keywords change.
+class fuzzy_keyword_matcher
+{
+public:
+    explicit fuzzy_keyword_matcher(const keyword_matcher& matcher);
+
+    // Edits allowed in a keyword word of the given length
+    static constexpr std::size_t max_distance(const std::size_t length)
+    {
+        return length >= 9 ? 2 : length >= 5 ? 1 : 0;
+    }
+
+    const keyword_matcher& exact() const
+    {
+        return matcher_;
+    }
+
+    // Same contract as keyword_matcher::for_each_match(), over the corrected text if the text has
+    // no exact match, an exact match being preferred. corrected holds the corrected text, it is
+    // only passed in so that its buffer is reused across calls.
+    template<typename Fn>
+    void for_each_match(std::string_view text, std::string& corrected, Fn&& fn) const
+    {
+        bool matched = false;
+        matcher_.for_each_match(text, [&matched, &fn](const std::uint16_t keyword) {
+            matched = true;
+            fn(keyword);
+        });
+
+        if (!matched && correct(text, corrected))
+        {
+            matcher_.for_each_match(corrected, fn);
+        }
+    }
+
+private:
+    static constexpr std::uint32_t no_word {UINT32_MAX};
+
+    // Longer keyword words are only matched exactly
+    static constexpr std::size_t max_word_length {32};
+
+    struct posting_range
+    {
+        std::uint32_t offset {0};
+        std::uint32_t count {0};
+    };
+
+    // Index in words_ of the closest keyword word, or no_word
+    std::uint32_t closest_word(std::string_view word) const;
+
+    // Writes the text with every word replaced by its closest keyword word into corrected, and
+    // returns whether any word was replaced
+    bool correct(std::string_view text, std::string& corrected) const;
+
+    keyword_matcher               matcher_;
+    std::vector<std::string_view> words_ {};  // Sorted, views into the string pool of the matcher
+    std::size_t                   longest_word_ {0};
+
+    // Hash of a deletion variant, to the words it comes from. Hash collisions only add candidates,
+    // which are checked anyway.
+    std::unordered_map<std::uint64_t, posting_range> deletions_ {};
+    std::vector<std::uint32_t>                       postings_ {};
+};
+
+}  // namespace manelemax
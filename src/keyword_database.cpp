@@ -0,0 +1,247 @@
+#include "keyword_database.hpp"
+
+#include <algorithm>
+#include <bit>
+#include <cerrno>
+#include <cstring>
+#include <fstream>
+#include <unordered_map>
+#include <unordered_set>
+#include <utility>
+#include <vector>
+
+namespace manelemax
+{
+
+namespace
+{
+
+static_assert(std::endian::native == std::endian::little, "The database format is little-endian");
+static_assert(sizeof(keyword_database::header) == 64);
+
+constexpr std::size_t section_alignment {8};
+
+using transition_row = keyword_matcher::transition_row;
+using state_output   = keyword_matcher::state_output;
+using keyword_ref    = keyword_matcher::keyword_ref;
+
+std::unexpected<os_error> format_error(const std::string_view check, const std::int64_t value)
+{
+    return std::unexpected {os_error {check, value}};
+}
+
+template<typename T>
+bool
+section_fits(const std::string_view data, const std::uint64_t offset, const std::uint64_t count)
+{
+    return offset % alignof(T) == 0 && offset <= data.size() &&
+           count <= (data.size() - offset) / sizeof(T);
+}
+
+template<typename T>
+std::span<const T>
+section(const std::string_view data, const std::uint64_t offset, const std::uint64_t count)
+{
+    return {reinterpret_cast<const T*>(data.data() + offset), std::size_t(count)};
+}
+
+std::uint64_t append_section(std::string& out, const std::span<const std::byte> bytes)
+{
+    out.resize((out.size() + section_alignment - 1) / section_alignment * section_alignment);
+
+    const std::uint64_t offset = out.size();
+    out.append(reinterpret_cast<const char*>(bytes.data()), bytes.size());
+    return offset;
+}
+
+}  // namespace
+
+keyword_database::keyword_database(
+    std::unique_ptr<std::uint64_t[]> storage,
+    const keyword_matcher            matcher
+)
+    : storage_ {std::move(storage)}
+    , matcher_ {matcher}
+{
+}
+
+std::expected<keyword_database, os_error> keyword_database::open(const std::filesystem::path& path)
+{
+    // The streams open the file through the C runtime, which tells why in errno
+    errno = 0;
+    std::ifstream file {path, std::ios::binary | std::ios::ate};
+    if (!file.is_open())
+    {
+        return std::unexpected {os_error {"keyword_database: open", errno != 0 ? errno : EIO}};
+    }
+
+    const std::streamoff size = file.tellg();
+    if (size < 0)
+    {
+        return std::unexpected {os_error {"keyword_database: read", EIO}};
+    }
+
+    // Whole words, so that every section is as aligned as in the file
+    auto storage = std::make_unique_for_overwrite<std::uint64_t[]>(
+        (std::size_t(size) + sizeof(std::uint64_t) - 1) / sizeof(std::uint64_t)
+    );
+    char* const bytes = reinterpret_cast<char*>(storage.get());
+    if (!file.seekg(0).read(bytes, size))
+    {
+        // Truncated while read
+        return std::unexpected {os_error {"keyword_database: read", EIO}};
+    }
+    file.close();
+
+    const std::string_view data {bytes, std::size_t(size)};
+
+    header hdr;
+    if (data.size() < sizeof(hdr))
+    {
+        return format_error("keyword_database: header size check", std::int64_t(data.size()));
+    }
+    std::memcpy(&hdr, data.data(), sizeof(hdr));
+
+    if (hdr.magic != magic)
+    {
+        return format_error("keyword_database: magic check", 0);
+    }
+    if (hdr.version != format_version)
+    {
+        return format_error("keyword_database: version check", hdr.version);
+    }
+    if (hdr.symbol_count != keyword_matcher::symbol_count)
+    {
+        return format_error("keyword_database: symbol count check", hdr.symbol_count);
+    }
+    if (hdr.state_count == 0 || hdr.state_count > UINT16_MAX)
+    {
+        return format_error("keyword_database: state count check", hdr.state_count);
+    }
+    if (hdr.keyword_count >= keyword_matcher::no_keyword)
+    {
+        return format_error("keyword_database: keyword count check", hdr.keyword_count);
+    }
+
+    if (!section_fits<transition_row>(data, hdr.transitions_offset, hdr.state_count) ||
+        !section_fits<state_output>(data, hdr.outputs_offset, hdr.state_count) ||
+        !section_fits<keyword_ref>(data, hdr.keywords_offset, hdr.keyword_count) ||
+        !section_fits<char>(data, hdr.string_pool_offset, hdr.string_pool_size))
+    {
+        return format_error("keyword_database: section bounds check", std::int64_t(data.size()));
+    }
+
+    const auto transitions = section<transition_row>(data, hdr.transitions_offset, hdr.state_count);
+    const auto outputs     = section<state_output>(data, hdr.outputs_offset, hdr.state_count);
+    const auto keywords    = section<keyword_ref>(data, hdr.keywords_offset, hdr.keyword_count);
+
+    for (const transition_row& row : transitions)
+    {
+        if (std::ranges::any_of(row, [&](const std::uint16_t next) {
+                return next >= hdr.state_count;
+            }))
+        {
+            return format_error("keyword_database: transition check", &row - transitions.data());
+        }
+    }
+    for (const state_output& out : outputs)
+    {
+        if (out.longest != keyword_matcher::no_keyword && out.longest >= hdr.keyword_count)
+        {
+            return format_error("keyword_database: output check", &out - outputs.data());
+        }
+    }
+    for (const keyword_ref& ref : keywords)
+    {
+        if (std::uint64_t(ref.offset) + ref.length > hdr.string_pool_size ||
+            ref.field > keyword_field::title)
+        {
+            return format_error("keyword_database: keyword check", &ref - keywords.data());
+        }
+    }
+
+    const keyword_matcher matcher {
+        transitions,
+        outputs,
+        keywords,
+        data.substr(std::size_t(hdr.string_pool_offset), std::size_t(hdr.string_pool_size))
+    };
+
+    return keyword_database {std::move(storage), matcher};
+}
+
+std::expected<std::string, os_error>
+keyword_database::compile(
+    const std::span<const std::string_view> keywords,
+    const std::span<const keyword_weight>   weights
+)
+{
+    std::unordered_set<std::string_view> unique;
+    for (std::size_t idx = 0; idx != keywords.size(); ++idx)
+    {
+        if (!_internal::is_matchable_keyword(keywords[idx]))
+        {
+            return format_error("keyword_database: keyword check", std::int64_t(idx));
+        }
+        if (!unique.insert(keywords[idx]).second)
+        {
+            return format_error("keyword_database: duplicate check", std::int64_t(idx));
+        }
+    }
+
+    std::unordered_map<std::string_view, const keyword_weight*> weight_of;
+    for (std::size_t idx = 0; idx != weights.size(); ++idx)
+    {
+        if (!unique.contains(weights[idx].keyword) || weights[idx].field > keyword_field::title ||
+            !weight_of.emplace(weights[idx].keyword, &weights[idx]).second)
+        {
+            return format_error("keyword_database: weight check", std::int64_t(idx));
+        }
+    }
+
+    const _internal::keyword_trie trie = _internal::build_keyword_trie(keywords);
+    if (trie.overflow)
+    {
+        return format_error("keyword_database: state count check", std::int64_t(keywords.size()));
+    }
+
+    std::vector<keyword_ref> refs;
+    std::string              string_pool;
+    for (const std::string_view keyword : keywords)
+    {
+        const auto weight = weight_of.find(keyword);
+        refs.push_back(_internal::make_keyword_ref(
+            std::uint32_t(string_pool.size()),
+            keyword,
+            weight == weight_of.end() ? nullptr : weight->second
+        ));
+        string_pool.append(keyword);
+    }
+
+    // The offsets are known once the sections are appended
+    header hdr {
+        .magic              = magic,
+        .version            = format_version,
+        .symbol_count       = keyword_matcher::symbol_count,
+        .state_count        = std::uint32_t(trie.transitions.size()),
+        .keyword_count      = std::uint32_t(keywords.size()),
+        .transitions_offset = 0,
+        .outputs_offset     = 0,
+        .keywords_offset    = 0,
+        .string_pool_offset = 0,
+        .string_pool_size   = 0,
+    };
+
+    // The header is written last, once the section offsets are known
+    std::string out(sizeof(hdr), '\0');
+    hdr.transitions_offset = append_section(out, std::as_bytes(std::span {trie.transitions}));
+    hdr.outputs_offset     = append_section(out, std::as_bytes(std::span {trie.outputs}));
+    hdr.keywords_offset    = append_section(out, std::as_bytes(std::span {refs}));
+    hdr.string_pool_offset = append_section(out, std::as_bytes(std::span {string_pool}));
+    hdr.string_pool_size   = string_pool.size();
+
+    std::memcpy(out.data(), &hdr, sizeof(hdr));
+    return out;
+}
+
+}  // namespace manelemax
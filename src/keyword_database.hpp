@@ -0,0 +1,76 @@
+#pragma once
+
+#include <array>
+#include <cstdint>
+#include <expected>
+#include <filesystem>
+#include <memory>
+#include <span>
+#include <string>
+#include <string_view>
+
+#include "keyword_matcher.hpp"
+#include "os_error.hpp"
+
+namespace manelemax
+{
+
+// Precompiled keyword list stored in a file, so that the keywords can change without a rebuild.
+//
+// The file holds the same tables as keyword_table: a header, then the transitions, the outputs,
+// the keyword refs (weights included) and the string pool, each section 8-byte aligned and
+// little-endian. It is read in memory as is and the automaton is used in place, without any
+// parsing.
+//
+// The file is read rather than mapped, and closed right away: a file mapped on Windows cannot be
+// replaced by a rename, and one mapped on POSIX faults with SIGBUS when truncated in place. So the
+// file can be replaced at any time. One rewritten in place may be read half written, which open()
+// rejects or keeps in bounds like any corrupt file.
+//
+// Format errors are reported as an os_error naming the failed check, with the offending value as
+// the code.
+class keyword_database
+{
+public:
+    static constexpr std::array<char, 8> magic {'M', 'M', 'X', 'K', 'W', 'D', 'B', '\0'};
+    static constexpr std::uint32_t       format_version {3};
+
+    struct header
+    {
+        std::array<char, 8> magic;
+        std::uint32_t       version;
+        std::uint32_t       symbol_count;
+        std::uint32_t       state_count;
+        std::uint32_t       keyword_count;
+        std::uint64_t       transitions_offset;
+        std::uint64_t       outputs_offset;
+        std::uint64_t       keywords_offset;
+        std::uint64_t       string_pool_offset;
+        std::uint64_t       string_pool_size;
+    };
+
+    // Reads the file and checks that every index it holds is in bounds, so that even a corrupt
+    // file cannot make the matcher read outside of the buffer
+    static std::expected<keyword_database, os_error> open(const std::filesystem::path& path);
+
+    // Returns the file contents for the given keywords, which must be normalized and unique. The
+    // keywords that are not in weights get the default weight, for any field.
+    static std::expected<std::string, os_error> compile(
+        std::span<const std::string_view> keywords,
+        std::span<const keyword_weight>   weights = {}
+    );
+
+    // Valid for as long as the database is
+    keyword_matcher matcher() const
+    {
+        return matcher_;
+    }
+
+private:
+    keyword_database(std::unique_ptr<std::uint64_t[]> storage, keyword_matcher matcher);
+
+    std::unique_ptr<std::uint64_t[]> storage_;
+    keyword_matcher                  matcher_;
+};
+
+}  // namespace manelemax
@@ -0,0 +1,412 @@
+#pragma once
+
+#include <algorithm>
+#include <array>
+#include <cstdint>
+#include <span>
+#include <string_view>
+#include <vector>
+
+namespace manelemax
+{
+
+// The field of the track a keyword is expected in. A match in the other field is weaker evidence.
+enum class keyword_field : std::uint8_t
+{
+    any,
+    artist,
+    title
+};
+
+// Weight and field of one keyword, for the ones that differ from the defaults
+struct keyword_weight
+{
+    std::string_view keyword {};
+    std::uint16_t    weight {0};
+    keyword_field    field {keyword_field::any};
+};
+
+// Aho-Corasick automaton matching keywords on whole-word boundaries.
+//
+// The text is expected to be normalized (lowercase ASCII letters and whitespace). Every keyword is
+// stored padded with a separator on both sides and the text is scanned as if it was padded the
+// same way, so a keyword can only match a run of whole words.
+//
+// The matcher is only a view over flat tables, see keyword_table for the storage.
+class keyword_matcher
+{
+public:
+    static constexpr std::size_t   symbol_count {27};  // separator, 'a' ... 'z'
+    static constexpr std::uint16_t no_keyword {UINT16_MAX};
+    static constexpr std::uint16_t default_weight {100};
+
+    using transition_row = std::array<std::uint16_t, symbol_count>;
+
+    struct state_output
+    {
+        // Longest keyword ending in this state, the one a keyword nested in it is part of
+        std::uint16_t longest {no_keyword};
+        std::uint16_t reserved {0};
+    };
+
+    // Location of a keyword in the string pool, and its weight as evidence of a manele track
+    struct keyword_ref
+    {
+        std::uint32_t offset {0};
+        std::uint32_t length {0};
+        std::uint16_t weight {default_weight};
+        keyword_field field {keyword_field::any};
+        std::uint8_t  reserved {0};
+    };
+
+    constexpr keyword_matcher(
+        const std::span<const transition_row> transitions,
+        const std::span<const state_output>   outputs,
+        const std::span<const keyword_ref>    keywords,
+        const std::string_view                string_pool
+    )
+        : transitions_ {transitions}
+        , outputs_ {outputs}
+        , keywords_ {keywords}
+        , string_pool_ {string_pool}
+    {
+    }
+
+    std::size_t keyword_count() const
+    {
+        return keywords_.size();
+    }
+
+    std::string_view keyword(const std::size_t idx) const
+    {
+        return string_pool_.substr(keywords_[idx].offset, keywords_[idx].length);
+    }
+
+    std::uint16_t weight(const std::size_t idx) const
+    {
+        return keywords_[idx].weight;
+    }
+
+    keyword_field field(const std::size_t idx) const
+    {
+        return keywords_[idx].field;
+    }
+
+    // Calls fn with the index of the longest keyword ending at each word of the text, left to
+    // right, in a single pass. A keyword nested at the end of a longer one is not reported again.
+    template<typename Fn>
+    void for_each_match(std::string_view text, Fn&& fn) const;
+
+private:
+    std::span<const transition_row> transitions_;
+    std::span<const state_output>   outputs_;
+    std::span<const keyword_ref>    keywords_;
+    std::string_view                string_pool_;
+};
+
+// Storage of the automaton. It holds no pointers, so a constexpr table lands in .rodata as is. The
+// keyword database file uses the same layout.
+template<std::size_t StateCount, std::size_t KeywordCount, std::size_t StringPoolSize>
+struct keyword_table
+{
+    std::array<keyword_matcher::transition_row, StateCount> transitions {};
+    std::array<keyword_matcher::state_output, StateCount>   outputs {};
+    std::array<keyword_matcher::keyword_ref, KeywordCount>  keywords {};
+    std::array<char, StringPoolSize>                        string_pool {};
+
+    constexpr keyword_matcher matcher() const
+    {
+        return {transitions, outputs, keywords, {string_pool.data(), string_pool.size()}};
+    }
+};
+
+namespace _internal
+{
+
+constexpr std::uint8_t keyword_separator_symbol {0};
+constexpr std::uint8_t keyword_invalid_symbol {UINT8_MAX};
+
+constexpr std::uint8_t keyword_symbol(const char c)
+{
+    if (c >= 'a' && c <= 'z')
+    {
+        return std::uint8_t(c - 'a' + 1);
+    }
+    if (c == ' ')
+    {
+        return keyword_separator_symbol;
+    }
+    return keyword_invalid_symbol;
+}
+
+// Keywords that could never be produced by the normalization (other characters than lowercase
+// letters and single spaces between words) can never match, so they are not added at all. The
+// compile time tables reject them instead, as the keyword databases do.
+constexpr bool is_matchable_keyword(const std::string_view keyword)
+{
+    if (keyword.empty() || keyword.front() == ' ' || keyword.back() == ' ' ||
+        keyword.find("  ") != std::string_view::npos)
+    {
+        return false;
+    }
+    return std::ranges::none_of(keyword, [](char c) {
+        return keyword_symbol(c) == keyword_invalid_symbol;
+    });
+}
+
+constexpr bool has_duplicate_keywords(const std::span<const std::string_view> keywords)
+{
+    for (std::size_t i = 0; i != keywords.size(); ++i)
+    {
+        for (std::size_t j = i + 1; j != keywords.size(); ++j)
+        {
+            if (keywords[i] == keywords[j])
+            {
+                return true;
+            }
+        }
+    }
+    return false;
+}
+
+struct keyword_trie
+{
+    std::vector<keyword_matcher::transition_row> transitions {};
+    std::vector<keyword_matcher::state_output>   outputs {};
+    bool                                         overflow {false};
+};
+
+// Adds the keywords to a trie, without the failure links yet
+constexpr keyword_trie insert_keywords(const std::span<const std::string_view> keywords)
+{
+    constexpr std::size_t max_states {UINT16_MAX};
+
+    keyword_trie trie;
+    trie.transitions.emplace_back();
+    trie.outputs.emplace_back();
+
+    if (keywords.size() >= keyword_matcher::no_keyword)
+    {
+        trie.overflow = true;
+        return trie;
+    }
+
+    for (std::size_t idx = 0; idx != keywords.size() && !trie.overflow; ++idx)
+    {
+        const std::string_view keyword = keywords[idx];
+        if (!is_matchable_keyword(keyword))
+        {
+            continue;
+        }
+
+        std::uint16_t crt = 0;
+
+        const auto advance = [&trie, &crt](const std::uint8_t symbol) {
+            if (trie.transitions[crt][symbol] == 0)
+            {
+                if (trie.transitions.size() == max_states)
+                {
+                    trie.overflow = true;
+                    return;
+                }
+                trie.transitions[crt][symbol] = std::uint16_t(trie.transitions.size());
+                trie.transitions.emplace_back();
+                trie.outputs.emplace_back();
+            }
+            crt = trie.transitions[crt][symbol];
+        };
+
+        advance(keyword_separator_symbol);
+        for (const char c : keyword)
+        {
+            advance(keyword_symbol(c));
+        }
+        advance(keyword_separator_symbol);
+
+        // On duplicates keep the first one
+        if (!trie.overflow && trie.outputs[crt].longest == keyword_matcher::no_keyword)
+        {
+            trie.outputs[crt].longest = std::uint16_t(idx);
+        }
+    }
+
+    return trie;
+}
+
+// Returns the number of states of the automaton, or 0 if it does not fit in the tables
+constexpr std::size_t keyword_state_count(const std::span<const std::string_view> keywords)
+{
+    const keyword_trie trie = insert_keywords(keywords);
+    return trie.overflow ? 0 : trie.transitions.size();
+}
+
+// Builds the full DFA of the automaton: transitions hold the complete goto function and every
+// state inherits the best keyword of its failure state.
+constexpr keyword_trie build_keyword_trie(const std::span<const std::string_view> keywords)
+{
+    keyword_trie trie = insert_keywords(keywords);
+    if (trie.overflow)
+    {
+        return trie;
+    }
+
+    // Breadth first, so that the failure state is always complete before its use
+    std::vector<std::uint16_t> fail(trie.transitions.size(), 0);
+    std::vector<std::uint16_t> pending {0};
+
+    for (std::size_t pending_idx = 0; pending_idx != pending.size(); ++pending_idx)
+    {
+        const std::uint16_t crt = pending[pending_idx];
+
+        for (std::size_t symbol = 0; symbol != keyword_matcher::symbol_count; ++symbol)
+        {
+            const std::uint16_t child = trie.transitions[crt][symbol];
+            if (child == 0)
+            {
+                trie.transitions[crt][symbol] =
+                    crt == 0 ? 0 : trie.transitions[fail[crt]][symbol];
+                continue;
+            }
+
+            fail[child] = crt == 0 ? 0 : trie.transitions[fail[crt]][symbol];
+
+            keyword_matcher::state_output& own = trie.outputs[child];
+            if (own.longest == keyword_matcher::no_keyword)
+            {
+                own.longest = trie.outputs[fail[child]].longest;
+            }
+
+            pending.push_back(child);
+        }
+    }
+
+    return trie;
+}
+
+// The keyword with the given weight, or with the default weight for any field if null
+constexpr keyword_matcher::keyword_ref make_keyword_ref(
+    const std::uint32_t    offset,
+    const std::string_view keyword,
+    const keyword_weight*  weight
+)
+{
+    keyword_matcher::keyword_ref ref {.offset = offset, .length = std::uint32_t(keyword.size())};
+    if (weight != nullptr)
+    {
+        ref.weight = weight->weight;
+        ref.field  = weight->field;
+    }
+    return ref;
+}
+
+constexpr const keyword_weight*
+find_keyword_weight(const std::string_view keyword, const std::span<const keyword_weight> weights)
+{
+    const auto found = std::ranges::find(weights, keyword, &keyword_weight::keyword);
+    return found == weights.end() ? nullptr : &*found;
+}
+
+// Whether a weight is given for a keyword that is not in the list, most likely a typo
+constexpr bool has_unknown_weights(
+    const std::span<const std::string_view> keywords,
+    const std::span<const keyword_weight>   weights
+)
+{
+    return std::ranges::any_of(weights, [keywords](const keyword_weight& weight) {
+        return std::ranges::find(keywords, weight.keyword) == keywords.end();
+    });
+}
+
+inline constexpr std::array<keyword_weight, 0> no_keyword_weights {};
+
+}  // namespace _internal
+
+template<typename Fn>
+void keyword_matcher::for_each_match(const std::string_view text, Fn&& fn) const
+{
+    using _internal::keyword_invalid_symbol;
+    using _internal::keyword_separator_symbol;
+    using _internal::keyword_symbol;
+
+    std::uint16_t crt          = transitions_[0][keyword_separator_symbol];
+    bool          in_separator = true;
+
+    const auto end_word = [&] {
+        crt = transitions_[crt][keyword_separator_symbol];
+        if (const std::uint16_t longest = outputs_[crt].longest; longest != no_keyword)
+        {
+            fn(longest);
+        }
+    };
+
+    for (const char c : text)
+    {
+        if (const std::uint8_t symbol = keyword_symbol(c);
+            symbol != keyword_separator_symbol && symbol != keyword_invalid_symbol)
+        {
+            crt          = transitions_[crt][symbol];
+            in_separator = false;
+        }
+        else if (!in_separator)
+        {
+            in_separator = true;
+            end_word();
+        }
+    }
+
+    if (!in_separator)
+    {
+        end_word();
+    }
+}
+
+// Builds the automaton for a constexpr keyword list at compile time, rejecting duplicates and
+// keywords that are not normalized. Weights lists the keywords that do not have the default
+// weight.
+template<const auto& Keywords, const auto& Weights = _internal::no_keyword_weights>
+consteval auto make_keyword_table()
+{
+    static_assert(!_internal::has_duplicate_keywords(Keywords), "The keyword list has duplicates");
+    static_assert(
+        std::ranges::all_of(Keywords, _internal::is_matchable_keyword),
+        "The keyword list has keywords that can never match, they have to be normalized"
+    );
+    static_assert(
+        !_internal::has_unknown_weights(Keywords, Weights),
+        "The weight list has keywords that are not in the keyword list"
+    );
+
+    constexpr std::size_t state_count = _internal::keyword_state_count(Keywords);
+    static_assert(state_count != 0, "The keyword list is too big");
+
+    constexpr std::size_t string_pool_size = [] {
+        std::size_t size = 0;
+        for (const std::string_view keyword : Keywords)
+        {
+            size += keyword.size();
+        }
+        return size;
+    }();
+
+    const _internal::keyword_trie trie = _internal::build_keyword_trie(Keywords);
+
+    keyword_table<state_count, Keywords.size(), string_pool_size> table;
+    std::ranges::copy(trie.transitions, table.transitions.begin());
+    std::ranges::copy(trie.outputs, table.outputs.begin());
+
+    std::size_t offset = 0;
+    for (std::size_t idx = 0; idx != Keywords.size(); ++idx)
+    {
+        table.keywords[idx] = _internal::make_keyword_ref(
+            std::uint32_t(offset),
+            Keywords[idx],
+            _internal::find_keyword_weight(Keywords[idx], Weights)
+        );
+        std::ranges::copy(Keywords[idx], table.string_pool.begin() + offset);
+        offset += Keywords[idx].size();
+    }
+
+    return table;
+}
+
+}  // namespace manelemax
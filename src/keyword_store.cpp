@@ -0,0 +1,323 @@
+#include "keyword_store.hpp"
+
+#include <array>
+#include <string>
+#include <system_error>
+#include <thread>
+#include <utility>
+
+#include "keywords.hpp"
+
+#ifdef _WIN32
+#include <Windows.h>
+#elif defined(__linux__)
+#include <cerrno>
+#include <poll.h>
+#include <sys/eventfd.h>
+#include <sys/inotify.h>
+#include <unistd.h>
+#else
+#include <cerrno>
+#endif
+
+namespace manelemax
+{
+
+namespace
+{
+
+std::unique_ptr<const keyword_store::snapshot> builtin_snapshot(const std::uint64_t generation)
+{
+    return std::make_unique<const keyword_store::snapshot>(
+        std::nullopt,
+        g_keyword_table.matcher(),
+        generation
+    );
+}
+
+std::filesystem::path watched_directory(const std::filesystem::path& path)
+{
+    return path.has_parent_path() ? path.parent_path() : std::filesystem::path {"."};
+}
+
+}  // namespace
+
+#ifdef _WIN32
+
+// Waits for changes in the directory of the file. The notifications do not say which file
+// changed, so the file is only reloaded if its size or its last write time did.
+class keyword_store::watcher
+{
+public:
+    static std::expected<std::unique_ptr<watcher>, os_error>
+    make(const std::filesystem::path& path, keyword_store& store)
+    {
+        const HANDLE change = ::FindFirstChangeNotificationW(
+            watched_directory(path).c_str(),
+            FALSE,
+            FILE_NOTIFY_CHANGE_FILE_NAME | FILE_NOTIFY_CHANGE_LAST_WRITE | FILE_NOTIFY_CHANGE_SIZE
+        );
+        if (change == INVALID_HANDLE_VALUE)
+        {
+            return std::unexpected {os_error {"FindFirstChangeNotificationW", ::GetLastError()}};
+        }
+
+        const HANDLE stop_event = ::CreateEventW(nullptr, TRUE, FALSE, nullptr);
+        if (!stop_event)
+        {
+            const DWORD err = ::GetLastError();
+            ::FindCloseChangeNotification(change);
+            return std::unexpected {os_error {"CreateEventW", err}};
+        }
+
+        return std::unique_ptr<watcher> {new watcher {path, store, change, stop_event}};
+    }
+
+    watcher(const watcher&)            = delete;
+    watcher& operator=(const watcher&) = delete;
+
+    ~watcher()
+    {
+        ::SetEvent(stop_event_);
+        thread_.join();
+        ::FindCloseChangeNotification(change_);
+        ::CloseHandle(stop_event_);
+    }
+
+private:
+    struct file_stamp
+    {
+        bool                            exists {false};
+        std::uintmax_t                  size {0};
+        std::filesystem::file_time_type write_time {};
+
+        bool operator==(const file_stamp&) const = default;
+    };
+
+    static file_stamp stamp(const std::filesystem::path& path)
+    {
+        std::error_code ec;
+        file_stamp      result;
+        result.size       = std::filesystem::file_size(path, ec);
+        result.exists     = !ec;
+        result.write_time = std::filesystem::last_write_time(path, ec);
+        return result.exists ? result : file_stamp {};
+    }
+
+    watcher(
+        const std::filesystem::path& path,
+        keyword_store&               store,
+        const HANDLE                 change,
+        const HANDLE                 stop_event
+    )
+        : change_ {change}
+        , stop_event_ {stop_event}
+        , thread_ {[this, path, &store] { run(path, store); }}
+    {
+    }
+
+    void run(const std::filesystem::path& path, keyword_store& store)
+    {
+        file_stamp loaded = stamp(path);
+
+        while (true)
+        {
+            const std::array<HANDLE, 2> handles {stop_event_, change_};
+            if (::WaitForMultipleObjects(DWORD(handles.size()), handles.data(), FALSE, INFINITE) !=
+                WAIT_OBJECT_0 + 1)
+            {
+                return;
+            }
+
+            if (const file_stamp crt = stamp(path); crt != loaded)
+            {
+                loaded = crt;
+                store.reload(path);
+            }
+
+            if (::FindNextChangeNotification(change_) == FALSE)
+            {
+                return;
+            }
+        }
+    }
+
+    HANDLE      change_;
+    HANDLE      stop_event_;
+    std::thread thread_;
+};
+
+#elif defined(__linux__)
+
+// Waits for the file to be written, replaced or removed, through inotify on its directory, which
+// also catches the file being replaced by a rename
+class keyword_store::watcher
+{
+public:
+    static std::expected<std::unique_ptr<watcher>, os_error>
+    make(const std::filesystem::path& path, keyword_store& store)
+    {
+        const int inotify_fd = ::inotify_init1(IN_CLOEXEC);
+        if (inotify_fd == -1)
+        {
+            return std::unexpected {os_error {"inotify_init1", errno}};
+        }
+
+        if (::inotify_add_watch(
+                inotify_fd,
+                watched_directory(path).c_str(),
+                IN_CLOSE_WRITE | IN_MOVED_TO | IN_MOVED_FROM | IN_DELETE
+            ) == -1)
+        {
+            const int err = errno;
+            ::close(inotify_fd);
+            return std::unexpected {os_error {"inotify_add_watch", err}};
+        }
+
+        const int stop_fd = ::eventfd(0, EFD_CLOEXEC);
+        if (stop_fd == -1)
+        {
+            const int err = errno;
+            ::close(inotify_fd);
+            return std::unexpected {os_error {"eventfd", err}};
+        }
+
+        return std::unique_ptr<watcher> {new watcher {path, store, inotify_fd, stop_fd}};
+    }
+
+    watcher(const watcher&)            = delete;
+    watcher& operator=(const watcher&) = delete;
+
+    ~watcher()
+    {
+        const std::uint64_t value {1};
+        [[maybe_unused]] const ssize_t written = ::write(stop_fd_, &value, sizeof(value));
+        thread_.join();
+        ::close(inotify_fd_);
+        ::close(stop_fd_);
+    }
+
+private:
+    watcher(
+        const std::filesystem::path& path,
+        keyword_store&               store,
+        const int                    inotify_fd,
+        const int                    stop_fd
+    )
+        : inotify_fd_ {inotify_fd}
+        , stop_fd_ {stop_fd}
+        , thread_ {[this, path, &store] { run(path, store); }}
+    {
+    }
+
+    void run(const std::filesystem::path& path, keyword_store& store)
+    {
+        const std::string file_name = path.filename().string();
+
+        alignas(inotify_event) char buf[4096];
+
+        while (true)
+        {
+            pollfd fds[2] {{inotify_fd_, POLLIN, 0}, {stop_fd_, POLLIN, 0}};
+            if (::poll(fds, 2, -1) == -1)
+            {
+                if (errno == EINTR)
+                {
+                    continue;
+                }
+                return;
+            }
+            if (fds[1].revents != 0)
+            {
+                return;
+            }
+
+            const ssize_t size = ::read(inotify_fd_, buf, sizeof(buf));
+            if (size <= 0)
+            {
+                continue;
+            }
+
+            bool changed = false;
+            for (ssize_t pos = 0; pos < size;)
+            {
+                const auto* const event = reinterpret_cast<const inotify_event*>(buf + pos);
+                changed |= event->len != 0 && file_name == event->name;
+                pos += ssize_t(sizeof(inotify_event) + event->len);
+            }
+
+            if (changed)
+            {
+                store.reload(path);
+            }
+        }
+    }
+
+    int         inotify_fd_;
+    int         stop_fd_;
+    std::thread thread_;
+};
+
+#else
+
+// No file watching on this platform, the database is only loaded once
+class keyword_store::watcher
+{
+public:
+    static std::expected<std::unique_ptr<watcher>, os_error>
+    make(const std::filesystem::path&, keyword_store&)
+    {
+        return std::unexpected {os_error {"keyword_store::watch", ENOSYS}};
+    }
+};
+
+#endif
+
+keyword_store::keyword_store()
+    : current_ {builtin_snapshot(0)}
+{
+}
+
+keyword_store::~keyword_store() = default;
+
+std::expected<void, os_error> keyword_store::watch(const std::filesystem::path& path)
+{
+    // Stop watching the previous file first, so that only one thread ever reloads
+    watcher_.reset();
+
+    reload(path);
+
+    auto new_watcher = watcher::make(path, *this);
+    if (!new_watcher.has_value())
+    {
+        return std::unexpected {new_watcher.error()};
+    }
+
+    watcher_ = *std::move(new_watcher);
+    return {};
+}
+
+void keyword_store::reload(const std::filesystem::path& path)
+{
+    std::error_code ec;
+    if (!std::filesystem::exists(path, ec))
+    {
+        if (current_.read()->database.has_value())
+        {
+            current_.update(builtin_snapshot(++generation_));
+        }
+        return;
+    }
+
+    // An invalid file may also be one that is still being written, it is reloaded once complete
+    auto database = keyword_database::open(path);
+    if (!database.has_value())
+    {
+        return;
+    }
+
+    const keyword_matcher matcher = database->matcher();
+    current_.update(std::make_unique<const snapshot>(*std::move(database), matcher, ++generation_));
+}
+
+}  // namespace manelemax
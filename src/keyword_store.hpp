@@ -0,0 +1,63 @@
+#pragma once
+
+#include <cstdint>
+#include <expected>
+#include <filesystem>
+#include <memory>
+#include <optional>
+
+#include "keyword_database.hpp"
+#include "keyword_matcher.hpp"
+#include "os_error.hpp"
+#include "rcu_ptr.hpp"
+
+namespace manelemax
+{
+
+// The keywords in use: the compiled-in list, or a keyword database file that is swapped in again
+// every time it changes on disk.
+//
+// Reading is lock free. A reload installs the new version through an RCU pointer, so the matcher
+// obtained from a read guard stays valid, and the same, for as long as the guard exists.
+class keyword_store
+{
+public:
+    struct snapshot
+    {
+        std::optional<keyword_database> database;  // Empty for the compiled-in keywords
+        keyword_matcher                 matcher;
+        std::uint64_t                   generation;  // Incremented on every reload
+    };
+
+    using read_guard = rcu_ptr<snapshot>::read_guard;
+
+    // Starts with the compiled-in keywords
+    keyword_store();
+
+    keyword_store(const keyword_store&)            = delete;
+    keyword_store& operator=(const keyword_store&) = delete;
+
+    ~keyword_store();
+
+    // Loads the database at path and reloads it every time the file is replaced. While the file
+    // is missing the compiled-in keywords are used, while it is invalid the previous version is
+    // kept. Fails only if the file cannot be watched, in which case it is still loaded once.
+    std::expected<void, os_error> watch(const std::filesystem::path& path);
+
+    // Keep the guard only for the duration of the matching, a reload waits for it
+    read_guard read() const
+    {
+        return current_.read();
+    }
+
+private:
+    class watcher;
+
+    void reload(const std::filesystem::path& path);
+
+    rcu_ptr<snapshot>        current_;
+    std::uint64_t            generation_ {0};
+    std::unique_ptr<watcher> watcher_ {};
+};
+
+}  // namespace manelemax
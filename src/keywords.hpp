@@ -3,12 +3,14 @@
 #include <array>
 #include <string_view>
 
+#include "keyword_matcher.hpp"
+
 namespace manelemax
 {
 
 using namespace std::string_view_literals;
 
-constexpr std::array g_keywords {
+inline constexpr std::array g_keywords {
     "nicolae guta"sv,
     "florin salam"sv,
     "tzanca uraganu"sv,
@@ -65,7 +67,6 @@ constexpr std::array g_keywords {
     "geany morandi"sv,
     "costel biju"sv,
     "antonio minune"sv,
-    "babi minune"sv,
     "denisa"sv,
     "brazilianu"sv,
     "brazilianul"sv,
@@ -86,7 +87,7 @@ constexpr std::array g_keywords {
     "valentino"sv,
     "mitzu din salaj"sv,
     "minodora"sv,
-    "a-tentat"sv,
+    "atentat"sv,
     "leonard"sv,
     "eduard de la roma"sv,
     "raluca dragoi"sv,
@@ -104,7 +105,6 @@ constexpr std::array g_keywords {
     "stana izbasa"sv,
     "lepa brena"sv,
     "gerard inima de leu"sv,
-    "lepa brena"sv,
     "fero"sv,
     "florin universalu"sv,
     "florin universalul"sv,
@@ -126,4 +126,37 @@ constexpr std::array g_keywords {
     "danezu music"sv,
 };
 
+// The keywords that are weaker evidence than the default weight: short names that are also common
+// words or the names of other artists, and music labels, which are only found as the artist. A
+// track scores keyword_matcher::default_weight with one keyword of any other kind.
+inline constexpr std::array g_keyword_weights {
+    keyword_weight {"nek"sv, 40, keyword_field::artist},
+    keyword_weight {"geo"sv, 40, keyword_field::artist},
+    keyword_weight {"asu"sv, 40, keyword_field::artist},
+    keyword_weight {"nino"sv, 40, keyword_field::artist},
+    keyword_weight {"boby"sv, 40, keyword_field::artist},
+    keyword_weight {"fero"sv, 40, keyword_field::artist},
+    keyword_weight {"brandy"sv, 40, keyword_field::artist},
+    keyword_weight {"modjo"sv, 50, keyword_field::artist},
+    keyword_weight {"mogjo"sv, 50, keyword_field::artist},
+    keyword_weight {"adriano"sv, 50, keyword_field::artist},
+    keyword_weight {"leonard"sv, 50, keyword_field::artist},
+    keyword_weight {"valentino"sv, 50, keyword_field::artist},
+    keyword_weight {"denisa"sv, 60, keyword_field::artist},
+    keyword_weight {"narcis"sv, 60, keyword_field::artist},
+    keyword_weight {"narcisa"sv, 60, keyword_field::artist},
+    keyword_weight {"alessio"sv, 60, keyword_field::artist},
+    keyword_weight {"florinel"sv, 60, keyword_field::artist},
+    keyword_weight {"amma music sound"sv, 100, keyword_field::artist},
+    keyword_weight {"big man romania"sv, 100, keyword_field::artist},
+    keyword_weight {"kompact play music"sv, 100, keyword_field::artist},
+    keyword_weight {"x pert production official"sv, 100, keyword_field::artist},
+    keyword_weight {"viper production"sv, 100, keyword_field::artist},
+    keyword_weight {"autenticmusicromania"sv, 100, keyword_field::artist},
+    keyword_weight {"danezu music"sv, 100, keyword_field::artist},
+};
+
+// Built at compile time, so no keyword table is built or hashed at startup
+inline constexpr auto g_keyword_table = make_keyword_table<g_keywords, g_keyword_weights>();
+
 }  // namespace manelemax
@@ -0,0 +1,466 @@
+#include "logger.hpp"
+
+#include <atomic>
+#include <cerrno>
+#include <cstdio>
+#include <fstream>
+#include <mutex>
+#include <stop_token>
+#include <string>
+#include <system_error>
+#include <thread>
+
+namespace manelemax
+{
+
+namespace
+{
+
+// A burst of a few hundred records is far more than the application logs, the writer is woken by
+// the first one
+constexpr std::size_t ring_capacity {1024};
+
+struct record
+{
+    std::chrono::system_clock::time_point at {};
+    logger::level                         lvl {logger::level::info};
+    bool                                  has_value {false};
+    bool                                  has_error {false};
+    std::string_view                      message {};
+    double                                value {0.0};
+    os_error                              error {};
+};
+
+// Bounded multi-producer queue after Dmitry Vyukov's, with a single consumer. The producers claim
+// a position with a CAS on the tail, then publish the record through the turn of its slot: 2 * lap
+// while the slot is free for the lap, 2 * lap + 1 once it holds the record of the lap. All zeros
+// is the empty ring, so it needs no constructor and can be logged into from static initializers.
+class ring
+{
+public:
+    bool push(const record& rec)
+    {
+        std::uint64_t pos = tail_.load(std::memory_order_relaxed);
+        while (true)
+        {
+            slot&               crt  = slots_[pos % ring_capacity];
+            const std::uint64_t turn = crt.turn.load(std::memory_order_acquire);
+            const std::uint64_t free = 2 * (pos / ring_capacity);
+
+            if (turn == free)
+            {
+                if (tail_.compare_exchange_weak(pos, pos + 1, std::memory_order_relaxed))
+                {
+                    crt.rec = rec;
+                    crt.turn.store(free + 1, std::memory_order_release);
+                    return true;
+                }
+            }
+            else if (turn < free)
+            {
+                // Still holds the record of the previous lap, the ring is full
+                return false;
+            }
+            else
+            {
+                pos = tail_.load(std::memory_order_relaxed);
+            }
+        }
+    }
+
+    // The positions claimed so far, published or about to be
+    std::uint64_t claimed() const
+    {
+        return tail_.load(std::memory_order_relaxed);
+    }
+
+    // Single consumer
+    bool consumed(const std::uint64_t pos) const
+    {
+        return head_ >= pos;
+    }
+
+    bool pop(record& rec)
+    {
+        slot&               crt  = slots_[head_ % ring_capacity];
+        const std::uint64_t full = 2 * (head_ / ring_capacity) + 1;
+        if (crt.turn.load(std::memory_order_acquire) != full)
+        {
+            return false;
+        }
+
+        rec = crt.rec;
+        crt.turn.store(full + 1, std::memory_order_release);
+        ++head_;
+        return true;
+    }
+
+private:
+    struct slot
+    {
+        std::atomic<std::uint64_t> turn {0};
+        record                     rec {};
+    };
+
+    std::array<slot, ring_capacity> slots_ {};
+    alignas(64) std::atomic<std::uint64_t> tail_ {0};
+    alignas(64) std::uint64_t head_ {0};
+};
+
+constinit ring                       g_ring {};
+constinit std::atomic<std::uint64_t> g_dropped {0};
+
+// Set by the first record since the writer last drained the ring, the writer sleeps on it. An
+// atomic rather than a condition variable: the producers must not take the mutex of the writer,
+// held while it writes, and like the ring it needs no constructor.
+constinit std::atomic<bool> g_pending {false};
+
+constinit std::atomic<void (*)()> g_sink {nullptr};
+
+// Either the writer sees what was published before the call, or the call sees the writer asleep
+// and wakes it: the fence orders the publication before the load, as the one of the writer orders
+// its store before draining. Only the first call of a batch pays for the notification.
+void wake_writer()
+{
+    std::atomic_thread_fence(std::memory_order_seq_cst);
+    if (!g_pending.load(std::memory_order_relaxed) &&
+        !g_pending.exchange(true, std::memory_order_relaxed))
+    {
+        g_pending.notify_one();
+    }
+}
+
+void push(const record& rec)
+{
+    if (!g_ring.push(rec))
+    {
+        g_dropped.fetch_add(1, std::memory_order_relaxed);
+    }
+    wake_writer();
+}
+
+// "2026-10-17T07:32:01.123456Z warning message: function failed with error code"
+void format_record(const record& rec, std::string& out)
+{
+    const auto                       day = std::chrono::floor<std::chrono::days>(rec.at);
+    const std::chrono::year_month_day date {day};
+    const std::chrono::hh_mm_ss       time {
+        std::chrono::floor<std::chrono::microseconds>(rec.at - day)
+    };
+    const std::string_view lvl = logger::level_names[std::size_t(rec.lvl)];
+
+    char line[160];
+    std::snprintf(
+        line,
+        sizeof(line),
+        "%04d-%02u-%02uT%02d:%02d:%02d.%06lldZ %-7.*s %.*s",
+        int(date.year()),
+        unsigned(date.month()),
+        unsigned(date.day()),
+        int(time.hours().count()),
+        int(time.minutes().count()),
+        int(time.seconds().count()),
+        static_cast<long long>(time.subseconds().count()),
+        int(lvl.size()),
+        lvl.data(),
+        int(rec.message.size()),
+        rec.message.data()
+    );
+    out.append(line);
+
+    if (rec.has_value)
+    {
+        std::snprintf(line, sizeof(line), " %.7g", rec.value);
+        out.append(line);
+    }
+
+    if (rec.has_error)
+    {
+        // As the error dialogs show them, HRESULTs in hexadecimal
+#ifdef _WIN32
+        std::snprintf(
+            line,
+            sizeof(line),
+            ": %.*s failed with error 0x%08llx",
+            int(rec.error.function.size()),
+            rec.error.function.data(),
+            static_cast<unsigned long long>(rec.error.code) & 0xFFFFFFFF
+        );
+#else
+        std::snprintf(
+            line,
+            sizeof(line),
+            ": %.*s failed with error %lld",
+            int(rec.error.function.size()),
+            rec.error.function.data(),
+            static_cast<long long>(rec.error.code)
+        );
+#endif
+        out.append(line);
+    }
+
+    out.push_back('\n');
+}
+
+// The consumer of the ring, on its own thread, or on the thread of flush()
+class writer
+{
+public:
+    static writer& instance()
+    {
+        static writer g_writer;
+        return g_writer;
+    }
+
+    ~writer()
+    {
+        stop();
+    }
+
+    std::expected<void, os_error> start(const logger::options& opts)
+    {
+        stop();
+
+        std::lock_guard lock {mutex_};
+
+        opts_ = opts;
+        if (const auto result = open(); !result.has_value())
+        {
+            return result;
+        }
+
+        thread_ = std::jthread {[this](const std::stop_token stop) { run(stop); }};
+        return {};
+    }
+
+    void stop()
+    {
+        thread_.request_stop();
+        if (thread_.joinable())
+        {
+            thread_.join();
+        }
+
+        std::lock_guard lock {mutex_};
+        if (file_.is_open())
+        {
+            drain();
+        }
+        file_ = {};
+        write_sink();
+    }
+
+    // A producer preempted between claiming its slot and publishing it holds the consumer back,
+    // so the records logged before the call are waited for rather than only drained
+    void flush()
+    {
+        const std::uint64_t logged = g_ring.claimed();
+
+        std::lock_guard lock {mutex_};
+        if (file_.is_open())
+        {
+            drain();
+            while (!g_ring.consumed(logged))
+            {
+                std::this_thread::yield();
+                drain();
+            }
+        }
+        write_sink();
+    }
+
+private:
+    // The mutex is held
+    std::expected<void, os_error> open()
+    {
+        file_ = std::ofstream {opts_.path, std::ios::binary | std::ios::app};
+        if (!file_.is_open())
+        {
+            return std::unexpected {os_error {"logger::start", EIO}};
+        }
+
+        std::error_code err;
+        size_ = std::filesystem::file_size(opts_.path, err);
+        if (err)
+        {
+            size_ = 0;
+        }
+        return {};
+    }
+
+    // The mutex is held. The renames fail when the older files are missing, which is fine.
+    void rotate()
+    {
+        file_ = {};
+
+        std::error_code err;
+        const auto      numbered = [this](const unsigned idx) {
+            std::filesystem::path path = opts_.path;
+            path += '.';
+            return path += std::to_string(idx);
+        };
+
+        if (opts_.max_files == 0)
+        {
+            std::filesystem::remove(opts_.path, err);
+        }
+        else
+        {
+            for (unsigned idx = opts_.max_files - 1; idx != 0; --idx)
+            {
+                std::filesystem::rename(numbered(idx), numbered(idx + 1), err);
+            }
+            std::filesystem::rename(opts_.path, numbered(1), err);
+        }
+
+        // Should it fail, drain() drops the records until the next start
+        static_cast<void>(open());
+    }
+
+    // The mutex is held. Without a file, as when rotate() could not reopen it, the records are
+    // still consumed and dropped, so that flush() never waits for them.
+    void drain()
+    {
+        buffer_.clear();
+        for (record rec; g_ring.pop(rec);)
+        {
+            if (file_.is_open())
+            {
+                format_record(rec, buffer_);
+            }
+        }
+
+        if (!file_.is_open())
+        {
+            return;
+        }
+
+        if (const std::uint64_t dropped = g_dropped.load(std::memory_order_relaxed);
+            dropped != reported_dropped_)
+        {
+            char line[64];
+            std::snprintf(
+                line,
+                sizeof(line),
+                "%llu records dropped, the ring was full\n",
+                static_cast<unsigned long long>(dropped - reported_dropped_)
+            );
+            buffer_.append(line);
+            reported_dropped_ = dropped;
+        }
+
+        if (buffer_.empty())
+        {
+            return;
+        }
+
+        file_.write(buffer_.data(), std::streamsize(buffer_.size())).flush();
+        size_ += buffer_.size();
+        if (size_ >= opts_.max_file_size)
+        {
+            rotate();
+        }
+    }
+
+    // The mutex is held
+    static void write_sink()
+    {
+        if (void (*const sink)() = g_sink.load(); sink != nullptr)
+        {
+            sink();
+        }
+    }
+
+    // Sleeps until a record is pushed, so that an idle application costs no wake up
+    void run(const std::stop_token stop)
+    {
+        // Stopping wakes it up as a record does
+        const std::stop_callback wake {stop, [] {
+            g_pending.store(true);
+            g_pending.notify_one();
+        }};
+
+        while (!stop.stop_requested())
+        {
+            g_pending.store(false, std::memory_order_relaxed);
+            std::atomic_thread_fence(std::memory_order_seq_cst);
+            {
+                std::lock_guard lock {mutex_};
+                drain();
+                write_sink();
+            }
+            g_pending.wait(false);
+        }
+    }
+
+    std::mutex      mutex_ {};
+    logger::options opts_ {};
+    std::ofstream   file_ {};
+    std::uintmax_t  size_ {0};
+    std::uint64_t   reported_dropped_ {0};
+    std::string     buffer_ {};
+
+    // Last, so that it stops before the members above are destroyed
+    std::jthread thread_ {};
+};
+
+}  // namespace
+
+std::expected<void, os_error> logger::start(const options& opts)
+{
+    return writer::instance().start(opts);
+}
+
+void logger::stop()
+{
+    writer::instance().stop();
+}
+
+void logger::log(const level lvl, const std::string_view message)
+{
+    push({.at = std::chrono::system_clock::now(), .lvl = lvl, .message = message});
+}
+
+void logger::log(const level lvl, const std::string_view message, const double value)
+{
+    push({
+        .at        = std::chrono::system_clock::now(),
+        .lvl       = lvl,
+        .has_value = true,
+        .message   = message,
+        .value     = value,
+    });
+}
+
+void logger::log(const level lvl, const std::string_view message, const os_error& err)
+{
+    push({
+        .at        = std::chrono::system_clock::now(),
+        .lvl       = lvl,
+        .has_error = true,
+        .message   = message,
+        .error     = err,
+    });
+}
+
+void logger::flush()
+{
+    writer::instance().flush();
+}
+
+void logger::set_sink(void (*const write)())
+{
+    g_sink.store(write);
+}
+
+void logger::wake()
+{
+    wake_writer();
+}
+
+std::uint64_t logger::dropped()
+{
+    return g_dropped.load(std::memory_order_relaxed);
+}
+
+}  // namespace manelemax
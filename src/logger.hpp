@@ -0,0 +1,71 @@
+#pragma once
+
+#include <array>
+#include <chrono>
+#include <cstdint>
+#include <expected>
+#include <filesystem>
+#include <string_view>
+
+#include "os_error.hpp"
+
+namespace manelemax
+{
+
+// Diagnostics that cost the hot paths a few nanoseconds and never block them: a log call copies
+// a fixed-size record into a lock-free ring, and a background thread formats the records and
+// writes them to a file, which is rotated once it grows past a size.
+//
+// The strings are not copied, only their pointers: the message, like the function of an os_error,
+// has to be a string literal. When the ring is full the record is dropped, and counted, rather
+// than waiting for the writer.
+class logger
+{
+public:
+    enum class level : std::uint8_t
+    {
+        info,
+        warning,
+        error,
+    };
+
+    static constexpr std::array<std::string_view, 3> level_names {"info", "warning", "error"};
+
+    struct options
+    {
+        std::filesystem::path path {};
+
+        // Once the file is larger, it is renamed to path.1, path.1 to path.2 and so on, and the
+        // oldest is removed
+        std::uintmax_t max_file_size {1 << 20};
+        unsigned       max_files {3};
+    };
+
+    // Opens the file, appending to it, and starts the writer. The records logged before are
+    // written then, as many as the ring holds.
+    static std::expected<void, os_error> start(const options& opts);
+
+    // Writes what is left in the ring and stops the writer
+    static void stop();
+
+    // Safe to call from any thread, lock free and allocation free
+    static void log(level lvl, std::string_view message);
+    static void log(level lvl, std::string_view message, double value);
+    static void log(level lvl, std::string_view message, const os_error& err);
+
+    // Blocks until the records logged so far are written, as before showing an error to the user
+    static void flush();
+
+    // Another file written by the writer thread, so that the threads that fill it never wait for
+    // the disk, like the event trace. write() is called after the records are written: once the
+    // writer is woken up, and by flush() and stop(), one call at a time. Null for none.
+    static void set_sink(void (*write)());
+
+    // Wakes the writer up as a record does, for the sink to write what it was given. Lock free.
+    static void wake();
+
+    // The records lost to a full ring
+    static std::uint64_t dropped();
+};
+
+}  // namespace manelemax
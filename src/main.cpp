@@ -1,10 +1,17 @@
 ﻿#include <format>
+#include <array>
 #include <cstdlib>
+#include <filesystem>
+#include <future>
+#include <optional>
 
 #include <Windows.h>
 #include <objbase.h>
 
 #include "auto_dj.hpp"
+#include "event_trace.hpp"
+#include "logger.hpp"
+#include "startup_trace.hpp"
 #include "systray_icon.hpp"
 #include "win32_error.hpp"
 #include "raii_exec.hpp"
@@ -12,9 +19,17 @@
 namespace manelemax
 {
 
+// Logged as well, and written out before the dialog blocks
 template<typename T>
 static void display_win32_error(const T& err)
 {
+    logger::log(
+        logger::level::error,
+        "reported to the user",
+        os_error {err.function, std::int64_t(err.code)}
+    );
+    logger::flush();
+
     ::MessageBoxA(
         nullptr,
         std::format("{} failed with error 0x{:08x}", err.function, err.code).c_str(),
@@ -23,6 +38,38 @@ static void display_win32_error(const T& err)
     );
 }
 
+// The keyword database is looked up next to the executable
+static std::filesystem::path keyword_database_path()
+{
+    std::array<wchar_t, MAX_PATH> module_path {};
+    const DWORD                   length =
+        ::GetModuleFileNameW(nullptr, module_path.data(), DWORD(module_path.size()));
+
+    return std::filesystem::path {std::wstring_view {module_path.data(), length}}.replace_filename(
+        L"keywords.kwdb"
+    );
+}
+
+// The log file, manelemax.log in the temporary directory
+static logger::options log_options()
+{
+    std::error_code err;
+    return {.path = std::filesystem::temp_directory_path(err) / L"manelemax.log"};
+}
+
+// The path held by the environment variable, if it is set
+static std::optional<std::filesystem::path> environment_path(const wchar_t* const name)
+{
+    std::array<wchar_t, MAX_PATH> path {};
+    const DWORD length = ::GetEnvironmentVariableW(name, path.data(), DWORD(path.size()));
+    if (length == 0 || length >= path.size())
+    {
+        return std::nullopt;
+    }
+
+    return std::filesystem::path {std::wstring_view {path.data(), length}};
+}
+
 }  // namespace manelemax
 
 int WINAPI WinMain(
@@ -32,6 +79,17 @@ int WINAPI WinMain(
     const int /*nShowCmd*/
 )
 {
+    manelemax::startup_trace& trace = manelemax::startup_trace::process();
+    trace.mark("main");
+
+    // Not fatal, the log calls then only fill the ring
+    static_cast<void>(manelemax::logger::start(manelemax::log_options()));
+    manelemax::logger::log(manelemax::logger::level::info, "started");
+    manelemax::raii_exec stop_logger {[] {
+        manelemax::logger::log(manelemax::logger::level::info, "stopped");
+        manelemax::logger::stop();
+    }};
+
     manelemax::raii_exec co_uninitialize {[] { ::CoUninitialize(); }};
 
     if (const HRESULT result = ::CoInitializeEx(nullptr, COINIT_MULTITHREADED); FAILED(result))
@@ -39,22 +97,49 @@ int WINAPI WinMain(
         manelemax::display_win32_error(manelemax::win32_com_error {"CoInitializeEx", result});
     }
 
-    auto auto_dj_obj = manelemax::auto_dj::make();
-    if (!auto_dj_obj.has_value())
+    // The file named by MANELEMAX_EVENT_TRACE records the events, for manelemax-replay
+    if (const auto event_trace_path = manelemax::environment_path(L"MANELEMAX_EVENT_TRACE");
+        event_trace_path.has_value())
     {
-        manelemax::display_win32_error(auto_dj_obj.error());
-        return EXIT_FAILURE;
+        if (const auto result = manelemax::event_trace::start_recording(*event_trace_path);
+            !result.has_value())
+        {
+            manelemax::display_win32_error(result.error());
+        }
     }
 
+    // The tray icon is shown while the audio endpoint and the media sessions are set up, the
+    // thread joins the multithreaded apartment initialized above
+    auto pending_auto_dj = std::async(std::launch::async, [] {
+        return manelemax::auto_dj::make(manelemax::keyword_database_path());
+    });
+
     auto tray = manelemax::systray_icon::make(hInstance);
     if (!tray.has_value())
     {
         manelemax::display_win32_error(tray.error());
         return EXIT_FAILURE;
     }
+    trace.mark("tray icon shown");
+
+    auto auto_dj_obj = pending_auto_dj.get();
+    if (!auto_dj_obj.has_value())
+    {
+        manelemax::display_win32_error(auto_dj_obj.error());
+        return EXIT_FAILURE;
+    }
 
-    tray->set_current_match_fn([&auto_dj_obj] { return auto_dj_obj->current_match(); });
+    tray->set_current_state_fn([&auto_dj_obj] { return auto_dj_obj->current_state(); });
     tray->process_messages();
 
+    manelemax::event_trace::stop_recording();
+
+    // The file named by MANELEMAX_STARTUP_TRACE gets the startup trace on exit
+    if (const auto trace_path = manelemax::environment_path(L"MANELEMAX_STARTUP_TRACE");
+        trace_path.has_value())
+    {
+        trace.save(*trace_path);
+    }
+
     return EXIT_SUCCESS;
 }
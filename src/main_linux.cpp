@@ -0,0 +1,123 @@
+#include <csignal>
+#include <cstdio>
+#include <cstdlib>
+#include <filesystem>
+#include <system_error>
+
+#include <pthread.h>
+
+#include "auto_dj.hpp"
+#include "event_trace.hpp"
+#include "logger.hpp"
+#include "metrics.hpp"
+#include "os_error.hpp"
+#include "startup_trace.hpp"
+
+namespace manelemax
+{
+
+static void display_error(const os_error& err)
+{
+    logger::log(logger::level::error, "reported to the user", err);
+
+    std::fprintf(
+        stderr,
+        "manelemax: %.*s failed with error %lld\n",
+        int(err.function.size()),
+        err.function.data(),
+        static_cast<long long>(err.code)
+    );
+}
+
+// The keyword database is looked up next to the executable
+static std::filesystem::path keyword_database_path()
+{
+    std::error_code err;
+    const std::filesystem::path exe_path = std::filesystem::read_symlink("/proc/self/exe", err);
+
+    return (err ? std::filesystem::current_path(err) : exe_path.parent_path()) / "keywords.kwdb";
+}
+
+// The log file, manelemax.log in the temporary directory
+static logger::options log_options()
+{
+    std::error_code err;
+    return {.path = std::filesystem::temp_directory_path(err) / "manelemax.log"};
+}
+
+// Where SIGUSR1 dumps the metrics
+static void save_metrics()
+{
+    std::error_code             err;
+    const std::filesystem::path path =
+        std::filesystem::temp_directory_path(err) / "manelemax-metrics.txt";
+
+    if (err || !metrics::take_snapshot().save(path))
+    {
+        std::fprintf(stderr, "manelemax: could not save the metrics to %s\n", path.c_str());
+    }
+}
+
+}  // namespace manelemax
+
+// Headless: there is no tray icon, the process runs until it is interrupted or terminated.
+// SIGUSR1 dumps the metrics to manelemax-metrics.txt in the temporary directory.
+int main()
+{
+    manelemax::startup_trace& trace = manelemax::startup_trace::process();
+    trace.mark("main");
+
+    // Blocked before any thread is started, so that they all inherit the mask and the signals are
+    // only taken by sigwait()
+    sigset_t signals;
+    sigemptyset(&signals);
+    sigaddset(&signals, SIGINT);
+    sigaddset(&signals, SIGTERM);
+    sigaddset(&signals, SIGUSR1);
+    pthread_sigmask(SIG_BLOCK, &signals, nullptr);
+
+    // Not fatal, the log calls then only fill the ring
+    if (const auto result = manelemax::logger::start(manelemax::log_options()); !result.has_value())
+    {
+        manelemax::display_error(result.error());
+    }
+    manelemax::logger::log(manelemax::logger::level::info, "started");
+
+    // The file named by MANELEMAX_EVENT_TRACE records the events, for manelemax-replay
+    if (const char* const event_trace_path = std::getenv("MANELEMAX_EVENT_TRACE");
+        event_trace_path != nullptr)
+    {
+        if (const auto result = manelemax::event_trace::start_recording(event_trace_path);
+            !result.has_value())
+        {
+            manelemax::display_error(result.error());
+        }
+    }
+
+    auto auto_dj_obj = manelemax::auto_dj::make(manelemax::keyword_database_path());
+    if (!auto_dj_obj.has_value())
+    {
+        manelemax::display_error(auto_dj_obj.error());
+        return EXIT_FAILURE;
+    }
+
+    int signal;
+    while (sigwait(&signals, &signal) == 0 && signal == SIGUSR1)
+    {
+        manelemax::save_metrics();
+    }
+
+    manelemax::event_trace::stop_recording();
+
+    manelemax::logger::log(manelemax::logger::level::info, "stopped");
+    manelemax::logger::stop();
+
+    // The file named by MANELEMAX_STARTUP_TRACE gets the startup trace on exit
+    if (const char* const trace_path = std::getenv("MANELEMAX_STARTUP_TRACE");
+        trace_path != nullptr)
+    {
+        trace.save(trace_path);
+    }
+
+    return EXIT_SUCCESS;
+}
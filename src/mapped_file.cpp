@@ -0,0 +1,152 @@
+#include "mapped_file.hpp"
+
+#include <utility>
+
+#ifdef _WIN32
+#include <Windows.h>
+#else
+#include <cerrno>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+namespace manelemax
+{
+
+#ifdef _WIN32
+
+std::expected<mapped_file, os_error> mapped_file::open(const std::filesystem::path& path)
+{
+    const HANDLE file = ::CreateFileW(
+        path.c_str(),
+        GENERIC_READ,
+        FILE_SHARE_READ | FILE_SHARE_WRITE | FILE_SHARE_DELETE,
+        nullptr,
+        OPEN_EXISTING,
+        FILE_ATTRIBUTE_NORMAL,
+        nullptr
+    );
+    if (file == INVALID_HANDLE_VALUE)
+    {
+        return std::unexpected {os_error {"CreateFileW", ::GetLastError()}};
+    }
+
+    LARGE_INTEGER size;
+    if (::GetFileSizeEx(file, &size) == FALSE)
+    {
+        const DWORD err = ::GetLastError();
+        ::CloseHandle(file);
+        return std::unexpected {os_error {"GetFileSizeEx", err}};
+    }
+
+    mapped_file instance;
+    if (size.QuadPart == 0)
+    {
+        ::CloseHandle(file);
+        return instance;
+    }
+
+    // The view keeps the mapping alive, the handles are not needed past this point
+    const HANDLE mapping     = ::CreateFileMappingW(file, nullptr, PAGE_READONLY, 0, 0, nullptr);
+    const DWORD  mapping_err = ::GetLastError();
+    ::CloseHandle(file);
+    if (!mapping)
+    {
+        return std::unexpected {os_error {"CreateFileMappingW", mapping_err}};
+    }
+
+    const void* view     = ::MapViewOfFile(mapping, FILE_MAP_READ, 0, 0, 0);
+    const DWORD view_err = ::GetLastError();
+    ::CloseHandle(mapping);
+    if (!view)
+    {
+        return std::unexpected {os_error {"MapViewOfFile", view_err}};
+    }
+
+    instance.data_ = static_cast<const char*>(view);
+    instance.size_ = std::size_t(size.QuadPart);
+    return instance;
+}
+
+void mapped_file::unmap() noexcept
+{
+    if (data_)
+    {
+        ::UnmapViewOfFile(data_);
+    }
+}
+
+#else
+
+std::expected<mapped_file, os_error> mapped_file::open(const std::filesystem::path& path)
+{
+    const int fd = ::open(path.c_str(), O_RDONLY | O_CLOEXEC);
+    if (fd == -1)
+    {
+        return std::unexpected {os_error {"open", errno}};
+    }
+
+    struct stat st;
+    if (::fstat(fd, &st) == -1)
+    {
+        const int err = errno;
+        ::close(fd);
+        return std::unexpected {os_error {"fstat", err}};
+    }
+
+    mapped_file instance;
+    if (st.st_size == 0)
+    {
+        ::close(fd);
+        return instance;
+    }
+
+    // The mapping stays valid after the descriptor is closed
+    void* const addr = ::mmap(nullptr, std::size_t(st.st_size), PROT_READ, MAP_PRIVATE, fd, 0);
+    const int   err  = errno;
+    ::close(fd);
+    if (addr == MAP_FAILED)
+    {
+        return std::unexpected {os_error {"mmap", err}};
+    }
+
+    instance.data_ = static_cast<const char*>(addr);
+    instance.size_ = std::size_t(st.st_size);
+    return instance;
+}
+
+void mapped_file::unmap() noexcept
+{
+    if (data_)
+    {
+        ::munmap(const_cast<char*>(data_), size_);
+    }
+}
+
+#endif
+
+mapped_file::mapped_file(mapped_file&& other) noexcept
+    : data_ {std::exchange(other.data_, nullptr)}
+    , size_ {std::exchange(other.size_, 0)}
+{
+}
+
+mapped_file& mapped_file::operator=(mapped_file&& other) noexcept
+{
+    if (this != &other)
+    {
+        unmap();
+        data_ = std::exchange(other.data_, nullptr);
+        size_ = std::exchange(other.size_, 0);
+    }
+    return *this;
+}
+
+mapped_file::~mapped_file()
+{
+    unmap();
+}
+
+}  // namespace manelemax
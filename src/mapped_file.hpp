@@ -0,0 +1,40 @@
+#pragma once
+
+#include <expected>
+#include <filesystem>
+#include <string_view>
+
+#include "os_error.hpp"
+
+namespace manelemax
+{
+
+// Read-only memory mapping of a whole file
+class mapped_file
+{
+public:
+    static std::expected<mapped_file, os_error> open(const std::filesystem::path& path);
+
+    mapped_file(const mapped_file&)            = delete;
+    mapped_file& operator=(const mapped_file&) = delete;
+
+    mapped_file(mapped_file&& other) noexcept;
+    mapped_file& operator=(mapped_file&& other) noexcept;
+
+    ~mapped_file();
+
+    std::string_view data() const
+    {
+        return {data_, size_};
+    }
+
+private:
+    mapped_file() noexcept = default;
+
+    void unmap() noexcept;
+
+    const char* data_ {nullptr};
+    std::size_t size_ {0};
+};
+
+}  // namespace manelemax
@@ -0,0 +1,107 @@
+#include "match_cache.hpp"
+
+#include <bit>
+#include <cstring>
+
+#include "metrics.hpp"
+
+namespace manelemax
+{
+
+namespace
+{
+
+constexpr std::uint64_t hash_multiplier {0x9E3779B97F4A7C15};
+
+// Finalizer of MurmurHash3
+constexpr std::uint64_t mix(std::uint64_t value)
+{
+    value ^= value >> 33;
+    value *= 0xFF51AFD7ED558CCD;
+    value ^= value >> 33;
+    value *= 0xC4CEB9FE1A85EC53;
+    value ^= value >> 33;
+    return value;
+}
+
+// Hashes the raw bytes 8 at a time with a multiply and a rotation, the final mix in make_key()
+// spreads the bits
+std::uint64_t hash_string(const std::wstring_view str, std::uint64_t hash)
+{
+    constexpr std::size_t word_size {sizeof(std::uint64_t)};
+
+    const char* bytes = reinterpret_cast<const char*>(str.data());
+    std::size_t size  = str.size() * sizeof(wchar_t);
+
+    for (; size >= word_size; bytes += word_size, size -= word_size)
+    {
+        std::uint64_t word;
+        std::memcpy(&word, bytes, sizeof(word));
+        hash = std::rotl((hash ^ word) * hash_multiplier, 31);
+    }
+
+    std::uint64_t tail = 0;
+    std::memcpy(&tail, bytes, size);
+    return std::rotl((hash ^ tail ^ size) * hash_multiplier, 31);
+}
+
+}  // namespace
+
+auto match_cache::make_key(const std::wstring_view artist, const std::wstring_view title) -> key
+{
+    return {
+        .hash        = mix(hash_string(title, hash_string(artist, 0))),
+        .artist_size = std::uint32_t(artist.size()),
+        .title_size  = std::uint32_t(title.size())
+    };
+}
+
+std::optional<track_classifier::result>
+match_cache::find(const key& k, const std::uint64_t generation)
+{
+    set_generation(generation);
+
+    for (entry& e : entries_)
+    {
+        if (e.used && e.k == k)
+        {
+            e.referenced = true;
+            metrics::add(metrics::counter::match_cache_hits);
+            return e.result;
+        }
+    }
+
+    metrics::add(metrics::counter::match_cache_misses);
+    return std::nullopt;
+}
+
+void match_cache::insert(
+    const key&                      k,
+    const std::uint64_t             generation,
+    const track_classifier::result& result
+)
+{
+    set_generation(generation);
+
+    // The hand skips, and clears, the entries referenced since its last pass
+    while (entries_[hand_].used && entries_[hand_].referenced)
+    {
+        entries_[hand_].referenced = false;
+        hand_                      = (hand_ + 1) % capacity;
+    }
+
+    entries_[hand_] = {.k = k, .result = result, .used = true, .referenced = false};
+    hand_           = (hand_ + 1) % capacity;
+}
+
+void match_cache::set_generation(const std::uint64_t generation)
+{
+    if (generation != generation_)
+    {
+        entries_.fill({});
+        hand_       = 0;
+        generation_ = generation;
+    }
+}
+
+}  // namespace manelemax
@@ -0,0 +1,59 @@
+#pragma once
+
+#include <array>
+#include <cstddef>
+#include <cstdint>
+#include <optional>
+#include <string_view>
+
+#include "track_classifier.hpp"
+
+namespace manelemax
+{
+
+// Small cache of classification results, keyed by a hash of the raw artist and title, so that
+// the repeated notifications for the same track skip the normalization and the matching.
+//
+// The entries are evicted with the CLOCK algorithm. Results are tagged with the generation of the
+// keywords they were computed with and the whole cache is dropped when it changes; the cached
+// keywords point into the keyword store, so a hit is only valid while the snapshot of that
+// generation is held. Not thread safe. The hits and misses are counted in metrics.
+class match_cache
+{
+public:
+    static constexpr std::size_t capacity {64};
+
+    // The sizes make a collision of two different tracks even less likely
+    struct key
+    {
+        std::uint64_t hash {0};
+        std::uint32_t artist_size {0};
+        std::uint32_t title_size {0};
+
+        bool operator==(const key&) const = default;
+    };
+
+    static key make_key(std::wstring_view artist, std::wstring_view title);
+
+    // Counts a hit or a miss
+    std::optional<track_classifier::result> find(const key& k, std::uint64_t generation);
+
+    void insert(const key& k, std::uint64_t generation, const track_classifier::result& result);
+
+private:
+    struct entry
+    {
+        key                      k {};
+        track_classifier::result result {};
+        bool                     used {false};
+        bool                     referenced {false};
+    };
+
+    void set_generation(std::uint64_t generation);
+
+    std::array<entry, capacity> entries_ {};
+    std::size_t                 hand_ {0};
+    std::uint64_t               generation_ {0};
+};
+
+}  // namespace manelemax
@@ -0,0 +1,61 @@
+#pragma once
+
+#include <algorithm>
+#include <array>
+#include <chrono>
+#include <cstdint>
+#include <string_view>
+
+namespace manelemax
+{
+
+enum class volume_mode : std::uint8_t
+{
+    idle,    // Nothing is playing
+    normal,  // Not manele, the volume is kept low
+    max      // Manele, the volume is forced to the max
+};
+
+// What auto_dj decided for the current track. Trivially copyable, so that it can be published
+// through a seqlock; the keyword and the score breakdown are copied in place and truncated if
+// longer than their buffers.
+struct match_state
+{
+    static constexpr std::size_t max_keyword_size {95};
+    static constexpr std::size_t max_breakdown_size {255};
+
+    std::array<char, max_keyword_size>    keyword_buf {};
+    std::uint8_t                          keyword_size {0};
+    volume_mode                           mode {volume_mode::idle};
+    float                                 volume {0.0f};
+    std::chrono::system_clock::time_point changed_at {};
+
+    // Score of the track and its breakdown, in the format of track_classifier::append_breakdown()
+    std::uint32_t                        score {0};
+    std::array<char, max_breakdown_size> breakdown_buf {};
+    std::uint8_t                         breakdown_size {0};
+
+    std::string_view keyword() const
+    {
+        return {keyword_buf.data(), keyword_size};
+    }
+
+    void set_keyword(const std::string_view keyword)
+    {
+        keyword_size = std::uint8_t(std::min(keyword.size(), max_keyword_size));
+        std::copy_n(keyword.data(), keyword_size, keyword_buf.data());
+    }
+
+    std::string_view breakdown() const
+    {
+        return {breakdown_buf.data(), breakdown_size};
+    }
+
+    void set_breakdown(const std::string_view breakdown)
+    {
+        breakdown_size = std::uint8_t(std::min(breakdown.size(), max_breakdown_size));
+        std::copy_n(breakdown.data(), breakdown_size, breakdown_buf.data());
+    }
+};
+
+}  // namespace manelemax
@@ -0,0 +1,81 @@
+#include "media_event_coalescer.hpp"
+
+#include <utility>
+
+#include "metrics.hpp"
+
+namespace manelemax
+{
+
+media_event_coalescer::media_event_coalescer(
+    executor&                       timer,
+    const executor::clock::duration window
+)
+    : timer_ {timer}
+    , window_ {window}
+{
+}
+
+void media_event_coalescer::set_listener(listener* const lsn)
+{
+    lsn_ = lsn;
+}
+
+void media_event_coalescer::on_play(const properties& media_props)
+{
+    push(media_props);
+}
+
+void media_event_coalescer::on_stop()
+{
+    push(std::nullopt);
+}
+
+void media_event_coalescer::push(media_state state)
+{
+    bool opens_window = false;
+    {
+        std::lock_guard lock {mutex_};
+        opens_window = !pending_.has_value();
+        pending_     = std::move(state);
+    }
+
+    // Lets the rest of the burst arrive, the window is not extended by the later events. With the
+    // timers full, or the executor stopped, the burst is dropped and the next event opens a window
+    // again.
+    if (opens_window && !timer_.post_after(window_, [this] { flush(); }))
+    {
+        metrics::add(metrics::counter::dropped_bursts);
+
+        std::lock_guard lock {mutex_};
+        pending_.reset();
+    }
+}
+
+void media_event_coalescer::flush()
+{
+    std::optional<media_state> state;
+    {
+        std::lock_guard lock {mutex_};
+        state = std::exchange(pending_, std::nullopt);
+    }
+
+    if (!state.has_value() || delivered_ == state)
+    {
+        return;
+    }
+
+    delivered_ = *state;
+    metrics::add(metrics::counter::transitions);
+
+    if (listener* const lsn = lsn_.load(); lsn && state->has_value())
+    {
+        lsn->on_play(**state);
+    }
+    else if (lsn)
+    {
+        lsn->on_stop();
+    }
+}
+
+}  // namespace manelemax
@@ -0,0 +1,61 @@
+#pragma once
+
+#include <atomic>
+#include <chrono>
+#include <mutex>
+#include <optional>
+
+#include "executor.hpp"
+#include "system_media_properties_notifier.hpp"
+
+namespace manelemax
+{
+
+// Stage between system_media_properties_notifier and its listener, which merges the bursts of
+// events of a single track change into one transition.
+//
+// The first event of a burst opens a window; once it elapses, the listener gets the last state
+// seen, from the executor, and only if that state differs from the previous one it got. The
+// window is timed by the executor, so that a manual one replays it in no time.
+//
+// The executor has to be stopped before the coalescer is destroyed, a transition still pending
+// is then dropped. The transitions and the dropped bursts are counted in metrics.
+class media_event_coalescer : public system_media_properties_notifier::listener
+{
+public:
+    using properties = system_media_properties_notifier::properties;
+    using listener   = system_media_properties_notifier::listener;
+
+    media_event_coalescer(executor& timer, executor::clock::duration window);
+
+    media_event_coalescer(const media_event_coalescer&)            = delete;
+    media_event_coalescer& operator=(const media_event_coalescer&) = delete;
+
+    void set_listener(listener* lsn);
+
+    void on_play(const properties& media_props) override;
+    void on_stop() override;
+
+private:
+    // Empty while nothing is playing
+    using media_state = std::optional<properties>;
+
+    void push(media_state state);
+
+    // Runs once the window elapsed
+    void flush();
+
+    executor&                       timer_;
+    const executor::clock::duration window_;
+
+    std::mutex                 mutex_ {};
+    std::optional<media_state> pending_ {};
+
+    // Unknown until the first transition, which is always delivered. Only used by flush(), which
+    // runs one at a time.
+    std::optional<media_state> delivered_ {};
+
+    std::atomic<listener*> lsn_ {nullptr};
+};
+
+}  // namespace manelemax
@@ -0,0 +1,60 @@
+#pragma once
+
+#include <expected>
+#include <memory>
+#include <string>
+
+#include "application.hpp"
+#include "os_error.hpp"
+
+namespace manelemax
+{
+
+// Media sessions of the platform: the system media transport controls on Windows, the MPRIS
+// players of the session bus elsewhere.
+class media_session_backend
+{
+public:
+    struct properties
+    {
+        std::wstring artist;
+        std::wstring title;
+
+        // Whose volume to change, rather than the one of every application
+        application app {};
+
+        bool operator==(const properties&) const = default;
+    };
+
+    struct session_state
+    {
+        properties media_props {};
+        bool       playing {false};
+
+        bool operator==(const session_state&) const = default;
+    };
+
+    // The id of a session is unique among the sessions alive at the same time: the application
+    // user model id on Windows, the unique bus name of the player with MPRIS
+    struct listener
+    {
+        virtual ~listener() = default;
+
+        // The whole state of a session, once it appears, then after any change to it. Runs on a
+        // thread of the backend.
+        virtual void on_session_changed(const std::string& id, const session_state& state) = 0;
+        virtual void on_session_removed(const std::string& id)                             = 0;
+    };
+
+    // Defined by the backend compiled for the platform
+    static std::expected<std::unique_ptr<media_session_backend>, os_error> make_default();
+
+    // Returns once the listener is no longer called, and never will be
+    virtual ~media_session_backend() = default;
+
+    // At most once. The listener gets the sessions that are already there first, then the
+    // changes, one at a time.
+    virtual void set_listener(listener* lsn) = 0;
+};
+
+}  // namespace manelemax
@@ -0,0 +1,268 @@
+#include "metrics.hpp"
+
+#include <algorithm>
+#include <atomic>
+#include <bit>
+#include <cstdio>
+#include <fstream>
+#include <memory>
+#include <mutex>
+#include <vector>
+
+namespace manelemax
+{
+
+namespace
+{
+
+constexpr std::size_t counter_count {metrics::counter_names.size()};
+constexpr std::size_t histogram_count {metrics::histogram_names.size()};
+
+// Written by its thread only, read by the snapshots
+struct shard
+{
+    struct histogram
+    {
+        std::array<std::atomic<std::uint64_t>, metrics::bucket_count> buckets {};
+        std::atomic<std::uint64_t>                                    total_ns {0};
+    };
+
+    std::array<std::atomic<std::uint64_t>, counter_count> counters {};
+    std::array<histogram, histogram_count>                histograms {};
+};
+
+// The only writer, no read-modify-write needed
+void bump(std::atomic<std::uint64_t>& value, const std::uint64_t delta)
+{
+    value.store(value.load(std::memory_order_relaxed) + delta, std::memory_order_relaxed);
+}
+
+std::size_t bucket_of(const std::uint64_t ns)
+{
+    return ns < 2 ? 0 : std::min<std::size_t>(std::bit_width(ns) - 1, metrics::bucket_count - 1);
+}
+
+void add_shard(const shard& from, metrics::snapshot& to)
+{
+    for (std::size_t idx = 0; idx != counter_count; ++idx)
+    {
+        to.counters[idx] += from.counters[idx].load(std::memory_order_relaxed);
+    }
+
+    for (std::size_t idx = 0; idx != histogram_count; ++idx)
+    {
+        const shard::histogram&      src = from.histograms[idx];
+        metrics::histogram_snapshot& dst = to.histograms[idx];
+
+        dst.total_ns += src.total_ns.load(std::memory_order_relaxed);
+        for (std::size_t bucket = 0; bucket != metrics::bucket_count; ++bucket)
+        {
+            const std::uint64_t count = src.buckets[bucket].load(std::memory_order_relaxed);
+            dst.buckets[bucket] += count;
+            dst.count += count;
+        }
+    }
+}
+
+// The shards of the running threads, and the totals of the ones that exited
+class registry
+{
+public:
+    // Never destroyed, the threads that exit after the static objects are destroyed still retire
+    // their shards
+    static registry& instance()
+    {
+        static registry* const g_registry = new registry;
+        return *g_registry;
+    }
+
+    void enroll(shard* const crt)
+    {
+        std::lock_guard lock {mutex_};
+        live_.push_back(crt);
+    }
+
+    void retire(shard* const crt)
+    {
+        std::lock_guard lock {mutex_};
+        add_shard(*crt, retired_);
+        std::erase(live_, crt);
+    }
+
+    metrics::snapshot take_snapshot()
+    {
+        std::lock_guard   lock {mutex_};
+        metrics::snapshot result = retired_;
+        for (const shard* const crt : live_)
+        {
+            add_shard(*crt, result);
+        }
+        return result;
+    }
+
+private:
+    std::mutex          mutex_ {};
+    std::vector<shard*> live_ {};
+    metrics::snapshot   retired_ {};
+};
+
+// Enrolls the shard of the thread on its first record, retires it when the thread exits
+class thread_shard
+{
+public:
+    thread_shard()
+    {
+        registry::instance().enroll(shard_.get());
+    }
+
+    thread_shard(const thread_shard&)            = delete;
+    thread_shard& operator=(const thread_shard&) = delete;
+
+    ~thread_shard()
+    {
+        registry::instance().retire(shard_.get());
+    }
+
+    shard& get()
+    {
+        return *shard_;
+    }
+
+private:
+    std::unique_ptr<shard> shard_ {std::make_unique<shard>()};
+};
+
+shard& local_shard()
+{
+    thread_local thread_shard g_thread_shard;
+    return g_thread_shard.get();
+}
+
+// A duration in the unit that keeps it within 4 digits
+struct duration_text
+{
+    explicit duration_text(const std::uint64_t ns)
+    {
+        const char*   unit  = "ns";
+        std::uint64_t value = ns;
+        if (ns >= 10'000'000)
+        {
+            unit  = "ms";
+            value = ns / 1'000'000;
+        }
+        else if (ns >= 10'000)
+        {
+            unit  = "us";
+            value = ns / 1'000;
+        }
+        std::snprintf(text, sizeof(text), "%llu %s", static_cast<unsigned long long>(value), unit);
+    }
+
+    char text[32];
+};
+
+}  // namespace
+
+std::uint64_t metrics::histogram_snapshot::quantile_ns(const double quantile) const
+{
+    if (count == 0)
+    {
+        return 0;
+    }
+
+    // The rank of the quantile, 1-based, so that 0 is the first duration and 1 the last one
+    const auto    rank = std::max<std::uint64_t>(std::uint64_t(quantile * double(count) + 0.5), 1);
+    std::uint64_t seen = 0;
+    for (std::size_t bucket = 0; bucket != bucket_count; ++bucket)
+    {
+        seen += buckets[bucket];
+        if (seen >= rank)
+        {
+            return std::uint64_t {1} << (bucket + 1);
+        }
+    }
+    return std::uint64_t {1} << bucket_count;
+}
+
+std::string metrics::snapshot::format() const
+{
+    std::string out;
+    char        line[256];
+
+    for (std::size_t idx = 0; idx != counters.size(); ++idx)
+    {
+        std::snprintf(
+            line,
+            sizeof(line),
+            "%-24.*s %llu\n",
+            int(counter_names[idx].size()),
+            counter_names[idx].data(),
+            static_cast<unsigned long long>(counters[idx])
+        );
+        out.append(line);
+    }
+
+    for (std::size_t idx = 0; idx != histograms.size(); ++idx)
+    {
+        const histogram_snapshot& crt = histograms[idx];
+        const int                 name_size {int(histogram_names[idx].size())};
+        const auto                count {static_cast<unsigned long long>(crt.count)};
+        if (crt.count == 0)
+        {
+            std::snprintf(
+                line,
+                sizeof(line),
+                "%-24.*s %llu calls\n",
+                name_size,
+                histogram_names[idx].data(),
+                count
+            );
+        }
+        else
+        {
+            std::snprintf(
+                line,
+                sizeof(line),
+                "%-24.*s %llu calls, mean %s, p50 < %s, p99 < %s, max < %s\n",
+                name_size,
+                histogram_names[idx].data(),
+                count,
+                duration_text {crt.mean_ns()}.text,
+                duration_text {crt.quantile_ns(0.5)}.text,
+                duration_text {crt.quantile_ns(0.99)}.text,
+                duration_text {crt.quantile_ns(1.0)}.text
+            );
+        }
+        out.append(line);
+    }
+
+    return out;
+}
+
+bool metrics::snapshot::save(const std::filesystem::path& path) const
+{
+    std::ofstream file {path, std::ios::binary | std::ios::trunc};
+    file << format();
+    return bool(file.flush());
+}
+
+void metrics::add(const counter id, const std::uint64_t value)
+{
+    bump(local_shard().counters[std::size_t(id)], value);
+}
+
+void metrics::record(const histogram id, const std::chrono::nanoseconds duration)
+{
+    const std::uint64_t ns = std::uint64_t(std::max<std::int64_t>(duration.count(), 0));
+
+    shard::histogram& crt = local_shard().histograms[std::size_t(id)];
+    bump(crt.buckets[bucket_of(ns)], 1);
+    bump(crt.total_ns, ns);
+}
+
+auto metrics::take_snapshot() -> snapshot
+{
+    return registry::instance().take_snapshot();
+}
+
+}  // namespace manelemax
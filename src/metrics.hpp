@@ -0,0 +1,152 @@
+#pragma once
+
+#include <array>
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+#include <filesystem>
+#include <string>
+#include <string_view>
+
+namespace manelemax
+{
+
+// Counters and latency histograms of the hot paths, for a view of what the daemon does in
+// production: how many events arrive, how long the matching takes, how often the volume is
+// written and how often the enforcement fights someone else.
+//
+// Every thread records into its own shard, with plain relaxed stores since it is the only writer,
+// so recording neither locks nor contends. A snapshot adds up the shards, along with the ones of
+// the threads that exited.
+class metrics
+{
+public:
+    enum class counter : std::uint8_t
+    {
+        session_changes,
+        session_removals,
+        play_events,
+        stop_events,
+        volume_writes,
+        mute_writes,
+        failed_writes,
+        external_volume_changes,  // Made by someone else, as notified by the endpoint
+        external_mute_changes,
+        volume_enforcements,  // Writes that undo an external change
+        mute_enforcements,
+        deferred_enforcements,  // Rate limited, retried later
+        match_cache_hits,
+        match_cache_misses,
+        transitions,     // Out of the coalescer, the other play and stop events were merged
+        dropped_bursts,  // Lost by the coalescer, with the timers full
+    };
+
+    static constexpr std::array<std::string_view, 16> counter_names {
+        "session_changes",
+        "session_removals",
+        "play_events",
+        "stop_events",
+        "volume_writes",
+        "mute_writes",
+        "failed_writes",
+        "external_volume_changes",
+        "external_mute_changes",
+        "volume_enforcements",
+        "mute_enforcements",
+        "deferred_enforcements",
+        "match_cache_hits",
+        "match_cache_misses",
+        "transitions",
+        "dropped_bursts",
+    };
+
+    enum class histogram : std::uint8_t
+    {
+        notifier_callback,  // A session change, up to the play or stop event
+        normalize,          // Of the artist and the title
+        keyword_match,      // Of the normalized artist and title
+        set_volume,
+        set_muted,
+    };
+
+    static constexpr std::array<std::string_view, 5> histogram_names {
+        "notifier_callback",
+        "normalize",
+        "keyword_match",
+        "set_volume",
+        "set_muted",
+    };
+
+    // Bucket i holds the durations in [2^i, 2^(i+1)) nanoseconds, bucket 0 holds 0 as well. The
+    // last one holds everything from 2^39 ns, about 9 minutes.
+    static constexpr std::size_t bucket_count {40};
+
+    struct histogram_snapshot
+    {
+        std::uint64_t                           count {0};
+        std::uint64_t                           total_ns {0};
+        std::array<std::uint64_t, bucket_count> buckets {};
+
+        std::uint64_t mean_ns() const
+        {
+            return count == 0 ? 0 : total_ns / count;
+        }
+
+        // The upper bound of the bucket of the given quantile, between 0 and 1, so within a factor
+        // of 2. Zero if empty.
+        std::uint64_t quantile_ns(double quantile) const;
+    };
+
+    struct snapshot
+    {
+        std::array<std::uint64_t, counter_names.size()>        counters {};
+        std::array<histogram_snapshot, histogram_names.size()> histograms {};
+
+        std::uint64_t get(const counter id) const
+        {
+            return counters[std::size_t(id)];
+        }
+
+        const histogram_snapshot& get(const histogram id) const
+        {
+            return histograms[std::size_t(id)];
+        }
+
+        // One line per counter, then one per histogram with its count, mean, p50, p99 and max
+        std::string format() const;
+
+        // Writes format() to the file, returns false if it could not be written
+        bool save(const std::filesystem::path& path) const;
+    };
+
+    static void add(counter id, std::uint64_t value = 1);
+    static void record(histogram id, std::chrono::nanoseconds duration);
+
+    // Safe to call from any thread, it only locks against the threads that start and exit
+    static snapshot take_snapshot();
+};
+
+// Records the time from its construction to its destruction into a histogram
+class scoped_timer
+{
+public:
+    explicit scoped_timer(const metrics::histogram id)
+        : id_ {id}
+        , start_ {std::chrono::steady_clock::now()}
+    {
+    }
+
+    scoped_timer(const scoped_timer&)            = delete;
+    scoped_timer& operator=(const scoped_timer&) = delete;
+
+    ~scoped_timer()
+    {
+        metrics::record(id_, std::chrono::steady_clock::now() - start_);
+    }
+
+private:
+    metrics::histogram                    id_;
+    std::chrono::steady_clock::time_point start_;
+};
+
+}  // namespace manelemax
@@ -0,0 +1,507 @@
+#include <cerrno>
+#include <cstdint>
+#include <map>
+#include <mutex>
+#include <optional>
+#include <string>
+#include <string_view>
+#include <thread>
+
+#include <poll.h>
+#include <sys/eventfd.h>
+#include <unistd.h>
+
+#include <dbus/dbus.h>
+
+#include "media_session_backend.hpp"
+#include "string_utils.hpp"
+
+namespace manelemax
+{
+
+namespace
+{
+
+constexpr std::string_view mpris_name_prefix {"org.mpris.MediaPlayer2."};
+constexpr const char*      mpris_path {"/org/mpris/MediaPlayer2"};
+constexpr const char*      mpris_player_interface {"org.mpris.MediaPlayer2.Player"};
+
+// A player that does not answer within it is skipped
+constexpr int call_timeout_ms {500};
+
+constexpr const char* properties_changed_rule {
+    "type='signal',interface='org.freedesktop.DBus.Properties',member='PropertiesChanged',"
+    "path='/org/mpris/MediaPlayer2'"
+};
+constexpr const char* name_owner_changed_rule {
+    "type='signal',sender='org.freedesktop.DBus',interface='org.freedesktop.DBus',"
+    "member='NameOwnerChanged',arg0namespace='org.mpris.MediaPlayer2'"
+};
+
+struct message_deleter
+{
+    void operator()(DBusMessage* const msg) const
+    {
+        dbus_message_unref(msg);
+    }
+};
+
+using message_ptr = std::unique_ptr<DBusMessage, message_deleter>;
+
+std::optional<std::string_view> get_string(DBusMessageIter& iter)
+{
+    const int type = dbus_message_iter_get_arg_type(&iter);
+    if (type != DBUS_TYPE_STRING && type != DBUS_TYPE_OBJECT_PATH)
+    {
+        return std::nullopt;
+    }
+
+    const char* str;
+    dbus_message_iter_get_basic(&iter, &str);
+    return str;
+}
+
+// A string, or an array of strings joined by commas, as xesam:artist is
+std::wstring get_text(DBusMessageIter& iter)
+{
+    if (const auto str = get_string(iter); str.has_value())
+    {
+        return stringutils::utf8_to_wide(*str);
+    }
+    if (dbus_message_iter_get_arg_type(&iter) != DBUS_TYPE_ARRAY)
+    {
+        return {};
+    }
+
+    std::string joined;
+
+    DBusMessageIter items;
+    dbus_message_iter_recurse(&iter, &items);
+    for (; dbus_message_iter_get_arg_type(&items) != DBUS_TYPE_INVALID;
+         dbus_message_iter_next(&items))
+    {
+        if (const auto str = get_string(items); str.has_value())
+        {
+            joined += joined.empty() ? "" : ", ";
+            joined += *str;
+        }
+    }
+
+    return stringutils::utf8_to_wide(joined);
+}
+
+// Calls fn(key, value) for each entry of the a{sv} dictionary at iter
+template<typename Fn>
+void for_each_entry(DBusMessageIter& iter, Fn fn)
+{
+    if (dbus_message_iter_get_arg_type(&iter) != DBUS_TYPE_ARRAY)
+    {
+        return;
+    }
+
+    DBusMessageIter entries;
+    dbus_message_iter_recurse(&iter, &entries);
+    for (; dbus_message_iter_get_arg_type(&entries) == DBUS_TYPE_DICT_ENTRY;
+         dbus_message_iter_next(&entries))
+    {
+        DBusMessageIter entry;
+        dbus_message_iter_recurse(&entries, &entry);
+
+        const auto key = get_string(entry);
+        if (!key.has_value() || !dbus_message_iter_next(&entry) ||
+            dbus_message_iter_get_arg_type(&entry) != DBUS_TYPE_VARIANT)
+        {
+            continue;
+        }
+
+        DBusMessageIter value;
+        dbus_message_iter_recurse(&entry, &value);
+        fn(*key, value);
+    }
+}
+
+// Applies the properties of the MPRIS Player interface found in the a{sv} dictionary at iter
+void apply_player_properties(DBusMessageIter& iter, media_session_backend::session_state& state)
+{
+    for_each_entry(iter, [&](const std::string_view key, DBusMessageIter& value) {
+        if (key == "PlaybackStatus")
+        {
+            state.playing = get_string(value) == "Playing";
+        }
+        else if (key == "Metadata")
+        {
+            // The metadata is replaced as a whole, the application is not part of it
+            state.media_props = {
+                .artist = {},
+                .title  = {},
+                .app    = std::move(state.media_props.app)
+            };
+            for_each_entry(value, [&](const std::string_view field, DBusMessageIter& text) {
+                if (field == "xesam:artist")
+                {
+                    state.media_props.artist = get_text(text);
+                }
+                else if (field == "xesam:title")
+                {
+                    state.media_props.title = get_text(text);
+                }
+            });
+        }
+    });
+}
+
+}  // namespace
+
+// The MPRIS players of the session bus, one session each.
+//
+// The bus is read from a thread of the backend that sleeps in poll() between messages, so nothing
+// is polled.
+class mpris_media_session_backend : public media_session_backend
+{
+public:
+    static std::expected<std::unique_ptr<media_session_backend>, os_error> make()
+    {
+        dbus_threads_init_default();
+
+        DBusError err;
+        dbus_error_init(&err);
+
+        // Private, as the connection is closed by this backend and used by its thread only
+        DBusConnection* const connection = dbus_bus_get_private(DBUS_BUS_SESSION, &err);
+        if (connection == nullptr)
+        {
+            dbus_error_free(&err);
+            return std::unexpected {os_error {"dbus_bus_get_private", ECONNREFUSED}};
+        }
+        dbus_connection_set_exit_on_disconnect(connection, false);
+
+        std::unique_ptr<mpris_media_session_backend> instance {
+            new mpris_media_session_backend {connection}
+        };
+
+        for (const char* const rule : {properties_changed_rule, name_owner_changed_rule})
+        {
+            dbus_bus_add_match(connection, rule, &err);
+            if (dbus_error_is_set(&err))
+            {
+                dbus_error_free(&err);
+                return std::unexpected {os_error {"dbus_bus_add_match", EIO}};
+            }
+        }
+
+        int bus_fd;
+        if (!dbus_connection_get_unix_fd(connection, &bus_fd))
+        {
+            return std::unexpected {os_error {"dbus_connection_get_unix_fd", EBADF}};
+        }
+
+        const int stop_fd = ::eventfd(0, EFD_CLOEXEC);
+        if (stop_fd == -1)
+        {
+            return std::unexpected {os_error {"eventfd", errno}};
+        }
+        instance->stop_fd_ = stop_fd;
+
+        // The players which were already running, before the signals were subscribed to
+        instance->add_running_players();
+
+        instance->thread_ = std::thread {[instance = instance.get(), bus_fd] {
+            instance->run(bus_fd);
+        }};
+
+        return instance;
+    }
+
+    mpris_media_session_backend(const mpris_media_session_backend&)            = delete;
+    mpris_media_session_backend& operator=(const mpris_media_session_backend&) = delete;
+
+    ~mpris_media_session_backend() override
+    {
+        if (thread_.joinable())
+        {
+            const std::uint64_t value {1};
+            [[maybe_unused]] const ssize_t written = ::write(stop_fd_, &value, sizeof(value));
+            thread_.join();
+        }
+        if (stop_fd_ != -1)
+        {
+            ::close(stop_fd_);
+        }
+
+        dbus_connection_close(connection_);
+        dbus_connection_unref(connection_);
+    }
+
+    void set_listener(listener* const lsn) override
+    {
+        std::lock_guard lock {mutex_};
+        lsn_ = lsn;
+
+        if (lsn_)
+        {
+            for (const auto& [owner, state] : players_)
+            {
+                lsn_->on_session_changed(owner, state);
+            }
+        }
+    }
+
+private:
+    explicit mpris_media_session_backend(DBusConnection* const connection)
+        : connection_ {connection}
+    {
+    }
+
+    void run(const int bus_fd)
+    {
+        while (true)
+        {
+            // Reads without blocking whatever arrived, then handles all of the queued messages,
+            // including the ones queued while waiting for the replies of earlier calls
+            if (!dbus_connection_read_write(connection_, 0))
+            {
+                return;
+            }
+            while (const message_ptr msg {dbus_connection_pop_message(connection_)})
+            {
+                handle(msg.get());
+            }
+
+            pollfd fds[2] {{bus_fd, POLLIN, 0}, {stop_fd_, POLLIN, 0}};
+            if (::poll(fds, 2, -1) == -1)
+            {
+                if (errno == EINTR)
+                {
+                    continue;
+                }
+                return;
+            }
+            if (fds[1].revents != 0)
+            {
+                return;
+            }
+        }
+    }
+
+    void handle(DBusMessage* const msg)
+    {
+        DBusMessageIter args;
+        if (!dbus_message_iter_init(msg, &args))
+        {
+            return;
+        }
+
+        if (dbus_message_is_signal(msg, "org.freedesktop.DBus.Properties", "PropertiesChanged"))
+        {
+            const char* const sender = dbus_message_get_sender(msg);
+            if (sender == nullptr || get_string(args) != mpris_player_interface ||
+                !dbus_message_iter_next(&args))
+            {
+                return;
+            }
+
+            std::lock_guard lock {mutex_};
+            if (const auto found = players_.find(sender); found != players_.end())
+            {
+                update_player(found->first, found->second, args);
+            }
+        }
+        else if (dbus_message_is_signal(msg, "org.freedesktop.DBus", "NameOwnerChanged"))
+        {
+            const auto name = get_string(args);
+            if (!name.has_value() || !name->starts_with(mpris_name_prefix) ||
+                !dbus_message_iter_next(&args))
+            {
+                return;
+            }
+
+            const auto old_owner = get_string(args);
+            if (!old_owner.has_value() || !dbus_message_iter_next(&args))
+            {
+                return;
+            }
+            const auto new_owner = get_string(args);
+
+            if (!old_owner->empty())
+            {
+                remove_player(std::string {*old_owner});
+            }
+            if (new_owner.has_value() && !new_owner->empty())
+            {
+                add_player(std::string {*new_owner}, *name);
+            }
+        }
+    }
+
+    // The mutex is held. The players may notify properties that did not change, those are not
+    // reported.
+    void update_player(const std::string& owner, session_state& state, DBusMessageIter& properties)
+    {
+        const session_state old_state = state;
+        apply_player_properties(properties, state);
+
+        if (state != old_state && lsn_)
+        {
+            lsn_->on_session_changed(owner, state);
+        }
+    }
+
+    void add_player(const std::string& owner, const std::string_view name)
+    {
+        application app = app_of(owner, name);
+
+        const message_ptr reply = call(
+            owner.c_str(),
+            mpris_path,
+            "org.freedesktop.DBus.Properties",
+            "GetAll",
+            mpris_player_interface
+        );
+
+        DBusMessageIter args;
+        if (!reply || !dbus_message_iter_init(reply.get(), &args))
+        {
+            return;
+        }
+
+        std::lock_guard lock {mutex_};
+        auto [added, inserted]        = players_.try_emplace(owner);
+        added->second.media_props.app = std::move(app);
+        apply_player_properties(args, added->second);
+        if (lsn_)
+        {
+            lsn_->on_session_changed(owner, added->second);
+        }
+    }
+
+    void remove_player(const std::string& owner)
+    {
+        std::lock_guard lock {mutex_};
+        if (players_.erase(owner) != 0 && lsn_)
+        {
+            lsn_->on_session_removed(owner);
+        }
+    }
+
+    void add_running_players()
+    {
+        const message_ptr names = call(
+            "org.freedesktop.DBus",
+            "/org/freedesktop/DBus",
+            "org.freedesktop.DBus",
+            "ListNames"
+        );
+
+        DBusMessageIter args;
+        if (!names || !dbus_message_iter_init(names.get(), &args) ||
+            dbus_message_iter_get_arg_type(&args) != DBUS_TYPE_ARRAY)
+        {
+            return;
+        }
+
+        DBusMessageIter items;
+        dbus_message_iter_recurse(&args, &items);
+        for (; dbus_message_iter_get_arg_type(&items) != DBUS_TYPE_INVALID;
+             dbus_message_iter_next(&items))
+        {
+            const auto name = get_string(items);
+            if (!name.has_value() || !name->starts_with(mpris_name_prefix))
+            {
+                continue;
+            }
+
+            const message_ptr owner = call(
+                "org.freedesktop.DBus",
+                "/org/freedesktop/DBus",
+                "org.freedesktop.DBus",
+                "GetNameOwner",
+                std::string {*name}.c_str()
+            );
+
+            DBusMessageIter owner_args;
+            if (owner && dbus_message_iter_init(owner.get(), &owner_args))
+            {
+                if (const auto unique_name = get_string(owner_args); unique_name.has_value())
+                {
+                    add_player(std::string {*unique_name}, *name);
+                }
+            }
+        }
+    }
+
+    // The process which owns the bus name, and the name the player registered under, as
+    // "firefox" for org.mpris.MediaPlayer2.firefox.instance_1_42, which is mostly the one of its
+    // executable
+    application app_of(const std::string& owner, std::string_view name)
+    {
+        name.remove_prefix(mpris_name_prefix.size());
+        name = name.substr(0, name.find('.'));
+
+        application app {.process_id = 0, .name = stringutils::utf8_to_wide(name)};
+
+        const message_ptr reply = call(
+            "org.freedesktop.DBus",
+            "/org/freedesktop/DBus",
+            "org.freedesktop.DBus",
+            "GetConnectionUnixProcessID",
+            owner.c_str()
+        );
+
+        DBusMessageIter args;
+        if (reply && dbus_message_iter_init(reply.get(), &args) &&
+            dbus_message_iter_get_arg_type(&args) == DBUS_TYPE_UINT32)
+        {
+            dbus_uint32_t process_id;
+            dbus_message_iter_get_basic(&args, &process_id);
+            app.process_id = process_id;
+        }
+
+        return app;
+    }
+
+    // Blocks until the reply, null on error or timeout
+    message_ptr call(
+        const char* const destination,
+        const char* const path,
+        const char* const interface,
+        const char* const method,
+        const char*       arg = nullptr
+    )
+    {
+        const message_ptr msg {dbus_message_new_method_call(destination, path, interface, method)};
+        if (!msg ||
+            (arg != nullptr &&
+             !dbus_message_append_args(msg.get(), DBUS_TYPE_STRING, &arg, DBUS_TYPE_INVALID)))
+        {
+            return nullptr;
+        }
+
+        DBusError err;
+        dbus_error_init(&err);
+
+        message_ptr reply {
+            dbus_connection_send_with_reply_and_block(connection_, msg.get(), call_timeout_ms, &err)
+        };
+        dbus_error_free(&err);
+
+        return reply;
+    }
+
+    DBusConnection* connection_;
+    int             stop_fd_ {-1};
+
+    // Written by the thread, and read by set_listener()
+    std::mutex                           mutex_ {};
+    std::map<std::string, session_state> players_ {};  // By unique bus name
+    listener*                            lsn_ {nullptr};
+
+    std::thread thread_ {};
+};
+
+std::expected<std::unique_ptr<media_session_backend>, os_error>
+media_session_backend::make_default()
+{
+    return mpris_media_session_backend::make();
+}
+
+}  // namespace manelemax
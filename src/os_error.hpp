@@ -0,0 +1,16 @@
+#pragma once
+
+#include <cstdint>
+#include <string_view>
+
+namespace manelemax
+{
+
+// Portable counterpart of win32_error: GetLastError() on Windows, errno elsewhere
+struct os_error
+{
+    std::string_view function;
+    std::int64_t     code;
+};
+
+}  // namespace manelemax
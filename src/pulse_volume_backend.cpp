@@ -0,0 +1,554 @@
+#include <algorithm>
+#include <cmath>
+#include <cstdint>
+#include <cstdlib>
+#include <map>
+#include <optional>
+#include <string>
+#include <vector>
+
+#include <pulse/pulseaudio.h>
+
+#include "string_utils.hpp"
+#include "volume_backend.hpp"
+
+namespace manelemax
+{
+
+namespace
+{
+
+// Resolved by the server, so that a change of the default sink is followed without tracking it
+constexpr const char* default_sink {"@DEFAULT_SINK@"};
+
+// The slider position, which is what the volume scalars of the other platforms are
+float to_scalar(const pa_cvolume& volume)
+{
+    return float(pa_cvolume_max(&volume)) / float(PA_VOLUME_NORM);
+}
+
+pa_volume_t from_scalar(const float vol)
+{
+    return pa_volume_t(std::lround(std::clamp(vol, 0.0f, 1.0f) * float(PA_VOLUME_NORM)));
+}
+
+}  // namespace
+
+// Default sink of a PulseAudio server, or of PipeWire through pipewire-pulse, or the sink inputs of
+// the target application.
+//
+// The requests are made from the calling thread and waited for; the subscription events arrive on
+// the thread of the mainloop, which sleeps in between, so nothing is polled. The sink inputs are
+// listed once, then kept up to date from the events, rather than listed again on every change.
+class pulse_volume_backend : public volume_backend
+{
+public:
+    static std::expected<std::unique_ptr<volume_backend>, os_error> make();
+
+    pulse_volume_backend(const pulse_volume_backend&)            = delete;
+    pulse_volume_backend& operator=(const pulse_volume_backend&) = delete;
+
+    ~pulse_volume_backend() override
+    {
+        if (mainloop_ == nullptr)
+        {
+            return;
+        }
+
+        pa_threaded_mainloop_stop(mainloop_);
+        if (context_ != nullptr)
+        {
+            pa_context_disconnect(context_);
+            pa_context_unref(context_);
+        }
+        pa_threaded_mainloop_free(mainloop_);
+    }
+
+    std::expected<endpoint, os_error> get() override
+    {
+        lock_guard lock {mainloop_};
+
+        if (target_.has_value())
+        {
+            for (const auto& [index, input] : inputs_)
+            {
+                if (target_->owns(input.process_id, input.name))
+                {
+                    return endpoint {.volume = to_scalar(input.volume), .muted = input.muted};
+                }
+            }
+            return endpoint {.volume = 1.0f, .muted = false};
+        }
+
+        const auto sink = get_sink();
+        if (!sink.has_value())
+        {
+            return std::unexpected {sink.error()};
+        }
+
+        return endpoint {.volume = to_scalar(sink->volume), .muted = sink->muted};
+    }
+
+    std::expected<void, os_error> set_volume(const float vol) override
+    {
+        lock_guard lock {mainloop_};
+
+        if (target_.has_value())
+        {
+            return for_each_target(
+                "pa_context_set_sink_input_volume",
+                [&](const target_input& input, pa_context_success_cb_t cb, void* userdata) {
+                    pa_cvolume volume = input.volume;
+                    pa_cvolume_scale(&volume, from_scalar(vol));
+
+                    return pa_context_set_sink_input_volume(
+                        context_,
+                        input.index,
+                        &volume,
+                        cb,
+                        userdata
+                    );
+                }
+            );
+        }
+
+        // Scaled, rather than set on every channel, so that the balance is kept
+        auto sink = get_sink();
+        if (!sink.has_value())
+        {
+            return std::unexpected {sink.error()};
+        }
+        pa_cvolume_scale(&sink->volume, from_scalar(vol));
+
+        return wait_for_success(
+            "pa_context_set_sink_volume_by_name",
+            [&](const pa_context_success_cb_t cb, void* const userdata) {
+                return pa_context_set_sink_volume_by_name(
+                    context_,
+                    default_sink,
+                    &sink->volume,
+                    cb,
+                    userdata
+                );
+            }
+        );
+    }
+
+    std::expected<void, os_error> set_muted(const bool muted) override
+    {
+        lock_guard lock {mainloop_};
+
+        if (target_.has_value())
+        {
+            return for_each_target(
+                "pa_context_set_sink_input_mute",
+                [&](const target_input& input, pa_context_success_cb_t cb, void* userdata) {
+                    return pa_context_set_sink_input_mute(
+                        context_,
+                        input.index,
+                        muted ? 1 : 0,
+                        cb,
+                        userdata
+                    );
+                }
+            );
+        }
+
+        return wait_for_success(
+            "pa_context_set_sink_mute_by_name",
+            [&](const pa_context_success_cb_t cb, void* const userdata) {
+                return pa_context_set_sink_mute_by_name(
+                    context_,
+                    default_sink,
+                    muted ? 1 : 0,
+                    cb,
+                    userdata
+                );
+            }
+        );
+    }
+
+    std::expected<void, os_error> set_listener(listener* const lsn) override
+    {
+        lock_guard lock {mainloop_};
+        lsn_ = lsn;
+
+        return {};
+    }
+
+    void set_target(const std::optional<application>& app) override
+    {
+        lock_guard lock {mainloop_};
+        target_ = app;
+    }
+
+    // The default sink is resolved by the server on every request, and the sink inputs are moved
+    // along by it. The change is reported as a change of the volume, from the server event.
+    std::expected<void, os_error> follow_default() override
+    {
+        return {};
+    }
+
+private:
+    struct sink_state
+    {
+        pa_cvolume volume {};
+        bool       muted {false};
+    };
+
+    // A stream played to a sink, by the process that owns it
+    struct sink_input
+    {
+        std::uint32_t process_id {0};
+        std::wstring  name {};  // Of the executable
+        pa_cvolume    volume {};
+        bool          muted {false};
+    };
+
+    struct target_input
+    {
+        std::uint32_t index;
+        pa_cvolume    volume;
+    };
+
+    class lock_guard
+    {
+    public:
+        explicit lock_guard(pa_threaded_mainloop* const mainloop)
+            : mainloop_ {mainloop}
+        {
+            pa_threaded_mainloop_lock(mainloop_);
+        }
+
+        lock_guard(const lock_guard&)            = delete;
+        lock_guard& operator=(const lock_guard&) = delete;
+
+        ~lock_guard()
+        {
+            pa_threaded_mainloop_unlock(mainloop_);
+        }
+
+    private:
+        pa_threaded_mainloop* mainloop_;
+    };
+
+    pulse_volume_backend() noexcept = default;
+
+    os_error context_error(const std::string_view function) const
+    {
+        return os_error {function, pa_context_errno(context_)};
+    }
+
+    // The lock is held. Waits for the operation, whose callback signals the mainloop.
+    void wait_for(pa_operation* const operation)
+    {
+        while (pa_operation_get_state(operation) == PA_OPERATION_RUNNING)
+        {
+            pa_threaded_mainloop_wait(mainloop_);
+        }
+        pa_operation_unref(operation);
+    }
+
+    template<typename Start>
+    std::expected<void, os_error> wait_for_success(const std::string_view function, Start start)
+    {
+        struct request
+        {
+            pa_threaded_mainloop* mainloop;
+            bool                  success;
+        } req {mainloop_, false};
+
+        constexpr pa_context_success_cb_t on_done =
+            [](pa_context* /*context*/, const int success, void* const userdata) {
+                auto& req   = *static_cast<request*>(userdata);
+                req.success = success != 0;
+                pa_threaded_mainloop_signal(req.mainloop, 0);
+            };
+
+        pa_operation* const operation = start(on_done, &req);
+        if (operation == nullptr)
+        {
+            return std::unexpected {context_error(function)};
+        }
+        wait_for(operation);
+
+        if (!req.success)
+        {
+            return std::unexpected {context_error(function)};
+        }
+        return {};
+    }
+
+    // The lock is held. Writes every sink input of the target, the first failure is returned once
+    // all were tried. They are picked beforehand, as the events may change them while waiting.
+    template<typename Start>
+    std::expected<void, os_error> for_each_target(const std::string_view function, Start start)
+    {
+        std::vector<target_input> targets;
+        for (const auto& [index, input] : inputs_)
+        {
+            if (target_->owns(input.process_id, input.name))
+            {
+                targets.push_back({.index = index, .volume = input.volume});
+            }
+        }
+
+        std::expected<void, os_error> first_failure {};
+        for (const target_input& input : targets)
+        {
+            const auto result = wait_for_success(
+                function,
+                [&](const pa_context_success_cb_t cb, void* const userdata) {
+                    return start(input, cb, userdata);
+                }
+            );
+            if (!result.has_value() && first_failure.has_value())
+            {
+                first_failure = result;
+            }
+        }
+        return first_failure;
+    }
+
+    std::expected<sink_state, os_error> get_sink()
+    {
+        struct request
+        {
+            pa_threaded_mainloop*     mainloop;
+            std::optional<sink_state> sink;
+        } req {mainloop_, std::nullopt};
+
+        constexpr pa_sink_info_cb_t on_info =
+            [](pa_context* /*context*/, const pa_sink_info* info, int eol, void* userdata) {
+                auto& req = *static_cast<request*>(userdata);
+                if (eol == 0 && info != nullptr)
+                {
+                    req.sink = sink_state {.volume = info->volume, .muted = info->mute != 0};
+                }
+                else
+                {
+                    pa_threaded_mainloop_signal(req.mainloop, 0);
+                }
+            };
+
+        pa_operation* const operation =
+            pa_context_get_sink_info_by_name(context_, default_sink, on_info, &req);
+        if (operation == nullptr)
+        {
+            return std::unexpected {context_error("pa_context_get_sink_info_by_name")};
+        }
+        wait_for(operation);
+
+        if (!req.sink.has_value())
+        {
+            return std::unexpected {context_error("pa_context_get_sink_info_by_name")};
+        }
+        return *req.sink;
+    }
+
+    // Runs on the thread of the mainloop, with the lock held, so the states are queried without
+    // waiting for them
+    static void on_event(
+        pa_context* const                  context,
+        const pa_subscription_event_type_t type,
+        const std::uint32_t                index,
+        void* const                        userdata
+    )
+    {
+        auto* const backend = static_cast<pulse_volume_backend*>(userdata);
+
+        const auto facility = type & PA_SUBSCRIPTION_EVENT_FACILITY_MASK;
+        if (facility == PA_SUBSCRIPTION_EVENT_SINK_INPUT)
+        {
+            if ((type & PA_SUBSCRIPTION_EVENT_TYPE_MASK) == PA_SUBSCRIPTION_EVENT_REMOVE)
+            {
+                backend->inputs_.erase(index);
+            }
+            else if (pa_operation* const operation =
+                         pa_context_get_sink_input_info(context, index, &on_input_info, userdata);
+                     operation != nullptr)
+            {
+                pa_operation_unref(operation);
+            }
+            return;
+        }
+
+        // The server events tell about a change of the default sink
+        if ((facility != PA_SUBSCRIPTION_EVENT_SINK && facility != PA_SUBSCRIPTION_EVENT_SERVER) ||
+            backend->target_.has_value())
+        {
+            return;
+        }
+
+        constexpr pa_sink_info_cb_t on_info =
+            [](pa_context* /*context*/, const pa_sink_info* info, int eol, void* userdata) {
+                auto* const backend = static_cast<pulse_volume_backend*>(userdata);
+                if (eol != 0 || info == nullptr || backend->lsn_ == nullptr ||
+                    backend->target_.has_value())
+                {
+                    return;
+                }
+
+                backend->lsn_->on_endpoint_changed({
+                    .volume = to_scalar(info->volume),
+                    .muted  = info->mute != 0
+                });
+            };
+
+        if (pa_operation* const operation =
+                pa_context_get_sink_info_by_name(context, default_sink, on_info, userdata);
+            operation != nullptr)
+        {
+            pa_operation_unref(operation);
+        }
+    }
+
+    // Indexes the sink input, and reports it when it belongs to the target. Signals the mainloop
+    // at the end of a list, for make() to wait for it.
+    static void on_input_info(
+        pa_context* /*context*/,
+        const pa_sink_input_info* info,
+        const int                 eol,
+        void* const               userdata
+    )
+    {
+        auto* const backend = static_cast<pulse_volume_backend*>(userdata);
+        if (eol != 0 || info == nullptr)
+        {
+            pa_threaded_mainloop_signal(backend->mainloop_, 0);
+            return;
+        }
+
+        sink_input& input = backend->inputs_[info->index];
+        input.volume      = info->volume;
+        input.muted       = info->mute != 0;
+
+        if (const char* const process_id =
+                pa_proplist_gets(info->proplist, PA_PROP_APPLICATION_PROCESS_ID);
+            process_id != nullptr)
+        {
+            input.process_id = std::uint32_t(std::strtoul(process_id, nullptr, 10));
+        }
+        if (const char* const binary =
+                pa_proplist_gets(info->proplist, PA_PROP_APPLICATION_PROCESS_BINARY);
+            binary != nullptr)
+        {
+            input.name = stringutils::utf8_to_wide(binary);
+        }
+
+        // Also a new stream of the target, whose volume is likely not the one wanted
+        if (backend->lsn_ != nullptr && backend->target_.has_value() &&
+            backend->target_->owns(input.process_id, input.name))
+        {
+            backend->lsn_->on_endpoint_changed({
+                .volume = to_scalar(input.volume),
+                .muted  = input.muted
+            });
+        }
+    }
+
+    pa_threaded_mainloop* mainloop_ {nullptr};
+    pa_context*           context_ {nullptr};
+    listener*             lsn_ {nullptr};
+
+    // Both guarded by the lock of the mainloop
+    std::optional<application>          target_ {};
+    std::map<std::uint32_t, sink_input> inputs_ {};  // By index
+};
+
+std::expected<std::unique_ptr<volume_backend>, os_error> pulse_volume_backend::make()
+{
+    std::unique_ptr<pulse_volume_backend> instance {new pulse_volume_backend};
+
+    instance->mainloop_ = pa_threaded_mainloop_new();
+    if (instance->mainloop_ == nullptr)
+    {
+        return std::unexpected {os_error {"pa_threaded_mainloop_new", PA_ERR_INTERNAL}};
+    }
+
+    instance->context_ =
+        pa_context_new(pa_threaded_mainloop_get_api(instance->mainloop_), "ManeleMax");
+    if (instance->context_ == nullptr)
+    {
+        return std::unexpected {os_error {"pa_context_new", PA_ERR_INTERNAL}};
+    }
+
+    pa_context_set_state_callback(
+        instance->context_,
+        [](pa_context* /*context*/, void* const mainloop) {
+            pa_threaded_mainloop_signal(static_cast<pa_threaded_mainloop*>(mainloop), 0);
+        },
+        instance->mainloop_
+    );
+
+    if (pa_context_connect(instance->context_, nullptr, PA_CONTEXT_NOFLAGS, nullptr) < 0)
+    {
+        return std::unexpected {instance->context_error("pa_context_connect")};
+    }
+
+    if (pa_threaded_mainloop_start(instance->mainloop_) < 0)
+    {
+        return std::unexpected {os_error {"pa_threaded_mainloop_start", PA_ERR_INTERNAL}};
+    }
+
+    lock_guard lock {instance->mainloop_};
+    while (true)
+    {
+        const pa_context_state_t state = pa_context_get_state(instance->context_);
+        if (state == PA_CONTEXT_READY)
+        {
+            break;
+        }
+        if (!PA_CONTEXT_IS_GOOD(state))
+        {
+            return std::unexpected {instance->context_error("pa_context_connect")};
+        }
+        pa_threaded_mainloop_wait(instance->mainloop_);
+    }
+
+    pa_context_set_subscribe_callback(
+        instance->context_,
+        &pulse_volume_backend::on_event,
+        instance.get()
+    );
+
+    // Subscribed to before the sink inputs are listed, so that none is missed in between
+    if (const auto result = instance->wait_for_success(
+            "pa_context_subscribe",
+            [&](const pa_context_success_cb_t cb, void* const userdata) {
+                return pa_context_subscribe(
+                    instance->context_,
+                    pa_subscription_mask_t(
+                        PA_SUBSCRIPTION_MASK_SINK | PA_SUBSCRIPTION_MASK_SERVER |
+                        PA_SUBSCRIPTION_MASK_SINK_INPUT
+                    ),
+                    cb,
+                    userdata
+                );
+            }
+        );
+        !result.has_value())
+    {
+        return std::unexpected {result.error()};
+    }
+
+    pa_operation* const operation = pa_context_get_sink_input_info_list(
+        instance->context_,
+        &pulse_volume_backend::on_input_info,
+        instance.get()
+    );
+    if (operation == nullptr)
+    {
+        return std::unexpected {instance->context_error("pa_context_get_sink_input_info_list")};
+    }
+    instance->wait_for(operation);
+
+    return instance;
+}
+
+std::expected<std::unique_ptr<volume_backend>, os_error> volume_backend::make_default()
+{
+    return pulse_volume_backend::make();
+}
+
+}  // namespace manelemax
@@ -0,0 +1,113 @@
+#pragma once
+
+#include <array>
+#include <atomic>
+#include <cstddef>
+#include <memory>
+#include <mutex>
+#include <thread>
+
+namespace manelemax
+{
+
+// Pointer to an immutable object that can be replaced while other threads keep reading it.
+//
+// Readers never lock and never wait: they register in one of two reader counters, picked by the
+// current epoch, and load the pointer. A writer publishes the new object, then flips the epoch and
+// waits for the readers of the previous one to leave, twice, after which no reader can still see
+// the old object and it is destroyed (the grace period of RCU). Writers are serialized and block
+// for the duration of the longest read section, so read sections must stay short.
+template<typename T>
+class rcu_ptr
+{
+public:
+    class read_guard
+    {
+    public:
+        read_guard(const read_guard&)            = delete;
+        read_guard& operator=(const read_guard&) = delete;
+
+        ~read_guard()
+        {
+            readers_->fetch_sub(1, std::memory_order_release);
+        }
+
+        const T& operator*() const
+        {
+            return *ptr_;
+        }
+
+        const T* operator->() const
+        {
+            return ptr_;
+        }
+
+    private:
+        friend class rcu_ptr;
+
+        read_guard(std::atomic<std::size_t>& readers, const T* const ptr)
+            : readers_ {&readers}
+            , ptr_ {ptr}
+        {
+        }
+
+        std::atomic<std::size_t>* readers_;
+        const T*                  ptr_;
+    };
+
+    explicit rcu_ptr(std::unique_ptr<const T> initial)
+        : ptr_ {initial.release()}
+    {
+    }
+
+    rcu_ptr(const rcu_ptr&)            = delete;
+    rcu_ptr& operator=(const rcu_ptr&) = delete;
+
+    ~rcu_ptr()
+    {
+        delete ptr_.load(std::memory_order_relaxed);
+    }
+
+    // The object stays alive, and unchanged, for as long as the guard exists
+    read_guard read() const
+    {
+        // Sequentially consistent, so that a writer either sees this reader in the counter or the
+        // reader sees the new pointer
+        std::atomic<std::size_t>& readers = readers_[epoch_.load() & 1].count;
+        readers.fetch_add(1);
+        return {readers, ptr_.load()};
+    }
+
+    // Blocks until no reader can still see the previous object, then destroys it
+    void update(std::unique_ptr<const T> replacement)
+    {
+        std::lock_guard lock {writer_mutex_};
+
+        const std::unique_ptr<const T> previous {ptr_.exchange(replacement.release())};
+
+        // A reader may have read the epoch right before a flip and registered right after it, so
+        // both counters have to be drained
+        for (int flip = 0; flip != 2; ++flip)
+        {
+            const std::size_t old_epoch = epoch_.fetch_add(1);
+            while (readers_[old_epoch & 1].count.load() != 0)
+            {
+                std::this_thread::yield();
+            }
+        }
+    }
+
+private:
+    // Each counter on its own cache line, so that readers of one epoch do not slow down the other
+    struct alignas(64) reader_count
+    {
+        std::atomic<std::size_t> count {0};
+    };
+
+    std::atomic<const T*>               ptr_;
+    std::atomic<std::size_t>            epoch_ {0};
+    mutable std::array<reader_count, 2> readers_ {};
+    std::mutex                          writer_mutex_ {};
+};
+
+}  // namespace manelemax
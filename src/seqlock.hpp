@@ -0,0 +1,100 @@
+#pragma once
+
+#include <array>
+#include <atomic>
+#include <cstdint>
+#include <cstring>
+#include <thread>
+#include <type_traits>
+
+namespace manelemax
+{
+
+// Publishes a small trivially copyable value to readers that never lock and never allocate.
+//
+// The value is stored as atomic words guarded by a sequence number, odd while a write is in
+// progress. A reader copies the words and retries if the sequence number changed meanwhile, so it
+// always gets a value that was stored as a whole, never a mix of two. Writers are serialized
+// between themselves through the sequence number.
+template<typename T>
+class seqlock
+{
+    static_assert(std::is_trivially_copyable_v<T>);
+
+public:
+    explicit seqlock(const T& value = {})
+    {
+        store_words(value);
+    }
+
+    seqlock(const seqlock&)            = delete;
+    seqlock& operator=(const seqlock&) = delete;
+
+    T load() const
+    {
+        while (true)
+        {
+            const std::uint64_t begin = seq_.load(std::memory_order_acquire);
+            if (begin % 2 != 0)
+            {
+                std::this_thread::yield();
+                continue;
+            }
+
+            std::array<std::uint64_t, word_count> words;
+            for (std::size_t idx = 0; idx != word_count; ++idx)
+            {
+                words[idx] = words_[idx].load(std::memory_order_relaxed);
+            }
+
+            std::atomic_thread_fence(std::memory_order_acquire);
+            if (seq_.load(std::memory_order_relaxed) == begin)
+            {
+                T value;
+                std::memcpy(static_cast<void*>(&value), words.data(), sizeof(T));
+                return value;
+            }
+        }
+    }
+
+    void store(const T& value)
+    {
+        std::uint64_t seq = seq_.load(std::memory_order_relaxed);
+        while (true)
+        {
+            if (seq % 2 != 0)
+            {
+                std::this_thread::yield();
+                seq = seq_.load(std::memory_order_relaxed);
+            }
+            else if (seq_.compare_exchange_weak(seq, seq + 1, std::memory_order_acquire))
+            {
+                break;
+            }
+        }
+
+        // The odd sequence number must be visible before any of the words
+        std::atomic_thread_fence(std::memory_order_release);
+        store_words(value);
+        seq_.store(seq + 2, std::memory_order_release);
+    }
+
+private:
+    static constexpr std::size_t word_count {(sizeof(T) + 7) / 8};
+
+    void store_words(const T& value)
+    {
+        std::array<std::uint64_t, word_count> words {};
+        std::memcpy(words.data(), &value, sizeof(T));
+
+        for (std::size_t idx = 0; idx != word_count; ++idx)
+        {
+            words_[idx].store(words[idx], std::memory_order_relaxed);
+        }
+    }
+
+    std::atomic<std::uint64_t>                         seq_ {0};
+    std::array<std::atomic<std::uint64_t>, word_count> words_ {};
+};
+
+}  // namespace manelemax
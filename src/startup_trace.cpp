@@ -0,0 +1,74 @@
+#include "startup_trace.hpp"
+
+#include <algorithm>
+#include <cstdio>
+#include <fstream>
+
+namespace manelemax
+{
+
+// Constructed with the other static objects, before main() runs
+static startup_trace g_process_trace {};
+
+startup_trace::startup_trace(const clock::time_point origin)
+    : origin_ {origin}
+{
+}
+
+startup_trace& startup_trace::process()
+{
+    return g_process_trace;
+}
+
+void startup_trace::mark(const char* const name)
+{
+    const auto at = std::chrono::duration_cast<std::chrono::microseconds>(clock::now() - origin_);
+
+    const std::size_t idx = claimed_.fetch_add(1, std::memory_order_relaxed);
+    if (idx >= max_milestones)
+    {
+        return;
+    }
+
+    slots_[idx].value = {.name = name, .at = at};
+    slots_[idx].complete.store(true, std::memory_order_release);
+}
+
+auto startup_trace::milestones() const -> std::vector<milestone>
+{
+    const std::size_t count = std::min(claimed_.load(std::memory_order_relaxed), max_milestones);
+
+    // A slot claimed by a mark still in progress is skipped
+    std::vector<milestone> result;
+    for (std::size_t idx = 0; idx != count; ++idx)
+    {
+        if (slots_[idx].complete.load(std::memory_order_acquire))
+        {
+            result.push_back(slots_[idx].value);
+        }
+    }
+
+    std::ranges::stable_sort(result, {}, &milestone::at);
+    return result;
+}
+
+std::string startup_trace::format() const
+{
+    std::string out;
+    for (const milestone& crt : milestones())
+    {
+        char at[24];
+        std::snprintf(at, sizeof(at), "%10lld us ", static_cast<long long>(crt.at.count()));
+        out.append(at).append(crt.name).push_back('\n');
+    }
+    return out;
+}
+
+bool startup_trace::save(const std::filesystem::path& path) const
+{
+    std::ofstream file {path, std::ios::binary | std::ios::trunc};
+    file << format();
+    return bool(file.flush());
+}
+
+}  // namespace manelemax
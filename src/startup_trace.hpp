@@ -0,0 +1,64 @@
+#pragma once
+
+#include <array>
+#include <atomic>
+#include <chrono>
+#include <cstddef>
+#include <filesystem>
+#include <string>
+#include <vector>
+
+namespace manelemax
+{
+
+// Milestones of the startup, in microseconds since the trace started, to tell where the time to
+// the tray icon goes.
+//
+// Marking is lock free and allocation free, from any thread. The milestones past max_milestones
+// are dropped.
+class startup_trace
+{
+public:
+    using clock = std::chrono::steady_clock;
+
+    static constexpr std::size_t max_milestones {32};
+
+    struct milestone
+    {
+        const char*               name {nullptr};
+        std::chrono::microseconds at {};
+    };
+
+    explicit startup_trace(clock::time_point origin = clock::now());
+
+    startup_trace(const startup_trace&)            = delete;
+    startup_trace& operator=(const startup_trace&) = delete;
+
+    // The trace of the process, started along with its static objects
+    static startup_trace& process();
+
+    // The name is not copied, it has to be a literal
+    void mark(const char* name);
+
+    // The complete milestones, in the order of their times
+    std::vector<milestone> milestones() const;
+
+    // One "<at> us <name>" line per milestone
+    std::string format() const;
+
+    // Writes format() to the file, returns false if it could not be written
+    bool save(const std::filesystem::path& path) const;
+
+private:
+    struct slot
+    {
+        milestone         value {};
+        std::atomic<bool> complete {false};
+    };
+
+    clock::time_point                origin_;
+    std::array<slot, max_milestones> slots_ {};
+    std::atomic<std::size_t>         claimed_ {0};
+};
+
+}  // namespace manelemax
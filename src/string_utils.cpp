@@ -7,6 +7,14 @@
 #include <sstream>
 #include <memory>
 
+#if defined(__AVX2__)
+#include <immintrin.h>
+#define MANELEMAX_NORMALIZE_AVX2
+#elif defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#include <emmintrin.h>
+#define MANELEMAX_NORMALIZE_SSE2
+#endif
+
 namespace manelemax::stringutils
 {
 
@@ -43,7 +51,10 @@ std::string remove_ro_diacritics(const std::wstring& wstr)
         c = convert(c);
     }
 
-    wstr_new.erase(std::remove_if(wstr_new.begin(), wstr_new.end(), cannot_narrow));
+    wstr_new.erase(
+        std::remove_if(wstr_new.begin(), wstr_new.end(), cannot_narrow),
+        wstr_new.end()
+    );
 
     std::string str;
     str.reserve(wstr.size());
@@ -66,9 +77,14 @@ std::string& to_lower(std::string& str)
 
 std::string& keep_alpha_and_spaces(std::string& str)
 {
-    str.erase(std::remove_if(str.begin(), str.end(), [](char c) {
-        return !std::isalpha(c) && !std::isspace(c);
-    }));
+    str.erase(
+        std::remove_if(
+            str.begin(),
+            str.end(),
+            [](char c) { return !std::isalpha(c) && !std::isspace(c); }
+        ),
+        str.end()
+    );
     return str;
 }
 
@@ -90,37 +106,540 @@ std::vector<std::string> split(const std::string& str)
 
 std::vector<std::string> all_word_aligned_substrings(const std::string& str, std::size_t max_words)
 {
-    if (str.empty())
+    // Collapse the whitespace, so that the view can be used
+    std::string text;
+    text.reserve(str.size());
+
+    bool pending_space = false;
+    for (const char c : str)
     {
-        return {};
+        if (std::isspace(static_cast<unsigned char>(c)))
+        {
+            pending_space = !text.empty();
+        }
+        else
+        {
+            if (pending_space)
+            {
+                text.push_back(' ');
+                pending_space = false;
+            }
+            text.push_back(c);
+        }
     }
 
-    std::vector<std::string>       result;
-    const std::vector<std::string> words = split(str);
+    std::vector<std::string> result;
+    for (const std::string_view substr : word_aligned_substrings_view {text, max_words})
+    {
+        result.emplace_back(substr);
+    }
+    return result;
+}
 
-    if (max_words == 0 || max_words > words.size())
+word_aligned_substrings_view::iterator::iterator(
+    const std::string_view text,
+    const std::size_t      max_words
+)
+    : text_ {text}
+    , max_words_ {max_words}
+{
+    first_with_word_count(1);
+}
+
+void word_aligned_substrings_view::iterator::first_with_word_count(const std::size_t word_count)
+{
+    word_count_ = 0;
+    begin_      = 0;
+    end_        = 0;
+
+    if (text_.empty() || (max_words_ != 0 && word_count > max_words_))
     {
-        max_words = words.size();
+        return;
     }
 
-    for (size_t word_count = 1; word_count <= max_words; ++word_count)
+    for (std::size_t word = 0; word != word_count; ++word)
     {
-        for (size_t start_word = 0; start_word < words.size() - word_count + 1; ++start_word)
+        if (word != 0)
         {
-            std::ostringstream ss;
-            for (size_t crt_word = start_word; crt_word != start_word + word_count; ++crt_word)
+            if (end_ == text_.size())
             {
-                ss << words[crt_word];
-                if (crt_word != start_word + word_count - 1)
-                {
-                    ss << ' ';
-                }
+                return;
             }
-            result.push_back(std::move(ss).str());
+            ++end_;
         }
+        end_ = std::min(text_.find(' ', end_), text_.size());
     }
 
-    return result;
+    word_count_ = word_count;
+}
+
+auto word_aligned_substrings_view::iterator::operator++() -> iterator&
+{
+    if (end_ == text_.size())
+    {
+        first_with_word_count(word_count_ + 1);
+        return *this;
+    }
+
+    begin_ = text_.find(' ', begin_) + 1;
+    end_   = std::min(text_.find(' ', end_ + 1), text_.size());
+
+    return *this;
+}
+
+namespace
+{
+
+enum class char_class
+{
+    letter,
+    space,
+    other
+};
+
+// Diacritics are folded straight to lowercase and anything outside ASCII is dropped, like
+// std::wctob does in the "C" locale
+constexpr char_class classify(char32_t& c)
+{
+    switch (c)
+    {
+        case U'ă': c = U'a'; return char_class::letter;
+        case U'â': c = U'a'; return char_class::letter;
+        case U'Ă': c = U'a'; return char_class::letter;
+        case U'Â': c = U'a'; return char_class::letter;
+        case U'î': c = U'i'; return char_class::letter;
+        case U'Î': c = U'i'; return char_class::letter;
+        case U'ș': c = U's'; return char_class::letter;
+        case U'Ș': c = U's'; return char_class::letter;
+        case U'ț': c = U't'; return char_class::letter;
+        case U'Ț': c = U't'; return char_class::letter;
+    }
+    if (c >= U'a' && c <= U'z')
+    {
+        return char_class::letter;
+    }
+    if (c >= U'A' && c <= U'Z')
+    {
+        c = c - U'A' + U'a';
+        return char_class::letter;
+    }
+    if (c == U' ' || (c >= U'\t' && c <= U'\r'))
+    {
+        return char_class::space;
+    }
+    return char_class::other;
+}
+
+// Decodes the code point starting at str[idx] and moves idx past it. Malformed sequences are
+// decoded as U+FFFD, one byte at a time.
+char32_t decode_utf8(const std::string_view str, std::size_t& idx)
+{
+    constexpr char32_t replacement = U'\xFFFD';
+
+    const auto lead = static_cast<unsigned char>(str[idx++]);
+    if (lead < 0x80)
+    {
+        return lead;
+    }
+
+    std::size_t length;
+    char32_t    c;
+    if ((lead & 0xE0) == 0xC0)
+    {
+        length = 1;
+        c      = lead & 0x1F;
+    }
+    else if ((lead & 0xF0) == 0xE0)
+    {
+        length = 2;
+        c      = lead & 0x0F;
+    }
+    else if ((lead & 0xF8) == 0xF0)
+    {
+        length = 3;
+        c      = lead & 0x07;
+    }
+    else
+    {
+        return replacement;
+    }
+
+    if (str.size() - idx < length)
+    {
+        return replacement;
+    }
+    for (std::size_t crt = idx; crt != idx + length; ++crt)
+    {
+        const auto cont = static_cast<unsigned char>(str[crt]);
+        if ((cont & 0xC0) != 0x80)
+        {
+            return replacement;
+        }
+        c = (c << 6) | (cont & 0x3F);
+    }
+    idx += length;
+    return c;
+}
+
+class normalizer
+{
+public:
+    explicit normalizer(normalized_text& out)
+        : out_ {out}
+    {
+        out_.text.clear();
+        out_.words.clear();
+    }
+
+    void append(char32_t c)
+    {
+        switch (classify(c))
+        {
+            case char_class::letter: append_letter(char(c)); break;
+            case char_class::space: in_word_ = false; break;
+            case char_class::other: break;
+        }
+    }
+
+    // Every byte of the block is either a lowercase letter, a space or 0 for a dropped character
+    void append_ascii_block(const char* const block, const std::size_t size, const bool all_letters)
+    {
+        if (all_letters)
+        {
+            if (!in_word_)
+            {
+                start_word();
+            }
+            out_.text.append(block, size);
+            out_.words.back().length += std::uint32_t(size);
+            return;
+        }
+
+        for (std::size_t idx = 0; idx != size; ++idx)
+        {
+            if (block[idx] == ' ')
+            {
+                in_word_ = false;
+            }
+            else if (block[idx] != 0)
+            {
+                append_letter(block[idx]);
+            }
+        }
+    }
+
+private:
+    void start_word()
+    {
+        if (!out_.text.empty())
+        {
+            out_.text.push_back(' ');
+        }
+        out_.words.push_back({.offset = std::uint32_t(out_.text.size()), .length = 0});
+        in_word_ = true;
+    }
+
+    void append_letter(const char c)
+    {
+        if (!in_word_)
+        {
+            start_word();
+        }
+        out_.text.push_back(c);
+        ++out_.words.back().length;
+    }
+
+    normalized_text& out_;
+    bool             in_word_ {false};
+};
+
+#if defined(MANELEMAX_NORMALIZE_AVX2)
+
+constexpr std::size_t   ascii_block_size {32};
+constexpr std::uint32_t ascii_block_mask {0xFFFFFFFF};
+
+using ascii_block = __m256i;
+
+// Narrows one block of characters to bytes. Returns false if it has any code unit outside ASCII.
+bool load_ascii_block(const wchar_t* const src, ascii_block& bytes)
+{
+    if constexpr (sizeof(wchar_t) == 2)
+    {
+        const __m256i lo = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(src));
+        const __m256i hi = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(src + 16));
+
+        const __m256i non_ascii = _mm256_and_si256(
+            _mm256_or_si256(lo, hi),
+            _mm256_set1_epi16(static_cast<short>(0xFF80))
+        );
+        if (!_mm256_testz_si256(non_ascii, non_ascii))
+        {
+            return false;
+        }
+
+        // The packing works per 128-bit lane, the permutation restores the order
+        bytes = _mm256_permute4x64_epi64(_mm256_packus_epi16(lo, hi), 0b11011000);
+    }
+    else
+    {
+        const __m256i a = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(src));
+        const __m256i b = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(src + 8));
+        const __m256i c = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(src + 16));
+        const __m256i d = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(src + 24));
+
+        const __m256i non_ascii = _mm256_and_si256(
+            _mm256_or_si256(_mm256_or_si256(a, b), _mm256_or_si256(c, d)),
+            _mm256_set1_epi32(~0x7F)
+        );
+        if (!_mm256_testz_si256(non_ascii, non_ascii))
+        {
+            return false;
+        }
+
+        bytes = _mm256_permutevar8x32_epi32(
+            _mm256_packus_epi16(_mm256_packs_epi32(a, b), _mm256_packs_epi32(c, d)),
+            _mm256_setr_epi32(0, 4, 1, 5, 2, 6, 3, 7)
+        );
+    }
+
+    return true;
+}
+
+bool load_ascii_block(const char* const src, ascii_block& bytes)
+{
+    bytes = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(src));
+    return _mm256_movemask_epi8(bytes) == 0;
+}
+
+// Lowercases and classifies one block of ASCII characters, returning the mask of the letters
+std::uint32_t normalize_ascii_block(const ascii_block bytes, char* const dst)
+{
+    const auto in_range = [](const __m256i v, const char first, const char last) {
+        return _mm256_and_si256(
+            _mm256_cmpgt_epi8(v, _mm256_set1_epi8(char(first - 1))),
+            _mm256_cmpgt_epi8(_mm256_set1_epi8(char(last + 1)), v)
+        );
+    };
+
+    const __m256i lower =
+        _mm256_or_si256(bytes, _mm256_and_si256(in_range(bytes, 'A', 'Z'), _mm256_set1_epi8(0x20)));
+    const __m256i letter = in_range(lower, 'a', 'z');
+    const __m256i space =
+        _mm256_or_si256(_mm256_cmpeq_epi8(bytes, _mm256_set1_epi8(' ')), in_range(bytes, '\t', '\r'));
+
+    _mm256_storeu_si256(
+        reinterpret_cast<__m256i*>(dst),
+        _mm256_or_si256(
+            _mm256_and_si256(letter, lower),
+            _mm256_and_si256(space, _mm256_set1_epi8(' '))
+        )
+    );
+    return std::uint32_t(_mm256_movemask_epi8(letter));
+}
+
+#elif defined(MANELEMAX_NORMALIZE_SSE2)
+
+constexpr std::size_t   ascii_block_size {16};
+constexpr std::uint32_t ascii_block_mask {0xFFFF};
+
+using ascii_block = __m128i;
+
+// Narrows one block of characters to bytes. Returns false if it has any code unit outside ASCII.
+bool load_ascii_block(const wchar_t* const src, ascii_block& bytes)
+{
+    if constexpr (sizeof(wchar_t) == 2)
+    {
+        const __m128i lo = _mm_loadu_si128(reinterpret_cast<const __m128i*>(src));
+        const __m128i hi = _mm_loadu_si128(reinterpret_cast<const __m128i*>(src + 8));
+
+        const __m128i non_ascii =
+            _mm_and_si128(_mm_or_si128(lo, hi), _mm_set1_epi16(static_cast<short>(0xFF80)));
+        if (_mm_movemask_epi8(_mm_cmpeq_epi8(non_ascii, _mm_setzero_si128())) != 0xFFFF)
+        {
+            return false;
+        }
+
+        bytes = _mm_packus_epi16(lo, hi);
+    }
+    else
+    {
+        const __m128i a = _mm_loadu_si128(reinterpret_cast<const __m128i*>(src));
+        const __m128i b = _mm_loadu_si128(reinterpret_cast<const __m128i*>(src + 4));
+        const __m128i c = _mm_loadu_si128(reinterpret_cast<const __m128i*>(src + 8));
+        const __m128i d = _mm_loadu_si128(reinterpret_cast<const __m128i*>(src + 12));
+
+        const __m128i non_ascii = _mm_and_si128(
+            _mm_or_si128(_mm_or_si128(a, b), _mm_or_si128(c, d)),
+            _mm_set1_epi32(~0x7F)
+        );
+        if (_mm_movemask_epi8(_mm_cmpeq_epi8(non_ascii, _mm_setzero_si128())) != 0xFFFF)
+        {
+            return false;
+        }
+
+        bytes = _mm_packus_epi16(_mm_packs_epi32(a, b), _mm_packs_epi32(c, d));
+    }
+
+    return true;
+}
+
+bool load_ascii_block(const char* const src, ascii_block& bytes)
+{
+    bytes = _mm_loadu_si128(reinterpret_cast<const __m128i*>(src));
+    return _mm_movemask_epi8(bytes) == 0;
+}
+
+// Lowercases and classifies one block of ASCII characters, returning the mask of the letters
+std::uint32_t normalize_ascii_block(const ascii_block bytes, char* const dst)
+{
+    const auto in_range = [](const __m128i v, const char first, const char last) {
+        return _mm_and_si128(
+            _mm_cmpgt_epi8(v, _mm_set1_epi8(char(first - 1))),
+            _mm_cmplt_epi8(v, _mm_set1_epi8(char(last + 1)))
+        );
+    };
+
+    const __m128i lower =
+        _mm_or_si128(bytes, _mm_and_si128(in_range(bytes, 'A', 'Z'), _mm_set1_epi8(0x20)));
+    const __m128i letter = in_range(lower, 'a', 'z');
+    const __m128i space =
+        _mm_or_si128(_mm_cmpeq_epi8(bytes, _mm_set1_epi8(' ')), in_range(bytes, '\t', '\r'));
+
+    _mm_storeu_si128(
+        reinterpret_cast<__m128i*>(dst),
+        _mm_or_si128(_mm_and_si128(letter, lower), _mm_and_si128(space, _mm_set1_epi8(' ')))
+    );
+    return std::uint32_t(_mm_movemask_epi8(letter));
+}
+
+#endif
+
+}  // namespace
+
+void normalize_into(const std::wstring_view wstr, normalized_text& out)
+{
+    normalizer norm {out};
+
+    std::size_t idx = 0;
+
+#if defined(MANELEMAX_NORMALIZE_AVX2) || defined(MANELEMAX_NORMALIZE_SSE2)
+    // Only the blocks with characters outside ASCII take the scalar path
+    for (; idx + ascii_block_size <= wstr.size(); idx += ascii_block_size)
+    {
+        if (ascii_block bytes; load_ascii_block(wstr.data() + idx, bytes))
+        {
+            alignas(ascii_block_size) char block[ascii_block_size];
+
+            const std::uint32_t letter_mask = normalize_ascii_block(bytes, block);
+            norm.append_ascii_block(block, ascii_block_size, letter_mask == ascii_block_mask);
+        }
+        else
+        {
+            for (const wchar_t c : wstr.substr(idx, ascii_block_size))
+            {
+                norm.append(char32_t(c));
+            }
+        }
+    }
+#endif
+
+    for (const wchar_t c : wstr.substr(idx))
+    {
+        norm.append(char32_t(c));
+    }
+}
+
+void normalize_into(const std::string_view utf8, normalized_text& out)
+{
+    normalizer norm {out};
+
+    std::size_t idx = 0;
+    while (idx != utf8.size())
+    {
+#if defined(MANELEMAX_NORMALIZE_AVX2) || defined(MANELEMAX_NORMALIZE_SSE2)
+        if (ascii_block bytes;
+            idx + ascii_block_size <= utf8.size() && load_ascii_block(utf8.data() + idx, bytes))
+        {
+            alignas(ascii_block_size) char block[ascii_block_size];
+
+            const std::uint32_t letter_mask = normalize_ascii_block(bytes, block);
+            norm.append_ascii_block(block, ascii_block_size, letter_mask == ascii_block_mask);
+
+            idx += ascii_block_size;
+            continue;
+        }
+#endif
+        norm.append(decode_utf8(utf8, idx));
+    }
+}
+
+std::wstring utf8_to_wide(const std::string_view utf8)
+{
+    std::wstring wstr;
+    wstr.reserve(utf8.size());
+
+    std::size_t idx = 0;
+    while (idx != utf8.size())
+    {
+        const char32_t c = decode_utf8(utf8, idx);
+        if (sizeof(wchar_t) == 2 && c > 0xFFFF)
+        {
+            wstr.push_back(wchar_t(0xD800 + ((c - 0x10000) >> 10)));
+            wstr.push_back(wchar_t(0xDC00 + ((c - 0x10000) & 0x3FF)));
+        }
+        else
+        {
+            wstr.push_back(wchar_t(c));
+        }
+    }
+
+    return wstr;
+}
+
+std::string wide_to_utf8(const std::wstring_view wstr)
+{
+    std::string utf8;
+    utf8.reserve(wstr.size());
+
+    for (std::size_t idx = 0; idx != wstr.size(); ++idx)
+    {
+        char32_t c = char32_t(wstr[idx]);
+        if (c >= 0xD800 && c <= 0xDFFF)
+        {
+            const bool paired = sizeof(wchar_t) == 2 && c <= 0xDBFF && idx + 1 != wstr.size() &&
+                                wstr[idx + 1] >= 0xDC00 && wstr[idx + 1] <= 0xDFFF;
+            c = paired ? 0x10000 + ((c - 0xD800) << 10) + (char32_t(wstr[++idx]) - 0xDC00) : 0xFFFD;
+        }
+        else if (c > 0x10FFFF)
+        {
+            c = 0xFFFD;
+        }
+
+        if (c < 0x80)
+        {
+            utf8.push_back(char(c));
+        }
+        else if (c < 0x800)
+        {
+            utf8.push_back(char(0xC0 | (c >> 6)));
+            utf8.push_back(char(0x80 | (c & 0x3F)));
+        }
+        else if (c < 0x10000)
+        {
+            utf8.push_back(char(0xE0 | (c >> 12)));
+            utf8.push_back(char(0x80 | ((c >> 6) & 0x3F)));
+            utf8.push_back(char(0x80 | (c & 0x3F)));
+        }
+        else
+        {
+            utf8.push_back(char(0xF0 | (c >> 18)));
+            utf8.push_back(char(0x80 | ((c >> 12) & 0x3F)));
+            utf8.push_back(char(0x80 | ((c >> 6) & 0x3F)));
+            utf8.push_back(char(0x80 | (c & 0x3F)));
+        }
+    }
+
+    return utf8;
 }
 
 }  // namespace manelemax::stringutils
@@ -1,6 +1,9 @@
 #pragma once
 
+#include <cstdint>
+#include <iterator>
 #include <string>
+#include <string_view>
 #include <vector>
 
 namespace manelemax::stringutils
@@ -14,4 +17,109 @@ std::vector<std::string> split(const std::string& str);
 std::vector<std::string>
 all_word_aligned_substrings(const std::string& str, std::size_t max_words = 0);
 
+// Lazy range over the word aligned substrings of a text whose words are separated by single
+// spaces (e.g. normalized_text::text), in the same order as all_word_aligned_substrings: by word
+// count, then by position. The substrings are views into the text, nothing is copied.
+class word_aligned_substrings_view
+{
+public:
+    class iterator
+    {
+    public:
+        using value_type      = std::string_view;
+        using difference_type = std::ptrdiff_t;
+
+        iterator() = default;
+
+        std::string_view operator*() const
+        {
+            return text_.substr(begin_, end_ - begin_);
+        }
+
+        iterator& operator++();
+
+        iterator operator++(int)
+        {
+            iterator prev = *this;
+            ++*this;
+            return prev;
+        }
+
+        bool operator==(const iterator& other) const = default;
+
+        bool operator==(std::default_sentinel_t) const
+        {
+            return word_count_ == 0;
+        }
+
+    private:
+        friend class word_aligned_substrings_view;
+
+        iterator(std::string_view text, std::size_t max_words);
+
+        // Moves to the first substring with word_count words, or to the end if there is none
+        void first_with_word_count(std::size_t word_count);
+
+        std::string_view text_ {};
+        std::size_t      max_words_ {0};
+        std::size_t      word_count_ {0};
+        std::size_t      begin_ {0};
+        std::size_t      end_ {0};
+    };
+
+    explicit word_aligned_substrings_view(std::string_view text, std::size_t max_words = 0)
+        : text_ {text}
+        , max_words_ {max_words}
+    {
+    }
+
+    iterator begin() const
+    {
+        return iterator {text_, max_words_};
+    }
+
+    std::default_sentinel_t end() const
+    {
+        return std::default_sentinel;
+    }
+
+private:
+    std::string_view text_;
+    std::size_t      max_words_;
+};
+
+struct word_span
+{
+    std::uint32_t offset;
+    std::uint32_t length;
+};
+
+// Lowercase ASCII words separated by single spaces, without leading or trailing spaces
+struct normalized_text
+{
+    std::string            text;
+    std::vector<word_span> words;
+
+    std::string_view word(const word_span& span) const
+    {
+        return std::string_view {text}.substr(span.offset, span.length);
+    }
+};
+
+// Same result as remove_ro_diacritics, keep_alpha_and_spaces, to_lower and split combined, but in
+// a single pass and without depending on the current locale. The buffer is cleared first and
+// reused, so no allocation is made once it has grown to fit the input.
+void normalize_into(std::wstring_view wstr, normalized_text& out);
+
+// Same as above, for UTF-8 input. Malformed sequences are dropped like any other non-ASCII
+// character.
+void normalize_into(std::string_view utf8, normalized_text& out);
+
+// Malformed sequences are decoded as U+FFFD. Outside the BMP, wchar_t is UTF-16 on Windows and
+// UTF-32 elsewhere.
+std::wstring utf8_to_wide(std::string_view utf8);
+
+// The reverse of the above. Unpaired surrogates are encoded as U+FFFD.
+std::string wide_to_utf8(std::wstring_view wstr);
+
 }  // namespace manelemax::stringutils
@@ -1,157 +1,180 @@
-#include <shared_mutex>
 #include <atomic>
+#include <mutex>
+#include <shared_mutex>
+#include <unordered_map>
+#include <vector>
 
-#include <winrt/Windows.Foundation.h>
-#include <winrt/Windows.Media.Control.h>
-
+#include "event_trace.hpp"
+#include "metrics.hpp"
 #include "system_media_properties_notifier.hpp"
 
 namespace manelemax
 {
 
-using namespace winrt::Windows::Media::Control;
-
-struct system_media_properties_notifier::impl
+struct system_media_properties_notifier::impl : public media_session_backend::listener
 {
-public:
-    impl()
-        : session_manager_ {GlobalSystemMediaTransportControlsSessionManager::RequestAsync().get()}
-        , current_session_ {session_manager_.GetCurrentSession()}
+    void on_session_changed(
+        const std::string&                          id,
+        const media_session_backend::session_state& state
+    ) override
     {
-        session_manager_.CurrentSessionChanged(
-            [this](const auto& /*sender*/, const auto& /*args*/) {
-                current_session_ = session_manager_.GetCurrentSession();
-                on_session_changed();
-            }
-        );
-        on_session_changed();
-    }
+        const scoped_timer timer {metrics::histogram::notifier_callback};
+        metrics::add(metrics::counter::session_changes);
 
-    impl(const impl&)            = delete;
-    impl& operator=(const impl&) = delete;
-    impl(impl&&)                 = delete;
-    impl& operator=(impl&&)      = delete;
+        std::unique_lock lock {sessions_mutex_};
+        event_trace::record_session_changed(id, state);
 
-    void on_session_changed()
-    {
-        if (current_session_)
+        session* found = nullptr;
+        if (const auto idx = index_.find(id); idx != index_.end())
         {
-            current_session_.MediaPropertiesChanged(
-                [this](const auto& /*sender*/, const auto& /*args*/) { update_media_properties(); }
-            );
-
-            current_session_.PlaybackInfoChanged(
-                [this](const auto& /*sender*/, const auto& /*args*/) { update_playback_status(); }
-            );
-
-            update_media_properties();
-            update_playback_status();
+            found = &sessions_[idx->second];
         }
         else
         {
-            std::unique_lock lock {media_properties_mutex_};
-            if (currently_playing_)
-            {
-                currently_playing_ = false;
-                lock.unlock();
-
-                auto lsn = lsn_.load();
-                if (lsn)
-                {
-                    lsn_.load()->on_stop();
-                }
-            }
+            index_.emplace(id, sessions_.size());
+            found = &sessions_.emplace_back(session {.id = id, .state = {}});
+        }
+
+        if (state.playing && !found->state.playing)
+        {
+            found->started_at = ++start_count_;
         }
+        found->state = state;
+
+        update();
     }
 
-    void update_playback_status()
+    void on_session_removed(const std::string& id) override
     {
-        const auto media = current_session_.GetPlaybackInfo();
+        const scoped_timer timer {metrics::histogram::notifier_callback};
+        metrics::add(metrics::counter::session_removals);
 
-        const bool currently_playing =
-            media.PlaybackStatus() ==
-            GlobalSystemMediaTransportControlsSessionPlaybackStatus::Playing;
+        std::unique_lock lock {sessions_mutex_};
+        event_trace::record_session_removed(id);
 
-        std::unique_lock lock {media_properties_mutex_};
+        const auto idx = index_.find(id);
+        if (idx == index_.end())
+        {
+            return;
+        }
 
-        const bool changed_currently_playing = currently_playing_ != currently_playing;
-        const auto media_properties          = media_properties_;
+        // The last session takes the place of the removed one, so that they stay contiguous
+        const std::size_t removed = idx->second;
+        index_.erase(idx);
+        if (removed != sessions_.size() - 1)
+        {
+            sessions_[removed]            = std::move(sessions_.back());
+            index_[sessions_[removed].id] = removed;
+        }
+        sessions_.pop_back();
 
-        currently_playing_ = currently_playing;
+        update();
+    }
 
-        lock.unlock();
+    // The lock is held. Picks the session that drives again, and reports how its state changed:
+    // a new track while playing is a play event as well, a pause is a stop. The listener is called
+    // with the lock held, so that the events keep the order of the changes.
+    void update()
+    {
+        const session* const driving = policy_(sessions_);
 
-        if (!changed_currently_playing)
-        {
-            return;
-        }
+        const media_session_backend::session_state state =
+            driving != nullptr ? driving->state : media_session_backend::session_state {};
+
+        const bool started = state.playing && !driving_state_.playing;
+        const bool changed = state.playing && driving_state_.media_props != state.media_props;
+        const bool stopped = !state.playing && driving_state_.playing;
 
-        auto lsn = lsn_.load();
+        driving_state_ = state;
+
+        system_media_properties_notifier::listener* const lsn = lsn_.load();
         if (!lsn)
         {
             return;
         }
 
-        if (currently_playing)
+        if (started || changed)
         {
-            lsn->on_play(media_properties);
+            metrics::add(metrics::counter::play_events);
+            lsn->on_play(state.media_props);
         }
-        else
+        else if (stopped)
         {
+            metrics::add(metrics::counter::stop_events);
             lsn->on_stop();
         }
     }
 
-    void update_media_properties()
-    {
-        const auto media = current_session_.TryGetMediaPropertiesAsync().get();
+    // Indexed by id, the sessions are kept contiguous for the policy
+    std::vector<session>                         sessions_ {};
+    std::unordered_map<std::string, std::size_t> index_ {};
+    std::uint64_t                                start_count_ {0};
+    session_policy                               policy_ {&most_recently_started};
 
-        const properties new_media_props {
-            .artist = media.Artist().c_str(),
-            .title  = media.Title().c_str()
-        };
+    media_session_backend::session_state driving_state_ {};
+    std::shared_mutex                    sessions_mutex_ {};
 
-        const bool currently_playing = [&] {
-            std::unique_lock props_lock {media_properties_mutex_};
-            media_properties_ = new_media_props;
-            return currently_playing_;
-        }();
+    // Not the listener of the backend, which this is
+    std::atomic<system_media_properties_notifier::listener*> lsn_ {nullptr};
 
-        auto lsn = lsn_.load();
-        if (!lsn)
-        {
-            return;
-        }
+    // Last, so that it stops calling the members above before they are destroyed
+    std::unique_ptr<media_session_backend> backend_ {};
+};
 
-        if (currently_playing)
+const system_media_properties_notifier::session*
+system_media_properties_notifier::most_recently_started(const std::span<const session> sessions)
+{
+    const session* picked = nullptr;
+    for (const session& candidate : sessions)
+    {
+        if (picked == nullptr || (candidate.state.playing && !picked->state.playing) ||
+            (candidate.state.playing == picked->state.playing &&
+             candidate.started_at > picked->started_at))
         {
-            lsn_.load()->on_play(new_media_props);
+            picked = &candidate;
         }
     }
+    return picked;
+}
 
-    GlobalSystemMediaTransportControlsSessionManager session_manager_;
-    GlobalSystemMediaTransportControlsSession        current_session_;
+auto system_media_properties_notifier::make()
+    -> std::expected<system_media_properties_notifier, os_error>
+{
+    auto backend = media_session_backend::make_default();
+    if (!backend.has_value())
+    {
+        return std::unexpected {backend.error()};
+    }
 
-    properties        media_properties_ {};
-    bool              currently_playing_ {false};
-    std::shared_mutex media_properties_mutex_ {};
+    return make(*std::move(backend));
+}
 
-    std::atomic<listener*> lsn_ {nullptr};
-};
+auto system_media_properties_notifier::make(std::unique_ptr<media_session_backend> backend)
+    -> std::expected<system_media_properties_notifier, os_error>
+{
+    system_media_properties_notifier instance;
+    instance.impl_ = std::make_unique<impl>();
 
-system_media_properties_notifier::~system_media_properties_notifier() = default;
+    // Reports the sessions right away, which are not events yet, as there is no listener
+    instance.impl_->backend_ = std::move(backend);
+    instance.impl_->backend_->set_listener(instance.impl_.get());
 
-system_media_properties_notifier::system_media_properties_notifier()
-    : impl_ {std::make_unique<impl>()}
-{
+    return instance;
 }
 
+system_media_properties_notifier::system_media_properties_notifier(
+    system_media_properties_notifier&&
+) = default;
+system_media_properties_notifier&
+system_media_properties_notifier::operator=(system_media_properties_notifier&&) = default;
+system_media_properties_notifier::~system_media_properties_notifier()           = default;
+
 auto system_media_properties_notifier::get_media_props() const -> std::optional<properties>
 {
-    std::shared_lock lock {impl_->media_properties_mutex_};
-    if (impl_->currently_playing_)
+    std::shared_lock lock {impl_->sessions_mutex_};
+    if (impl_->driving_state_.playing)
     {
-        return impl_->media_properties_;
+        return impl_->driving_state_.media_props;
     }
     return std::nullopt;
 }
@@ -161,4 +184,11 @@ void system_media_properties_notifier::set_listener(listener* const lsn)
     impl_->lsn_ = lsn;
 }
 
+void system_media_properties_notifier::set_policy(session_policy policy)
+{
+    std::unique_lock lock {impl_->sessions_mutex_};
+    impl_->policy_ = std::move(policy);
+    impl_->update();
+}
+
 }  // namespace manelemax
@@ -1,21 +1,45 @@
 #pragma once
 
+#include <cstdint>
+#include <expected>
+#include <functional>
 #include <optional>
+#include <span>
 #include <string>
 #include <memory>
 
+#include "media_session_backend.hpp"
+#include "os_error.hpp"
+
 namespace manelemax
 {
 
+// Turns the session changes of a media_session_backend into play and stop events.
+//
+// Every session is tracked, and a policy picks the one that drives them, so that a player keeps
+// driving while another one is merely focused.
 class system_media_properties_notifier
 {
 public:
-    struct properties
+    using properties = media_session_backend::properties;
+
+    struct session
     {
-        std::wstring artist;
-        std::wstring title;
+        std::string                          id;
+        media_session_backend::session_state state;
+
+        // The order in which the sessions last started playing, 0 for the ones that never did
+        std::uint64_t started_at {0};
     };
 
+    // Returns the session that drives the events, one of the given ones, or null for none. Runs
+    // on a thread of the backend, one call at a time.
+    using session_policy = std::move_only_function<const session*(std::span<const session>)>;
+
+    // The default policy: the session that started playing last, else the one that was paused
+    // last
+    static const session* most_recently_started(std::span<const session> sessions);
+
     struct listener
     {
         virtual ~listener() = default;
@@ -24,15 +48,29 @@ public:
         virtual void on_stop()                              = 0;
     };
 
-    system_media_properties_notifier();
+    static std::expected<system_media_properties_notifier, os_error> make();
+
+    // Same as above, over the given backend instead of the one of the platform
+    static std::expected<system_media_properties_notifier, os_error>
+    make(std::unique_ptr<media_session_backend> backend);
+
+    system_media_properties_notifier(system_media_properties_notifier&&);
+    system_media_properties_notifier& operator=(system_media_properties_notifier&&);
+
     ~system_media_properties_notifier();
 
+    // The properties of the session that drives, if it plays
     std::optional<properties> get_media_props() const;
     void                      set_listener(listener* lsn);
 
+    // Picks the session that drives again, with the new policy
+    void set_policy(session_policy policy);
+
 private:
     struct impl;
 
+    system_media_properties_notifier() = default;
+
     std::unique_ptr<impl> impl_;
 };
 
@@ -1,16 +1,22 @@
 #include <algorithm>
+#include <filesystem>
 #include <format>
+#include <string>
+#include <system_error>
 
+#include "metrics.hpp"
 #include "systray_icon.hpp"
 #include "resource.h"
 
 namespace manelemax
 {
 
-static constexpr UINT g_systray_notif_msg     = WM_USER + 0x100;
-static constexpr WORD g_context_menu_cmd_exit = 101;
+static constexpr UINT g_systray_notif_msg             = WM_USER + 0x100;
+static constexpr WORD g_context_menu_cmd_exit         = 101;
+static constexpr WORD g_context_menu_cmd_show_metrics = 102;
+static constexpr WORD g_context_menu_cmd_save_metrics = 103;
 
-std::function<std::string()> systray_icon::current_match_fn_;
+std::function<match_state()> systray_icon::current_state_fn_;
 
 std::expected<systray_icon, win32_error> systray_icon::make(const HINSTANCE hInstance)
 {
@@ -185,6 +191,25 @@ void systray_icon::context_menu_cmd(const HWND hWnd, const WORD cmd)
         case g_context_menu_cmd_exit:
         {
             ::PostMessageA(hWnd, WM_CLOSE, 0, 0);
+            break;
+        }
+        case g_context_menu_cmd_show_metrics:
+        {
+            const std::string text = metrics::take_snapshot().format();
+            ::MessageBoxA(hWnd, text.c_str(), "ManeleMax statistics", MB_OK | MB_ICONINFORMATION);
+            break;
+        }
+        case g_context_menu_cmd_save_metrics:
+        {
+            std::error_code             ec;
+            const std::filesystem::path path =
+                std::filesystem::temp_directory_path(ec) / "manelemax-metrics.txt";
+
+            const std::string text = !ec && metrics::take_snapshot().save(path) ?
+                                         std::format("Statistics saved to {}", path.string()) :
+                                         std::string {"The statistics could not be saved"};
+            ::MessageBoxA(hWnd, text.c_str(), "ManeleMax", MB_OK | MB_ICONINFORMATION);
+            break;
         }
     }
 }
@@ -203,12 +228,12 @@ void systray_icon::display_context_menu(const HWND hWnd)
         return;
     }
 
-    if (current_match_fn_)
+    if (current_state_fn_)
     {
-        const std::string current_match = current_match_fn_();
-        const std::string menu_text     = current_match.empty() ?
-                                              "No manele playing" :
-                                              std::format("Match found: {}", current_match);
+        const match_state crt_state = current_state_fn_();
+        const std::string menu_text = crt_state.keyword().empty() ?
+                                          "No manele playing" :
+                                          std::format("Match found: {}", crt_state.keyword());
 
         if (::InsertMenuA(
                 hMenu,
@@ -223,8 +248,22 @@ void systray_icon::display_context_menu(const HWND hWnd)
         }
     }
 
-    if (::InsertMenuA(hMenu, -1, MF_BYPOSITION | MF_STRING, g_context_menu_cmd_exit, "Exit") ==
-        FALSE)
+    if (::InsertMenuA(
+            hMenu,
+            -1,
+            MF_BYPOSITION | MF_STRING,
+            g_context_menu_cmd_show_metrics,
+            "Statistics"
+        ) == FALSE ||
+        ::InsertMenuA(
+            hMenu,
+            -1,
+            MF_BYPOSITION | MF_STRING,
+            g_context_menu_cmd_save_metrics,
+            "Save statistics"
+        ) == FALSE ||
+        ::InsertMenuA(hMenu, -1, MF_BYPOSITION | MF_STRING, g_context_menu_cmd_exit, "Exit") ==
+            FALSE)
     {
         ::DestroyMenu(hMenu);
         return;
@@ -3,11 +3,11 @@
 #include <expected>
 #include <memory>
 #include <functional>
-#include <string>
 
 #include <Windows.h>
 #include <shellapi.h>
 
+#include "match_state.hpp"
 #include "win32_error.hpp"
 
 namespace manelemax
@@ -43,9 +43,10 @@ public:
 
     void process_messages();
 
-    static void set_current_match_fn(std::function<std::string()>&& fn)
+    // Read each time the context menu opens, see auto_dj::current_state()
+    static void set_current_state_fn(std::function<match_state()>&& fn)
     {
-        current_match_fn_ = std::move(fn);
+        current_state_fn_ = std::move(fn);
     }
 
 private:
@@ -58,7 +59,7 @@ private:
     HWND                             hWnd_ {nullptr};
     std::unique_ptr<NOTIFYICONDATAA> nidata_ {nullptr};
 
-    static std::function<std::string()> current_match_fn_;
+    static std::function<match_state()> current_state_fn_;
 };
 
 }  // namespace manelemax
@@ -0,0 +1,189 @@
+#include "track_classifier.hpp"
+
+#include <algorithm>
+#include <charconv>
+#include <chrono>
+#include <span>
+#include <type_traits>
+
+#include "metrics.hpp"
+
+namespace manelemax
+{
+
+track_classifier::track_classifier(const std::uint32_t threshold)
+    : threshold_ {threshold}
+{
+}
+
+template<typename Fn>
+void track_classifier::for_each_match(
+    const keyword_matcher& matcher,
+    const std::string_view text,
+    Fn&&                   fn
+)
+{
+    matcher.for_each_match(text, fn);
+}
+
+template<typename Fn>
+void track_classifier::for_each_match(
+    const fuzzy_keyword_matcher& matcher,
+    const std::string_view       text,
+    Fn&&                         fn
+)
+{
+    matcher.for_each_match(text, corrected_, fn);
+}
+
+template<typename Matcher, typename String>
+auto track_classifier::classify_impl(
+    const Matcher& matcher,
+    const String   artist,
+    const String   title
+) -> result
+{
+    const keyword_matcher& exact = [&matcher]() -> const keyword_matcher& {
+        if constexpr (std::is_same_v<Matcher, fuzzy_keyword_matcher>)
+        {
+            return matcher.exact();
+        }
+        else
+        {
+            return matcher;
+        }
+    }();
+
+    result res;
+    field  crt_field = field::artist;
+
+    const auto add_match = [&](const std::uint16_t idx) {
+        const std::string_view keyword = exact.keyword(idx);
+
+        const auto matches = std::span {res.matches}.first(res.match_count);
+        if (res.match_count == max_matches ||
+            std::ranges::any_of(matches, [&](const match& previous) {
+                return previous.matched_field == crt_field && previous.keyword == keyword;
+            }))
+        {
+            return;
+        }
+
+        const keyword_field expected = exact.field(idx);
+        const bool          elsewhere =
+            (expected == keyword_field::artist && crt_field != field::artist) ||
+            (expected == keyword_field::title && crt_field != field::title);
+
+        const std::uint16_t points = elsewhere ? exact.weight(idx) / 2 : exact.weight(idx);
+
+        res.matches[res.match_count++] = {
+            .keyword       = keyword,
+            .matched_field = crt_field,
+            .points        = points
+        };
+        res.score += points;
+    };
+
+    using clock = std::chrono::steady_clock;
+
+    clock::duration normalize_time {};
+    clock::duration match_time {};
+
+    const auto classify_field = [&](const String text) {
+        if (!timed_)
+        {
+            stringutils::normalize_into(text, normalized_);
+            for_each_match(matcher, normalized_.text, add_match);
+            return;
+        }
+
+        const clock::time_point start = clock::now();
+        stringutils::normalize_into(text, normalized_);
+        const clock::time_point normalized = clock::now();
+        for_each_match(matcher, normalized_.text, add_match);
+
+        normalize_time += normalized - start;
+        match_time += clock::now() - normalized;
+    };
+
+    classify_field(artist);
+    crt_field = field::title;
+    classify_field(title);
+
+    if (timed_)
+    {
+        metrics::record(metrics::histogram::normalize, normalize_time);
+        metrics::record(metrics::histogram::keyword_match, match_time);
+    }
+
+    if (res.score >= threshold_ && res.match_count != 0)
+    {
+        // The first one on ties, the artist before the title
+        const auto   matches   = std::span {res.matches}.first(res.match_count);
+        const match& strongest = *std::ranges::max_element(
+            matches,
+            [](const match& lhs, const match& rhs) { return lhs.points < rhs.points; }
+        );
+        res.keyword       = strongest.keyword;
+        res.matched_field = strongest.matched_field;
+    }
+
+    return res;
+}
+
+auto track_classifier::classify(
+    const keyword_matcher&  matcher,
+    const std::wstring_view artist,
+    const std::wstring_view title
+) -> result
+{
+    return classify_impl(matcher, artist, title);
+}
+
+auto track_classifier::classify(
+    const keyword_matcher& matcher,
+    const std::string_view artist,
+    const std::string_view title
+) -> result
+{
+    return classify_impl(matcher, artist, title);
+}
+
+auto track_classifier::classify(
+    const fuzzy_keyword_matcher& matcher,
+    const std::wstring_view      artist,
+    const std::wstring_view      title
+) -> result
+{
+    return classify_impl(matcher, artist, title);
+}
+
+auto track_classifier::classify(
+    const fuzzy_keyword_matcher& matcher,
+    const std::string_view       artist,
+    const std::string_view       title
+) -> result
+{
+    return classify_impl(matcher, artist, title);
+}
+
+void track_classifier::append_breakdown(const result& res, std::string& out)
+{
+    for (std::size_t idx = 0; idx != res.match_count; ++idx)
+    {
+        const match& m = res.matches[idx];
+        if (idx != 0)
+        {
+            out.append(", ");
+        }
+
+        out.append(m.keyword);
+        out.append(m.matched_field == field::artist ? " (artist) " : " (title) ");
+
+        char       points[8];
+        const auto printed = std::to_chars(std::begin(points), std::end(points), m.points);
+        out.append(points, printed.ptr);
+    }
+}
+
+}  // namespace manelemax
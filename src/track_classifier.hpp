@@ -0,0 +1,110 @@
+#pragma once
+
+#include <array>
+#include <cstdint>
+#include <string>
+#include <string_view>
+
+#include "fuzzy_keyword_matcher.hpp"
+#include "keyword_matcher.hpp"
+#include "string_utils.hpp"
+
+namespace manelemax
+{
+
+// Decides whether a track is manele by adding up the weights of the keywords found in its artist
+// and title, in one pass over each. A keyword found in the other field than the one it is
+// expected in counts for half. The track is manele when the score reaches the threshold, so that
+// a short keyword that is also a common word is not enough on its own.
+//
+// It owns the normalization buffer, so each thread needs its own instance. The matcher is passed
+// on every call since the keywords can be reloaded between tracks. The returned keywords point
+// into the matcher's string pool.
+class track_classifier
+{
+public:
+    enum class field
+    {
+        none,
+        artist,
+        title
+    };
+
+    // One keyword with a keyword_matcher::default_weight is enough for any field
+    static constexpr std::uint32_t default_threshold {keyword_matcher::default_weight};
+
+    // Only the first ones count, a keyword found again in the same field does not
+    static constexpr std::size_t max_matches {8};
+
+    struct match
+    {
+        std::string_view keyword {};
+        field            matched_field {field::none};
+        std::uint16_t    points {0};
+    };
+
+    struct result
+    {
+        // The match with the most points, only set when the score reaches the threshold
+        std::string_view keyword {};
+        field            matched_field {field::none};
+
+        // The breakdown of the score, in the order of the matches
+        std::uint32_t                  score {0};
+        std::array<match, max_matches> matches {};
+        std::uint8_t                   match_count {0};
+    };
+
+    explicit track_classifier(std::uint32_t threshold = default_threshold);
+
+    std::uint32_t threshold() const
+    {
+        return threshold_;
+    }
+
+    // Records the time taken by the normalization and by the matching of every track into the
+    // metrics. Off by default, the offline tools classify millions of tracks.
+    void set_timed(const bool timed)
+    {
+        timed_ = timed;
+    }
+
+    result
+    classify(const keyword_matcher& matcher, std::wstring_view artist, std::wstring_view title);
+
+    // Same as above, for UTF-8 input
+    result
+    classify(const keyword_matcher& matcher, std::string_view artist, std::string_view title);
+
+    // Same as above, with keywords misspelled within a few edits matching as well. A field with an
+    // exact match is not corrected.
+    result classify(
+        const fuzzy_keyword_matcher& matcher,
+        std::wstring_view            artist,
+        std::wstring_view            title
+    );
+
+    result
+    classify(const fuzzy_keyword_matcher& matcher, std::string_view artist, std::string_view title);
+
+    // Appends the matches of the result as "keyword (field) points, ...", the format shared by
+    // auto_dj and manelemax-classify
+    static void append_breakdown(const result& res, std::string& out);
+
+private:
+    template<typename Matcher, typename String>
+    result classify_impl(const Matcher& matcher, String artist, String title);
+
+    template<typename Fn>
+    void for_each_match(const keyword_matcher& matcher, std::string_view text, Fn&& fn);
+
+    template<typename Fn>
+    void for_each_match(const fuzzy_keyword_matcher& matcher, std::string_view text, Fn&& fn);
+
+    std::uint32_t                threshold_;
+    bool                         timed_ {false};
+    stringutils::normalized_text normalized_ {};
+    std::string                  corrected_ {};
+};
+
+}  // namespace manelemax
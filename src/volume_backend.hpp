@@ -0,0 +1,65 @@
+#pragma once
+
+#include <expected>
+#include <memory>
+#include <optional>
+
+#include "application.hpp"
+#include "os_error.hpp"
+
+namespace manelemax
+{
+
+// Volume and mute state of the default audio output of the platform: WASAPI on Windows, PulseAudio
+// elsewhere, which PipeWire also serves through pipewire-pulse.
+//
+// The volume is a scalar between 0 and 1, as shown by the volume slider of the platform.
+//
+// The target may be moved to the audio streams of one application, so that the other ones, like a
+// call, keep their volume.
+class volume_backend
+{
+public:
+    // The state of the target, the endpoint or the streams of the application
+    struct endpoint
+    {
+        float volume {0.0f};
+        bool  muted {false};
+    };
+
+    struct listener
+    {
+        virtual ~listener() = default;
+
+        // The whole state, after any change to it. Runs on a thread of the backend, and must not
+        // call back into it.
+        virtual void on_endpoint_changed(const endpoint& new_endpoint) = 0;
+
+        // Another endpoint became the default one, follow_default() moves to it. Same as above,
+        // the notification thread is left right away.
+        virtual void on_default_changed() = 0;
+    };
+
+    // Defined by the backend compiled for the platform
+    static std::expected<std::unique_ptr<volume_backend>, os_error> make_default();
+
+    // Returns once the listener is no longer called, and never will be
+    virtual ~volume_backend() = default;
+
+    virtual std::expected<endpoint, os_error> get()                 = 0;
+    virtual std::expected<void, os_error>     set_volume(float vol) = 0;
+    virtual std::expected<void, os_error>     set_muted(bool muted) = 0;
+
+    // At most once. The changes made through set_*() may be reported as well.
+    virtual std::expected<void, os_error> set_listener(listener* lsn) = 0;
+
+    // Moves get(), set_*() and the notifications to the audio streams of the application, or back
+    // to the endpoint for none. The streams it opens afterwards are picked up as they appear, and
+    // reported then; until it has one, the target reads as full volume, unmuted.
+    virtual void set_target(const std::optional<application>& app) = 0;
+
+    // Moves to the endpoint which is the default one now, if it changed, with the same target
+    virtual std::expected<void, os_error> follow_default() = 0;
+};
+
+}  // namespace manelemax
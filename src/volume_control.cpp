@@ -1,159 +1,286 @@
 #include "volume_control.hpp"
 
+#include <cmath>
+#include <mutex>
+
+#include "event_trace.hpp"
+#include "metrics.hpp"
+
 namespace manelemax
 {
 
-class volume_control_callback : public IAudioEndpointVolumeCallback
+// Below the resolution of the volume slider, the endpoint may round the scalars it reports
+static constexpr float g_volume_epsilon {0.001f};
+
+static bool same_volume(const float lhs, const float rhs)
 {
-public:
-    volume_control_callback(const GUID& guid_context, volume_control::listener* const lsn)
-        : guid_context_ {guid_context}
-        , lsn_ {lsn}
-    {
-    }
+    return std::abs(lhs - rhs) < g_volume_epsilon;
+}
 
-    ULONG STDMETHODCALLTYPE AddRef() override
+class volume_control_callback : public volume_backend::listener
+{
+public:
+    volume_control_callback(
+        volume_control::listener* const                 lsn,
+        std::shared_ptr<volume_control::endpoint_state> state
+    )
+        : lsn_ {lsn}
+        , state_ {std::move(state)}
     {
-        return InterlockedIncrement(&ref_count_);
     }
 
-    ULONG STDMETHODCALLTYPE Release() override
+    void on_endpoint_changed(const volume_backend::endpoint& new_endpoint) override
     {
-        const ULONG ref = InterlockedDecrement(&ref_count_);
-        if (ref == 0)
+        // A notification carries both values, only the ones that changed are reported
+        float old_volume = 0.0f;
+        bool  old_muted  = false;
         {
-            delete this;
-        }
-        return ref;
-    }
+            std::lock_guard lock {state_->trace_mutex};
+            old_volume = state_->volume.exchange(new_endpoint.volume);
+            old_muted  = state_->muted.exchange(new_endpoint.muted);
 
-    HRESULT STDMETHODCALLTYPE QueryInterface(REFIID riid, VOID** ppvInterface) override
-    {
-        if (IID_IUnknown == riid)
-        {
-            AddRef();
-            *ppvInterface = (IUnknown*) this;
+            if (!same_volume(old_volume, new_endpoint.volume) || old_muted != new_endpoint.muted)
+            {
+                event_trace::record_endpoint(event_trace::kind::endpoint_changed, new_endpoint);
+            }
         }
-        else if (__uuidof(IAudioEndpointVolumeCallback) == riid)
+
+        if (!same_volume(old_volume, new_endpoint.volume))
         {
-            AddRef();
-            *ppvInterface = (IAudioEndpointVolumeCallback*) this;
+            metrics::add(metrics::counter::external_volume_changes);
+            lsn_->on_volume_changed(old_volume, new_endpoint.volume);
         }
-        else
+        if (old_muted != new_endpoint.muted)
         {
-            *ppvInterface = NULL;
-            return E_NOINTERFACE;
+            metrics::add(metrics::counter::external_mute_changes);
+            lsn_->on_muted_state_changed(new_endpoint.muted);
         }
-        return S_OK;
     }
 
-    HRESULT STDMETHODCALLTYPE OnNotify(PAUDIO_VOLUME_NOTIFICATION_DATA pNotify) override
+    void on_default_changed() override
     {
-        if (pNotify == NULL)
-        {
-            return E_INVALIDARG;
-        }
-        if (pNotify->guidEventContext == guid_context_)
-        {
-            return S_OK;
-        }
-
-        if (lsn_)
-        {
-            lsn_->on_volume_changed(pNotify->fMasterVolume);
-            lsn_->on_muted_state_changed(pNotify->bMuted);
-        }
-
-        return S_OK;
+        event_trace::record_default_changed();
+        lsn_->on_device_changed();
     }
 
 private:
-    GUID                      guid_context_;
     volume_control::listener* lsn_;
-    ULONG                     ref_count_ {1};
+
+    std::shared_ptr<volume_control::endpoint_state> state_;
 };
 
-std::expected<volume_control, win32_com_error> volume_control::make()
+std::expected<volume_control, os_error>
+volume_control::make(const clock::duration enforcement_interval)
+{
+    auto backend = volume_backend::make_default();
+    if (!backend.has_value())
+    {
+        return std::unexpected {backend.error()};
+    }
+
+    return make(*std::move(backend), enforcement_interval);
+}
+
+std::expected<volume_control, os_error> volume_control::make(
+    std::unique_ptr<volume_backend> backend,
+    const clock::duration           enforcement_interval
+)
 {
-    constexpr CLSID CLSID_MMDeviceEnumerator = __uuidof(MMDeviceEnumerator);
-    constexpr IID   IID_IMMDeviceEnumerator  = __uuidof(IMMDeviceEnumerator);
-    constexpr IID   IID_IAudioEndpointVolume = __uuidof(IAudioEndpointVolume);
+    const auto endpoint = backend->get();
+    if (!endpoint.has_value())
+    {
+        return std::unexpected {endpoint.error()};
+    }
 
-    HRESULT result;
+    event_trace::record_endpoint(event_trace::kind::endpoint_opened, *endpoint);
 
     volume_control instance;
 
-    result = CoCreateGuid(&instance.guid_context_);
-    if (FAILED(result))
+    instance.state_                = std::make_shared<endpoint_state>();
+    instance.state_->volume        = endpoint->volume;
+    instance.state_->muted         = endpoint->muted;
+    instance.enforcement_interval_ = enforcement_interval;
+    instance.backend_              = std::move(backend);
+
+    return instance;
+}
+
+volume_control::volume_control(volume_control&&) = default;
+volume_control::~volume_control()                = default;
+
+volume_control& volume_control::operator=(volume_control&& other)
+{
+    // The backend that is replaced may still call its callback until it is destroyed, so it goes
+    // first, unlike with the member order
+    backend_  = std::move(other.backend_);
+    callback_ = std::move(other.callback_);
+
+    state_                   = std::move(other.state_);
+    target_                  = std::move(other.target_);
+    enforcement_interval_    = other.enforcement_interval_;
+    last_volume_enforcement_ = other.last_volume_enforcement_;
+    last_mute_enforcement_   = other.last_mute_enforcement_;
+
+    return *this;
+}
+
+std::expected<void, os_error> volume_control::set_application(const std::optional<application>& app)
+{
+    // An unknown application is no target. The presence is compared first, so that no empty
+    // optional is ever read.
+    const bool known = app.has_value() && app->known();
+    if (known ? target_.has_value() && *target_ == *app : !target_.has_value())
+    {
+        return {};
+    }
+
+    target_ = known ? app : std::nullopt;
+    backend_->set_target(target_);
+
+    return refresh_state();
+}
+
+std::expected<void, os_error> volume_control::follow_default()
+{
+    if (const auto result = backend_->follow_default(); !result.has_value())
     {
-        return std::unexpected {win32_com_error {"CoCreateGuid", result}};
+        return std::unexpected {result.error()};
     }
 
-    IMMDeviceEnumerator* mm_device_enumerator;
-    if (const HRESULT result = CoCreateInstance(
-            CLSID_MMDeviceEnumerator,
-            nullptr,
-            CLSCTX_ALL,
-            IID_IMMDeviceEnumerator,
-            reinterpret_cast<void**>(&mm_device_enumerator)
-        );
-        FAILED(result))
+    return refresh_state();
+}
+
+std::expected<void, os_error> volume_control::refresh_state()
+{
+    const auto endpoint = backend_->get();
+    if (!endpoint.has_value())
     {
-        return std::unexpected {win32_com_error {"CoCreateInstance", result}};
+        return std::unexpected {endpoint.error()};
     }
-    instance.mm_device_enumerator_.reset(mm_device_enumerator);
+    state_->volume = endpoint->volume;
+    state_->muted  = endpoint->muted;
+
+    return {};
+}
 
-    IMMDevice* mm_device;
-    if (const HRESULT result = instance.mm_device_enumerator_
-                                   ->GetDefaultAudioEndpoint(eRender, eMultimedia, &mm_device);
-        FAILED(result))
+// The state is updated before the write, so that the backends which notify their own writes do
+// not report them as changes made by someone else
+std::expected<void, os_error> volume_control::set_muted(const bool muted)
+{
     {
-        return std::unexpected {
-            win32_com_error {"IMMDeviceEnumerator::GetDefaultAudioEndpoint", result}
-        };
+        std::lock_guard lock {state_->trace_mutex};
+        if (state_->muted.exchange(muted) == muted)
+        {
+            return {};
+        }
+        event_trace::record_mute_written(muted);
     }
-    instance.mm_device_.reset(mm_device);
 
-    IAudioEndpointVolume* audio_endpoint_volume;
-    if (const HRESULT result = instance.mm_device_->Activate(
-            IID_IAudioEndpointVolume,
-            CLSCTX_ALL,
-            nullptr,
-            reinterpret_cast<void**>(&audio_endpoint_volume)
-        );
-        FAILED(result))
+    const scoped_timer timer {metrics::histogram::set_muted};
+    metrics::add(metrics::counter::mute_writes);
+
+    if (const auto result = backend_->set_muted(muted); !result.has_value())
     {
-        return std::unexpected {win32_com_error {"IMMDevice::Activate", result}};
+        metrics::add(metrics::counter::failed_writes);
+        state_->muted = !muted;
+        return std::unexpected {result.error()};
     }
-    instance.audio_endpoint_volume_.reset(audio_endpoint_volume);
 
-    return instance;
+    return {};
 }
 
-std::expected<void, win32_com_error> volume_control::set_muted(bool muted) const
+std::expected<void, os_error> volume_control::set_volume(const float vol)
 {
-    if (const HRESULT result = audio_endpoint_volume_->SetMute(muted, &guid_context_);
-        FAILED(result))
+    float old_volume = 0.0f;
+    {
+        std::lock_guard lock {state_->trace_mutex};
+        old_volume = state_->volume.exchange(vol);
+        if (same_volume(old_volume, vol))
+        {
+            return {};
+        }
+        event_trace::record_volume_written(vol);
+    }
+
+    const scoped_timer timer {metrics::histogram::set_volume};
+    metrics::add(metrics::counter::volume_writes);
+
+    if (const auto result = backend_->set_volume(vol); !result.has_value())
     {
-        return std::unexpected {win32_com_error {"IAudioEndpointVolume::SetMute", result}};
+        metrics::add(metrics::counter::failed_writes);
+        state_->volume = old_volume;
+        return std::unexpected {result.error()};
     }
+
     return {};
 }
 
-std::expected<void, win32_com_error> volume_control::set_volume(float vol) const
+auto volume_control::enforce_unmuted(const clock::time_point now)
+    -> std::expected<clock::duration, os_error>
 {
-    if (const HRESULT result =
-            audio_endpoint_volume_->SetMasterVolumeLevelScalar(vol, &guid_context_);
-        FAILED(result))
+    if (!state_->muted)
     {
-        return std::unexpected {
-            win32_com_error {"IAudioEndpointVolume::SetMasterVolumeLevelScalar", result}
-        };
+        return clock::duration::zero();
     }
-    return {};
+
+    if (const clock::duration delay =
+            rate_limit(last_mute_enforcement_, enforcement_interval_, now);
+        delay != clock::duration::zero())
+    {
+        metrics::add(metrics::counter::deferred_enforcements);
+        return delay;
+    }
+
+    if (const auto result = set_muted(false); !result.has_value())
+    {
+        return std::unexpected {result.error()};
+    }
+
+    metrics::add(metrics::counter::mute_enforcements);
+    return clock::duration::zero();
+}
+
+auto volume_control::enforce_volume(const float vol, const clock::time_point now)
+    -> std::expected<clock::duration, os_error>
+{
+    if (same_volume(state_->volume, vol))
+    {
+        return clock::duration::zero();
+    }
+
+    if (const clock::duration delay =
+            rate_limit(last_volume_enforcement_, enforcement_interval_, now);
+        delay != clock::duration::zero())
+    {
+        metrics::add(metrics::counter::deferred_enforcements);
+        return delay;
+    }
+
+    if (const auto result = set_volume(vol); !result.has_value())
+    {
+        return std::unexpected {result.error()};
+    }
+
+    metrics::add(metrics::counter::volume_enforcements);
+    return clock::duration::zero();
+}
+
+auto volume_control::rate_limit(
+    clock::time_point&      last_write,
+    const clock::duration   interval,
+    const clock::time_point now
+) -> clock::duration
+{
+    if (now - last_write < interval)
+    {
+        return interval - (now - last_write);
+    }
+
+    last_write = now;
+    return clock::duration::zero();
 }
 
-std::expected<void, win32_com_error> volume_control::set_listener(listener* const lsn)
+std::expected<void, os_error> volume_control::set_listener(listener* const lsn)
 {
     if (lsn == nullptr)
     {
@@ -161,22 +288,18 @@ std::expected<void, win32_com_error> volume_control::set_listener(listener* cons
     }
 
     // Allow only once
-    if (audio_endpoint_volume_cb_)
+    if (callback_)
     {
         return {};
     }
 
-    com_ptr<IAudioEndpointVolumeCallback> cb_obj {new volume_control_callback {guid_context_, lsn}};
-
-    if (const HRESULT result = audio_endpoint_volume_->RegisterControlChangeNotify(cb_obj.get());
-        FAILED(result))
+    auto callback = std::make_unique<volume_control_callback>(lsn, state_);
+    if (const auto result = backend_->set_listener(callback.get()); !result.has_value())
     {
-        return std::unexpected {
-            win32_com_error {"IAudioEndpointVolume::RegisterControlChangeNotify", result}
-        };
+        return std::unexpected {result.error()};
     }
 
-    audio_endpoint_volume_cb_ = std::move(cb_obj);
+    callback_ = std::move(callback);
 
     return {};
 }
@@ -1,43 +1,114 @@
 #pragma once
 
+#include <atomic>
+#include <chrono>
 #include <expected>
-#include <functional>
+#include <memory>
+#include <mutex>
+#include <optional>
 
-#include <endpointvolume.h>
-#include <mmdeviceapi.h>
-
-#include "win32_error.hpp"
-#include "com_ptr.hpp"
+#include "application.hpp"
+#include "os_error.hpp"
+#include "volume_backend.hpp"
 
 namespace manelemax
 {
 
+class volume_control_callback;
+
+// Volume and mute state of the default audio endpoint, or of the audio streams of one application
+// on it.
+//
+// The last known state, either applied here or notified by the endpoint, is tracked so that the
+// writes that would not change anything are skipped and the listener only hears about the real
+// changes made by someone else.
 class volume_control
 {
 public:
-    static std::expected<volume_control, win32_com_error> make();
+    using clock = std::chrono::steady_clock;
+
+    // The enforce_*() writes are limited to one per enforcement interval
+    static std::expected<volume_control, os_error> make(clock::duration enforcement_interval);
+
+    // Same as above, over the given backend instead of the one of the platform
+    static std::expected<volume_control, os_error>
+    make(std::unique_ptr<volume_backend> backend, clock::duration enforcement_interval);
+
+    volume_control(volume_control&&);
+    volume_control& operator=(volume_control&&);
+
+    ~volume_control();
+
+    std::expected<void, os_error> set_muted(bool muted);
+    std::expected<void, os_error> set_volume(float vol);
+
+    // Moves the control to the streams of the application, or back to the endpoint for none, or
+    // for an application that is not known(). The state of the new target becomes the last known
+    // one, without being reported.
+    std::expected<void, os_error> set_application(const std::optional<application>& app);
+
+    // Moves the control to the endpoint which is the default one now, see
+    // volume_backend::follow_default(). Its state becomes the last known one, without being
+    // reported.
+    std::expected<void, os_error> follow_default();
+
+    // Last known volume, which may have been changed by someone else since
+    float volume() const
+    {
+        return state_->volume.load();
+    }
 
-    std::expected<void, win32_com_error> set_muted(bool muted) const;
-    std::expected<void, win32_com_error> set_volume(float vol) const;
+    // Same as above, to undo a change made by someone else, like a user dragging the slider. A
+    // write coming too soon after the previous one is deferred: nothing is written and the delay
+    // after which to call again is returned, zero otherwise. The time is the one of the caller's
+    // clock, which may be a manual one.
+    std::expected<clock::duration, os_error> enforce_unmuted(clock::time_point now);
+    std::expected<clock::duration, os_error> enforce_volume(float vol, clock::time_point now);
 
     struct listener
     {
         virtual ~listener() = default;
 
-        virtual void on_volume_changed(float vol)       = 0;
-        virtual void on_muted_state_changed(bool muted) = 0;
+        virtual void on_volume_changed(float old_vol, float new_vol) = 0;
+        virtual void on_muted_state_changed(bool muted)              = 0;
+
+        // Another endpoint became the default one, follow_default() is to be called
+        virtual void on_device_changed() = 0;
     };
 
-    std::expected<void, win32_com_error> set_listener(listener* lsn);
+    std::expected<void, os_error> set_listener(listener* lsn);
 
 private:
+    friend class volume_control_callback;
+
+    // Shared with the notification callback, which runs on a thread of the backend
+    struct endpoint_state
+    {
+        std::atomic<float> volume {0.0f};
+        std::atomic<bool>  muted {false};
+
+        // Taken to apply a change and record it, so that the event trace has the changes in
+        // the order they were applied. Never held while calling into the backend.
+        std::mutex trace_mutex {};
+    };
+
     volume_control() noexcept = default;
 
-    GUID                                  guid_context_ {};
-    com_ptr<IMMDeviceEnumerator>          mm_device_enumerator_ {nullptr};
-    com_ptr<IMMDevice>                    mm_device_ {nullptr};
-    com_ptr<IAudioEndpointVolume>         audio_endpoint_volume_ {nullptr};
-    com_ptr<IAudioEndpointVolumeCallback> audio_endpoint_volume_cb_ {nullptr};
+    static clock::duration
+    rate_limit(clock::time_point& last_write, clock::duration interval, clock::time_point now);
+
+    // Reads the state of the target again, after it moved
+    std::expected<void, os_error> refresh_state();
+
+    std::shared_ptr<endpoint_state> state_ {};
+    std::optional<application>      target_ {};
+    clock::duration                 enforcement_interval_ {};
+    clock::time_point               last_volume_enforcement_ {};
+    clock::time_point               last_mute_enforcement_ {};
+
+    // The backend is destroyed first, so that it no longer calls the callback
+    std::unique_ptr<volume_control_callback> callback_ {};
+    std::unique_ptr<volume_backend>          backend_ {};
 };
 
 }  // namespace manelemax
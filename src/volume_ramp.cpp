@@ -0,0 +1,109 @@
+#include "volume_ramp.hpp"
+
+#include <algorithm>
+#include <cmath>
+
+namespace manelemax
+{
+
+namespace
+{
+
+// Quieter than this is treated as silence by the dB curve, the log of 0 being -inf
+constexpr float silence_db {-60.0f};
+
+float to_db(const float volume)
+{
+    return volume <= 0.0f ? silence_db : std::max(20.0f * std::log10(volume), silence_db);
+}
+
+float from_db(const float db)
+{
+    return db <= silence_db ? 0.0f : std::pow(10.0f, db / 20.0f);
+}
+
+}  // namespace
+
+volume_ramp::volume_ramp(
+    const ramp_curve      curve,
+    const clock::duration duration,
+    const clock::duration tick_interval
+)
+    : curve_ {curve}
+    , duration_ {duration}
+    , tick_interval_ {tick_interval}
+{
+}
+
+void volume_ramp::start(const float current, const float target, const clock::time_point now)
+{
+    // A retarget keeps the last tick, so that it writes no sooner than the next one was due
+    if (!active_)
+    {
+        from_      = current;
+        last_tick_ = now - tick_interval_;
+    }
+    else
+    {
+        from_ = value_at(now);
+    }
+    to_         = target;
+    start_time_ = now;
+    active_     = true;
+}
+
+auto volume_ramp::tick(const clock::time_point now) -> step
+{
+    if (!active_)
+    {
+        return {};
+    }
+
+    // Early, the timer fired before the end of the interval
+    if (now - last_tick_ < tick_interval_)
+    {
+        return {.next_tick = last_tick_ + tick_interval_};
+    }
+
+    last_tick_ = now;
+
+    if (now - start_time_ >= duration_)
+    {
+        active_ = false;
+        return {.volume = to_};
+    }
+
+    return {.volume = value_at(now), .next_tick = now + tick_interval_};
+}
+
+float volume_ramp::value_at(const clock::time_point now) const
+{
+    if (duration_ <= clock::duration::zero())
+    {
+        return to_;
+    }
+
+    const float progress = std::clamp(
+        std::chrono::duration<float>(now - start_time_) / std::chrono::duration<float>(duration_),
+        0.0f,
+        1.0f
+    );
+
+    switch (curve_)
+    {
+        case ramp_curve::linear: break;
+        case ramp_curve::db_linear:
+        {
+            return from_db(to_db(from_) + (to_db(to_) - to_db(from_)) * progress);
+        }
+        case ramp_curve::s_curve:
+        {
+            const float eased = progress * progress * (3.0f - 2.0f * progress);
+            return from_ + (to_ - from_) * eased;
+        }
+    }
+
+    return from_ + (to_ - from_) * progress;
+}
+
+}  // namespace manelemax
@@ -0,0 +1,71 @@
+#pragma once
+
+#include <chrono>
+#include <optional>
+
+namespace manelemax
+{
+
+enum class ramp_curve
+{
+    linear,     // Same volume scalar step on every tick
+    db_linear,  // Same loudness step on every tick, which sounds even to the ear
+    s_curve     // Slow at both ends, fast in the middle
+};
+
+// Moves a volume to a target over time, one value per tick.
+//
+// The ramp owns no thread and reads no clock: the owner passes the current time and calls tick()
+// when the previous tick asked for, so that it can be driven by any timer, or by a fake clock.
+class volume_ramp
+{
+public:
+    using clock = std::chrono::steady_clock;
+
+    struct step
+    {
+        std::optional<float>             volume {};     // The value to write now, if any
+        std::optional<clock::time_point> next_tick {};  // Empty once the ramp is done
+    };
+
+    // Ticks are at least tick_interval apart, which bounds the write rate
+    volume_ramp(ramp_curve curve, clock::duration duration, clock::duration tick_interval);
+
+    // Starts moving from current to target. A ramp in progress is retargeted instead: the new one
+    // starts from where the previous one is at now, current is ignored, and the ticks keep their
+    // interval.
+    void start(float current, float target, clock::time_point now);
+
+    void cancel()
+    {
+        active_ = false;
+    }
+
+    bool active() const
+    {
+        return active_;
+    }
+
+    float target() const
+    {
+        return to_;
+    }
+
+    // At most one volume per call
+    step tick(clock::time_point now);
+
+private:
+    float value_at(clock::time_point now) const;
+
+    ramp_curve      curve_;
+    clock::duration duration_;
+    clock::duration tick_interval_;
+
+    bool              active_ {false};
+    float             from_ {0.0f};
+    float             to_ {0.0f};
+    clock::time_point start_time_ {};
+    clock::time_point last_tick_ {};
+};
+
+}  // namespace manelemax
@@ -0,0 +1,1018 @@
+#include <algorithm>
+#include <atomic>
+#include <cstdint>
+#include <filesystem>
+#include <mutex>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+#include <audiopolicy.h>
+#include <endpointvolume.h>
+#include <mmdeviceapi.h>
+
+#include "com_ptr.hpp"
+#include "volume_backend.hpp"
+
+namespace manelemax
+{
+
+// Kept unsigned, so that the HRESULTs read as usual once printed in hexadecimal
+static os_error com_error(const std::string_view function, const HRESULT result)
+{
+    return os_error {function, static_cast<std::uint32_t>(result)};
+}
+
+// Name of the executable of the process, without its extension, empty when it cannot be queried
+static std::wstring process_name(const DWORD process_id)
+{
+    const HANDLE process = OpenProcess(PROCESS_QUERY_LIMITED_INFORMATION, FALSE, process_id);
+    if (process == nullptr)
+    {
+        return {};
+    }
+
+    wchar_t    path[MAX_PATH];
+    DWORD      size    = MAX_PATH;
+    const BOOL queried = QueryFullProcessImageNameW(process, 0, path, &size);
+    CloseHandle(process);
+
+    if (!queried)
+    {
+        return {};
+    }
+    return std::filesystem::path {std::wstring_view {path, size}}.stem().wstring();
+}
+
+// Reference counting of the objects handed to WASAPI, which implement a single interface
+template<typename Interface>
+class com_callback : public Interface
+{
+public:
+    virtual ~com_callback() = default;
+
+    ULONG STDMETHODCALLTYPE AddRef() override
+    {
+        return InterlockedIncrement(&ref_count_);
+    }
+
+    ULONG STDMETHODCALLTYPE Release() override
+    {
+        const ULONG ref = InterlockedDecrement(&ref_count_);
+        if (ref == 0)
+        {
+            delete this;
+        }
+        return ref;
+    }
+
+    HRESULT STDMETHODCALLTYPE QueryInterface(REFIID riid, VOID** ppvInterface) override
+    {
+        if (IID_IUnknown == riid)
+        {
+            AddRef();
+            *ppvInterface = (IUnknown*) this;
+        }
+        else if (__uuidof(Interface) == riid)
+        {
+            AddRef();
+            *ppvInterface = (Interface*) this;
+        }
+        else
+        {
+            *ppvInterface = NULL;
+            return E_NOINTERFACE;
+        }
+        return S_OK;
+    }
+
+private:
+    ULONG ref_count_ {1};
+};
+
+class wasapi_volume_backend;
+
+// An audio session of an endpoint, of the process that owns it
+struct audio_session
+{
+    std::wstring                   name;
+    std::wstring                   instance_id;
+    com_ptr<IAudioSessionControl2> control {nullptr};
+    com_ptr<ISimpleAudioVolume>    volume {nullptr};
+    com_ptr<IAudioSessionEvents>   events {nullptr};
+};
+
+// A render endpoint, the default one or one that was, activated once and kept while it is cached.
+// Its audio sessions are indexed by process once, then kept up to date from the notifications of
+// its session manager and of each session, rather than enumerated again on every change.
+struct audio_device
+{
+    std::wstring                          id;
+    com_ptr<IMMDevice>                    mm_device {nullptr};
+    com_ptr<IAudioEndpointVolume>         endpoint_volume {nullptr};
+    com_ptr<IAudioEndpointVolumeCallback> endpoint_volume_cb {nullptr};
+    com_ptr<IAudioSessionManager2>        session_manager {nullptr};
+    com_ptr<IAudioSessionNotification>    session_notification {nullptr};
+
+    // Guarded by the mutex of the backend
+    std::unordered_map<DWORD, std::vector<audio_session>> sessions {};  // By process id
+    std::vector<DWORD>                                    target_processes {};
+};
+
+// The callbacks below forward to the backend, which outlives their registrations
+
+class wasapi_volume_callback : public com_callback<IAudioEndpointVolumeCallback>
+{
+public:
+    wasapi_volume_callback(wasapi_volume_backend* const backend, const audio_device* const device)
+        : backend_ {backend}
+        , device_ {device}
+    {
+    }
+
+    HRESULT STDMETHODCALLTYPE OnNotify(PAUDIO_VOLUME_NOTIFICATION_DATA pNotify) override;
+
+private:
+    wasapi_volume_backend* backend_;
+    const audio_device*    device_;
+};
+
+// Reports the sessions opened on the endpoint after the enumeration
+class wasapi_session_notification : public com_callback<IAudioSessionNotification>
+{
+public:
+    wasapi_session_notification(wasapi_volume_backend* const backend, audio_device* const device)
+        : backend_ {backend}
+        , device_ {device}
+    {
+    }
+
+    HRESULT STDMETHODCALLTYPE OnSessionCreated(IAudioSessionControl* NewSession) override;
+
+private:
+    wasapi_volume_backend* backend_;
+    audio_device*          device_;
+};
+
+// Reports the volume changes of one session, and its end
+class wasapi_session_events : public com_callback<IAudioSessionEvents>
+{
+public:
+    wasapi_session_events(
+        wasapi_volume_backend* const backend,
+        audio_device* const          device,
+        const DWORD                  process_id,
+        std::wstring                 name,
+        std::wstring                 instance_id
+    )
+        : backend_ {backend}
+        , device_ {device}
+        , process_id_ {process_id}
+        , name_ {std::move(name)}
+        , instance_id_ {std::move(instance_id)}
+    {
+    }
+
+    HRESULT STDMETHODCALLTYPE
+    OnDisplayNameChanged(LPCWSTR /*NewDisplayName*/, LPCGUID /*EventContext*/) override
+    {
+        return S_OK;
+    }
+
+    HRESULT STDMETHODCALLTYPE
+    OnIconPathChanged(LPCWSTR /*NewIconPath*/, LPCGUID /*EventContext*/) override
+    {
+        return S_OK;
+    }
+
+    HRESULT STDMETHODCALLTYPE OnChannelVolumeChanged(
+        DWORD /*ChannelCount*/,
+        float /*NewChannelVolumeArray*/[],
+        DWORD /*ChangedChannel*/,
+        LPCGUID /*EventContext*/
+    ) override
+    {
+        return S_OK;
+    }
+
+    HRESULT STDMETHODCALLTYPE
+    OnGroupingParamChanged(LPCGUID /*NewGroupingParam*/, LPCGUID /*EventContext*/) override
+    {
+        return S_OK;
+    }
+
+    HRESULT STDMETHODCALLTYPE
+    OnSimpleVolumeChanged(float NewVolume, BOOL NewMute, LPCGUID EventContext) override;
+
+    HRESULT STDMETHODCALLTYPE OnStateChanged(AudioSessionState NewState) override;
+
+    HRESULT STDMETHODCALLTYPE
+    OnSessionDisconnected(AudioSessionDisconnectReason /*DisconnectReason*/) override;
+
+private:
+    wasapi_volume_backend* backend_;
+    audio_device*          device_;
+    DWORD                  process_id_;
+    std::wstring           name_;
+    std::wstring           instance_id_;
+};
+
+// Reports that the default multimedia render endpoint changed, which is then followed from the
+// thread calling into the backend: nothing is activated on the notification thread
+class wasapi_device_notification : public com_callback<IMMNotificationClient>
+{
+public:
+    explicit wasapi_device_notification(wasapi_volume_backend* const backend)
+        : backend_ {backend}
+    {
+    }
+
+    HRESULT STDMETHODCALLTYPE
+    OnDeviceStateChanged(LPCWSTR /*pwstrDeviceId*/, DWORD /*dwNewState*/) override
+    {
+        return S_OK;
+    }
+
+    HRESULT STDMETHODCALLTYPE OnDeviceAdded(LPCWSTR /*pwstrDeviceId*/) override
+    {
+        return S_OK;
+    }
+
+    HRESULT STDMETHODCALLTYPE OnDeviceRemoved(LPCWSTR /*pwstrDeviceId*/) override
+    {
+        return S_OK;
+    }
+
+    HRESULT STDMETHODCALLTYPE
+    OnPropertyValueChanged(LPCWSTR /*pwstrDeviceId*/, const PROPERTYKEY /*key*/) override
+    {
+        return S_OK;
+    }
+
+    HRESULT STDMETHODCALLTYPE
+    OnDefaultDeviceChanged(EDataFlow flow, ERole role, LPCWSTR /*pwstrDefaultDeviceId*/) override;
+
+private:
+    wasapi_volume_backend* backend_;
+};
+
+// IAudioEndpointVolume of the default multimedia render endpoint, or the ISimpleAudioVolume of the
+// audio sessions of the target application on it. The writes are tagged with a context GUID, so
+// that their own notifications are skipped.
+//
+// The endpoints that were the default one are cached, so that switching back and forth between
+// speakers and headphones does not activate them again. The current one is swapped atomically,
+// and the notifications of the others are dropped.
+class wasapi_volume_backend : public volume_backend
+{
+public:
+    static std::expected<std::unique_ptr<volume_backend>, os_error> make();
+
+    wasapi_volume_backend(const wasapi_volume_backend&)            = delete;
+    wasapi_volume_backend& operator=(const wasapi_volume_backend&) = delete;
+
+    ~wasapi_volume_backend() override
+    {
+        if (device_notification_)
+        {
+            mm_device_enumerator_->UnregisterEndpointNotificationCallback(
+                device_notification_.get()
+            );
+        }
+
+        current_device_.store(nullptr);
+        for (const std::shared_ptr<audio_device>& device : devices_)
+        {
+            release_device(*device);
+        }
+        release_expired();
+    }
+
+    std::expected<endpoint, os_error> get() override
+    {
+        release_expired();
+
+        const std::shared_ptr<audio_device> device = current_device_.load();
+
+        if (const auto volume = first_target(*device); volume.has_value())
+        {
+            return get_session(volume->get());
+        }
+        if (is_targeting())
+        {
+            return endpoint {.volume = 1.0f, .muted = false};
+        }
+
+        endpoint state;
+        if (const HRESULT result =
+                device->endpoint_volume->GetMasterVolumeLevelScalar(&state.volume);
+            FAILED(result))
+        {
+            return std::unexpected {
+                com_error("IAudioEndpointVolume::GetMasterVolumeLevelScalar", result)
+            };
+        }
+
+        BOOL muted;
+        if (const HRESULT result = device->endpoint_volume->GetMute(&muted); FAILED(result))
+        {
+            return std::unexpected {com_error("IAudioEndpointVolume::GetMute", result)};
+        }
+        state.muted = muted != FALSE;
+
+        return state;
+    }
+
+    std::expected<void, os_error> set_volume(const float vol) override
+    {
+        release_expired();
+
+        const std::shared_ptr<audio_device> device = current_device_.load();
+
+        if (is_targeting())
+        {
+            return for_each_target(
+                *device,
+                "ISimpleAudioVolume::SetMasterVolume",
+                [&](ISimpleAudioVolume* const volume) {
+                    return volume->SetMasterVolume(vol, &guid_context_);
+                }
+            );
+        }
+
+        if (const HRESULT result =
+                device->endpoint_volume->SetMasterVolumeLevelScalar(vol, &guid_context_);
+            FAILED(result))
+        {
+            return std::unexpected {
+                com_error("IAudioEndpointVolume::SetMasterVolumeLevelScalar", result)
+            };
+        }
+        return {};
+    }
+
+    std::expected<void, os_error> set_muted(const bool muted) override
+    {
+        release_expired();
+
+        const std::shared_ptr<audio_device> device = current_device_.load();
+
+        if (is_targeting())
+        {
+            return for_each_target(
+                *device,
+                "ISimpleAudioVolume::SetMute",
+                [&](ISimpleAudioVolume* const volume) {
+                    return volume->SetMute(muted, &guid_context_);
+                }
+            );
+        }
+
+        if (const HRESULT result = device->endpoint_volume->SetMute(muted, &guid_context_);
+            FAILED(result))
+        {
+            return std::unexpected {com_error("IAudioEndpointVolume::SetMute", result)};
+        }
+        return {};
+    }
+
+    // The endpoints notify from the moment they are activated, this only lets them through
+    std::expected<void, os_error> set_listener(listener* const lsn) override
+    {
+        std::lock_guard lock {mutex_};
+        lsn_ = lsn;
+
+        return {};
+    }
+
+    void set_target(const std::optional<application>& app) override
+    {
+        release_expired();
+
+        std::lock_guard lock {mutex_};
+
+        target_ = app;
+        for (const std::shared_ptr<audio_device>& device : devices_)
+        {
+            update_target_processes(*device);
+        }
+    }
+
+    std::expected<void, os_error> follow_default() override
+    {
+        release_expired();
+
+        IMMDevice* raw_mm_device;
+        if (const HRESULT result = mm_device_enumerator_->GetDefaultAudioEndpoint(
+                eRender,
+                eMultimedia,
+                &raw_mm_device
+            );
+            FAILED(result))
+        {
+            return std::unexpected {
+                com_error("IMMDeviceEnumerator::GetDefaultAudioEndpoint", result)
+            };
+        }
+        com_ptr<IMMDevice> mm_device {raw_mm_device};
+
+        LPWSTR raw_id;
+        if (const HRESULT result = mm_device->GetId(&raw_id); FAILED(result))
+        {
+            return std::unexpected {com_error("IMMDevice::GetId", result)};
+        }
+        const std::wstring id {raw_id};
+        CoTaskMemFree(raw_id);
+
+        // The most recently used first, the current one included
+        if (const auto cached = std::ranges::find_if(
+                devices_,
+                [&](const std::shared_ptr<audio_device>& device) { return device->id == id; }
+            );
+            cached != devices_.end())
+        {
+            std::rotate(devices_.begin(), cached, cached + 1);
+        }
+        else
+        {
+            auto device = activate(std::move(mm_device), id);
+            if (!device.has_value())
+            {
+                return std::unexpected {device.error()};
+            }
+            devices_.insert(devices_.begin(), *std::move(device));
+
+            if (devices_.size() > max_cached_devices)
+            {
+                release_device(*devices_.back());
+                devices_.pop_back();
+            }
+        }
+
+        current_device_.store(devices_.front());
+
+        return {};
+    }
+
+private:
+    friend class wasapi_volume_callback;
+    friend class wasapi_session_notification;
+    friend class wasapi_session_events;
+    friend class wasapi_device_notification;
+
+    static constexpr std::size_t max_cached_devices {4};
+
+    wasapi_volume_backend() noexcept = default;
+
+    static std::expected<endpoint, os_error> get_session(ISimpleAudioVolume* const volume)
+    {
+        endpoint state;
+        if (const HRESULT result = volume->GetMasterVolume(&state.volume); FAILED(result))
+        {
+            return std::unexpected {com_error("ISimpleAudioVolume::GetMasterVolume", result)};
+        }
+
+        BOOL muted;
+        if (const HRESULT result = volume->GetMute(&muted); FAILED(result))
+        {
+            return std::unexpected {com_error("ISimpleAudioVolume::GetMute", result)};
+        }
+        state.muted = muted != FALSE;
+
+        return state;
+    }
+
+    // Activates the volume and the session manager of the endpoint, and indexes its sessions
+    std::expected<std::shared_ptr<audio_device>, os_error>
+    activate(com_ptr<IMMDevice> mm_device, const std::wstring& id)
+    {
+        constexpr IID IID_IAudioEndpointVolume  = __uuidof(IAudioEndpointVolume);
+        constexpr IID IID_IAudioSessionManager2 = __uuidof(IAudioSessionManager2);
+
+        auto device       = std::make_shared<audio_device>();
+        device->id        = id;
+        device->mm_device = std::move(mm_device);
+
+        IAudioEndpointVolume* endpoint_volume;
+        if (const HRESULT result = device->mm_device->Activate(
+                IID_IAudioEndpointVolume,
+                CLSCTX_ALL,
+                nullptr,
+                reinterpret_cast<void**>(&endpoint_volume)
+            );
+            FAILED(result))
+        {
+            return std::unexpected {com_error("IMMDevice::Activate", result)};
+        }
+        device->endpoint_volume.reset(endpoint_volume);
+
+        IAudioSessionManager2* session_manager;
+        if (const HRESULT result = device->mm_device->Activate(
+                IID_IAudioSessionManager2,
+                CLSCTX_ALL,
+                nullptr,
+                reinterpret_cast<void**>(&session_manager)
+            );
+            FAILED(result))
+        {
+            return std::unexpected {com_error("IMMDevice::Activate", result)};
+        }
+        device->session_manager.reset(session_manager);
+
+        com_ptr<IAudioEndpointVolumeCallback> volume_cb {
+            new wasapi_volume_callback {this, device.get()}
+        };
+        if (const HRESULT result =
+                device->endpoint_volume->RegisterControlChangeNotify(volume_cb.get());
+            FAILED(result))
+        {
+            return std::unexpected {
+                com_error("IAudioEndpointVolume::RegisterControlChangeNotify", result)
+            };
+        }
+        device->endpoint_volume_cb = std::move(volume_cb);
+
+        // Subscribed to before the enumeration, so that no session is missed in between. The
+        // sessions created meanwhile are reported twice, and indexed once.
+        com_ptr<IAudioSessionNotification> session_notification {
+            new wasapi_session_notification {this, device.get()}
+        };
+        if (const HRESULT result =
+                device->session_manager->RegisterSessionNotification(session_notification.get());
+            FAILED(result))
+        {
+            release_device(*device);
+            return std::unexpected {
+                com_error("IAudioSessionManager2::RegisterSessionNotification", result)
+            };
+        }
+        device->session_notification = std::move(session_notification);
+
+        IAudioSessionEnumerator* raw_enumerator;
+        if (const HRESULT result = device->session_manager->GetSessionEnumerator(&raw_enumerator);
+            FAILED(result))
+        {
+            release_device(*device);
+            return std::unexpected {
+                com_error("IAudioSessionManager2::GetSessionEnumerator", result)
+            };
+        }
+        const com_ptr<IAudioSessionEnumerator> enumerator {raw_enumerator};
+
+        int count;
+        if (const HRESULT result = enumerator->GetCount(&count); FAILED(result))
+        {
+            release_device(*device);
+            return std::unexpected {com_error("IAudioSessionEnumerator::GetCount", result)};
+        }
+        for (int i = 0; i < count; ++i)
+        {
+            IAudioSessionControl* raw_session;
+            if (SUCCEEDED(enumerator->GetSession(i, &raw_session)))
+            {
+                const com_ptr<IAudioSessionControl> session {raw_session};
+                add_session(*device, session.get());
+            }
+        }
+
+        return device;
+    }
+
+    // Unregisters from the endpoint and its sessions, from the thread calling into the backend
+    void release_device(audio_device& device)
+    {
+        if (device.endpoint_volume_cb)
+        {
+            device.endpoint_volume->UnregisterControlChangeNotify(device.endpoint_volume_cb.get());
+        }
+        if (device.session_notification)
+        {
+            device.session_manager->UnregisterSessionNotification(
+                device.session_notification.get()
+            );
+        }
+
+        // Moved out first, as the sessions that expire meanwhile are moved by their notifications
+        std::unordered_map<DWORD, std::vector<audio_session>> sessions;
+        {
+            std::lock_guard lock {mutex_};
+            sessions.swap(device.sessions);
+            device.target_processes.clear();
+        }
+
+        for (auto& [process_id, process_sessions] : sessions)
+        {
+            for (audio_session& session : process_sessions)
+            {
+                session.control->UnregisterAudioSessionNotification(session.events.get());
+            }
+        }
+    }
+
+    bool is_targeting()
+    {
+        std::lock_guard lock {mutex_};
+        return target_.has_value();
+    }
+
+    // The mutex is held. The sessions of a process all have the same executable, the first one
+    // tells.
+    void update_target_processes(audio_device& device) const
+    {
+        device.target_processes.clear();
+        if (!target_.has_value())
+        {
+            return;
+        }
+
+        for (const auto& [process_id, sessions] : device.sessions)
+        {
+            if (target_->owns(process_id, sessions.front().name))
+            {
+                device.target_processes.push_back(process_id);
+            }
+        }
+    }
+
+    // The volumes are referenced, and written once the mutex is released, so that the
+    // notifications of the writes never wait for it
+    std::vector<com_ptr<ISimpleAudioVolume>> targets(const audio_device& device)
+    {
+        std::lock_guard lock {mutex_};
+
+        std::vector<com_ptr<ISimpleAudioVolume>> volumes;
+        for (const DWORD process_id : device.target_processes)
+        {
+            for (const audio_session& session : device.sessions.at(process_id))
+            {
+                session.volume->AddRef();
+                volumes.emplace_back(session.volume.get());
+            }
+        }
+        return volumes;
+    }
+
+    std::optional<com_ptr<ISimpleAudioVolume>> first_target(const audio_device& device)
+    {
+        auto volumes = targets(device);
+        if (volumes.empty())
+        {
+            return std::nullopt;
+        }
+        return std::move(volumes.front());
+    }
+
+    // Writes every session of the target, the first failure is returned once all were tried
+    template<typename Write>
+    std::expected<void, os_error>
+    for_each_target(const audio_device& device, const std::string_view function, Write write)
+    {
+        HRESULT first_failure = S_OK;
+        for (const com_ptr<ISimpleAudioVolume>& volume : targets(device))
+        {
+            if (const HRESULT result = write(volume.get());
+                FAILED(result) && SUCCEEDED(first_failure))
+            {
+                first_failure = result;
+            }
+        }
+
+        if (FAILED(first_failure))
+        {
+            return std::unexpected {com_error(function, first_failure)};
+        }
+        return {};
+    }
+
+    // The mutex is held. The listener, if the notifications of the device are to be reported.
+    listener* listener_for(const audio_device& device) const
+    {
+        return current_device_.load().get() == &device ? lsn_ : nullptr;
+    }
+
+    // Runs on the thread calling into the backend, or on a notification thread of WASAPI
+    void add_session(audio_device& device, IAudioSessionControl* const new_session)
+    {
+        IAudioSessionControl2* raw_control;
+        if (FAILED(new_session->QueryInterface(
+                __uuidof(IAudioSessionControl2),
+                reinterpret_cast<void**>(&raw_control)
+            )))
+        {
+            return;
+        }
+        com_ptr<IAudioSessionControl2> control {raw_control};
+
+        AudioSessionState state;
+        DWORD             process_id;
+        if (control->IsSystemSoundsSession() == S_OK || FAILED(control->GetState(&state)) ||
+            state == AudioSessionStateExpired || FAILED(control->GetProcessId(&process_id)))
+        {
+            return;
+        }
+
+        LPWSTR raw_instance_id;
+        if (FAILED(control->GetSessionInstanceIdentifier(&raw_instance_id)))
+        {
+            return;
+        }
+        std::wstring instance_id {raw_instance_id};
+        CoTaskMemFree(raw_instance_id);
+
+        ISimpleAudioVolume* raw_volume;
+        if (FAILED(control->QueryInterface(
+                __uuidof(ISimpleAudioVolume),
+                reinterpret_cast<void**>(&raw_volume)
+            )))
+        {
+            return;
+        }
+
+        audio_session added {
+            .name        = process_name(process_id),
+            .instance_id = std::move(instance_id),
+            .control     = std::move(control),
+            .volume      = com_ptr<ISimpleAudioVolume> {raw_volume}
+        };
+        added.events.reset(
+            new wasapi_session_events {this, &device, process_id, added.name, added.instance_id}
+        );
+
+        // Registered first, so that the session cannot expire unnoticed once it is indexed
+        if (FAILED(added.control->RegisterAudioSessionNotification(added.events.get())))
+        {
+            return;
+        }
+
+        std::unique_lock lock {mutex_};
+
+        // Created while the sessions were enumerated, it is reported twice
+        std::vector<audio_session>& sessions = device.sessions[process_id];
+        if (std::ranges::any_of(sessions, [&](const audio_session& session) {
+                return session.instance_id == added.instance_id;
+            }))
+        {
+            expired_.push_back(std::move(added));
+            return;
+        }
+
+        const bool targeted = target_.has_value() && target_->owns(process_id, added.name);
+        if (targeted && !std::ranges::contains(device.target_processes, process_id))
+        {
+            device.target_processes.push_back(process_id);
+        }
+
+        added.volume->AddRef();
+        const com_ptr<ISimpleAudioVolume> volume {added.volume.get()};
+        sessions.push_back(std::move(added));
+
+        listener* const lsn = targeted ? listener_for(device) : nullptr;
+        lock.unlock();
+
+        // The target has a new stream, whose volume is likely not the one wanted
+        if (lsn)
+        {
+            if (const auto session_state = get_session(volume.get()); session_state.has_value())
+            {
+                lsn->on_endpoint_changed(*session_state);
+            }
+        }
+    }
+
+    // Runs on a notification thread of the session, which cannot unregister from it
+    void remove_session(
+        audio_device&       device,
+        const DWORD         process_id,
+        const std::wstring& instance_id
+    )
+    {
+        std::lock_guard lock {mutex_};
+
+        const auto found = device.sessions.find(process_id);
+        if (found == device.sessions.end())
+        {
+            return;
+        }
+
+        std::vector<audio_session>& sessions = found->second;
+        const auto removed = std::ranges::find(sessions, instance_id, &audio_session::instance_id);
+        if (removed == sessions.end())
+        {
+            return;
+        }
+
+        expired_.push_back(std::move(*removed));
+        sessions.erase(removed);
+
+        if (sessions.empty())
+        {
+            device.sessions.erase(found);
+            std::erase(device.target_processes, process_id);
+        }
+    }
+
+    // Unregisters from the sessions that expired, from the thread calling into the backend
+    void release_expired()
+    {
+        std::vector<audio_session> expired;
+        {
+            std::lock_guard lock {mutex_};
+            expired.swap(expired_);
+        }
+
+        for (audio_session& session : expired)
+        {
+            session.control->UnregisterAudioSessionNotification(session.events.get());
+        }
+    }
+
+    void on_endpoint_notify(const audio_device& device, const endpoint& new_endpoint)
+    {
+        std::unique_lock lock {mutex_};
+        listener* const  lsn = target_.has_value() ? nullptr : listener_for(device);
+        lock.unlock();
+
+        if (lsn)
+        {
+            lsn->on_endpoint_changed(new_endpoint);
+        }
+    }
+
+    void on_session_notify(
+        const audio_device& device,
+        const DWORD         process_id,
+        const std::wstring& name,
+        const endpoint&     new_endpoint
+    )
+    {
+        std::unique_lock lock {mutex_};
+        listener* const  lsn =
+            target_.has_value() && target_->owns(process_id, name) ? listener_for(device) : nullptr;
+        lock.unlock();
+
+        if (lsn)
+        {
+            lsn->on_endpoint_changed(new_endpoint);
+        }
+    }
+
+    void on_default_notify()
+    {
+        std::unique_lock lock {mutex_};
+        listener* const  lsn = lsn_;
+        lock.unlock();
+
+        if (lsn)
+        {
+            lsn->on_default_changed();
+        }
+    }
+
+    GUID                           guid_context_ {};
+    com_ptr<IMMDeviceEnumerator>   mm_device_enumerator_ {nullptr};
+    com_ptr<IMMNotificationClient> device_notification_ {nullptr};
+
+    // Used and swapped by the thread calling into the backend, read by the notification threads
+    std::vector<std::shared_ptr<audio_device>> devices_ {};  // The most recently used first
+    std::atomic<std::shared_ptr<audio_device>> current_device_ {};
+
+    // Written by the notification threads of WASAPI as well
+    std::mutex                 mutex_ {};
+    std::vector<audio_session> expired_ {};
+    std::optional<application> target_ {};
+    listener*                  lsn_ {nullptr};
+};
+
+HRESULT STDMETHODCALLTYPE wasapi_volume_callback::OnNotify(PAUDIO_VOLUME_NOTIFICATION_DATA pNotify)
+{
+    if (pNotify == NULL)
+    {
+        return E_INVALIDARG;
+    }
+    if (pNotify->guidEventContext == backend_->guid_context_)
+    {
+        return S_OK;
+    }
+
+    backend_->on_endpoint_notify(*device_, {
+        .volume = pNotify->fMasterVolume,
+        .muted  = pNotify->bMuted != FALSE
+    });
+
+    return S_OK;
+}
+
+HRESULT STDMETHODCALLTYPE
+wasapi_session_notification::OnSessionCreated(IAudioSessionControl* NewSession)
+{
+    if (NewSession == NULL)
+    {
+        return E_INVALIDARG;
+    }
+
+    backend_->add_session(*device_, NewSession);
+    return S_OK;
+}
+
+HRESULT STDMETHODCALLTYPE wasapi_session_events::OnSimpleVolumeChanged(
+    float   NewVolume,
+    BOOL    NewMute,
+    LPCGUID EventContext
+)
+{
+    if (EventContext != NULL && *EventContext == backend_->guid_context_)
+    {
+        return S_OK;
+    }
+
+    backend_->on_session_notify(*device_, process_id_, name_, {
+        .volume = NewVolume,
+        .muted  = NewMute != FALSE
+    });
+
+    return S_OK;
+}
+
+HRESULT STDMETHODCALLTYPE wasapi_session_events::OnStateChanged(AudioSessionState NewState)
+{
+    if (NewState == AudioSessionStateExpired)
+    {
+        backend_->remove_session(*device_, process_id_, instance_id_);
+    }
+    return S_OK;
+}
+
+HRESULT STDMETHODCALLTYPE
+wasapi_session_events::OnSessionDisconnected(AudioSessionDisconnectReason /*DisconnectReason*/)
+{
+    backend_->remove_session(*device_, process_id_, instance_id_);
+    return S_OK;
+}
+
+HRESULT STDMETHODCALLTYPE wasapi_device_notification::OnDefaultDeviceChanged(
+    EDataFlow flow,
+    ERole     role,
+    LPCWSTR /*pwstrDefaultDeviceId*/
+)
+{
+    if (flow == eRender && role == eMultimedia)
+    {
+        backend_->on_default_notify();
+    }
+    return S_OK;
+}
+
+std::expected<std::unique_ptr<volume_backend>, os_error> wasapi_volume_backend::make()
+{
+    constexpr CLSID CLSID_MMDeviceEnumerator = __uuidof(MMDeviceEnumerator);
+    constexpr IID   IID_IMMDeviceEnumerator  = __uuidof(IMMDeviceEnumerator);
+
+    std::unique_ptr<wasapi_volume_backend> instance {new wasapi_volume_backend};
+
+    if (const HRESULT result = CoCreateGuid(&instance->guid_context_); FAILED(result))
+    {
+        return std::unexpected {com_error("CoCreateGuid", result)};
+    }
+
+    IMMDeviceEnumerator* mm_device_enumerator;
+    if (const HRESULT result = CoCreateInstance(
+            CLSID_MMDeviceEnumerator,
+            nullptr,
+            CLSCTX_ALL,
+            IID_IMMDeviceEnumerator,
+            reinterpret_cast<void**>(&mm_device_enumerator)
+        );
+        FAILED(result))
+    {
+        return std::unexpected {com_error("CoCreateInstance", result)};
+    }
+    instance->mm_device_enumerator_.reset(mm_device_enumerator);
+
+    // Subscribed to before the default endpoint is looked up, so that no change is missed
+    com_ptr<IMMNotificationClient> notification {new wasapi_device_notification {instance.get()}};
+    if (const HRESULT result =
+            instance->mm_device_enumerator_->RegisterEndpointNotificationCallback(
+                notification.get()
+            );
+        FAILED(result))
+    {
+        return std::unexpected {
+            com_error("IMMDeviceEnumerator::RegisterEndpointNotificationCallback", result)
+        };
+    }
+    instance->device_notification_ = std::move(notification);
+
+    if (const auto result = instance->follow_default(); !result.has_value())
+    {
+        return std::unexpected {result.error()};
+    }
+
+    return instance;
+}
+
+std::expected<std::unique_ptr<volume_backend>, os_error> volume_backend::make_default()
+{
+    return wasapi_volume_backend::make();
+}
+
+}  // namespace manelemax
@@ -0,0 +1,400 @@
+#include <cstdint>
+#include <map>
+#include <mutex>
+#include <set>
+#include <string>
+#include <string_view>
+#include <vector>
+
+#include <winrt/Windows.Foundation.h>
+#include <winrt/Windows.Foundation.Collections.h>
+#include <winrt/Windows.Media.Control.h>
+
+#include "detached_task.hpp"
+#include "fetch_sequence.hpp"
+#include "media_session_backend.hpp"
+#include "startup_trace.hpp"
+
+namespace manelemax
+{
+
+using namespace winrt::Windows::Media::Control;
+
+using media_session         = GlobalSystemMediaTransportControlsSession;
+using media_session_manager = GlobalSystemMediaTransportControlsSessionManager;
+using media_properties      = GlobalSystemMediaTransportControlsSessionMediaProperties;
+
+// All of the sessions of the system media transport controls, rather than only the one Windows
+// considers current, which follows the focus.
+//
+// SessionsChanged does not tell what changed, so the list of sessions is compared with the ones
+// already tracked: only the new ones are subscribed to and queried, and the gone ones dropped.
+//
+// Nothing blocks on the async operations of WinRT, neither the startup nor the event handlers:
+// they are awaited by coroutines, which take the mutex once they resume. A session is reported
+// once its properties are known.
+//
+// The event handlers enter the scope too and check stopping_, so that the destructor waits for
+// the ones already running when their events are revoked.
+class winrt_media_session_backend : public media_session_backend
+{
+public:
+    // The session manager is requested in the background, the sessions are reported once it is
+    // there
+    static std::expected<std::unique_ptr<media_session_backend>, os_error> make()
+    {
+        std::unique_ptr<winrt_media_session_backend> backend {new winrt_media_session_backend};
+
+        try
+        {
+            backend->manager_request_ = media_session_manager::RequestAsync();
+        }
+        catch (const winrt::hresult_error& err)
+        {
+            return std::unexpected {os_error {
+                "GlobalSystemMediaTransportControlsSessionManager::RequestAsync",
+                static_cast<std::uint32_t>(err.code().value)
+            }};
+        }
+
+        backend->receive_session_manager(backend->scope_.enter(), backend->manager_request_);
+        return backend;
+    }
+
+    winrt_media_session_backend(const winrt_media_session_backend&)            = delete;
+    winrt_media_session_backend& operator=(const winrt_media_session_backend&) = delete;
+
+    ~winrt_media_session_backend() override
+    {
+        // Stopping first, then unsubscribed under the lock, so that neither a handler nor the
+        // receiving of the session manager subscribes again
+        std::vector<fetch_sequence::cancel_fn> cancellations;
+        {
+            std::lock_guard lock {mutex_};
+            stopping_ = true;
+            lsn_      = nullptr;
+            sessions_changed_.revoke();
+            for (auto& [id, tracked] : sessions_)
+            {
+                tracked.media_props_changed.revoke();
+                tracked.playback_changed.revoke();
+                cancellations.push_back(tracked.fetch.stop());
+            }
+        }
+
+        // The coroutines resume, find out that they are stale and complete. They resume on any
+        // thread of the multithreaded apartment, not on this one, which would deadlock. The
+        // handlers still running find out that the backend is stopping.
+        manager_request_.Cancel();
+        for (fetch_sequence::cancel_fn& cancel : cancellations)
+        {
+            if (cancel)
+            {
+                cancel();
+            }
+        }
+        scope_.wait();
+
+        std::lock_guard lock {mutex_};
+        sessions_.clear();
+    }
+
+    void set_listener(listener* const lsn) override
+    {
+        std::vector<std::string> added;
+        {
+            std::lock_guard lock {mutex_};
+            lsn_ = lsn;
+
+            if (session_manager_)
+            {
+                subscribe();
+                added = sync_sessions();
+            }
+        }
+
+        for (const std::string& id : added)
+        {
+            fetch_media_properties(id);
+        }
+    }
+
+private:
+    struct tracked_session
+    {
+        media_session                                 session {nullptr};
+        media_session::MediaPropertiesChanged_revoker media_props_changed {};
+        media_session::PlaybackInfoChanged_revoker    playback_changed {};
+        session_state                                 state {};
+
+        // Only the properties of the latest change are applied
+        fetch_sequence fetch {};
+        bool           fetched {false};
+    };
+
+    winrt_media_session_backend() = default;
+
+    detached_task receive_session_manager(
+        async_scope::guard /*guard*/,
+        const winrt::Windows::Foundation::IAsyncOperation<media_session_manager> request
+    )
+    {
+        media_session_manager session_manager {nullptr};
+        try
+        {
+            session_manager = co_await request;
+            startup_trace::process().mark("media session manager ready");
+        }
+        catch (const winrt::hresult_error&)
+        {
+            // Cancelled, or no media sessions at all, which is not worth failing for
+        }
+
+        std::vector<std::string> added;
+        {
+            std::lock_guard lock {mutex_};
+            if (stopping_ || !session_manager)
+            {
+                co_return;
+            }
+
+            session_manager_ = std::move(session_manager);
+            if (lsn_)
+            {
+                subscribe();
+                added = sync_sessions();
+            }
+        }
+
+        for (const std::string& id : added)
+        {
+            fetch_media_properties(id);
+        }
+    }
+
+    // The mutex is held
+    void subscribe()
+    {
+        sessions_changed_ = session_manager_.SessionsChanged(
+            winrt::auto_revoke,
+            [this](const auto& /*sender*/, const auto& /*args*/) {
+                const async_scope::guard guard = scope_.enter();
+
+                std::vector<std::string> added;
+                {
+                    std::lock_guard lock {mutex_};
+                    added = sync_sessions();
+                }
+
+                for (const std::string& id : added)
+                {
+                    fetch_media_properties(id);
+                }
+            }
+        );
+    }
+
+    // The mutex is held. Returns the ids of the new sessions, whose properties are to be fetched
+    // once it is released, none once stopping.
+    std::vector<std::string> sync_sessions()
+    {
+        std::vector<std::string> added;
+        if (stopping_)
+        {
+            return added;
+        }
+
+        std::set<std::string> alive;
+        for (const auto& session : session_manager_.GetSessions())
+        {
+            std::string id = winrt::to_string(session.SourceAppUserModelId());
+            if (!sessions_.contains(id))
+            {
+                add_session(id, session);
+                added.push_back(id);
+            }
+            alive.insert(std::move(id));
+        }
+
+        for (auto it = sessions_.begin(); it != sessions_.end();)
+        {
+            if (alive.contains(it->first))
+            {
+                ++it;
+                continue;
+            }
+
+            // The fetch in progress, if any, finds no session once it resumes
+            const std::string id          = it->first;
+            const bool        was_fetched = it->second.fetched;
+            it                            = sessions_.erase(it);
+            if (lsn_ && was_fetched)
+            {
+                lsn_->on_session_removed(id);
+            }
+        }
+
+        return added;
+    }
+
+    // The mutex is held
+    void add_session(const std::string& id, const media_session& session)
+    {
+        tracked_session& added      = sessions_[id];
+        added.session               = session;
+        added.state.media_props.app = app_of(session.SourceAppUserModelId());
+
+        added.media_props_changed = session.MediaPropertiesChanged(
+            winrt::auto_revoke,
+            [this, id](const auto& /*sender*/, const auto& /*args*/) {
+                const async_scope::guard guard = scope_.enter();
+                fetch_media_properties(id);
+            }
+        );
+
+        added.playback_changed = session.PlaybackInfoChanged(
+            winrt::auto_revoke,
+            [this, id](const auto& /*sender*/, const auto& /*args*/) {
+                const async_scope::guard guard = scope_.enter();
+
+                std::lock_guard lock {mutex_};
+                if (const auto found = sessions_.find(id);
+                    !stopping_ && found != sessions_.end() && found->second.fetched)
+                {
+                    update_playback_status(found->second);
+                    report(id, found->second);
+                }
+            }
+        );
+
+        update_playback_status(added);
+    }
+
+    // The mutex is not held. Starts fetching the properties of the session, which makes the fetch
+    // still in progress for it stale.
+    void fetch_media_properties(const std::string& id)
+    {
+        winrt::Windows::Foundation::IAsyncOperation<media_properties> operation {nullptr};
+        fetch_sequence::started                                       started;
+        {
+            std::lock_guard lock {mutex_};
+            const auto      found = sessions_.find(id);
+            if (stopping_ || found == sessions_.end())
+            {
+                return;
+            }
+
+            try
+            {
+                operation = found->second.session.TryGetMediaPropertiesAsync();
+            }
+            catch (const winrt::hresult_error&)
+            {
+                return;
+            }
+            started = found->second.fetch.start([operation] { operation.Cancel(); });
+        }
+
+        if (started.cancel_previous)
+        {
+            started.cancel_previous();
+        }
+        apply_media_properties(scope_.enter(), id, operation, started.id);
+    }
+
+    detached_task apply_media_properties(
+        async_scope::guard /*guard*/,
+        const std::string                                                   id,
+        const winrt::Windows::Foundation::IAsyncOperation<media_properties> operation,
+        const std::uint64_t                                                 fetch_id
+    )
+    {
+        media_properties media {nullptr};
+        try
+        {
+            media = co_await operation;
+        }
+        catch (const winrt::hresult_error&)
+        {
+            // Cancelled by a newer fetch, or failed, in which case the previous properties stay
+        }
+
+        std::lock_guard lock {mutex_};
+        const auto      found = sessions_.find(id);
+        if (found == sessions_.end() || !found->second.fetch.is_latest(fetch_id))
+        {
+            co_return;
+        }
+
+        tracked_session& tracked = found->second;
+        tracked.fetch.finish(fetch_id);
+        tracked.fetched = true;
+        if (media)
+        {
+            update_media_properties(tracked, media);
+        }
+        report(id, tracked);
+    }
+
+    static void update_playback_status(tracked_session& tracked)
+    {
+        tracked.state.playing = tracked.session.GetPlaybackInfo().PlaybackStatus() ==
+                                GlobalSystemMediaTransportControlsSessionPlaybackStatus::Playing;
+    }
+
+    static void update_media_properties(tracked_session& tracked, const media_properties& media)
+    {
+        tracked.state.media_props = {
+            .artist = media.Artist().c_str(),
+            .title  = media.Title().c_str(),
+            .app    = std::move(tracked.state.media_props.app)
+        };
+    }
+
+    // The sessions do not tell their process. Desktop applications are mostly identified by their
+    // executable, as "Spotify.exe", which is matched by name; the ids of the packaged ones, and
+    // the hashed ones of some others, match no executable.
+    static application app_of(const winrt::hstring& app_user_model_id)
+    {
+        constexpr std::wstring_view extension {L".exe"};
+
+        std::wstring name {app_user_model_id};
+        if (name.size() > extension.size() &&
+            _wcsicmp(name.c_str() + name.size() - extension.size(), extension.data()) == 0)
+        {
+            name.resize(name.size() - extension.size());
+        }
+
+        return application {.process_id = 0, .name = std::move(name)};
+    }
+
+    void report(const std::string& id, const tracked_session& tracked) const
+    {
+        if (lsn_)
+        {
+            lsn_->on_session_changed(id, tracked.state);
+        }
+    }
+
+    winrt::Windows::Foundation::IAsyncOperation<media_session_manager> manager_request_ {nullptr};
+
+    media_session_manager                          session_manager_ {nullptr};
+    media_session_manager::SessionsChanged_revoker sessions_changed_ {};
+
+    // Serializes the handlers and the coroutines, which WinRT may run on several threads at once
+    std::mutex                             mutex_ {};
+    std::map<std::string, tracked_session> sessions_ {};  // By application user model id
+    listener*                              lsn_ {nullptr};
+    bool                                   stopping_ {false};
+
+    // The coroutines and the handlers in progress, waited for on destruction
+    async_scope scope_ {};
+};
+
+std::expected<std::unique_ptr<media_session_backend>, os_error>
+media_session_backend::make_default()
+{
+    return winrt_media_session_backend::make();
+}
+
+}  // namespace manelemax
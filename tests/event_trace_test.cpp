@@ -0,0 +1,188 @@
+#include <cstdint>
+#include <filesystem>
+#include <fstream>
+#include <optional>
+#include <string>
+#include <string_view>
+#include <vector>
+
+#include <gtest/gtest.h>
+
+#include "event_trace.hpp"
+
+namespace manelemax
+{
+
+namespace
+{
+
+using kind = event_trace::kind;
+
+class event_trace_test : public ::testing::Test
+{
+protected:
+    ~event_trace_test() override
+    {
+        event_trace::stop_recording();
+
+        std::error_code ignored;
+        std::filesystem::remove(path, ignored);
+    }
+
+    // Every event of the trace, up to its end or to the first error
+    std::vector<event_trace::event> read_all()
+    {
+        std::vector<event_trace::event> events;
+
+        auto reader = event_trace::reader::open(path);
+        EXPECT_TRUE(reader.has_value());
+        if (!reader.has_value())
+        {
+            return events;
+        }
+
+        while (true)
+        {
+            auto next = reader->next();
+            EXPECT_TRUE(next.has_value());
+            if (!next.has_value() || !next->has_value())
+            {
+                return events;
+            }
+            events.push_back(**next);
+        }
+    }
+
+    // A trace written by hand, after the magic
+    void write_trace(const std::string_view records)
+    {
+        std::ofstream file {path, std::ios::binary | std::ios::trunc};
+        file.write(event_trace::magic.data(), event_trace::magic.size());
+        file.write(records.data(), std::streamsize(records.size()));
+    }
+
+    std::filesystem::path path {
+        std::filesystem::temp_directory_path() / "manelemax_event_trace_test.trace"
+    };
+};
+
+TEST_F(event_trace_test, reads_back_every_kind)
+{
+    const media_session_backend::session_state state {
+        .media_props =
+            {.artist = L"Florin Salam",
+             .title  = L"Ce bine ne stă",
+             .app    = {.process_id = 4242, .name = L"Spotify"}},
+        .playing = true
+    };
+
+    ASSERT_TRUE(event_trace::start_recording(path).has_value());
+    event_trace::record_endpoint(kind::endpoint_opened, {.volume = 0.25f, .muted = true});
+    event_trace::record_session_changed("spotify", state);
+    event_trace::record_endpoint(kind::endpoint_changed, {.volume = 0.75f, .muted = false});
+    event_trace::record_default_changed();
+    event_trace::record_volume_written(1.0f);
+    event_trace::record_mute_written(false);
+    event_trace::record_session_removed("spotify");
+    event_trace::stop_recording();
+
+    // Not recording anymore
+    event_trace::record_default_changed();
+
+    const std::vector<event_trace::event> events = read_all();
+    ASSERT_EQ(events.size(), 7u);
+
+    EXPECT_EQ(events[0].type, kind::endpoint_opened);
+    EXPECT_EQ(events[0].endpoint.volume, 0.25f);
+    EXPECT_TRUE(events[0].endpoint.muted);
+
+    EXPECT_EQ(events[1].type, kind::session_changed);
+    EXPECT_EQ(events[1].session_id, "spotify");
+    EXPECT_TRUE(events[1].session.playing);
+    EXPECT_EQ(events[1].session.media_props.artist, L"Florin Salam");
+    EXPECT_EQ(events[1].session.media_props.title, L"Ce bine ne stă");
+    EXPECT_EQ(events[1].session.media_props.app.process_id, 4242u);
+    EXPECT_EQ(events[1].session.media_props.app.name, L"Spotify");
+
+    EXPECT_EQ(events[2].type, kind::endpoint_changed);
+    EXPECT_EQ(events[2].endpoint.volume, 0.75f);
+    EXPECT_FALSE(events[2].endpoint.muted);
+
+    EXPECT_EQ(events[3].type, kind::default_changed);
+
+    EXPECT_EQ(events[4].type, kind::volume_written);
+    EXPECT_EQ(events[4].endpoint.volume, 1.0f);
+
+    EXPECT_EQ(events[5].type, kind::mute_written);
+    EXPECT_FALSE(events[5].endpoint.muted);
+
+    EXPECT_EQ(events[6].type, kind::session_removed);
+    EXPECT_EQ(events[6].session_id, "spotify");
+
+    for (std::size_t idx = 1; idx != events.size(); ++idx)
+    {
+        EXPECT_GE(events[idx].at, events[idx - 1].at);
+    }
+}
+
+// As written by a process killed in the middle of a record
+TEST_F(event_trace_test, a_truncated_record_ends_the_trace)
+{
+    ASSERT_TRUE(event_trace::start_recording(path).has_value());
+    event_trace::record_volume_written(0.5f);
+    event_trace::record_session_removed("spotify");
+    event_trace::stop_recording();
+
+    std::filesystem::resize_file(path, std::filesystem::file_size(path) - 1);
+
+    const std::vector<event_trace::event> events = read_all();
+    ASSERT_EQ(events.size(), 1u);
+    EXPECT_EQ(events[0].type, kind::volume_written);
+}
+
+TEST_F(event_trace_test, an_unknown_kind_is_an_error)
+{
+    // A volume write at 0 µs, then a kind that does not exist
+    write_trace(std::string_view {"\x00\x06\x00\x00\x80\x3f\x00\x63", 8});
+
+    auto reader = event_trace::reader::open(path);
+    ASSERT_TRUE(reader.has_value());
+
+    const auto first = reader->next();
+    ASSERT_TRUE(first.has_value() && first->has_value());
+    EXPECT_EQ((*first)->endpoint.volume, 1.0f);
+
+    const auto second = reader->next();
+    ASSERT_FALSE(second.has_value());
+    EXPECT_EQ(second.error().function, "event_trace kind");
+    EXPECT_EQ(second.error().code, 0x63);
+}
+
+TEST_F(event_trace_test, another_magic_is_an_error)
+{
+    std::ofstream {path, std::ios::binary | std::ios::trunc} << "MMXTRC0";
+
+    const auto reader = event_trace::reader::open(path);
+    ASSERT_FALSE(reader.has_value());
+    EXPECT_EQ(reader.error().function, "event_trace magic");
+}
+
+// No logger runs in the tests, so the recording thread writes the records once enough are pending
+TEST_F(event_trace_test, the_pending_records_are_bounded_without_a_logger)
+{
+    ASSERT_TRUE(event_trace::start_recording(path).has_value());
+
+    const std::uintmax_t empty_size = std::filesystem::file_size(path);
+    for (int idx = 0; idx != 100'000; ++idx)
+    {
+        event_trace::record_volume_written(0.5f);
+    }
+    EXPECT_GT(std::filesystem::file_size(path), empty_size);
+
+    event_trace::stop_recording();
+    EXPECT_EQ(read_all().size(), 100'000u);
+}
+
+}  // namespace
+
+}  // namespace manelemax
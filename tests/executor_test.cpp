@@ -0,0 +1,143 @@
+#include <chrono>
+#include <future>
+#include <utility>
+#include <vector>
+
+#include <gtest/gtest.h>
+
+#include "executor.hpp"
+
+namespace manelemax
+{
+
+namespace
+{
+
+using namespace std::chrono_literals;
+
+TEST(executor, runs_the_tasks_in_order_on_its_thread)
+{
+    executor loop {16};
+
+    std::vector<int>  order;
+    std::promise<int> done;
+    for (int idx = 0; idx != 10; ++idx)
+    {
+        ASSERT_TRUE(loop.post([&, idx] {
+            EXPECT_TRUE(loop.is_executor_thread());
+            order.push_back(idx);
+        }));
+    }
+    loop.post([&] { done.set_value(int(order.size())); });
+
+    EXPECT_FALSE(loop.is_executor_thread());
+    EXPECT_EQ(done.get_future().get(), 10);
+    EXPECT_EQ(order, (std::vector {0, 1, 2, 3, 4, 5, 6, 7, 8, 9}));
+}
+
+TEST(executor, runs_a_delayed_task_once_it_is_due)
+{
+    executor loop {4};
+
+    const auto         posted_at = executor::clock::now();
+    std::promise<void> done;
+    ASSERT_TRUE(loop.post_after(20ms, [&] { done.set_value(); }));
+
+    done.get_future().get();
+    EXPECT_GE(executor::clock::now() - posted_at, 20ms);
+}
+
+// A timer posted while the loop waits for a later one must not wait for it
+TEST(executor, an_earlier_timer_overtakes_a_later_one)
+{
+    executor loop {4};
+
+    std::promise<void> done;
+    ASSERT_TRUE(loop.post_after(1h, [] {}));
+    ASSERT_TRUE(loop.post_after(1ms, [&] { done.set_value(); }));
+
+    EXPECT_EQ(done.get_future().wait_for(10s), std::future_status::ready);
+}
+
+// The loop waits for the first deadline while the timers grow, and reallocate, under it
+TEST(executor, waits_through_timers_posted_meanwhile)
+{
+    executor loop {1024};
+
+    std::promise<void> done;
+    ASSERT_TRUE(loop.post_after(1h, [] {}));
+    for (int idx = 0; idx != 1000; ++idx)
+    {
+        ASSERT_TRUE(loop.post_after(1h + std::chrono::seconds {idx}, [] {}));
+    }
+    ASSERT_TRUE(loop.post_after(1ms, [&] { done.set_value(); }));
+
+    EXPECT_EQ(done.get_future().wait_for(10s), std::future_status::ready);
+}
+
+TEST(executor, drops_the_tasks_past_its_capacity)
+{
+    executor loop {2, executor::mode::manual};
+
+    int runs = 0;
+    EXPECT_TRUE(loop.post([&] { ++runs; }));
+    EXPECT_TRUE(loop.post([&] { ++runs; }));
+    EXPECT_FALSE(loop.post([&] { ++runs; }));
+    EXPECT_EQ(loop.dropped(), 1u);
+
+    loop.advance_to(loop.now());
+    EXPECT_EQ(runs, 2);
+}
+
+TEST(executor, rejects_the_tasks_once_stopped)
+{
+    executor loop {4};
+    loop.stop();
+
+    EXPECT_FALSE(loop.post([] {}));
+    EXPECT_FALSE(loop.post_after(1ms, [] {}));
+    EXPECT_EQ(loop.dropped(), 2u);
+}
+
+TEST(executor, manual_runs_the_timers_in_deadline_order_on_its_clock)
+{
+    executor loop {8, executor::mode::manual};
+
+    using run = std::pair<int, executor::clock::duration>;
+
+    const auto       start = loop.now();
+    std::vector<run> runs;
+    const auto       record = [&](const int id) {
+        return [&, id] { runs.emplace_back(id, loop.now() - start); };
+    };
+
+    loop.post_after(30ms, record(3));
+    loop.post_after(10ms, record(1));
+    loop.post_after(20ms, [&] {
+        runs.emplace_back(2, loop.now() - start);
+
+        // Due within the advance, so it runs in it
+        loop.post_after(5ms, record(4));
+    });
+    loop.post_after(100ms, record(5));
+
+    loop.advance_to(start + 50ms);
+    EXPECT_EQ(
+        runs,
+        (std::vector<run> {
+            {1, 10ms},
+            {2, 20ms},
+            {4, 25ms},
+            {3, 30ms},
+        })
+    );
+    EXPECT_EQ(loop.now(), start + 50ms);
+
+    loop.advance_to(start + 100ms);
+    ASSERT_EQ(runs.size(), 5u);
+    EXPECT_EQ(runs.back().first, 5);
+}
+
+}  // namespace
+
+}  // namespace manelemax
@@ -0,0 +1,23 @@
+#include <cerrno>
+#include <expected>
+#include <memory>
+
+#include "media_session_backend.hpp"
+#include "volume_backend.hpp"
+
+namespace manelemax
+{
+
+// The tests have no platform backends, they pass the fake ones explicitly
+std::expected<std::unique_ptr<volume_backend>, os_error> volume_backend::make_default()
+{
+    return std::unexpected {os_error {"volume_backend::make_default", ENOSYS}};
+}
+
+std::expected<std::unique_ptr<media_session_backend>, os_error>
+media_session_backend::make_default()
+{
+    return std::unexpected {os_error {"media_session_backend::make_default", ENOSYS}};
+}
+
+}  // namespace manelemax
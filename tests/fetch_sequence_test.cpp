@@ -0,0 +1,301 @@
+#include <atomic>
+#include <chrono>
+#include <coroutine>
+#include <memory>
+#include <mutex>
+#include <optional>
+#include <string>
+#include <thread>
+#include <utility>
+#include <vector>
+
+#include <gtest/gtest.h>
+
+#include "detached_task.hpp"
+#include "fetch_sequence.hpp"
+
+namespace manelemax
+{
+
+namespace
+{
+
+// An asynchronous operation completed, or cancelled, by hand, like the ones of the media sessions.
+// The coroutine awaiting it resumes on the thread that completes it, or at once if it is already
+// complete. A cancelled operation yields no value.
+class fake_operation
+{
+public:
+    fake_operation()
+        : state_ {std::make_shared<state>()}
+    {
+    }
+
+    void complete(std::optional<std::string> value)
+    {
+        std::coroutine_handle<> awaiting;
+        {
+            std::lock_guard lock {state_->mutex};
+            if (state_->done)
+            {
+                return;
+            }
+            state_->done  = true;
+            state_->value = std::move(value);
+            awaiting      = std::exchange(state_->awaiting, {});
+        }
+
+        if (awaiting)
+        {
+            awaiting.resume();
+        }
+    }
+
+    void cancel()
+    {
+        complete(std::nullopt);
+    }
+
+    bool await_ready() const
+    {
+        std::lock_guard lock {state_->mutex};
+        return state_->done;
+    }
+
+    bool await_suspend(const std::coroutine_handle<> awaiting)
+    {
+        std::lock_guard lock {state_->mutex};
+        if (state_->done)
+        {
+            return false;
+        }
+        state_->awaiting = awaiting;
+        return true;
+    }
+
+    std::optional<std::string> await_resume() const
+    {
+        std::lock_guard lock {state_->mutex};
+        return state_->value;
+    }
+
+private:
+    struct state
+    {
+        mutable std::mutex         mutex {};
+        bool                       done {false};
+        std::optional<std::string> value {};
+        std::coroutine_handle<>    awaiting {};
+    };
+
+    std::shared_ptr<state> state_;
+};
+
+// Fetches a value the way the media session backend fetches the properties of a session
+class fetcher
+{
+public:
+    ~fetcher()
+    {
+        stop();
+        scope_.wait();
+    }
+
+    // The mutex is not held
+    fake_operation fetch()
+    {
+        fake_operation          operation;
+        fetch_sequence::started started;
+        {
+            std::lock_guard lock {mutex_};
+            started = sequence_.start([operation]() mutable { operation.cancel(); });
+        }
+
+        // Outside of the lock, the stale coroutine takes it once cancelled
+        if (started.cancel_previous)
+        {
+            started.cancel_previous();
+        }
+        apply(scope_.enter(), operation, started.id);
+        return operation;
+    }
+
+    void stop()
+    {
+        fetch_sequence::cancel_fn cancel;
+        {
+            std::lock_guard lock {mutex_};
+            cancel = sequence_.stop();
+        }
+
+        if (cancel)
+        {
+            cancel();
+        }
+    }
+
+    std::vector<std::string> applied() const
+    {
+        std::lock_guard lock {mutex_};
+        return applied_;
+    }
+
+    int completed() const
+    {
+        std::lock_guard lock {mutex_};
+        return completed_;
+    }
+
+private:
+    detached_task
+    apply(async_scope::guard /*guard*/, fake_operation operation, const std::uint64_t id)
+    {
+        const std::optional<std::string> value = co_await operation;
+
+        std::lock_guard lock {mutex_};
+        ++completed_;
+        if (!sequence_.is_latest(id))
+        {
+            co_return;
+        }
+
+        sequence_.finish(id);
+        if (value.has_value())
+        {
+            applied_.push_back(*value);
+        }
+    }
+
+    mutable std::mutex       mutex_ {};
+    fetch_sequence           sequence_ {};
+    std::vector<std::string> applied_ {};
+    int                      completed_ {0};
+
+    // Last, so that it waits for the coroutines before the members above are destroyed
+    async_scope scope_ {};
+};
+
+TEST(fetch_sequence, hands_back_the_cancellation_of_the_fetch_in_progress)
+{
+    fetch_sequence sequence;
+    int            cancelled = 0;
+
+    fetch_sequence::started first = sequence.start([&] { ++cancelled; });
+    EXPECT_FALSE(first.cancel_previous);
+    EXPECT_TRUE(sequence.is_latest(first.id));
+
+    fetch_sequence::started second = sequence.start([&] { cancelled += 10; });
+    EXPECT_FALSE(sequence.is_latest(first.id));
+    EXPECT_TRUE(sequence.is_latest(second.id));
+    ASSERT_TRUE(second.cancel_previous);
+    second.cancel_previous();
+    EXPECT_EQ(cancelled, 1);
+
+    // Nothing left to cancel once the latest fetch finished
+    sequence.finish(second.id);
+    EXPECT_FALSE(sequence.start([] {}).cancel_previous);
+}
+
+TEST(fetch_sequence, stop_makes_the_fetch_in_progress_stale)
+{
+    fetch_sequence sequence;
+
+    const fetch_sequence::started started = sequence.start([] {});
+    EXPECT_TRUE(sequence.stop());
+    EXPECT_FALSE(sequence.is_latest(started.id));
+    EXPECT_FALSE(sequence.stop());
+}
+
+TEST(fetch_sequence, applies_the_result_of_the_latest_fetch)
+{
+    fetcher        fetches;
+    fake_operation operation = fetches.fetch();
+
+    EXPECT_TRUE(fetches.applied().empty());
+    operation.complete("Ce bine ne sta");
+    EXPECT_EQ(fetches.applied(), (std::vector<std::string> {"Ce bine ne sta"}));
+}
+
+// The newer fetch cancels the older one, which completes at once on this thread and is ignored
+TEST(fetch_sequence, a_newer_fetch_cancels_the_older_one)
+{
+    fetcher        fetches;
+    fake_operation older = fetches.fetch();
+    fake_operation newer = fetches.fetch();
+    EXPECT_EQ(fetches.completed(), 1);
+
+    // Too late, the older one was cancelled already
+    older.complete("A");
+    newer.complete("B");
+    EXPECT_EQ(fetches.applied(), (std::vector<std::string> {"B"}));
+    EXPECT_EQ(fetches.completed(), 2);
+}
+
+// Destroying the fetcher cancels the fetch in progress, then waits for its coroutine
+TEST(fetch_sequence, stopping_completes_the_fetch_in_progress)
+{
+    std::optional<fetcher> fetches {std::in_place};
+    fake_operation         operation = fetches->fetch();
+
+    fetches.reset();
+    EXPECT_TRUE(operation.await_ready());
+}
+
+TEST(detached_task, runs_at_once_up_to_its_first_suspension)
+{
+    fake_operation operation;
+    async_scope    scope;
+    std::string    steps;
+
+    const auto task = [&](async_scope::guard /*guard*/) -> detached_task {
+        steps += "started ";
+        co_await operation;
+        steps += "resumed";
+    };
+
+    task(scope.enter());
+    EXPECT_EQ(steps, "started ");
+
+    operation.complete("A");
+    EXPECT_EQ(steps, "started resumed");
+    scope.wait();
+}
+
+TEST(async_scope, waits_for_a_coroutine_resumed_on_another_thread)
+{
+    fake_operation    operation;
+    std::atomic<bool> resumed {false};
+
+    const auto task = [&](async_scope::guard /*guard*/) -> detached_task {
+        co_await operation;
+        std::this_thread::sleep_for(std::chrono::milliseconds {20});
+        resumed = true;
+    };
+
+    async_scope scope;
+    task(scope.enter());
+
+    std::jthread completer {[operation]() mutable { operation.complete("A"); }};
+    scope.wait();
+    EXPECT_TRUE(resumed);
+}
+
+// The owner destroys the scope as soon as wait() returns, while the thread that left it last may
+// still be in the guard destructor
+TEST(async_scope, can_be_destroyed_as_soon_as_wait_returns)
+{
+    for (int round = 0; round != 2000; ++round)
+    {
+        auto scope = std::make_unique<async_scope>();
+
+        std::jthread leaving {[guard = std::optional {scope->enter()}]() mutable {
+            guard.reset();
+        }};
+        scope->wait();
+        scope.reset();
+    }
+}
+
+}  // namespace
+
+}  // namespace manelemax
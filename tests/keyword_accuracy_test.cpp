@@ -0,0 +1,121 @@
+#include <algorithm>
+#include <initializer_list>
+#include <string>
+#include <string_view>
+#include <vector>
+
+#include <gtest/gtest.h>
+
+#include "fuzzy_keyword_matcher.hpp"
+#include "keywords.hpp"
+#include "labeled_tracks.hpp"
+#include "string_utils.hpp"
+#include "track_classifier.hpp"
+
+namespace manelemax
+{
+
+namespace
+{
+
+struct accuracy
+{
+    std::size_t true_positives {0};
+    std::size_t false_positives {0};
+    std::size_t false_negatives {0};
+
+    // The artists of the tracks classified wrongly
+    std::vector<std::wstring_view> wrong {};
+
+    double precision() const
+    {
+        return double(true_positives) / double(true_positives + false_positives);
+    }
+
+    double recall() const
+    {
+        return double(true_positives) / double(true_positives + false_negatives);
+    }
+};
+
+template<typename Matcher>
+accuracy measure(const Matcher& matcher)
+{
+    track_classifier classifier;
+    accuracy         result;
+
+    for (const labeled_track& labeled : g_labeled_tracks)
+    {
+        const bool matched =
+            !classifier.classify(matcher, labeled.artist, labeled.title).keyword.empty();
+        const bool manele = labeled.expected != label::other;
+
+        result.true_positives += matched && manele;
+        result.false_positives += matched && !manele;
+        result.false_negatives += !matched && manele;
+
+        if (matched != manele)
+        {
+            result.wrong.push_back(labeled.artist);
+        }
+    }
+    return result;
+}
+
+std::vector<std::wstring_view> artists_labeled(const std::initializer_list<label> labels)
+{
+    std::vector<std::wstring_view> artists;
+    for (const labeled_track& labeled : g_labeled_tracks)
+    {
+        if (std::ranges::find(labels, labeled.expected) != labels.end())
+        {
+            artists.push_back(labeled.artist);
+        }
+    }
+    return artists;
+}
+
+TEST(keyword_accuracy, exact_matches_only_the_spelled_keywords)
+{
+    const accuracy result = measure(g_keyword_table.matcher());
+
+    EXPECT_EQ(result.precision(), 1.0);
+    EXPECT_EQ(result.wrong, artists_labeled({label::misspelled, label::unmatched}));
+}
+
+TEST(keyword_accuracy, fuzzy_recalls_the_misspellings_without_losing_precision)
+{
+    const accuracy exact = measure(g_keyword_table.matcher());
+    const accuracy fuzzy = measure(fuzzy_keyword_matcher {g_keyword_table.matcher()});
+
+    EXPECT_EQ(fuzzy.precision(), 1.0);
+    EXPECT_EQ(fuzzy.wrong, artists_labeled({label::unmatched}));
+    EXPECT_GT(fuzzy.recall(), exact.recall());
+}
+
+// An exact match is preferred, so the fuzzy matcher finds the same keyword for every track the
+// exact one matches
+TEST(keyword_accuracy, fuzzy_keeps_the_exact_matches)
+{
+    const keyword_matcher       exact = g_keyword_table.matcher();
+    const fuzzy_keyword_matcher fuzzy {exact};
+
+    track_classifier classifier;
+    for (const labeled_track& labeled : g_labeled_tracks)
+    {
+        const std::string exact_keyword {
+            classifier.classify(exact, labeled.artist, labeled.title).keyword
+        };
+        if (exact_keyword.empty())
+        {
+            continue;
+        }
+
+        EXPECT_EQ(classifier.classify(fuzzy, labeled.artist, labeled.title).keyword, exact_keyword)
+            << stringutils::wide_to_utf8(labeled.artist);
+    }
+}
+
+}  // namespace
+
+}  // namespace manelemax
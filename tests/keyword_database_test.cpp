@@ -0,0 +1,315 @@
+#include <array>
+#include <atomic>
+#include <cerrno>
+#include <chrono>
+#include <cstdint>
+#include <cstring>
+#include <filesystem>
+#include <fstream>
+#include <memory>
+#include <span>
+#include <string>
+#include <string_view>
+#include <thread>
+#include <vector>
+
+#include <gtest/gtest.h>
+
+#include "keyword_database.hpp"
+#include "rcu_ptr.hpp"
+
+namespace manelemax
+{
+
+namespace
+{
+
+using namespace std::chrono_literals;
+
+constexpr std::array<std::string_view, 3> g_keywords {"florin salam", "salam", "guta"};
+constexpr std::array<keyword_weight, 1>   g_weights {
+    keyword_weight {.keyword = "guta", .weight = 40, .field = keyword_field::artist}
+};
+
+// The indexes of the keywords matched in the text, in the order they were reported
+std::vector<std::uint16_t> matches(const keyword_matcher& matcher, const std::string_view text)
+{
+    std::vector<std::uint16_t> found;
+    matcher.for_each_match(text, [&found](const std::uint16_t keyword) {
+        found.push_back(keyword);
+    });
+    return found;
+}
+
+class keyword_database_test : public ::testing::Test
+{
+protected:
+    void SetUp() override
+    {
+        auto compiled = keyword_database::compile(g_keywords, g_weights);
+        ASSERT_TRUE(compiled.has_value());
+        contents = *std::move(compiled);
+        std::memcpy(&hdr, contents.data(), sizeof(hdr));
+    }
+
+    ~keyword_database_test() override
+    {
+        std::error_code ignored;
+        std::filesystem::permissions(path, std::filesystem::perms::owner_all, ignored);
+        std::filesystem::remove(path, ignored);
+    }
+
+    // Writes the compiled contents, with hdr as their header, and opens the file
+    std::expected<keyword_database, os_error> open()
+    {
+        std::memcpy(contents.data(), &hdr, sizeof(hdr));
+        return open(contents);
+    }
+
+    std::expected<keyword_database, os_error> open(const std::string_view data)
+    {
+        std::ofstream {path, std::ios::binary | std::ios::trunc}.write(
+            data.data(),
+            std::streamsize(data.size())
+        );
+        return keyword_database::open(path);
+    }
+
+    // The check an open() of the current contents failed
+    std::string_view failed_check()
+    {
+        const auto database = open();
+        return database.has_value() ? "none" : database.error().function;
+    }
+
+    template<typename T>
+    T& at(const std::uint64_t offset)
+    {
+        return *reinterpret_cast<T*>(contents.data() + offset);
+    }
+
+    std::filesystem::path path {
+        std::filesystem::temp_directory_path() / "manelemax_keyword_database_test.kwdb"
+    };
+    std::string              contents {};
+    keyword_database::header hdr {};
+};
+
+TEST_F(keyword_database_test, reads_back_what_was_compiled)
+{
+    const auto database = open();
+    ASSERT_TRUE(database.has_value());
+
+    const keyword_matcher matcher = database->matcher();
+    ASSERT_EQ(matcher.keyword_count(), g_keywords.size());
+    for (std::size_t idx = 0; idx != g_keywords.size(); ++idx)
+    {
+        EXPECT_EQ(matcher.keyword(idx), g_keywords[idx]);
+    }
+    EXPECT_EQ(matcher.weight(0), keyword_matcher::default_weight);
+    EXPECT_EQ(matcher.weight(2), 40);
+    EXPECT_EQ(matcher.field(0), keyword_field::any);
+    EXPECT_EQ(matcher.field(2), keyword_field::artist);
+
+    // The same automaton as the compiled-in tables, the nested "salam" included
+    EXPECT_EQ(matches(matcher, "guta si florin salam"), (std::vector<std::uint16_t> {2, 0}));
+    EXPECT_EQ(matches(matcher, "salam de sibiu"), (std::vector<std::uint16_t> {1}));
+    EXPECT_TRUE(matches(matcher, "salamandra gutai").empty());
+}
+
+// The check compile() failed
+std::string_view failed_compile_check(
+    const std::span<const std::string_view> keywords,
+    const std::span<const keyword_weight>   weights = {}
+)
+{
+    const auto compiled = keyword_database::compile(keywords, weights);
+    return compiled.has_value() ? "none" : compiled.error().function;
+}
+
+TEST_F(keyword_database_test, compile_rejects_what_could_never_match)
+{
+    constexpr std::array<std::string_view, 2> duplicates {"guta", "guta"};
+    constexpr std::array<std::string_view, 1> not_normalized {"Guta"};
+    constexpr std::array<keyword_weight, 1>   unknown_weight {
+        keyword_weight {.keyword = "salami"}
+    };
+
+    EXPECT_EQ(failed_compile_check(duplicates), "keyword_database: duplicate check");
+    EXPECT_EQ(failed_compile_check(not_normalized), "keyword_database: keyword check");
+    EXPECT_EQ(failed_compile_check(g_keywords, unknown_weight), "keyword_database: weight check");
+}
+
+TEST_F(keyword_database_test, a_missing_file_is_not_found)
+{
+    const auto database = keyword_database::open(path);
+    ASSERT_FALSE(database.has_value());
+    EXPECT_EQ(database.error().function, "keyword_database: open");
+    EXPECT_EQ(database.error().code, ENOENT);
+}
+
+// Reported as such, rather than as a missing file
+TEST_F(keyword_database_test, an_unreadable_file_is_not_reported_as_missing)
+{
+    ASSERT_TRUE(open().has_value());
+    std::filesystem::permissions(path, std::filesystem::perms::none);
+    if (std::ifstream {path}.is_open())
+    {
+        GTEST_SKIP() << "The permissions are not enforced for this user";
+    }
+
+    const auto database = keyword_database::open(path);
+    ASSERT_FALSE(database.has_value());
+    EXPECT_EQ(database.error().function, "keyword_database: open");
+    EXPECT_NE(database.error().code, ENOENT);
+}
+
+TEST_F(keyword_database_test, rejects_a_corrupt_header)
+{
+    contents.resize(sizeof(hdr) - 1);
+    EXPECT_EQ(open(contents).error().function, "keyword_database: header size check");
+    SetUp();
+
+    hdr.magic[0] = 'X';
+    EXPECT_EQ(failed_check(), "keyword_database: magic check");
+    SetUp();
+
+    hdr.version = keyword_database::format_version + 1;
+    EXPECT_EQ(failed_check(), "keyword_database: version check");
+    SetUp();
+
+    hdr.symbol_count = 26;
+    EXPECT_EQ(failed_check(), "keyword_database: symbol count check");
+    SetUp();
+
+    hdr.state_count = 0;
+    EXPECT_EQ(failed_check(), "keyword_database: state count check");
+    SetUp();
+
+    hdr.keyword_count = keyword_matcher::no_keyword;
+    EXPECT_EQ(failed_check(), "keyword_database: keyword count check");
+}
+
+// The sections are checked against the size of the file, as it was read
+TEST_F(keyword_database_test, rejects_sections_out_of_the_file)
+{
+    contents.pop_back();
+    EXPECT_EQ(open(contents).error().function, "keyword_database: section bounds check");
+    SetUp();
+
+    hdr.outputs_offset = contents.size();
+    EXPECT_EQ(failed_check(), "keyword_database: section bounds check");
+    SetUp();
+
+    hdr.keywords_offset += 1;
+    EXPECT_EQ(failed_check(), "keyword_database: section bounds check");
+    SetUp();
+
+    hdr.string_pool_size = UINT64_MAX;
+    EXPECT_EQ(failed_check(), "keyword_database: section bounds check");
+}
+
+// Every index in the tables is checked, so that a corrupt file cannot make the matcher read out
+// of bounds
+TEST_F(keyword_database_test, rejects_indexes_out_of_the_tables)
+{
+    using transition_row = keyword_matcher::transition_row;
+    using state_output   = keyword_matcher::state_output;
+    using keyword_ref    = keyword_matcher::keyword_ref;
+
+    at<transition_row>(hdr.transitions_offset + sizeof(transition_row))[3] =
+        std::uint16_t(hdr.state_count);
+    EXPECT_EQ(failed_check(), "keyword_database: transition check");
+    SetUp();
+
+    at<state_output>(hdr.outputs_offset).longest = std::uint16_t(hdr.keyword_count);
+    EXPECT_EQ(failed_check(), "keyword_database: output check");
+    SetUp();
+
+    at<keyword_ref>(hdr.keywords_offset).length = std::uint32_t(hdr.string_pool_size) + 1;
+    EXPECT_EQ(failed_check(), "keyword_database: keyword check");
+    SetUp();
+
+    at<keyword_ref>(hdr.keywords_offset).field = keyword_field(3);
+    EXPECT_EQ(failed_check(), "keyword_database: keyword check");
+}
+
+// Destroyed flags, that outlive the objects they are set by
+struct tracked
+{
+    ~tracked()
+    {
+        destroyed->store(true);
+    }
+
+    std::atomic<bool>* destroyed;
+};
+
+TEST(rcu_ptr, update_waits_for_the_readers_of_the_previous_object)
+{
+    std::atomic<bool> first_destroyed {false};
+    std::atomic<bool> second_destroyed {false};
+    rcu_ptr<tracked>  ptr {std::make_unique<const tracked>(&first_destroyed)};
+
+    std::atomic<bool> reading {false};
+    std::atomic<bool> release {false};
+    std::jthread      reader {[&] {
+        const auto guard = ptr.read();
+        reading          = true;
+        reading.notify_one();
+        release.wait(false);
+        EXPECT_FALSE(guard->destroyed->load());
+    }};
+    reading.wait(false);
+
+    std::atomic<bool> updated {false};
+    std::jthread      writer {[&] {
+        ptr.update(std::make_unique<const tracked>(&second_destroyed));
+        updated = true;
+    }};
+
+    std::this_thread::sleep_for(50ms);
+    EXPECT_FALSE(updated);
+    EXPECT_FALSE(first_destroyed);
+
+    // The readers that come meanwhile already see the new object, and do not delay the update
+    EXPECT_EQ(ptr.read()->destroyed, &second_destroyed);
+
+    release = true;
+    release.notify_one();
+    writer.join();
+    EXPECT_TRUE(first_destroyed);
+    EXPECT_FALSE(second_destroyed);
+}
+
+TEST(rcu_ptr, readers_never_see_a_destroyed_object)
+{
+    constexpr std::size_t update_count {2000};
+
+    std::vector<std::atomic<bool>> destroyed(update_count + 1);
+    rcu_ptr<tracked>               ptr {std::make_unique<const tracked>(&destroyed[0])};
+
+    std::atomic<bool> stop {false};
+    std::atomic<int>  torn {0};
+    std::jthread      reader {[&] {
+        while (!stop)
+        {
+            const auto guard = ptr.read();
+            torn += guard->destroyed->load() ? 1 : 0;
+        }
+    }};
+
+    for (std::size_t idx = 1; idx <= update_count; ++idx)
+    {
+        ptr.update(std::make_unique<const tracked>(&destroyed[idx]));
+        EXPECT_TRUE(destroyed[idx - 1]);
+    }
+    stop = true;
+    reader.join();
+
+    EXPECT_EQ(torn, 0);
+}
+
+}  // namespace
+
+}  // namespace manelemax
@@ -0,0 +1,167 @@
+#include <algorithm>
+#include <array>
+#include <cstdint>
+#include <random>
+#include <string>
+#include <string_view>
+#include <unordered_set>
+#include <utility>
+#include <vector>
+
+#include <gtest/gtest.h>
+
+#include "keyword_matcher.hpp"
+#include "keywords.hpp"
+#include "string_utils.hpp"
+
+namespace manelemax
+{
+
+namespace
+{
+
+// Nested at the end of one another, overlapping, and longer than the 4 words the substring search
+// was limited to
+constexpr std::array g_nested_keywords {
+    "la"sv,
+    "la la"sv,
+    "la la la la la la"sv,
+    "de la"sv,
+    "jean de la craiova"sv,
+    "craiova"sv,
+    "de la craiova la la"sv,
+    "sorin copilu de aur din craiova live"sv,
+};
+
+constexpr auto g_nested_table = make_keyword_table<g_nested_keywords>();
+
+// What the matcher replaced: every word aligned substring, looked up in a set
+std::vector<std::string> baseline_matches(
+    const keyword_matcher& matcher,
+    const std::string&     text,
+    const std::size_t      max_words = 0
+)
+{
+    std::unordered_set<std::string_view> keywords;
+    for (std::size_t idx = 0; idx != matcher.keyword_count(); ++idx)
+    {
+        keywords.insert(matcher.keyword(idx));
+    }
+
+    std::vector<std::string> found;
+    for (std::string& substr : stringutils::all_word_aligned_substrings(text, max_words))
+    {
+        if (keywords.contains(substr))
+        {
+            found.push_back(std::move(substr));
+        }
+    }
+    std::ranges::sort(found);
+    return found;
+}
+
+// The matcher only reports the longest keyword ending at each word, the ones nested at its end are
+// added back
+std::vector<std::string> automaton_matches(const keyword_matcher& matcher, const std::string& text)
+{
+    std::vector<std::string> found;
+    matcher.for_each_match(text, [&matcher, &found](const std::uint16_t longest) {
+        const std::string_view keyword = matcher.keyword(longest);
+        for (std::size_t idx = 0; idx != matcher.keyword_count(); ++idx)
+        {
+            const std::string_view nested = matcher.keyword(idx);
+            if (keyword == nested ||
+                (keyword.ends_with(nested) && keyword[keyword.size() - nested.size() - 1] == ' '))
+            {
+                found.emplace_back(nested);
+            }
+        }
+    });
+    std::ranges::sort(found);
+    return found;
+}
+
+// The words of the keywords, their near misses, and a few others
+std::vector<std::string> vocabulary_of(const keyword_matcher& matcher)
+{
+    std::vector<std::string> words {"muzica", "de", "petrecere", "live", "remix"};
+    for (std::size_t idx = 0; idx != matcher.keyword_count(); ++idx)
+    {
+        for (std::string& word : stringutils::split(std::string {matcher.keyword(idx)}))
+        {
+            if (word.size() > 1)
+            {
+                words.emplace_back(word, 0, word.size() - 1);
+            }
+            words.push_back(word + "a");
+            words.push_back(std::move(word));
+        }
+    }
+    return words;
+}
+
+// Up to 12 words, separated by one or two spaces, as the scan has to skip runs of them
+std::string random_text(std::mt19937& rng, const std::vector<std::string>& vocabulary)
+{
+    std::uniform_int_distribution<std::size_t> word_count_dist {0, 12};
+    std::uniform_int_distribution<std::size_t> word_dist {0, vocabulary.size() - 1};
+    std::uniform_int_distribution<int>         space_dist {0, 9};
+
+    const std::size_t word_count = word_count_dist(rng);
+
+    std::string text;
+    for (std::size_t idx = 0; idx != word_count; ++idx)
+    {
+        text.append(space_dist(rng) == 0 ? "  " : " ");
+        text.append(vocabulary[word_dist(rng)]);
+    }
+    return text;
+}
+
+void expect_agreement(const keyword_matcher& matcher, const std::uint32_t seed)
+{
+    constexpr int text_count {20'000};
+
+    std::mt19937                   rng {seed};
+    const std::vector<std::string> vocabulary = vocabulary_of(matcher);
+
+    int matched = 0;
+    for (int idx = 0; idx != text_count; ++idx)
+    {
+        const std::string              text     = random_text(rng, vocabulary);
+        const std::vector<std::string> expected = baseline_matches(matcher, text);
+        ASSERT_EQ(automaton_matches(matcher, text), expected) << '"' << text << '"';
+        matched += expected.empty() ? 0 : 1;
+    }
+
+    // Not an agreement on finding nothing
+    EXPECT_GT(matched, text_count / 10);
+}
+
+TEST(keyword_matcher, agrees_with_the_word_aligned_substrings)
+{
+    expect_agreement(g_keyword_table.matcher(), 20261017);
+}
+
+TEST(keyword_matcher, agrees_with_the_word_aligned_substrings_on_nested_keywords)
+{
+    expect_agreement(g_nested_table.matcher(), 20261018);
+}
+
+// The substring search only looked at up to 4 words
+TEST(keyword_matcher, matches_keywords_of_any_word_count)
+{
+    const keyword_matcher matcher = g_nested_table.matcher();
+    const std::string     text {"sorin copilu de aur din craiova live la la la la la la"};
+
+    const std::vector<std::string> found = automaton_matches(matcher, text);
+    EXPECT_EQ(std::ranges::count(found, "sorin copilu de aur din craiova live"), 1);
+    EXPECT_EQ(std::ranges::count(found, "la la la la la la"), 1);
+    EXPECT_EQ(found, baseline_matches(matcher, text));
+
+    EXPECT_NE(found, baseline_matches(matcher, text, 4));
+}
+
+}  // namespace
+
+}  // namespace manelemax
@@ -0,0 +1,78 @@
+#pragma once
+
+#include <array>
+#include <string_view>
+
+namespace manelemax
+{
+
+enum class label
+{
+    manele,      // Spelled as a keyword
+    misspelled,  // Manele, with a keyword within the edits the fuzzy matcher allows
+    unmatched,   // Manele, with a keyword too far, or as close to another keyword word
+    other        // Not manele, near misses of the keywords included
+};
+
+struct labeled_track
+{
+    std::wstring_view artist;
+    std::wstring_view title;
+    label             expected;
+};
+
+// Labeled by hand, for the precision and recall of the exact and fuzzy matching, measured by both
+// the keyword accuracy tests and the benchmarks
+inline constexpr auto g_labeled_tracks = std::to_array<labeled_track>({
+    {L"Florin Salam", L"Ma tin de tine", label::manele},
+    {L"Nicolae Guta", L"Cine e ca mine", label::manele},
+    {L"Nicolae Guța", L"Of viata mea", label::manele},
+    {L"Dani Mocanu", L"Împărăția mea", label::manele},
+    {L"Babasha", L"Iubirea mea", label::manele},
+    {L"Colaj", L"Manele de dragoste 2024", label::manele},
+    {L"Nek & Babi Minune", L"Ce viata", label::manele},
+    {L"Geo", L"Florin Salam - Regele", label::manele},
+    {L"Florin Salamm", L"Ma tin de tine", label::misspelled},
+    {L"Tzanca Uragan", L"Numai tu", label::misspelled},
+    {L"Tzanka Uraganu", L"Fara tine", label::misspelled},
+    {L"Romeo Fantastic", L"Sunt tot al tau", label::misspelled},
+    {L"Sorinel Pustu", L"Dusmanii mei", label::misspelled},
+    {L"Bogdan de la Ploesti", L"Viata mea", label::misspelled},
+    {L"Jean de la Craiva", L"Banii", label::misspelled},
+    {L"Liviu Mititel", L"Tu esti viata mea", label::misspelled},
+    {L"Adi de la Vilcea", L"Dragostea mea", label::misspelled},
+
+    // No edit is allowed in a word of 4 letters
+    {L"Nicolae Gutta", L"Cine e ca mine", label::unmatched},
+    {L"Costel Bijou", L"Ce frumoasa esti", label::unmatched},
+
+    // One edit from both "salam" and "salaj", the latter is picked
+    {L"Florin Salan", L"Saracie lucie", label::unmatched},
+
+    // A single word is not corrected
+    {L"Manea", L"Muzica de petrecere", label::unmatched},
+
+    {L"Adele", L"Rolling in the Deep", label::other},
+    {L"Dua Lipa", L"Levitating", label::other},
+    {L"Coldplay", L"Viva La Vida", label::other},
+    {L"Radiohead", L"Paranoid Android", label::other},
+    {L"Metallica", L"Nothing Else Matters", label::other},
+    {L"Eminem", L"Lose Yourself", label::other},
+    {L"Narcos", L"Tuyo (Main Title Theme)", label::other},
+    {L"Denise", L"Bright Morning", label::other},
+    {L"Leonardo", L"Renaissance Suite", label::other},
+    {L"Valentina", L"Dancing Queen", label::other},
+    {L"Florin Piersic", L"Povestea vorbei", label::other},
+    {L"Salami Brothers", L"Pizza Party", label::other},
+    {L"Jean Michel Jarre", L"Oxygene Part IV", label::other},
+    {L"Brandi Carlile", L"The Joke", label::other},
+    {L"Romeo Santos", L"Propuesta Indecente", label::other},
+    {L"Costel Busuioc", L"Ave Maria", label::other},
+    {L"Nek", L"Laura non c'è", label::other},
+    {L"Brandy", L"The Boy Is Mine", label::other},
+    {L"Modjo", L"Lady (Hear Me Tonight)", label::other},
+    {L"Nino Rota", L"Love Theme from The Godfather", label::other},
+    {L"Valentino Khan", L"Deep Down Low", label::other},
+});
+
+}  // namespace manelemax
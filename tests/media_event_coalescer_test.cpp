@@ -0,0 +1,164 @@
+#include <chrono>
+#include <future>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include <gtest/gtest.h>
+
+#include "executor.hpp"
+#include "media_event_coalescer.hpp"
+#include "metrics.hpp"
+
+namespace manelemax
+{
+
+namespace
+{
+
+using namespace std::chrono_literals;
+
+// Records what the coalescer lets through, "play <title>" or "stop"
+struct recording_listener : public system_media_properties_notifier::listener
+{
+    void on_play(const system_media_properties_notifier::properties& media_props) override
+    {
+        events.push_back("play " + std::string(media_props.title.begin(), media_props.title.end()));
+    }
+
+    void on_stop() override
+    {
+        events.emplace_back("stop");
+    }
+
+    std::vector<std::string> events;
+};
+
+system_media_properties_notifier::properties track(const std::wstring& title)
+{
+    return {.artist = L"Florin Salam", .title = title};
+}
+
+// The increase of a counter since the snapshot, the metrics being those of the whole process
+std::uint64_t counted_since(const metrics::snapshot& before, const metrics::counter id)
+{
+    return metrics::take_snapshot().get(id) - before.get(id);
+}
+
+class media_event_coalescer_test : public ::testing::Test
+{
+protected:
+    media_event_coalescer_test()
+    {
+        coalescer.set_listener(&lsn);
+    }
+
+    void advance(const executor::clock::duration delay)
+    {
+        loop.advance_to(loop.now() + delay);
+    }
+
+    static constexpr executor::clock::duration window {150ms};
+
+    const metrics::snapshot before {metrics::take_snapshot()};
+
+    executor              loop {16, executor::mode::manual};
+    recording_listener    lsn;
+    media_event_coalescer coalescer {loop, window};
+};
+
+TEST_F(media_event_coalescer_test, merges_a_burst_into_its_last_state)
+{
+    coalescer.on_stop();
+    coalescer.on_play(track(L"Unknown"));
+    coalescer.on_play(track(L"Ce bine ne sta"));
+
+    advance(window - 1ms);
+    EXPECT_TRUE(lsn.events.empty());
+
+    advance(1ms);
+    EXPECT_EQ(lsn.events, (std::vector<std::string> {"play Ce bine ne sta"}));
+    EXPECT_EQ(counted_since(before, metrics::counter::transitions), 1u);
+}
+
+TEST_F(media_event_coalescer_test, later_events_do_not_extend_the_window)
+{
+    coalescer.on_play(track(L"A"));
+    advance(100ms);
+    coalescer.on_play(track(L"B"));
+    advance(50ms);
+
+    EXPECT_EQ(lsn.events, (std::vector<std::string> {"play B"}));
+}
+
+TEST_F(media_event_coalescer_test, drops_a_burst_that_ends_where_it_started)
+{
+    coalescer.on_play(track(L"A"));
+    advance(window);
+
+    coalescer.on_stop();
+    coalescer.on_play(track(L"A"));
+    advance(window);
+
+    coalescer.on_stop();
+    advance(window);
+
+    EXPECT_EQ(lsn.events, (std::vector<std::string> {"play A", "stop"}));
+    EXPECT_EQ(counted_since(before, metrics::counter::transitions), 2u);
+}
+
+TEST_F(media_event_coalescer_test, delivers_the_first_transition_even_if_a_stop)
+{
+    coalescer.on_stop();
+    advance(window);
+
+    EXPECT_EQ(lsn.events, (std::vector<std::string> {"stop"}));
+}
+
+TEST_F(media_event_coalescer_test, drops_the_burst_once_the_executor_stopped)
+{
+    loop.stop();
+
+    coalescer.on_play(track(L"A"));
+    advance(window);
+
+    EXPECT_TRUE(lsn.events.empty());
+    EXPECT_EQ(counted_since(before, metrics::counter::transitions), 0u);
+    EXPECT_EQ(counted_since(before, metrics::counter::dropped_bursts), 1u);
+}
+
+// Events from several threads, as the backends raise them, over a threaded executor
+TEST(media_event_coalescer, merges_the_events_of_concurrent_sources)
+{
+    const metrics::snapshot before {metrics::take_snapshot()};
+
+    executor              loop {16};
+    recording_listener    lsn;
+    media_event_coalescer coalescer {loop, 50ms};
+    coalescer.set_listener(&lsn);
+
+    {
+        std::vector<std::jthread> sources;
+        for (int source = 0; source != 4; ++source)
+        {
+            sources.emplace_back([&] {
+                for (int idx = 0; idx != 100; ++idx)
+                {
+                    coalescer.on_play(track(L"A"));
+                }
+            });
+        }
+    }
+
+    std::promise<void> done;
+    loop.post_after(100ms, [&] { done.set_value(); });
+    done.get_future().get();
+    loop.stop();
+
+    EXPECT_EQ(lsn.events, (std::vector<std::string> {"play A"}));
+    EXPECT_EQ(counted_since(before, metrics::counter::transitions), 1u);
+}
+
+}  // namespace
+
+}  // namespace manelemax
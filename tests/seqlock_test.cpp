@@ -0,0 +1,144 @@
+#include <algorithm>
+#include <array>
+#include <atomic>
+#include <cstdint>
+#include <string>
+#include <string_view>
+#include <thread>
+#include <vector>
+
+#include <gtest/gtest.h>
+
+#include "match_state.hpp"
+#include "seqlock.hpp"
+
+namespace manelemax
+{
+
+namespace
+{
+
+// Every word holds the same counter, so a torn read shows as words that differ
+struct stamped
+{
+    std::array<std::uint64_t, 9> words {};
+};
+
+stamped stamp(const std::uint64_t value)
+{
+    stamped result;
+    result.words.fill(value);
+    return result;
+}
+
+bool is_whole(const stamped& value)
+{
+    return std::ranges::all_of(value.words, [&](const std::uint64_t word) {
+        return word == value.words[0];
+    });
+}
+
+// Several writers and readers, with the readers also checking that the value never goes back
+// within a writer's own sequence
+TEST(seqlock, never_returns_a_torn_value)
+{
+    constexpr int           writer_count {2};
+    constexpr int           reader_count {2};
+    constexpr std::uint64_t stores {200'000};
+
+    seqlock<stamped>  lock {stamp(0)};
+    std::atomic<bool> done {false};
+    std::atomic<int>  torn {0};
+
+    std::vector<std::jthread> readers;
+    for (int reader = 0; reader != reader_count; ++reader)
+    {
+        readers.emplace_back([&] {
+            std::array<std::uint64_t, writer_count> last {};
+            while (!done.load(std::memory_order_relaxed))
+            {
+                const stamped value = lock.load();
+                if (!is_whole(value))
+                {
+                    torn.fetch_add(1, std::memory_order_relaxed);
+                    continue;
+                }
+
+                // The writer is in the low bits, its sequence in the others
+                const std::uint64_t writer = value.words[0] % writer_count;
+                const std::uint64_t seq    = value.words[0] / writer_count;
+                if (seq < last[writer])
+                {
+                    torn.fetch_add(1, std::memory_order_relaxed);
+                }
+                last[writer] = seq;
+            }
+        });
+    }
+
+    {
+        std::vector<std::jthread> writers;
+        for (int writer = 0; writer != writer_count; ++writer)
+        {
+            writers.emplace_back([&, writer] {
+                for (std::uint64_t seq = 1; seq <= stores; ++seq)
+                {
+                    lock.store(stamp(seq * writer_count + std::uint64_t(writer)));
+                }
+            });
+        }
+    }
+
+    done.store(true, std::memory_order_relaxed);
+    readers.clear();
+
+    EXPECT_EQ(torn.load(), 0);
+    EXPECT_TRUE(is_whole(lock.load()));
+}
+
+// The type auto_dj publishes, whose size is not a multiple of the word size
+TEST(seqlock, publishes_match_state_whole)
+{
+    seqlock<match_state> lock;
+    std::atomic<bool>    done {false};
+    std::atomic<int>     torn {0};
+
+    std::jthread reader {[&] {
+        while (!done.load(std::memory_order_relaxed))
+        {
+            const match_state state = lock.load();
+
+            // The keyword, the breakdown and the score are all derived from the same letter
+            const std::string_view keyword   = state.keyword();
+            const std::string_view breakdown = state.breakdown();
+            if (keyword.size() != state.score % match_state::max_keyword_size ||
+                breakdown.size() != keyword.size() ||
+                std::ranges::any_of(keyword, [&](const char c) { return c != keyword[0]; }) ||
+                breakdown != keyword)
+            {
+                torn.fetch_add(1, std::memory_order_relaxed);
+            }
+        }
+    }};
+
+    for (std::uint32_t score = 0; score != 100'000; ++score)
+    {
+        const std::string keyword(score % match_state::max_keyword_size, char('a' + score % 26));
+
+        match_state state;
+        state.score = score;
+        state.set_keyword(keyword);
+        state.set_breakdown(keyword);
+        lock.store(state);
+    }
+
+    done.store(true, std::memory_order_relaxed);
+    reader.join();
+
+    EXPECT_EQ(torn.load(), 0);
+    EXPECT_EQ(lock.load().score, 99'999u);
+}
+
+}  // namespace
+
+}  // namespace manelemax
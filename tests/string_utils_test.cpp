@@ -0,0 +1,155 @@
+#include <random>
+#include <string>
+#include <string_view>
+#include <vector>
+
+#include <gtest/gtest.h>
+
+#include "string_utils.hpp"
+
+namespace manelemax
+{
+
+namespace
+{
+
+// What normalize_into replaced: one allocation per step, and per word
+std::vector<std::string> normalize_reference(const std::wstring& wstr)
+{
+    std::string narrowed = stringutils::remove_ro_diacritics(wstr);
+    stringutils::keep_alpha_and_spaces(narrowed);
+    stringutils::to_lower(narrowed);
+    return stringutils::split(narrowed);
+}
+
+std::vector<std::string> words_of(const stringutils::normalized_text& normalized)
+{
+    std::vector<std::string> words;
+    for (const stringutils::word_span& span : normalized.words)
+    {
+        words.emplace_back(normalized.word(span));
+    }
+    return words;
+}
+
+std::string join(const std::vector<std::string>& words)
+{
+    std::string text;
+    for (const std::string& word : words)
+    {
+        if (!text.empty())
+        {
+            text.push_back(' ');
+        }
+        text.append(word);
+    }
+    return text;
+}
+
+// Mostly ASCII, like track metadata, with every Romanian diacritic, whitespace, punctuation and
+// other non-ASCII characters, the astral ones included
+std::wstring random_text(std::mt19937& rng)
+{
+    static constexpr std::wstring_view ascii =
+        L"abcdefghijklmnopqrstuvwxyzABCDEFGHIJKLMNOPQRSTUVWXYZ0123456789"
+        L" \t\n\v\f\r-_.,'&()[]/!?";
+    static constexpr std::wstring_view non_ascii = L"ăâĂÂîÎșȘțȚşţéÉüßñ ’ÿĀ";
+
+    std::uniform_int_distribution<std::size_t> length_dist {0, 100};
+    std::uniform_int_distribution<int>         kind_dist {0, 9};
+
+    const std::size_t length = length_dist(rng);
+
+    std::wstring text;
+    for (std::size_t idx = 0; idx != length; ++idx)
+    {
+        const int kind = kind_dist(rng);
+        if (kind < 7)
+        {
+            text.push_back(ascii[rng() % ascii.size()]);
+        }
+        else if (kind < 9)
+        {
+            text.push_back(non_ascii[rng() % non_ascii.size()]);
+        }
+        else if constexpr (sizeof(wchar_t) == 2)
+        {
+            // U+1F3B5, as a surrogate pair
+            text.append(L"\xD83C\xDFB5");
+        }
+        else
+        {
+            text.push_back(wchar_t(0x1F3B5));
+        }
+    }
+    return text;
+}
+
+TEST(normalize_into, matches_the_reference_pipeline)
+{
+    std::mt19937                 rng {20261017};
+    stringutils::normalized_text normalized;
+
+    for (int iteration = 0; iteration != 100'000; ++iteration)
+    {
+        const std::wstring text = random_text(rng);
+
+        const std::vector<std::string> expected = normalize_reference(text);
+
+        stringutils::normalize_into(text, normalized);
+        ASSERT_EQ(words_of(normalized), expected) << "iteration " << iteration;
+        ASSERT_EQ(normalized.text, join(expected)) << "iteration " << iteration;
+    }
+}
+
+TEST(normalize_into, utf8_matches_wide)
+{
+    std::mt19937                 rng {42};
+    stringutils::normalized_text wide;
+    stringutils::normalized_text utf8;
+
+    for (int iteration = 0; iteration != 10'000; ++iteration)
+    {
+        const std::wstring text = random_text(rng);
+
+        stringutils::normalize_into(text, wide);
+        stringutils::normalize_into(stringutils::wide_to_utf8(text), utf8);
+        ASSERT_EQ(utf8.text, wide.text) << "iteration " << iteration;
+    }
+}
+
+// Every length around the vector block sizes, with the non-ASCII character at every position
+TEST(normalize_into, non_ascii_at_every_block_position)
+{
+    stringutils::normalized_text normalized;
+
+    for (std::size_t length = 1; length != 70; ++length)
+    {
+        for (std::size_t pos = 0; pos != length; ++pos)
+        {
+            std::wstring text(length, L'A');
+            text[pos] = L'Ș';
+
+            stringutils::normalize_into(text, normalized);
+            ASSERT_EQ(normalized.text, join(normalize_reference(text)))
+                << "length " << length << ", position " << pos;
+        }
+    }
+}
+
+TEST(normalize_into, reuses_the_buffer)
+{
+    stringutils::normalized_text normalized;
+
+    stringutils::normalize_into(L"  Florin   SALAM - Ce bine ne stă ", normalized);
+    EXPECT_EQ(normalized.text, "florin salam ce bine ne sta");
+    EXPECT_EQ(normalized.words.size(), 6u);
+
+    stringutils::normalize_into(L"", normalized);
+    EXPECT_TRUE(normalized.text.empty());
+    EXPECT_TRUE(normalized.words.empty());
+}
+
+}  // namespace
+
+}  // namespace manelemax
@@ -0,0 +1,198 @@
+#include <memory>
+#include <optional>
+#include <span>
+#include <string>
+#include <utility>
+#include <vector>
+
+#include <gtest/gtest.h>
+
+#include "fake_media_session_backend.hpp"
+#include "system_media_properties_notifier.hpp"
+
+namespace manelemax
+{
+
+namespace
+{
+
+using session_state = media_session_backend::session_state;
+
+// "play <title>" or "stop", in the order the notifier raised them
+struct recording_listener : public system_media_properties_notifier::listener
+{
+    void on_play(const system_media_properties_notifier::properties& media_props) override
+    {
+        events.push_back("play " + std::string(media_props.title.begin(), media_props.title.end()));
+    }
+
+    void on_stop() override
+    {
+        events.emplace_back("stop");
+    }
+
+    std::vector<std::string> events;
+};
+
+session_state playing(const std::wstring& title)
+{
+    return {.media_props = {.artist = L"Florin Salam", .title = title}, .playing = true};
+}
+
+session_state paused(const std::wstring& title)
+{
+    return {.media_props = {.artist = L"Florin Salam", .title = title}, .playing = false};
+}
+
+class notifier_test : public ::testing::Test
+{
+protected:
+    // The sessions that are already there are given before the notifier is made
+    void make(const std::vector<std::pair<std::string, session_state>>& existing = {})
+    {
+        auto backend = std::make_unique<fake_media_session_backend>();
+        sessions     = backend.get();
+        for (const auto& [id, state] : existing)
+        {
+            sessions->update(id, state);
+        }
+
+        auto made = system_media_properties_notifier::make(std::move(backend));
+        ASSERT_TRUE(made.has_value());
+        notifier.emplace(*std::move(made));
+        notifier->set_listener(&lsn);
+    }
+
+    std::wstring driving_title() const
+    {
+        const auto props = notifier->get_media_props();
+        return props.has_value() ? props->title : L"";
+    }
+
+    // Owned by the notifier
+    fake_media_session_backend*                     sessions {nullptr};
+    std::optional<system_media_properties_notifier> notifier {};
+    recording_listener                              lsn;
+};
+
+TEST_F(notifier_test, reports_the_existing_sessions_as_state_not_events)
+{
+    make({{"spotify", playing(L"Ce bine ne sta")}});
+
+    EXPECT_TRUE(lsn.events.empty());
+    EXPECT_EQ(driving_title(), L"Ce bine ne sta");
+}
+
+TEST_F(notifier_test, turns_the_changes_of_a_session_into_events)
+{
+    make();
+
+    sessions->update("spotify", paused(L"A"));
+    sessions->update("spotify", playing(L"A"));
+    sessions->update("spotify", playing(L"B"));
+    sessions->update("spotify", playing(L"B"));
+    sessions->update("spotify", paused(L"B"));
+    sessions->remove("spotify");
+
+    EXPECT_EQ(lsn.events, (std::vector<std::string> {"play A", "play B", "stop"}));
+    EXPECT_FALSE(notifier->get_media_props().has_value());
+}
+
+// The player that started last drives, and a paused one does not take over when focused
+TEST_F(notifier_test, the_most_recently_started_session_drives)
+{
+    make();
+
+    sessions->update("spotify", playing(L"A"));
+    sessions->update("browser", playing(L"B"));
+    EXPECT_EQ(driving_title(), L"B");
+
+    sessions->update("spotify", paused(L"A"));
+    sessions->update("spotify", paused(L"C"));
+    EXPECT_EQ(driving_title(), L"B");
+
+    // Back to the one still playing once the driving one pauses
+    sessions->update("spotify", playing(L"A"));
+    sessions->update("spotify", paused(L"A"));
+    EXPECT_EQ(driving_title(), L"B");
+
+    EXPECT_EQ(lsn.events, (std::vector<std::string> {"play A", "play B", "play A", "play B"}));
+}
+
+TEST_F(notifier_test, removing_the_driving_session_falls_back_to_another)
+{
+    make();
+
+    sessions->update("spotify", playing(L"A"));
+    sessions->update("browser", playing(L"B"));
+    sessions->remove("browser");
+    EXPECT_EQ(driving_title(), L"A");
+
+    sessions->remove("spotify");
+    sessions->remove("unknown");
+
+    EXPECT_EQ(lsn.events, (std::vector<std::string> {"play A", "play B", "play A", "stop"}));
+}
+
+// The sessions are kept contiguous on removal, the index has to follow the one that moved
+TEST_F(notifier_test, keeps_tracking_a_session_moved_by_a_removal)
+{
+    make();
+
+    sessions->update("a", paused(L"A"));
+    sessions->update("b", paused(L"B"));
+    sessions->update("c", paused(L"C"));
+    sessions->remove("a");
+
+    sessions->update("c", playing(L"C"));
+    EXPECT_EQ(driving_title(), L"C");
+    sessions->update("b", playing(L"B"));
+    EXPECT_EQ(driving_title(), L"B");
+}
+
+TEST_F(notifier_test, a_new_policy_picks_again_right_away)
+{
+    make({{"spotify", playing(L"A")}, {"browser", playing(L"B")}});
+
+    std::vector<std::string> seen;
+    notifier->set_policy(
+        [&](const std::span<const system_media_properties_notifier::session> candidates)
+            -> const system_media_properties_notifier::session* {
+            seen.clear();
+            const system_media_properties_notifier::session* picked = nullptr;
+            for (const auto& candidate : candidates)
+            {
+                seen.push_back(candidate.id);
+                if (candidate.id == "browser")
+                {
+                    picked = &candidate;
+                }
+            }
+            return picked;
+        }
+    );
+
+    // Spotify started last, and drove until then
+    EXPECT_EQ(seen.size(), 2u);
+    EXPECT_EQ(driving_title(), L"B");
+
+    // Ignored by the policy
+    sessions->update("spotify", playing(L"C"));
+    EXPECT_EQ(lsn.events, (std::vector<std::string> {"play B"}));
+}
+
+TEST_F(notifier_test, no_session_picked_is_a_stop)
+{
+    make({{"spotify", playing(L"A")}});
+
+    notifier->set_policy([](std::span<const system_media_properties_notifier::session>) {
+        return static_cast<const system_media_properties_notifier::session*>(nullptr);
+    });
+
+    EXPECT_EQ(lsn.events, (std::vector<std::string> {"stop"}));
+    EXPECT_FALSE(notifier->get_media_props().has_value());
+}
+
+}  // namespace
+
+}  // namespace manelemax
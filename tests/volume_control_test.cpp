@@ -0,0 +1,192 @@
+#include <cerrno>
+#include <chrono>
+#include <memory>
+#include <optional>
+#include <string>
+#include <utility>
+#include <vector>
+
+#include <gtest/gtest.h>
+
+#include "fake_volume_backend.hpp"
+#include "volume_control.hpp"
+
+namespace manelemax
+{
+
+namespace
+{
+
+using namespace std::chrono_literals;
+
+using clock = volume_control::clock;
+
+// Counts the writes that reach the endpoint, and fails them on demand, as with a device unplugged
+class counting_backend : public fake_volume_backend
+{
+public:
+    std::expected<void, os_error> set_volume(const float vol) override
+    {
+        ++volume_writes;
+        if (fail)
+        {
+            return std::unexpected {os_error {"counting_backend::set_volume", EIO}};
+        }
+        return fake_volume_backend::set_volume(vol);
+    }
+
+    std::expected<void, os_error> set_muted(const bool muted) override
+    {
+        ++mute_writes;
+        if (fail)
+        {
+            return std::unexpected {os_error {"counting_backend::set_muted", EIO}};
+        }
+        return fake_volume_backend::set_muted(muted);
+    }
+
+    int  volume_writes {0};
+    int  mute_writes {0};
+    bool fail {false};
+};
+
+// "volume <old> <new>", "muted <state>" or "device", in the order they were reported
+struct recording_listener : public volume_control::listener
+{
+    void on_volume_changed(const float old_vol, const float new_vol) override
+    {
+        events.push_back("volume " + std::to_string(old_vol) + " " + std::to_string(new_vol));
+    }
+
+    void on_muted_state_changed(const bool muted) override
+    {
+        events.push_back(muted ? "muted 1" : "muted 0");
+    }
+
+    void on_device_changed() override
+    {
+        events.emplace_back("device");
+    }
+
+    std::vector<std::string> events;
+};
+
+class volume_control_test : public ::testing::Test
+{
+protected:
+    static constexpr clock::duration enforcement_interval {100ms};
+
+    void SetUp() override
+    {
+        auto owned = std::make_unique<counting_backend>();
+        backend    = owned.get();
+
+        auto made = volume_control::make(std::move(owned), enforcement_interval);
+        ASSERT_TRUE(made.has_value());
+        control.emplace(*std::move(made));
+        ASSERT_TRUE(control->set_listener(&lsn).has_value());
+    }
+
+    // Owned by the control, at full volume and unmuted
+    counting_backend*             backend {nullptr};
+    std::optional<volume_control> control {};
+    recording_listener            lsn;
+    clock::time_point             now {clock::time_point {} + 1h};
+};
+
+TEST_F(volume_control_test, skips_the_writes_that_change_nothing)
+{
+    EXPECT_TRUE(control->set_volume(1.0f).has_value());
+    EXPECT_TRUE(control->set_volume(0.9995f).has_value());
+    EXPECT_TRUE(control->set_muted(false).has_value());
+    EXPECT_EQ(backend->volume_writes, 0);
+    EXPECT_EQ(backend->mute_writes, 0);
+
+    EXPECT_TRUE(control->set_volume(0.5f).has_value());
+    EXPECT_TRUE(control->set_volume(0.5f).has_value());
+    EXPECT_EQ(backend->volume_writes, 1);
+}
+
+// The writes of the control, which the endpoint reports back, are not changes made by someone else
+TEST_F(volume_control_test, reports_only_what_someone_else_changed)
+{
+    EXPECT_TRUE(control->set_volume(0.5f).has_value());
+    EXPECT_TRUE(control->set_muted(true).has_value());
+    EXPECT_TRUE(lsn.events.empty());
+
+    // A mute-only change is not a volume change, and the other way round
+    backend->update({.volume = 0.5f, .muted = false});
+    backend->update({.volume = 0.25f, .muted = false});
+    backend->change_default();
+
+    EXPECT_EQ(
+        lsn.events,
+        (std::vector<std::string> {
+            "muted 0",
+            "volume " + std::to_string(0.5f) + " " + std::to_string(0.25f),
+            "device"
+        })
+    );
+}
+
+// A user dragging the slider sends a change every few milliseconds, each one undone at most once
+// per interval
+TEST_F(volume_control_test, a_slider_storm_gets_one_enforcement_per_interval)
+{
+    for (int idx = 0; idx != 50; ++idx)
+    {
+        backend->update({.volume = 0.2f + 0.01f * float(idx), .muted = false});
+
+        const auto delay = control->enforce_volume(1.0f, now);
+        ASSERT_TRUE(delay.has_value());
+        if (idx % 10 == 0)
+        {
+            EXPECT_EQ(*delay, clock::duration::zero());
+        }
+        else
+        {
+            EXPECT_EQ(*delay, enforcement_interval - (idx % 10) * 10ms);
+        }
+        now += 10ms;
+    }
+
+    EXPECT_EQ(backend->volume_writes, 5);
+}
+
+TEST_F(volume_control_test, enforcing_a_state_already_there_writes_nothing)
+{
+    EXPECT_EQ(control->enforce_volume(1.0f, now), clock::duration::zero());
+    EXPECT_EQ(control->enforce_unmuted(now), clock::duration::zero());
+    EXPECT_EQ(backend->volume_writes, 0);
+    EXPECT_EQ(backend->mute_writes, 0);
+
+    // Nor does it use up the interval
+    backend->update({.volume = 0.5f, .muted = true});
+    EXPECT_EQ(control->enforce_volume(1.0f, now), clock::duration::zero());
+    EXPECT_EQ(control->enforce_unmuted(now), clock::duration::zero());
+    EXPECT_EQ(backend->volume_writes, 1);
+    EXPECT_EQ(backend->mute_writes, 1);
+}
+
+// The write is retried rather than skipped as if it had been made
+TEST_F(volume_control_test, a_failed_write_restores_the_old_state)
+{
+    backend->fail = true;
+    EXPECT_FALSE(control->set_volume(0.5f).has_value());
+    EXPECT_FALSE(control->set_muted(true).has_value());
+    EXPECT_EQ(control->volume(), 1.0f);
+
+    backend->fail = false;
+    EXPECT_TRUE(control->set_volume(0.5f).has_value());
+    EXPECT_TRUE(control->set_muted(true).has_value());
+    EXPECT_EQ(backend->volume_writes, 2);
+    EXPECT_EQ(backend->mute_writes, 2);
+
+    EXPECT_EQ(backend->get()->volume, 0.5f);
+    EXPECT_TRUE(backend->get()->muted);
+    EXPECT_TRUE(lsn.events.empty());
+}
+
+}  // namespace
+
+}  // namespace manelemax
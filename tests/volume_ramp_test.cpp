@@ -0,0 +1,203 @@
+#include <chrono>
+#include <vector>
+
+#include <gtest/gtest.h>
+
+#include "volume_ramp.hpp"
+
+namespace manelemax
+{
+
+namespace
+{
+
+using namespace std::chrono_literals;
+
+using clock = volume_ramp::clock;
+
+// The clock the ramp is driven by, moved by hand
+struct fake_clock
+{
+    clock::time_point now {clock::time_point {} + 1h};
+};
+
+// Ticks the ramp whenever it asks to until it is done, and returns the volumes it wrote
+std::vector<float> run(volume_ramp& ramp, fake_clock& time)
+{
+    std::vector<float> volumes;
+    while (true)
+    {
+        const volume_ramp::step step = ramp.tick(time.now);
+        if (step.volume.has_value())
+        {
+            volumes.push_back(*step.volume);
+        }
+        if (!step.next_tick.has_value())
+        {
+            return volumes;
+        }
+        time.now = *step.next_tick;
+    }
+}
+
+TEST(volume_ramp, linear_moves_by_the_same_step)
+{
+    fake_clock  time;
+    volume_ramp ramp {ramp_curve::linear, 100ms, 25ms};
+
+    ramp.start(0.0f, 1.0f, time.now);
+    const std::vector<float> volumes = run(ramp, time);
+
+    ASSERT_EQ(volumes.size(), 5u);
+    for (std::size_t idx = 0; idx != volumes.size(); ++idx)
+    {
+        EXPECT_FLOAT_EQ(volumes[idx], 0.25f * float(idx));
+    }
+    EXPECT_FALSE(ramp.active());
+}
+
+// Halfway in loudness is the geometric mean of the volumes
+TEST(volume_ramp, db_linear_moves_by_the_same_loudness_step)
+{
+    fake_clock  time;
+    volume_ramp ramp {ramp_curve::db_linear, 100ms, 50ms};
+
+    ramp.start(0.25f, 1.0f, time.now);
+    const std::vector<float> volumes = run(ramp, time);
+
+    ASSERT_EQ(volumes.size(), 3u);
+    EXPECT_FLOAT_EQ(volumes[0], 0.25f);
+    EXPECT_NEAR(volumes[1], 0.5f, 1e-5f);
+    EXPECT_FLOAT_EQ(volumes[2], 1.0f);
+}
+
+TEST(volume_ramp, db_linear_reaches_silence)
+{
+    fake_clock  time;
+    volume_ramp ramp {ramp_curve::db_linear, 100ms, 10ms};
+
+    ramp.start(1.0f, 0.0f, time.now);
+    const std::vector<float> volumes = run(ramp, time);
+
+    ASSERT_FALSE(volumes.empty());
+    EXPECT_EQ(volumes.back(), 0.0f);
+    for (std::size_t idx = 1; idx != volumes.size(); ++idx)
+    {
+        EXPECT_LE(volumes[idx], volumes[idx - 1]);
+    }
+}
+
+TEST(volume_ramp, s_curve_is_slow_at_both_ends)
+{
+    fake_clock  time;
+    volume_ramp ramp {ramp_curve::s_curve, 100ms, 10ms};
+
+    ramp.start(0.0f, 1.0f, time.now);
+    const std::vector<float> volumes = run(ramp, time);
+
+    ASSERT_EQ(volumes.size(), 11u);
+    EXPECT_FLOAT_EQ(volumes[5], 0.5f);
+    EXPECT_LT(volumes[1] - volumes[0], volumes[6] - volumes[5]);
+    EXPECT_LT(volumes[10] - volumes[9], volumes[6] - volumes[5]);
+
+    // Symmetric around the middle
+    for (std::size_t idx = 0; idx != volumes.size(); ++idx)
+    {
+        EXPECT_NEAR(volumes[idx], 1.0f - volumes[10 - idx], 1e-6f);
+    }
+}
+
+// A timer that fires early gets no write, and is told when to come back
+TEST(volume_ramp, an_early_tick_writes_nothing)
+{
+    fake_clock  time;
+    volume_ramp ramp {ramp_curve::linear, 100ms, 25ms};
+
+    ramp.start(0.0f, 1.0f, time.now);
+    ASSERT_TRUE(ramp.tick(time.now).volume.has_value());
+
+    time.now += 10ms;
+    const volume_ramp::step early = ramp.tick(time.now);
+    EXPECT_FALSE(early.volume.has_value());
+    EXPECT_EQ(early.next_tick, time.now + 15ms);
+}
+
+// However late the timer, the ramp ends on time, with the target
+TEST(volume_ramp, a_late_tick_catches_up)
+{
+    fake_clock  time;
+    volume_ramp ramp {ramp_curve::linear, 100ms, 25ms};
+
+    ramp.start(0.0f, 1.0f, time.now);
+    time.now += 60ms;
+    EXPECT_FLOAT_EQ(*ramp.tick(time.now).volume, 0.6f);
+
+    time.now += 1s;
+    const volume_ramp::step last = ramp.tick(time.now);
+    EXPECT_EQ(last.volume, 1.0f);
+    EXPECT_FALSE(last.next_tick.has_value());
+    EXPECT_FALSE(ramp.active());
+}
+
+TEST(volume_ramp, a_retarget_starts_from_where_the_ramp_is)
+{
+    fake_clock  time;
+    volume_ramp ramp {ramp_curve::linear, 100ms, 25ms};
+
+    ramp.start(0.0f, 1.0f, time.now);
+    time.now += 50ms;
+
+    // The current volume is ignored, the ramp is at 0.5
+    ramp.start(0.9f, 0.0f, time.now);
+    EXPECT_EQ(ramp.target(), 0.0f);
+
+    const std::vector<float> volumes = run(ramp, time);
+    ASSERT_EQ(volumes.size(), 5u);
+    EXPECT_FLOAT_EQ(volumes.front(), 0.5f);
+    EXPECT_FLOAT_EQ(volumes.back(), 0.0f);
+}
+
+// A new track right after a tick waits for the next one, so that the writes stay one per tick
+TEST(volume_ramp, a_retarget_right_after_a_tick_waits_for_the_next_one)
+{
+    fake_clock  time;
+    volume_ramp ramp {ramp_curve::linear, 100ms, 25ms};
+
+    ramp.start(0.0f, 1.0f, time.now);
+    ASSERT_TRUE(ramp.tick(time.now).volume.has_value());
+
+    time.now += 1ms;
+    ramp.start(0.0f, 0.0f, time.now);
+    const volume_ramp::step early = ramp.tick(time.now);
+    EXPECT_FALSE(early.volume.has_value());
+    EXPECT_EQ(early.next_tick, time.now + 24ms);
+
+    time.now = *early.next_tick;
+    EXPECT_TRUE(ramp.tick(time.now).volume.has_value());
+}
+
+TEST(volume_ramp, no_duration_jumps_to_the_target)
+{
+    fake_clock  time;
+    volume_ramp ramp {ramp_curve::db_linear, 0ms, 25ms};
+
+    ramp.start(0.25f, 1.0f, time.now);
+    EXPECT_EQ(run(ramp, time), (std::vector {1.0f}));
+}
+
+TEST(volume_ramp, a_cancelled_ramp_writes_nothing)
+{
+    fake_clock  time;
+    volume_ramp ramp {ramp_curve::linear, 100ms, 25ms};
+
+    ramp.start(0.0f, 1.0f, time.now);
+    ramp.cancel();
+
+    const volume_ramp::step step = ramp.tick(time.now);
+    EXPECT_FALSE(step.volume.has_value());
+    EXPECT_FALSE(step.next_tick.has_value());
+}
+
+}  // namespace
+
+}  // namespace manelemax
@@ -0,0 +1,523 @@
+#include <algorithm>
+#include <atomic>
+#include <charconv>
+#include <chrono>
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+#include <memory>
+#include <optional>
+#include <string>
+#include <string_view>
+#include <thread>
+#include <vector>
+
+#include "fuzzy_keyword_matcher.hpp"
+#include "keyword_database.hpp"
+#include "keywords.hpp"
+#include "mapped_file.hpp"
+#include "record_parser.hpp"
+#include "track_classifier.hpp"
+
+namespace manelemax
+{
+
+namespace
+{
+
+constexpr std::string_view usage_text =
+    "Usage: manelemax-classify [options] <input file | ->\n"
+    "\n"
+    "Classifies every row of a TSV, CSV or NDJSON file of tracks and writes one line per row, in\n"
+    "input order: <1|0> <tab> <matched field> <tab> <matched keyword>\n"
+    "With --scores, two more columns follow: <score> <tab> <breakdown>, the breakdown listing\n"
+    "every keyword found as \"keyword (field) points\", the same as the ManeleMax daemon.\n"
+    "\n"
+    "Options:\n"
+    "  --format <tsv|csv|ndjson>  Input format (default: from the file extension)\n"
+    "  --header                   The first TSV/CSV row holds the column names\n"
+    "  --artist <column|key>      Artist column index, column name or NDJSON key\n"
+    "                             (default: 0 or \"artist\")\n"
+    "  --title <column|key>       Title column index, column name or NDJSON key\n"
+    "                             (default: 1 or \"title\")\n"
+    "  --database <file>          Keyword database built by manelemax-compile-keywords\n"
+    "                             (default: the built-in keywords)\n"
+    "  --fuzzy                    Also match the keywords with a typo or two\n"
+    "  --threshold <points>       Score from which a track is manele (default: 100)\n"
+    "  --scores                   Also write the score and its breakdown\n"
+    "  --threads <count>          Worker threads (default: all cores)\n"
+    "  --output <file>            Output file (default: standard output)\n";
+
+constexpr std::size_t chunk_size {1 << 20};
+
+struct options
+{
+    std::optional<input_format> format {};
+    bool                        header {false};
+    std::string                 artist_field {};
+    std::string                 title_field {};
+    std::string                 database {};
+    bool                        fuzzy {false};
+    std::uint32_t               threshold {track_classifier::default_threshold};
+    bool                        scores {false};
+    unsigned                    threads {std::max(1u, std::thread::hardware_concurrency())};
+    std::string                 input {};
+    std::string                 output {};
+};
+
+struct chunk
+{
+    std::string_view  input {};
+    std::string       output {};
+    std::uint64_t     rows {0};
+    std::uint64_t     matches {0};
+    std::atomic<bool> done {false};
+};
+
+void print_error(const std::string_view message, const std::string_view detail = "")
+{
+    std::fprintf(
+        stderr,
+        "manelemax-classify: %.*s%.*s\n",
+        int(message.size()),
+        message.data(),
+        int(detail.size()),
+        detail.data()
+    );
+}
+
+std::optional<std::size_t> parse_index(const std::string_view str)
+{
+    std::size_t value;
+    if (const auto [ptr, ec] = std::from_chars(str.data(), str.data() + str.size(), value);
+        ec != std::errc {} || ptr != str.data() + str.size())
+    {
+        return std::nullopt;
+    }
+    return value;
+}
+
+std::optional<options> parse_options(const int argc, char** const argv)
+{
+    options opts;
+
+    for (int idx = 1; idx < argc; ++idx)
+    {
+        const std::string_view arg = argv[idx];
+
+        const auto value = [&]() -> std::optional<std::string_view> {
+            if (idx + 1 == argc)
+            {
+                print_error("missing value for ", arg);
+                return std::nullopt;
+            }
+            return argv[++idx];
+        };
+
+        if (arg == "--format")
+        {
+            const auto name = value();
+            if (!name || !(opts.format = parse_input_format(*name)))
+            {
+                print_error("unknown format");
+                return std::nullopt;
+            }
+        }
+        else if (arg == "--header")
+        {
+            opts.header = true;
+        }
+        else if (arg == "--fuzzy")
+        {
+            opts.fuzzy = true;
+        }
+        else if (arg == "--scores")
+        {
+            opts.scores = true;
+        }
+        else if (arg == "--threshold")
+        {
+            const auto points    = value();
+            const auto threshold = points ? parse_index(*points) : std::nullopt;
+            if (!threshold || *threshold > UINT32_MAX)
+            {
+                print_error("invalid threshold");
+                return std::nullopt;
+            }
+            opts.threshold = std::uint32_t(*threshold);
+        }
+        else if (arg == "--artist" || arg == "--title")
+        {
+            const auto field = value();
+            if (!field)
+            {
+                return std::nullopt;
+            }
+            (arg == "--artist" ? opts.artist_field : opts.title_field) = *field;
+        }
+        else if (arg == "--threads")
+        {
+            const auto count   = value();
+            const auto threads = count ? parse_index(*count) : std::nullopt;
+            if (!threads || *threads == 0)
+            {
+                print_error("invalid thread count");
+                return std::nullopt;
+            }
+            opts.threads = unsigned(*threads);
+        }
+        else if (arg == "--output" || arg == "--database")
+        {
+            const auto file = value();
+            if (!file)
+            {
+                return std::nullopt;
+            }
+            (arg == "--output" ? opts.output : opts.database) = *file;
+        }
+        else if (arg == "--help")
+        {
+            std::fputs(usage_text.data(), stdout);
+            std::exit(EXIT_SUCCESS);
+        }
+        else if (opts.input.empty() && (arg == "-" || !arg.starts_with("--")))
+        {
+            opts.input = arg;
+        }
+        else
+        {
+            print_error("unexpected argument ", arg);
+            return std::nullopt;
+        }
+    }
+
+    if (opts.input.empty())
+    {
+        std::fputs(usage_text.data(), stderr);
+        return std::nullopt;
+    }
+
+    if (!opts.format)
+    {
+        if (opts.input.ends_with(".tsv"))
+        {
+            opts.format = input_format::tsv;
+        }
+        else if (opts.input.ends_with(".csv"))
+        {
+            opts.format = input_format::csv;
+        }
+        else if (opts.input.ends_with(".ndjson") || opts.input.ends_with(".jsonl"))
+        {
+            opts.format = input_format::ndjson;
+        }
+        else
+        {
+            print_error("cannot guess the format from the file name, use --format");
+            return std::nullopt;
+        }
+    }
+
+    const bool ndjson = opts.format == input_format::ndjson;
+    if (opts.artist_field.empty())
+    {
+        opts.artist_field = ndjson ? "artist" : "0";
+    }
+    if (opts.title_field.empty())
+    {
+        opts.title_field = ndjson ? "title" : "1";
+    }
+
+    return opts;
+}
+
+// Column fields are either indices or, with a header row, column names
+std::optional<std::size_t> resolve_column(
+    const options&         opts,
+    const std::string_view header_row,
+    const std::string_view field
+)
+{
+    if (const auto index = parse_index(field))
+    {
+        return index;
+    }
+    if (opts.header)
+    {
+        if (const auto index = find_column(*opts.format, header_row, field))
+        {
+            return index;
+        }
+    }
+    print_error("unknown column ", field);
+    return std::nullopt;
+}
+
+std::string read_all(std::FILE* const file)
+{
+    std::string data;
+    std::size_t size = 0;
+    while (true)
+    {
+        data.resize(size + chunk_size);
+        const std::size_t read = std::fread(data.data() + size, 1, chunk_size, file);
+        size += read;
+        if (read != chunk_size)
+        {
+            break;
+        }
+    }
+    data.resize(size);
+    return data;
+}
+
+void print_open_error(const std::string& path, const os_error& err)
+{
+    std::fprintf(
+        stderr,
+        "manelemax-classify: cannot open %s: %.*s failed with error %lld\n",
+        path.c_str(),
+        int(err.function.size()),
+        err.function.data(),
+        static_cast<long long>(err.code)
+    );
+}
+
+template<typename Matcher>
+void classify_chunk(
+    chunk&            ch,
+    record_parser&    parser,
+    track_classifier& classifier,
+    const Matcher&    matcher,
+    const bool        scores
+)
+{
+    constexpr auto field_name = [](const track_classifier::field field) {
+        switch (field)
+        {
+            case track_classifier::field::artist: return "artist";
+            case track_classifier::field::title: return "title";
+            case track_classifier::field::none: break;
+        }
+        return "";
+    };
+
+    for (std::size_t pos = 0; pos != ch.input.size();)
+    {
+        const std::size_t end = parser.row_end(ch.input, pos);
+        const auto        row = parser.parse(ch.input.substr(pos, end - pos));
+        pos                   = end;
+
+        const auto match = classifier.classify(matcher, row.artist, row.title);
+
+        ch.output.push_back(match.keyword.empty() ? '0' : '1');
+        ch.output.push_back('\t');
+        ch.output.append(field_name(match.matched_field));
+        ch.output.push_back('\t');
+        ch.output.append(match.keyword);
+        if (scores)
+        {
+            ch.output.push_back('\t');
+            ch.output.append(std::to_string(match.score));
+            ch.output.push_back('\t');
+            track_classifier::append_breakdown(match, ch.output);
+        }
+        ch.output.push_back('\n');
+
+        ++ch.rows;
+        ch.matches += !match.keyword.empty();
+    }
+}
+
+int run(const options& opts)
+{
+    std::optional<mapped_file> mapping;
+    std::string                stdin_data;
+    std::string_view           data;
+
+    if (opts.input == "-")
+    {
+        stdin_data = read_all(stdin);
+        data       = stdin_data;
+    }
+    else if (auto file = mapped_file::open(opts.input); file.has_value())
+    {
+        mapping = std::move(*file);
+        data    = mapping->data();
+    }
+    else
+    {
+        print_open_error(opts.input, file.error());
+        return EXIT_FAILURE;
+    }
+
+    std::optional<keyword_database> database;
+    if (!opts.database.empty())
+    {
+        auto db = keyword_database::open(opts.database);
+        if (!db.has_value())
+        {
+            print_open_error(opts.database, db.error());
+            return EXIT_FAILURE;
+        }
+        database = *std::move(db);
+    }
+
+    const keyword_matcher matcher = database ? database->matcher() : g_keyword_table.matcher();
+
+    std::optional<fuzzy_keyword_matcher> fuzzy_matcher;
+    if (opts.fuzzy)
+    {
+        fuzzy_matcher.emplace(matcher);
+    }
+
+    std::FILE* const out = opts.output.empty() ? stdout : std::fopen(opts.output.c_str(), "wb");
+    if (!out)
+    {
+        print_error("cannot open ", opts.output);
+        return EXIT_FAILURE;
+    }
+
+    const auto start_time = std::chrono::steady_clock::now();
+
+    record_parser parser {*opts.format, 0, 0, opts.artist_field, opts.title_field};
+
+    if (opts.header && opts.format != input_format::ndjson)
+    {
+        const std::size_t header_end = parser.row_end(data, 0);
+        const auto        header_row = data.substr(0, header_end);
+
+        const auto artist_column = resolve_column(opts, header_row, opts.artist_field);
+        const auto title_column  = resolve_column(opts, header_row, opts.title_field);
+        if (!artist_column || !title_column)
+        {
+            return EXIT_FAILURE;
+        }
+
+        parser = record_parser {*opts.format, *artist_column, *title_column, {}, {}};
+        data.remove_prefix(header_end);
+        std::fputs(
+            opts.scores ? "match\tfield\tkeyword\tscore\tbreakdown\n" : "match\tfield\tkeyword\n",
+            out
+        );
+    }
+    else if (opts.format != input_format::ndjson)
+    {
+        const auto artist_column = resolve_column(opts, {}, opts.artist_field);
+        const auto title_column  = resolve_column(opts, {}, opts.title_field);
+        if (!artist_column || !title_column)
+        {
+            return EXIT_FAILURE;
+        }
+
+        parser = record_parser {*opts.format, *artist_column, *title_column, {}, {}};
+    }
+
+    // Row aligned chunks, classified in parallel and written in order
+    std::vector<std::string_view> chunk_inputs;
+    for (std::size_t begin = 0; begin != data.size();)
+    {
+        const std::size_t end = parser.chunk_end(data, begin, begin + chunk_size);
+        chunk_inputs.push_back(data.substr(begin, end - begin));
+        begin = end;
+    }
+
+    const std::size_t        chunk_count = chunk_inputs.size();
+    std::unique_ptr<chunk[]> chunks {new chunk[chunk_count]};
+    for (std::size_t idx = 0; idx != chunk_count; ++idx)
+    {
+        chunks[idx].input = chunk_inputs[idx];
+    }
+
+    // Bounds the memory held by the outputs that are not written yet
+    const std::size_t max_pending = std::size_t(opts.threads) * 4;
+
+    std::atomic<std::size_t> next_chunk {0};
+    std::atomic<std::size_t> written {0};
+
+    const auto worker = [&, parser] mutable {
+        track_classifier classifier {opts.threshold};
+
+        for (std::size_t idx; (idx = next_chunk.fetch_add(1)) < chunk_count;)
+        {
+            for (std::size_t crt_written; idx >= (crt_written = written.load()) + max_pending;)
+            {
+                written.wait(crt_written);
+            }
+
+            if (fuzzy_matcher)
+            {
+                classify_chunk(chunks[idx], parser, classifier, *fuzzy_matcher, opts.scores);
+            }
+            else
+            {
+                classify_chunk(chunks[idx], parser, classifier, matcher, opts.scores);
+            }
+
+            chunks[idx].done = true;
+            chunks[idx].done.notify_one();
+        }
+    };
+
+    std::vector<std::jthread> workers;
+    for (unsigned idx = 0; idx != opts.threads; ++idx)
+    {
+        workers.emplace_back(worker);
+    }
+
+    std::uint64_t rows    = 0;
+    std::uint64_t matches = 0;
+    for (std::size_t idx = 0; idx != chunk_count; ++idx)
+    {
+        chunks[idx].done.wait(false);
+
+        std::fwrite(chunks[idx].output.data(), 1, chunks[idx].output.size(), out);
+        rows += chunks[idx].rows;
+        matches += chunks[idx].matches;
+        std::string {}.swap(chunks[idx].output);
+
+        written = idx + 1;
+        written.notify_all();
+    }
+
+    workers.clear();
+
+    // A full disk shows in the error indicator, or only once the buffered output is flushed
+    const bool write_failed = std::ferror(out) != 0;
+    const bool close_failed = out != stdout ? std::fclose(out) != 0 : std::fflush(out) != 0;
+    if (write_failed || close_failed)
+    {
+        print_error("cannot write ", opts.output.empty() ? "the standard output" : opts.output);
+        return EXIT_FAILURE;
+    }
+
+    const double seconds =
+        std::chrono::duration<double>(std::chrono::steady_clock::now() - start_time).count();
+
+    std::fprintf(
+        stderr,
+        "%llu rows, %llu matches in %.3f s (%.0f rows/s, %u threads)\n",
+        static_cast<unsigned long long>(rows),
+        static_cast<unsigned long long>(matches),
+        seconds,
+        seconds > 0 ? double(rows) / seconds : 0.0,
+        opts.threads
+    );
+
+    return EXIT_SUCCESS;
+}
+
+}  // namespace
+
+}  // namespace manelemax
+
+int main(int argc, char** argv)
+{
+    const auto opts = manelemax::parse_options(argc, argv);
+    if (!opts)
+    {
+        return EXIT_FAILURE;
+    }
+
+    return manelemax::run(*opts);
+}
@@ -0,0 +1,491 @@
+#include "record_parser.hpp"
+
+#include <algorithm>
+#include <cstdint>
+
+namespace manelemax
+{
+
+namespace
+{
+
+std::string_view strip_line_end(std::string_view row)
+{
+    while (!row.empty() && (row.back() == '\n' || row.back() == '\r'))
+    {
+        row.remove_suffix(1);
+    }
+    return row;
+}
+
+// Calls fn(column, value, quoted) for every field of a TSV/CSV row. For quoted CSV fields the
+// value is the text between the quotes, with the doubled quotes still escaped.
+template<typename Fn>
+void visit_fields(const std::string_view row, const char separator, Fn&& fn)
+{
+    std::size_t pos    = 0;
+    std::size_t column = 0;
+
+    while (true)
+    {
+        if (separator == ',' && pos < row.size() && row[pos] == '"')
+        {
+            std::size_t closing = pos + 1;
+            while ((closing = row.find('"', closing)) != std::string_view::npos &&
+                   closing + 1 < row.size() && row[closing + 1] == '"')
+            {
+                closing += 2;
+            }
+            closing = std::min(closing, row.size());
+
+            if (!fn(column, row.substr(pos + 1, closing - pos - 1), true))
+            {
+                return;
+            }
+            pos = closing;
+        }
+        else
+        {
+            const std::size_t end = std::min(row.find(separator, pos), row.size());
+            if (!fn(column, row.substr(pos, end - pos), false))
+            {
+                return;
+            }
+            pos = end;
+        }
+
+        pos = row.find(separator, pos);
+        if (pos == std::string_view::npos)
+        {
+            return;
+        }
+        ++pos;
+        ++column;
+    }
+}
+
+// Replaces the doubled quotes of a quoted CSV field, copying only if there are any
+std::string_view unquote_csv(const std::string_view value, std::string& buf)
+{
+    if (value.find('"') == std::string_view::npos)
+    {
+        return value;
+    }
+
+    buf.clear();
+    for (std::size_t idx = 0; idx != value.size(); ++idx)
+    {
+        buf.push_back(value[idx]);
+        if (value[idx] == '"' && idx + 1 != value.size() && value[idx + 1] == '"')
+        {
+            ++idx;
+        }
+    }
+    return buf;
+}
+
+void skip_json_whitespace(const std::string_view str, std::size_t& pos)
+{
+    while (pos < str.size() &&
+           (str[pos] == ' ' || str[pos] == '\t' || str[pos] == '\r' || str[pos] == '\n'))
+    {
+        ++pos;
+    }
+}
+
+void append_utf8(std::string& out, const char32_t c)
+{
+    if (c < 0x80)
+    {
+        out.push_back(char(c));
+    }
+    else if (c < 0x800)
+    {
+        out.push_back(char(0xC0 | (c >> 6)));
+        out.push_back(char(0x80 | (c & 0x3F)));
+    }
+    else if (c < 0x10000)
+    {
+        out.push_back(char(0xE0 | (c >> 12)));
+        out.push_back(char(0x80 | ((c >> 6) & 0x3F)));
+        out.push_back(char(0x80 | (c & 0x3F)));
+    }
+    else
+    {
+        out.push_back(char(0xF0 | (c >> 18)));
+        out.push_back(char(0x80 | ((c >> 12) & 0x3F)));
+        out.push_back(char(0x80 | ((c >> 6) & 0x3F)));
+        out.push_back(char(0x80 | (c & 0x3F)));
+    }
+}
+
+std::optional<char32_t> parse_hex4(const std::string_view str, const std::size_t pos)
+{
+    if (str.size() - pos < 4)
+    {
+        return std::nullopt;
+    }
+
+    char32_t value = 0;
+    for (const char c : str.substr(pos, 4))
+    {
+        value <<= 4;
+        if (c >= '0' && c <= '9')
+        {
+            value |= char32_t(c - '0');
+        }
+        else if (c >= 'a' && c <= 'f')
+        {
+            value |= char32_t(c - 'a' + 10);
+        }
+        else if (c >= 'A' && c <= 'F')
+        {
+            value |= char32_t(c - 'A' + 10);
+        }
+        else
+        {
+            return std::nullopt;
+        }
+    }
+    return value;
+}
+
+// Parses the JSON string starting at the opening quote at pos and moves pos past the closing one.
+// The result points into the row unless it has escapes, in which case it is decoded into buf.
+std::optional<std::string_view>
+parse_json_string(const std::string_view str, std::size_t& pos, std::string& buf)
+{
+    const std::size_t begin = ++pos;
+
+    const std::size_t special = str.find_first_of("\"\\", begin);
+    if (special == std::string_view::npos)
+    {
+        return std::nullopt;
+    }
+    if (str[special] == '"')
+    {
+        pos = special + 1;
+        return str.substr(begin, special - begin);
+    }
+
+    buf.assign(str.substr(begin, special - begin));
+    pos = special;
+
+    while (pos < str.size())
+    {
+        const char c = str[pos++];
+        if (c == '"')
+        {
+            return buf;
+        }
+        if (c != '\\')
+        {
+            buf.push_back(c);
+            continue;
+        }
+        if (pos == str.size())
+        {
+            return std::nullopt;
+        }
+
+        switch (const char escaped = str[pos++])
+        {
+            case 'b': buf.push_back('\b'); break;
+            case 'f': buf.push_back('\f'); break;
+            case 'n': buf.push_back('\n'); break;
+            case 'r': buf.push_back('\r'); break;
+            case 't': buf.push_back('\t'); break;
+            case 'u':
+            {
+                std::optional<char32_t> code_point = parse_hex4(str, pos);
+                if (!code_point)
+                {
+                    return std::nullopt;
+                }
+                pos += 4;
+
+                // Surrogate pair
+                if (*code_point >= 0xD800 && *code_point <= 0xDBFF &&
+                    str.substr(pos, 2) == "\\u")
+                {
+                    if (const auto low = parse_hex4(str, pos + 2);
+                        low && *low >= 0xDC00 && *low <= 0xDFFF)
+                    {
+                        code_point = 0x10000 + ((*code_point - 0xD800) << 10) + (*low - 0xDC00);
+                        pos += 6;
+                    }
+                }
+
+                append_utf8(buf, *code_point);
+                break;
+            }
+            default: buf.push_back(escaped); break;
+        }
+    }
+
+    return std::nullopt;
+}
+
+// Skips any JSON value starting at pos. Returns false on malformed input.
+bool skip_json_value(const std::string_view str, std::size_t& pos, std::string& scratch)
+{
+    if (pos >= str.size())
+    {
+        return false;
+    }
+
+    if (str[pos] == '"')
+    {
+        return parse_json_string(str, pos, scratch).has_value();
+    }
+
+    if (str[pos] == '{' || str[pos] == '[')
+    {
+        std::size_t depth = 0;
+        while (pos < str.size())
+        {
+            switch (str[pos])
+            {
+                case '"':
+                {
+                    if (!parse_json_string(str, pos, scratch))
+                    {
+                        return false;
+                    }
+                    continue;
+                }
+                case '{': [[fallthrough]];
+                case '[': ++depth; break;
+                case '}': [[fallthrough]];
+                case ']':
+                {
+                    if (--depth == 0)
+                    {
+                        ++pos;
+                        return true;
+                    }
+                    break;
+                }
+            }
+            ++pos;
+        }
+        return false;
+    }
+
+    // Number or literal
+    pos = std::min(str.find_first_of(",}] \t\r\n", pos), str.size());
+    return true;
+}
+
+}  // namespace
+
+std::optional<input_format> parse_input_format(const std::string_view name)
+{
+    if (name == "tsv")
+    {
+        return input_format::tsv;
+    }
+    if (name == "csv")
+    {
+        return input_format::csv;
+    }
+    if (name == "ndjson" || name == "jsonl")
+    {
+        return input_format::ndjson;
+    }
+    return std::nullopt;
+}
+
+record_parser::record_parser(
+    const input_format     format,
+    const std::size_t      artist_column,
+    const std::size_t      title_column,
+    const std::string_view artist_key,
+    const std::string_view title_key
+)
+    : format_ {format}
+    , artist_column_ {artist_column}
+    , title_column_ {title_column}
+    , artist_key_ {artist_key}
+    , title_key_ {title_key}
+{
+}
+
+std::size_t record_parser::row_end(const std::string_view data, const std::size_t pos) const
+{
+    if (format_ != input_format::csv)
+    {
+        const std::size_t end = data.find('\n', pos);
+        return end == std::string_view::npos ? data.size() : end + 1;
+    }
+
+    bool in_quotes = false;
+    for (std::size_t idx = pos; idx != data.size(); ++idx)
+    {
+        if (data[idx] == '"')
+        {
+            in_quotes = !in_quotes;
+        }
+        else if (data[idx] == '\n' && !in_quotes)
+        {
+            return idx + 1;
+        }
+    }
+    return data.size();
+}
+
+std::size_t record_parser::chunk_end(
+    const std::string_view data,
+    const std::size_t      chunk_begin,
+    const std::size_t      target
+) const
+{
+    if (target >= data.size())
+    {
+        return data.size();
+    }
+    if (target <= chunk_begin)
+    {
+        return chunk_begin;
+    }
+
+    if (format_ != input_format::csv)
+    {
+        return row_end(data, target - 1);
+    }
+
+    // A line break only ends a CSV row when it is outside of quotes
+    bool in_quotes = std::count(data.begin() + chunk_begin, data.begin() + target - 1, '"') % 2;
+    for (std::size_t idx = target - 1; idx != data.size(); ++idx)
+    {
+        if (data[idx] == '"')
+        {
+            in_quotes = !in_quotes;
+        }
+        else if (data[idx] == '\n' && !in_quotes)
+        {
+            return idx + 1;
+        }
+    }
+    return data.size();
+}
+
+auto record_parser::parse(const std::string_view row) -> fields
+{
+    switch (format_)
+    {
+        case input_format::tsv: return parse_separated(strip_line_end(row), '\t');
+        case input_format::csv: return parse_separated(strip_line_end(row), ',');
+        case input_format::ndjson: return parse_ndjson(strip_line_end(row));
+    }
+    return {};
+}
+
+auto record_parser::parse_separated(const std::string_view row, const char separator) -> fields
+{
+    fields result;
+
+    const std::size_t last_column = std::max(artist_column_, title_column_);
+
+    visit_fields(row, separator, [&](std::size_t column, std::string_view value, bool quoted) {
+        if (column == artist_column_)
+        {
+            result.artist = quoted ? unquote_csv(value, artist_buf_) : value;
+        }
+        if (column == title_column_)
+        {
+            result.title = quoted ? unquote_csv(value, title_buf_) : value;
+        }
+        return column != last_column;
+    });
+
+    return result;
+}
+
+auto record_parser::parse_ndjson(const std::string_view row) -> fields
+{
+    fields result;
+
+    std::size_t pos = 0;
+    skip_json_whitespace(row, pos);
+    if (pos == row.size() || row[pos] != '{')
+    {
+        return result;
+    }
+    ++pos;
+
+    while (true)
+    {
+        skip_json_whitespace(row, pos);
+        if (pos == row.size() || row[pos] != '"')
+        {
+            return result;
+        }
+
+        const auto key = parse_json_string(row, pos, key_buf_);
+        if (!key)
+        {
+            return result;
+        }
+
+        // The key may live in key_buf_, so compare it before parsing the value
+        const bool is_artist = *key == artist_key_;
+        const bool is_title  = *key == title_key_;
+
+        skip_json_whitespace(row, pos);
+        if (pos == row.size() || row[pos] != ':')
+        {
+            return result;
+        }
+        ++pos;
+        skip_json_whitespace(row, pos);
+
+        if ((is_artist || is_title) && pos < row.size() && row[pos] == '"')
+        {
+            const auto value = parse_json_string(row, pos, is_artist ? artist_buf_ : title_buf_);
+            if (!value)
+            {
+                return result;
+            }
+            (is_artist ? result.artist : result.title) = *value;
+        }
+        else if (!skip_json_value(row, pos, key_buf_))
+        {
+            return result;
+        }
+
+        skip_json_whitespace(row, pos);
+        if (pos == row.size() || row[pos] != ',')
+        {
+            return result;
+        }
+        ++pos;
+    }
+}
+
+std::optional<std::size_t> find_column(
+    const input_format     format,
+    const std::string_view header_row,
+    const std::string_view name
+)
+{
+    std::optional<std::size_t> result;
+    std::string                buf;
+
+    visit_fields(
+        strip_line_end(header_row),
+        format == input_format::csv ? ',' : '\t',
+        [&](std::size_t column, std::string_view value, bool quoted) {
+            if ((quoted ? unquote_csv(value, buf) : value) == name)
+            {
+                result = column;
+                return false;
+            }
+            return true;
+        }
+    );
+
+    return result;
+}
+
+}  // namespace manelemax
@@ -0,0 +1,72 @@
+#pragma once
+
+#include <cstddef>
+#include <optional>
+#include <string>
+#include <string_view>
+
+namespace manelemax
+{
+
+enum class input_format
+{
+    tsv,
+    csv,
+    ndjson
+};
+
+std::optional<input_format> parse_input_format(std::string_view name);
+
+// Extracts the artist and the title from the rows of a TSV, CSV or NDJSON file. The values are
+// UTF-8 views either into the row itself or into the parser's scratch buffers, valid until the
+// next call to parse().
+class record_parser
+{
+public:
+    struct fields
+    {
+        std::string_view artist;
+        std::string_view title;
+    };
+
+    // For TSV/CSV the fields are column indices, for NDJSON they are the object keys
+    record_parser(
+        input_format     format,
+        std::size_t      artist_column,
+        std::size_t      title_column,
+        std::string_view artist_key,
+        std::string_view title_key
+    );
+
+    // Returns the position right after the row starting at pos (past its line terminator).
+    // Only CSV rows can span multiple lines, through quoted fields.
+    std::size_t row_end(std::string_view data, std::size_t pos) const;
+
+    // Returns the first row boundary at or after target, scanning from chunk_begin which must be
+    // a row boundary itself
+    std::size_t
+    chunk_end(std::string_view data, std::size_t chunk_begin, std::size_t target) const;
+
+    // The row may still hold its line terminator. Missing fields are returned as empty.
+    fields parse(std::string_view row);
+
+private:
+    fields parse_separated(std::string_view row, char separator);
+    fields parse_ndjson(std::string_view row);
+
+    input_format format_;
+    std::size_t  artist_column_;
+    std::size_t  title_column_;
+    std::string  artist_key_;
+    std::string  title_key_;
+
+    std::string artist_buf_ {};
+    std::string title_buf_ {};
+    std::string key_buf_ {};
+};
+
+// Splits a header row in column names and returns the index of the given one
+std::optional<std::size_t>
+find_column(input_format format, std::string_view header_row, std::string_view name);
+
+}  // namespace manelemax
@@ -0,0 +1,283 @@
+#include <algorithm>
+#include <array>
+#include <charconv>
+#include <cstdio>
+#include <cstdlib>
+#include <filesystem>
+#include <optional>
+#include <string>
+#include <string_view>
+#include <system_error>
+#include <unordered_set>
+#include <utility>
+#include <vector>
+
+#include "keyword_database.hpp"
+#include "keywords.hpp"
+#include "mapped_file.hpp"
+#include "string_utils.hpp"
+
+namespace manelemax
+{
+
+namespace
+{
+
+constexpr std::string_view usage_text =
+    "Usage: manelemax-compile-keywords <keyword list> <output file>\n"
+    "       manelemax-compile-keywords --list-builtin\n"
+    "\n"
+    "Compiles a UTF-8 list of keywords, one per line, into a keyword database for ManeleMax\n"
+    "and manelemax-classify. The keywords are normalized like the track metadata: diacritics are\n"
+    "removed, letters are lowercased, whitespace separates words and everything else is dropped.\n"
+    "Empty lines and lines starting with # are ignored.\n"
+    "\n"
+    "A keyword can be followed by its weight, from 0 to 65535, and the field it is expected in\n"
+    "(any, artist or title): \"nek | 40 | artist\". A track is manele from a score of 100, found\n"
+    "in the other field a keyword counts for half. The default is 100 for any field.\n"
+    "\n"
+    "The output file is written next to it first, then renamed over it. ManeleMax only holds the\n"
+    "file open while it reads it, so it reloads the new version, or retries on its next change.\n"
+    "\n"
+    "Options:\n"
+    "  --list-builtin  Print the built-in keywords, as a starting point for a custom list\n";
+
+void print_message(const std::string_view message, const std::string_view detail = "")
+{
+    std::fprintf(
+        stderr,
+        "manelemax-compile-keywords: %.*s%.*s\n",
+        int(message.size()),
+        message.data(),
+        int(detail.size()),
+        detail.data()
+    );
+}
+
+void print_error(const std::string_view context, const os_error& err)
+{
+    std::fprintf(
+        stderr,
+        "manelemax-compile-keywords: %.*s: %.*s failed with error %lld\n",
+        int(context.size()),
+        context.data(),
+        int(err.function.size()),
+        err.function.data(),
+        static_cast<long long>(err.code)
+    );
+}
+
+constexpr std::array<std::string_view, 3> field_names {"any", "artist", "title"};
+
+int list_builtin()
+{
+    for (const std::string_view keyword : g_keywords)
+    {
+        std::printf("%.*s", int(keyword.size()), keyword.data());
+
+        if (const keyword_weight* const weight =
+                _internal::find_keyword_weight(keyword, g_keyword_weights))
+        {
+            const std::string_view field = field_names[std::size_t(weight->field)];
+            std::printf(" | %u | %.*s", unsigned(weight->weight), int(field.size()), field.data());
+        }
+
+        std::printf("\n");
+    }
+    return EXIT_SUCCESS;
+}
+
+std::string_view trim(const std::string_view str)
+{
+    const std::size_t first = str.find_first_not_of(" \t\r");
+    if (first == std::string_view::npos)
+    {
+        return {};
+    }
+    return str.substr(first, str.find_last_not_of(" \t\r") - first + 1);
+}
+
+// The weight and the field that follow the keyword on its line: "40 | artist", "40" or "| title"
+std::optional<keyword_weight> parse_weight(const std::string_view columns)
+{
+    keyword_weight result {.weight = keyword_matcher::default_weight};
+
+    const std::size_t      field_pos = std::min(columns.find('|'), columns.size());
+    const std::string_view weight    = trim(columns.substr(0, field_pos));
+    const std::string_view field =
+        trim(columns.substr(std::min(field_pos + 1, columns.size())));
+
+    if (!weight.empty())
+    {
+        const char* const end = weight.data() + weight.size();
+        const auto [ptr, ec]  = std::from_chars(weight.data(), end, result.weight);
+        if (ec != std::errc {} || ptr != end)
+        {
+            return std::nullopt;
+        }
+    }
+
+    if (!field.empty())
+    {
+        const auto found = std::ranges::find(field_names, field);
+        if (found == field_names.end())
+        {
+            return std::nullopt;
+        }
+        result.field = keyword_field(found - field_names.begin());
+    }
+
+    return result;
+}
+
+struct keyword_list
+{
+    std::vector<std::string> keywords {};
+
+    // The weights read from the list, keyword_weight::keyword is set once the list is complete
+    std::vector<std::pair<std::size_t, keyword_weight>> weights {};
+};
+
+// Returns the normalized keywords of the list, skipping the ones that are empty once normalized,
+// duplicates of a previous one or followed by an invalid weight
+keyword_list read_keywords(const std::string_view data)
+{
+    keyword_list                    list;
+    std::unordered_set<std::string> seen;
+    stringutils::normalized_text    normalized;
+    std::size_t                     line_number = 0;
+
+    for (std::size_t pos = 0; pos < data.size();)
+    {
+        std::size_t end = data.find('\n', pos);
+        end             = end == std::string_view::npos ? data.size() : end;
+
+        const std::string_view line = data.substr(pos, end - pos);
+        pos                         = end + 1;
+        ++line_number;
+
+        const std::size_t first = line.find_first_not_of(" \t\r");
+        if (first == std::string_view::npos || line[first] == '#')
+        {
+            continue;
+        }
+
+        // keyword | weight | field
+        const std::size_t      weight_pos = line.find('|');
+        const std::string_view keyword    = line.substr(0, weight_pos);
+
+        std::optional<keyword_weight> weight;
+        if (weight_pos != std::string_view::npos &&
+            !(weight = parse_weight(line.substr(weight_pos + 1))))
+        {
+            print_message("invalid weight or field, skipped line ", std::to_string(line_number));
+            continue;
+        }
+
+        stringutils::normalize_into(keyword, normalized);
+        if (normalized.text.empty())
+        {
+            print_message("no letters, skipped line ", std::to_string(line_number));
+            continue;
+        }
+        if (!seen.insert(normalized.text).second)
+        {
+            print_message("duplicate keyword, skipped line ", std::to_string(line_number));
+            continue;
+        }
+
+        if (weight)
+        {
+            list.weights.emplace_back(list.keywords.size(), *weight);
+        }
+        list.keywords.push_back(normalized.text);
+    }
+
+    return list;
+}
+
+int compile(const std::filesystem::path& input, const std::filesystem::path& output)
+{
+    const auto file = mapped_file::open(input);
+    if (!file.has_value())
+    {
+        print_error(input.string(), file.error());
+        return EXIT_FAILURE;
+    }
+
+    const keyword_list                  list = read_keywords(file->data());
+    const std::vector<std::string_view> views {list.keywords.begin(), list.keywords.end()};
+
+    std::vector<keyword_weight> weights;
+    for (auto [idx, weight] : list.weights)
+    {
+        weight.keyword = views[idx];
+        weights.push_back(weight);
+    }
+
+    const auto database = keyword_database::compile(views, weights);
+    if (!database.has_value())
+    {
+        print_error(input.string(), database.error());
+        return EXIT_FAILURE;
+    }
+
+    // Written next to the output first, then renamed over it, so that the output is never seen
+    // half written
+    std::filesystem::path temp_path = output;
+    temp_path += ".tmp";
+
+    std::FILE* const out = std::fopen(temp_path.string().c_str(), "wb");
+    if (!out)
+    {
+        print_message("cannot create ", temp_path.string());
+        return EXIT_FAILURE;
+    }
+
+    const bool written =
+        std::fwrite(database->data(), 1, database->size(), out) == database->size();
+    std::error_code ec;
+    if (std::fclose(out) != 0 || !written)
+    {
+        print_message("cannot write ", temp_path.string());
+        std::filesystem::remove(temp_path, ec);
+        return EXIT_FAILURE;
+    }
+
+    std::filesystem::rename(temp_path, output, ec);
+    if (ec)
+    {
+        print_message("cannot replace ", output.string());
+        std::filesystem::remove(temp_path, ec);
+        return EXIT_FAILURE;
+    }
+
+    std::fprintf(stderr, "%zu keywords, %zu bytes\n", views.size(), database->size());
+    return EXIT_SUCCESS;
+}
+
+}  // namespace
+
+}  // namespace manelemax
+
+int main(int argc, char** argv)
+{
+    if (argc == 2 && std::string_view {argv[1]} == "--list-builtin")
+    {
+        return manelemax::list_builtin();
+    }
+
+    if (argc == 2 && std::string_view {argv[1]} == "--help")
+    {
+        std::fputs(manelemax::usage_text.data(), stdout);
+        return EXIT_SUCCESS;
+    }
+
+    if (argc != 3)
+    {
+        std::fputs(manelemax::usage_text.data(), stderr);
+        return EXIT_FAILURE;
+    }
+
+    return manelemax::compile(argv[1], argv[2]);
+}
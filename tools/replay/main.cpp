@@ -0,0 +1,367 @@
+#include <algorithm>
+#include <cerrno>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <memory>
+#include <optional>
+#include <string>
+#include <string_view>
+#include <thread>
+#include <vector>
+
+#include "auto_dj.hpp"
+#include "event_trace.hpp"
+#include "fake_media_session_backend.hpp"
+#include "fake_volume_backend.hpp"
+
+namespace manelemax
+{
+
+namespace
+{
+
+constexpr std::string_view usage_text =
+    "Usage: manelemax-replay [options] <trace file>\n"
+    "\n"
+    "Replays a trace recorded by ManeleMax with MANELEMAX_EVENT_TRACE set, through the same\n"
+    "logic over fake backends, and writes one line per volume or mute write it makes:\n"
+    "<seconds since the start> <tab> <volume|muted> <tab> <value>\n"
+    "\n"
+    "The time of the replay is simulated, so days of events replay in seconds, and a trace\n"
+    "always replays the same way: the output of two builds can be compared as is.\n"
+    "\n"
+    "Options:\n"
+    "  --database <file>  Keyword database built by manelemax-compile-keywords\n"
+    "                     (default: the built-in keywords)\n"
+    "  --realtime         Replay at the pace the events were recorded\n"
+    "  --recorded         Write the volume and mute writes of the trace instead, as recorded\n";
+
+// Lets the last track change settle, the ramps and the retries included
+constexpr std::chrono::seconds settle_time {5};
+
+// The step of the simulated clock with --realtime
+constexpr std::chrono::milliseconds realtime_step {10};
+
+struct options
+{
+    std::string database {};
+    bool        realtime {false};
+    bool        recorded {false};
+    std::string input {};
+};
+
+void print_error(const std::string_view message, const std::string_view detail = "")
+{
+    std::fprintf(
+        stderr,
+        "manelemax-replay: %.*s%.*s\n",
+        int(message.size()),
+        message.data(),
+        int(detail.size()),
+        detail.data()
+    );
+}
+
+void print_error(const std::string_view context, const os_error& err)
+{
+    std::fprintf(
+        stderr,
+        "manelemax-replay: %.*s: %.*s failed with error %lld\n",
+        int(context.size()),
+        context.data(),
+        int(err.function.size()),
+        err.function.data(),
+        static_cast<long long>(err.code)
+    );
+}
+
+std::optional<options> parse_options(const int argc, char** const argv)
+{
+    options opts;
+
+    for (int idx = 1; idx < argc; ++idx)
+    {
+        const std::string_view arg = argv[idx];
+
+        if (arg == "--database")
+        {
+            if (idx + 1 == argc)
+            {
+                print_error("missing value for ", arg);
+                return std::nullopt;
+            }
+            opts.database = argv[++idx];
+        }
+        else if (arg == "--realtime")
+        {
+            opts.realtime = true;
+        }
+        else if (arg == "--recorded")
+        {
+            opts.recorded = true;
+        }
+        else if (arg == "--help")
+        {
+            std::fputs(usage_text.data(), stdout);
+            std::exit(EXIT_SUCCESS);
+        }
+        else if (opts.input.empty() && !arg.starts_with("--"))
+        {
+            opts.input = arg;
+        }
+        else
+        {
+            print_error("unexpected argument ", arg);
+            return std::nullopt;
+        }
+    }
+
+    if (opts.input.empty())
+    {
+        std::fputs(usage_text.data(), stderr);
+        return std::nullopt;
+    }
+
+    return opts;
+}
+
+void print_write(
+    const executor::clock::duration since_start,
+    const event_trace::kind         type,
+    const volume_backend::endpoint& endpoint
+)
+{
+    const double seconds = std::chrono::duration<double>(since_start).count();
+    if (type == event_trace::kind::volume_written)
+    {
+        std::printf("%.6f\tvolume\t%.3f\n", seconds, double(endpoint.volume));
+    }
+    else
+    {
+        std::printf("%.6f\tmuted\t%d\n", seconds, int(endpoint.muted));
+    }
+}
+
+// The endpoint of the trace, which prints the writes made by the replay
+class replay_volume_backend : public fake_volume_backend
+{
+public:
+    using fake_volume_backend::fake_volume_backend;
+
+    // Until then, while auto_dj starts, the writes are made at the start of the trace
+    void set_clock(const auto_dj& clock)
+    {
+        clock_ = &clock;
+    }
+
+    std::expected<void, os_error> set_volume(const float vol) override
+    {
+        print_write(since_start(), event_trace::kind::volume_written, {.volume = vol});
+        ++writes_;
+        return fake_volume_backend::set_volume(vol);
+    }
+
+    std::expected<void, os_error> set_muted(const bool muted) override
+    {
+        print_write(since_start(), event_trace::kind::mute_written, {.muted = muted});
+        ++writes_;
+        return fake_volume_backend::set_muted(muted);
+    }
+
+    std::uint64_t writes() const
+    {
+        return writes_;
+    }
+
+private:
+    // The manual executor starts at the epoch
+    executor::clock::duration since_start() const
+    {
+        return clock_ ? clock_->now().time_since_epoch() : executor::clock::duration::zero();
+    }
+
+    const auto_dj* clock_ {nullptr};
+    std::uint64_t  writes_ {0};
+};
+
+std::expected<std::vector<event_trace::event>, os_error> read_trace(const std::string& path)
+{
+    auto trace = event_trace::reader::open(path);
+    if (!trace.has_value())
+    {
+        return std::unexpected {trace.error()};
+    }
+
+    std::vector<event_trace::event> events;
+    while (true)
+    {
+        auto next = trace->next();
+        if (!next.has_value())
+        {
+            return std::unexpected {next.error()};
+        }
+        if (!next->has_value())
+        {
+            return events;
+        }
+        events.push_back(**std::move(next));
+    }
+}
+
+int run(const options& opts)
+{
+    const auto events = read_trace(opts.input);
+    if (!events.has_value())
+    {
+        print_error(opts.input, events.error());
+        return EXIT_FAILURE;
+    }
+
+    if (opts.recorded)
+    {
+        for (const event_trace::event& ev : *events)
+        {
+            if (ev.type == event_trace::kind::volume_written ||
+                ev.type == event_trace::kind::mute_written)
+            {
+                print_write(ev.at, ev.type, ev.endpoint);
+            }
+        }
+        return EXIT_SUCCESS;
+    }
+
+    // The endpoint as it was when the recording started
+    volume_backend::endpoint initial {.volume = 1.0f, .muted = false};
+    for (const event_trace::event& ev : *events)
+    {
+        if (ev.type == event_trace::kind::endpoint_opened)
+        {
+            initial = ev.endpoint;
+            break;
+        }
+    }
+
+    auto  volume       = std::make_unique<replay_volume_backend>(initial);
+    auto  sessions     = std::make_unique<fake_media_session_backend>();
+    auto* volume_ptr   = volume.get();
+    auto* sessions_ptr = sessions.get();
+
+    auto auto_dj_obj = auto_dj::make(
+        opts.database,
+        std::move(volume),
+        std::move(sessions),
+        executor::mode::manual
+    );
+    if (!auto_dj_obj.has_value())
+    {
+        print_error("auto_dj", auto_dj_obj.error());
+        return EXIT_FAILURE;
+    }
+
+    volume_ptr->set_clock(*auto_dj_obj);
+
+    const executor::clock::time_point start {};
+
+    const auto wall_start = std::chrono::steady_clock::now();
+    const auto advance_to = [&](const executor::clock::time_point time) {
+        if (!opts.realtime)
+        {
+            auto_dj_obj->advance_to(time);
+            return;
+        }
+
+        for (executor::clock::time_point crt = auto_dj_obj->now(); crt < time;)
+        {
+            crt = std::min(time, crt + realtime_step);
+            std::this_thread::sleep_until(wall_start + (crt - start));
+            auto_dj_obj->advance_to(crt);
+        }
+    };
+
+    std::uint64_t recorded_writes = 0;
+    for (const event_trace::event& ev : *events)
+    {
+        advance_to(start + ev.at);
+
+        switch (ev.type)
+        {
+            case event_trace::kind::session_changed:
+            {
+                sessions_ptr->update(ev.session_id, ev.session);
+                break;
+            }
+            case event_trace::kind::session_removed:
+            {
+                sessions_ptr->remove(ev.session_id);
+                break;
+            }
+            case event_trace::kind::endpoint_changed:
+            {
+                volume_ptr->update(ev.endpoint);
+                break;
+            }
+            case event_trace::kind::default_changed:
+            {
+                volume_ptr->change_default();
+                break;
+            }
+            case event_trace::kind::volume_written: [[fallthrough]];
+            case event_trace::kind::mute_written:
+            {
+                // The output of the recording, the replay makes its own
+                ++recorded_writes;
+                break;
+            }
+            case event_trace::kind::endpoint_opened:
+            {
+                break;
+            }
+        }
+    }
+
+    const executor::clock::time_point end = auto_dj_obj->now() + settle_time;
+    advance_to(end);
+
+    const double replayed_seconds = std::chrono::duration<double>(end - start).count();
+    const double wall_seconds =
+        std::chrono::duration<double>(std::chrono::steady_clock::now() - wall_start).count();
+    std::fprintf(
+        stderr,
+        "manelemax-replay: %zu events, %.1f s replayed in %.3f s, %llu writes (%llu recorded)\n",
+        events->size(),
+        replayed_seconds,
+        wall_seconds,
+        static_cast<unsigned long long>(volume_ptr->writes()),
+        static_cast<unsigned long long>(recorded_writes)
+    );
+
+    return EXIT_SUCCESS;
+}
+
+}  // namespace
+
+// The replay has no platform backends, it always runs over the fake ones
+std::expected<std::unique_ptr<volume_backend>, os_error> volume_backend::make_default()
+{
+    return std::unexpected {os_error {"volume_backend::make_default", ENOSYS}};
+}
+
+std::expected<std::unique_ptr<media_session_backend>, os_error>
+media_session_backend::make_default()
+{
+    return std::unexpected {os_error {"media_session_backend::make_default", ENOSYS}};
+}
+
+}  // namespace manelemax
+
+int main(int argc, char** argv)
+{
+    const auto opts = manelemax::parse_options(argc, argv);
+    if (!opts)
+    {
+        return EXIT_FAILURE;
+    }
+
+    return manelemax::run(*opts);
+}